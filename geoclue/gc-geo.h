@@ -0,0 +1,32 @@
+/*
+ * Geoclue
+ * gc-geo.h - Shared geometry constants
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GC_GEO_H
+#define _GC_GEO_H
+
+/* Not installed: shared by Geoclue Master and the providers */
+
+/* meters per degree of latitude, and of longitude at the equator */
+#define GC_METERS_PER_DEGREE 111319.49
+
+#endif /* _GC_GEO_H */
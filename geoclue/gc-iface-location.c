@@ -0,0 +1,166 @@
+/*
+ * Geoclue
+ * gc-iface-location.c - GInterface for org.freedesktop.Geoclue.Location
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <glib.h>
+
+#include <dbus/dbus-glib.h>
+#include <geoclue/gc-iface-location.h>
+#include <geoclue/geoclue-marshal.h>
+
+enum {
+	LOCATION_CHANGED,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
+static gboolean
+gc_iface_location_get_all (GcIfaceLocation  *gc,
+			   int              *status,
+			   int              *position_fields,
+			   int              *position_timestamp,
+			   double           *latitude,
+			   double           *longitude,
+			   double           *altitude,
+			   GeoclueAccuracy **position_accuracy,
+			   int              *velocity_fields,
+			   int              *velocity_timestamp,
+			   double           *speed,
+			   double           *direction,
+			   double           *climb,
+			   int              *address_timestamp,
+			   GHashTable      **address,
+			   GeoclueAccuracy **address_accuracy,
+			   GError          **error);
+
+#include "gc-iface-location-glue.h"
+
+static void
+gc_iface_location_base_init (gpointer klass)
+{
+	static gboolean initialized = FALSE;
+
+	if (initialized) {
+		return;
+	}
+	initialized = TRUE;
+
+	signals[LOCATION_CHANGED] = g_signal_new ("location-changed",
+						  G_OBJECT_CLASS_TYPE (klass),
+						  G_SIGNAL_RUN_LAST, 0,
+						  NULL, NULL,
+						  geoclue_marshal_VOID__INT_INT_INT_INT_DOUBLE_DOUBLE_DOUBLE_BOXED_INT_INT_DOUBLE_DOUBLE_DOUBLE_INT_BOXED_BOXED,
+						  G_TYPE_NONE, 16,
+						  G_TYPE_INT,
+						  G_TYPE_INT,
+						  G_TYPE_INT,
+						  G_TYPE_INT,
+						  G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE,
+						  GEOCLUE_ACCURACY_TYPE,
+						  G_TYPE_INT,
+						  G_TYPE_INT,
+						  G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE,
+						  G_TYPE_INT,
+						  DBUS_TYPE_G_STRING_STRING_HASHTABLE,
+						  GEOCLUE_ACCURACY_TYPE);
+	dbus_g_object_type_install_info (gc_iface_location_get_type (),
+					 &dbus_glib_gc_iface_location_object_info);
+}
+
+GType
+gc_iface_location_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		const GTypeInfo info = {
+			sizeof (GcIfaceLocationClass),
+			gc_iface_location_base_init,
+			NULL,
+		};
+
+		type = g_type_register_static (G_TYPE_INTERFACE,
+					       "GcIfaceLocation", &info, 0);
+	}
+
+	return type;
+}
+
+static gboolean
+gc_iface_location_get_all (GcIfaceLocation  *gc,
+			   int              *status,
+			   int              *position_fields,
+			   int              *position_timestamp,
+			   double           *latitude,
+			   double           *longitude,
+			   double           *altitude,
+			   GeoclueAccuracy **position_accuracy,
+			   int              *velocity_fields,
+			   int              *velocity_timestamp,
+			   double           *speed,
+			   double           *direction,
+			   double           *climb,
+			   int              *address_timestamp,
+			   GHashTable      **address,
+			   GeoclueAccuracy **address_accuracy,
+			   GError          **error)
+{
+	return GC_IFACE_LOCATION_GET_CLASS (gc)->get_all
+		(gc, (GeoclueStatus *) status,
+		 (GeocluePositionFields *) position_fields, position_timestamp,
+		 latitude, longitude, altitude, position_accuracy,
+		 (GeoclueVelocityFields *) velocity_fields, velocity_timestamp,
+		 speed, direction, climb,
+		 address_timestamp, address, address_accuracy, error);
+}
+
+void
+gc_iface_location_emit_location_changed (GcIfaceLocation           *gc,
+					 GeoclueLocationChangeFlags changed,
+					 GeoclueStatus              status,
+					 GeocluePositionFields      position_fields,
+					 int                        position_timestamp,
+					 double                     latitude,
+					 double                     longitude,
+					 double                     altitude,
+					 GeoclueAccuracy           *position_accuracy,
+					 GeoclueVelocityFields      velocity_fields,
+					 int                        velocity_timestamp,
+					 double                     speed,
+					 double                     direction,
+					 double                     climb,
+					 int                        address_timestamp,
+					 GHashTable                *address,
+					 GeoclueAccuracy           *address_accuracy)
+{
+	g_signal_emit (gc, signals[LOCATION_CHANGED], 0, changed, status,
+		       position_fields, position_timestamp,
+		       latitude, longitude, altitude, position_accuracy,
+		       velocity_fields, velocity_timestamp,
+		       speed, direction, climb,
+		       address_timestamp, address, address_accuracy);
+}
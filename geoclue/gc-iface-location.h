@@ -0,0 +1,106 @@
+/*
+ * Geoclue
+ * gc-iface-location.h - GInterface for org.freedesktop.Geoclue.Location
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GC_IFACE_LOCATION_H
+#define _GC_IFACE_LOCATION_H
+
+#include <geoclue/geoclue-types.h>
+#include <geoclue/geoclue-accuracy.h>
+
+G_BEGIN_DECLS
+
+#define GC_TYPE_IFACE_LOCATION (gc_iface_location_get_type ())
+#define GC_IFACE_LOCATION(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GC_TYPE_IFACE_LOCATION, GcIfaceLocation))
+#define GC_IFACE_LOCATION_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), GC_TYPE_IFACE_LOCATION, GcIfaceLocationClass))
+#define GC_IS_IFACE_LOCATION(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GC_TYPE_IFACE_LOCATION))
+#define GC_IS_IFACE_LOCATION_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GC_TYPE_IFACE_LOCATION))
+#define GC_IFACE_LOCATION_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_INTERFACE ((obj), GC_TYPE_IFACE_LOCATION, GcIfaceLocationClass))
+
+typedef struct _GcIfaceLocation GcIfaceLocation; /* Dummy typedef */
+typedef struct _GcIfaceLocationClass GcIfaceLocationClass;
+
+struct _GcIfaceLocationClass {
+	GTypeInterface base_iface;
+
+	/* signals */
+	void (* location_changed) (GcIfaceLocation           *gc,
+				   GeoclueLocationChangeFlags changed,
+				   GeoclueStatus              status,
+				   GeocluePositionFields      position_fields,
+				   int                        position_timestamp,
+				   double                     latitude,
+				   double                     longitude,
+				   double                     altitude,
+				   GeoclueAccuracy           *position_accuracy,
+				   GeoclueVelocityFields      velocity_fields,
+				   int                        velocity_timestamp,
+				   double                     speed,
+				   double                     direction,
+				   double                     climb,
+				   int                        address_timestamp,
+				   GHashTable                *address,
+				   GeoclueAccuracy           *address_accuracy);
+
+	/* vtable */
+	gboolean (* get_all) (GcIfaceLocation       *gc,
+			      GeoclueStatus         *status,
+			      GeocluePositionFields *position_fields,
+			      int                   *position_timestamp,
+			      double                *latitude,
+			      double                *longitude,
+			      double                *altitude,
+			      GeoclueAccuracy      **position_accuracy,
+			      GeoclueVelocityFields *velocity_fields,
+			      int                   *velocity_timestamp,
+			      double                *speed,
+			      double                *direction,
+			      double                *climb,
+			      int                   *address_timestamp,
+			      GHashTable           **address,
+			      GeoclueAccuracy      **address_accuracy,
+			      GError               **error);
+};
+
+GType gc_iface_location_get_type (void);
+
+void gc_iface_location_emit_location_changed (GcIfaceLocation           *gc,
+					      GeoclueLocationChangeFlags changed,
+					      GeoclueStatus              status,
+					      GeocluePositionFields      position_fields,
+					      int                        position_timestamp,
+					      double                     latitude,
+					      double                     longitude,
+					      double                     altitude,
+					      GeoclueAccuracy           *position_accuracy,
+					      GeoclueVelocityFields      velocity_fields,
+					      int                        velocity_timestamp,
+					      double                     speed,
+					      double                     direction,
+					      double                     climb,
+					      int                        address_timestamp,
+					      GHashTable                *address,
+					      GeoclueAccuracy           *address_accuracy);
+
+G_END_DECLS
+
+#endif
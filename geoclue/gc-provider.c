@@ -35,6 +35,26 @@
  * Derived classes should define the #GcIfaceGeoclue methods in their 
  * class_init() and call gc_provider_set_details() in init()
  * 
+ * A provider can also be built as a plug-in module that Geoclue Master
+ * loads into its own process, so that data does not have to go over 
+ * D-Bus. The module must not have a main() but use 
+ * GC_PROVIDER_PLUGIN_DEFINE() with the get_type function of the provider.
+ * The same source usually builds both, e.g.
+ * <informalexample>
+ * <programlisting>
+ * #ifdef GEOCLUE_PROVIDER_PLUGIN
+ * GC_PROVIDER_PLUGIN_DEFINE (geoclue_example_get_type)
+ * #else
+ * int
+ * main (int argc, char **argv)
+ * {
+ * 	...
+ * }
+ * #endif
+ * </programlisting>
+ * </informalexample>
+ * Plug-ins are enabled with a "Plugin" key in the .provider file. Providers
+ * without one (or plug-ins that fail to load) are used over D-Bus.
  */
 #include <config.h>
 
@@ -58,6 +78,8 @@ typedef struct {
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GC_TYPE_PROVIDER, GcProviderPrivate))
 
+static gboolean plugin_mode = FALSE;
+
 static void gc_provider_geoclue_init (GcIfaceGeoclueClass *iface);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (GcProvider, gc_provider, G_TYPE_OBJECT,
@@ -104,11 +126,14 @@ gc_provider_init (GcProvider *provider)
 	GError *error = NULL;
 	GcProviderPrivate *priv = GET_PRIVATE (provider);
 	
-	provider->connection = dbus_g_bus_get (GEOCLUE_DBUS_BUS, &error);
-	if (provider->connection == NULL) {
-		g_warning ("%s was unable to create a connection to D-Bus: %s",
-			   G_OBJECT_TYPE_NAME (provider), error->message);
-		g_error_free (error);
+	/* in-process providers are exported by Geoclue Master */
+	if (!plugin_mode) {
+		provider->connection = dbus_g_bus_get (GEOCLUE_DBUS_BUS, &error);
+		if (provider->connection == NULL) {
+			g_warning ("%s was unable to create a connection to D-Bus: %s",
+				   G_OBJECT_TYPE_NAME (provider), error->message);
+			g_error_free (error);
+		}
 	}
 	
 	priv->connections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
@@ -284,10 +309,18 @@ gc_provider_set_details (GcProvider *provider,
 	guint request_ret;
 
 	g_return_if_fail (GC_IS_PROVIDER (provider));
-	g_return_if_fail (provider->connection != NULL);
 	g_return_if_fail (service != NULL);
 	g_return_if_fail (path != NULL);
 
+	if (plugin_mode) {
+		/* in-process: Geoclue Master calls the object directly */
+		priv->name = g_strdup (name);
+		priv->description = g_strdup (description);
+		return;
+	}
+
+	g_return_if_fail (provider->connection != NULL);
+
 	driver = dbus_g_proxy_new_for_name (provider->connection,
 					    DBUS_SERVICE_DBUS,
 					    DBUS_PATH_DBUS,
@@ -315,3 +348,19 @@ gc_provider_set_details (GcProvider *provider,
 	priv->name = g_strdup (name);
 	priv->description = g_strdup (description);
 }
+
+/**
+ * gc_provider_set_plugin_mode:
+ * @enabled: %TRUE if providers are created inside Geoclue Master
+ *
+ * Only used by Geoclue Master, once at startup: every provider it 
+ * creates afterwards is a plug-in or runs in the master itself. 
+ * In plugin mode providers do not connect to the bus, and 
+ * gc_provider_set_details() does not request the service name nor 
+ * register the provider: Geoclue Master exports it.
+ */
+void
+gc_provider_set_plugin_mode (gboolean enabled)
+{
+	plugin_mode = enabled;
+}
@@ -27,6 +27,7 @@
 #define _GC_PROVIDER
 
 #include <glib-object.h>
+#include <gmodule.h>
 #include <dbus/dbus-glib.h>
 
 #include <geoclue/gc-iface-geoclue.h>
@@ -69,6 +70,21 @@ void gc_provider_set_details (GcProvider *provider,
 			      const char *name,
 			      const char *description);
 
+/* In-process provider plug-ins */
+#define GC_PROVIDER_PLUGIN_ABI_VERSION 1
+
+typedef GType (*GcProviderPluginGetType) (void);
+
+#define GC_PROVIDER_PLUGIN_DEFINE(get_type_func)				\
+	G_MODULE_EXPORT const int gc_provider_plugin_abi_version =		\
+		GC_PROVIDER_PLUGIN_ABI_VERSION;					\
+	G_MODULE_EXPORT GType gc_provider_plugin_get_type (void)		\
+	{									\
+		return get_type_func ();					\
+	}
+
+void gc_provider_set_plugin_mode (gboolean enabled);
+
 G_END_DECLS
 
 #endif
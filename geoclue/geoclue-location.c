@@ -0,0 +1,410 @@
+/*
+ * Geoclue
+ * geoclue-location.c - Client API for accessing GcIfaceLocation
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ * SECTION:geoclue-location
+ * @short_description: Geoclue combined location client API
+ *
+ * #GeoclueLocation fetches status, position, velocity and address
+ * with a single D-Bus call. It is meant for clients that would
+ * otherwise call geoclue_position_get_position(),
+ * geoclue_velocity_get_velocity() and geoclue_address_get_address()
+ * one after another, e.g. every time they redraw.
+ * 
+ * A #GeoclueLocation is usually obtained with 
+ * geoclue_master_client_create_location(); geoclue_location_new() 
+ * can be used for providers that implement the Location interface.
+ * 
+ * The location-changed signal delivers the same values on every 
+ * change. Master clients only emit it after 
+ * geoclue_master_client_set_coalesce_signals() has been called.
+ */
+
+#include <geoclue/geoclue-location.h>
+#include <geoclue/geoclue-marshal.h>
+
+#include "gc-iface-location-bindings.h"
+
+enum {
+	LOCATION_CHANGED,
+	LAST_SIGNAL
+};
+
+static guint32 signals[LAST_SIGNAL] = {0, };
+
+G_DEFINE_TYPE (GeoclueLocation, geoclue_location, GEOCLUE_TYPE_PROVIDER);
+
+static void
+location_changed (DBusGProxy      *proxy,
+		  int              changed,
+		  int              status,
+		  int              position_fields,
+		  int              position_timestamp,
+		  double           latitude,
+		  double           longitude,
+		  double           altitude,
+		  GeoclueAccuracy *position_accuracy,
+		  int              velocity_fields,
+		  int              velocity_timestamp,
+		  double           speed,
+		  double           direction,
+		  double           climb,
+		  int              address_timestamp,
+		  GHashTable      *address,
+		  GeoclueAccuracy *address_accuracy,
+		  GeoclueLocation *location)
+{
+	g_signal_emit (location, signals[LOCATION_CHANGED], 0, changed, status,
+		       position_fields, position_timestamp,
+		       latitude, longitude, altitude, position_accuracy,
+		       velocity_fields, velocity_timestamp,
+		       speed, direction, climb,
+		       address_timestamp, address, address_accuracy);
+}
+
+static GObject *
+constructor (GType                  type,
+	     guint                  n_props,
+	     GObjectConstructParam *props)
+{
+	GObject *object;
+	GeoclueProvider *provider;
+
+	object = G_OBJECT_CLASS (geoclue_location_parent_class)->constructor 
+		(type, n_props, props);
+	provider = GEOCLUE_PROVIDER (object);
+
+	dbus_g_proxy_add_signal (provider->proxy, "LocationChanged",
+				 G_TYPE_INT, G_TYPE_INT,
+				 G_TYPE_INT, G_TYPE_INT,
+				 G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE,
+				 GEOCLUE_ACCURACY_TYPE,
+				 G_TYPE_INT, G_TYPE_INT,
+				 G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE,
+				 G_TYPE_INT,
+				 DBUS_TYPE_G_STRING_STRING_HASHTABLE,
+				 GEOCLUE_ACCURACY_TYPE,
+				 G_TYPE_INVALID);
+	dbus_g_proxy_connect_signal (provider->proxy, "LocationChanged",
+				     G_CALLBACK (location_changed),
+				     object, NULL);
+
+	return object;
+}
+
+static void
+geoclue_location_class_init (GeoclueLocationClass *klass)
+{
+	GObjectClass *o_class = (GObjectClass *) klass;
+
+	o_class->constructor = constructor;
+
+	/**
+	 * GeoclueLocation::location-changed:
+	 * @location: the #GeoclueLocation object emitting the signal
+	 * @changed: A #GeoclueLocationChangeFlags bitfield telling what changed
+	 * @status: Current #GeoclueStatus
+	 * @position_fields: A #GeocluePositionFields bitfield representing the validity of the position values
+	 * @position_timestamp: Time of position measurement (Unix timestamp)
+	 * @latitude: Latitude in degrees
+	 * @longitude: Longitude in degrees
+	 * @altitude: Altitude in meters
+	 * @position_accuracy: Accuracy of the position as #GeoclueAccuracy
+	 * @velocity_fields: A #GeoclueVelocityFields bitfield representing the validity of the velocity values
+	 * @velocity_timestamp: Time of velocity measurement (Unix timestamp)
+	 * @speed: Horizontal speed
+	 * @direction: Horizontal direction (bearing)
+	 * @climb: Vertical speed
+	 * @address_timestamp: Time of address measurement (Unix timestamp)
+	 * @address: Address details as #GHashTable
+	 * @address_accuracy: Accuracy of the address as #GeoclueAccuracy
+	 * 
+	 * The location-changed signal is emitted once for all changes 
+	 * caused by a single event, instead of separate position-changed,
+	 * address-changed and provider-changed signals.
+	 */
+	signals[LOCATION_CHANGED] = g_signal_new ("location-changed",
+						  G_TYPE_FROM_CLASS (klass),
+						  G_SIGNAL_RUN_FIRST |
+						  G_SIGNAL_NO_RECURSE,
+						  G_STRUCT_OFFSET (GeoclueLocationClass, location_changed),
+						  NULL, NULL,
+						  geoclue_marshal_VOID__INT_INT_INT_INT_DOUBLE_DOUBLE_DOUBLE_BOXED_INT_INT_DOUBLE_DOUBLE_DOUBLE_INT_BOXED_BOXED,
+						  G_TYPE_NONE, 16,
+						  G_TYPE_INT, G_TYPE_INT,
+						  G_TYPE_INT, G_TYPE_INT,
+						  G_TYPE_DOUBLE, G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE, G_TYPE_POINTER,
+						  G_TYPE_INT, G_TYPE_INT,
+						  G_TYPE_DOUBLE, G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE, G_TYPE_INT,
+						  G_TYPE_POINTER, G_TYPE_POINTER);
+}
+
+static void
+geoclue_location_init (GeoclueLocation *location)
+{
+}
+
+/**
+ * geoclue_location_new:
+ * @service: D-Bus service name
+ * @path: D-Bus path name
+ *
+ * Creates a #GeoclueLocation with given D-Bus service name and path.
+ * 
+ * Return value: Pointer to a new #GeoclueLocation
+ */
+GeoclueLocation *
+geoclue_location_new (const char *service,
+		      const char *path)
+{
+	return g_object_new (GEOCLUE_TYPE_LOCATION,
+			     "service", service,
+			     "path", path,
+			     "interface", GEOCLUE_LOCATION_INTERFACE_NAME,
+			     NULL);
+}
+
+/**
+ * geoclue_location_get_all:
+ * @location: A #GeoclueLocation object
+ * @status: Pointer to returned #GeoclueStatus or %NULL
+ * @position_fields: Pointer to returned #GeocluePositionFields or %NULL
+ * @position_timestamp: Pointer to returned time of position measurement (Unix timestamp) or %NULL
+ * @latitude: Pointer to returned latitude in degrees or %NULL
+ * @longitude: Pointer to returned longitude in degrees or %NULL
+ * @altitude: Pointer to returned altitude in meters or %NULL
+ * @position_accuracy: Pointer to returned position #GeoclueAccuracy or %NULL
+ * @velocity_fields: Pointer to returned #GeoclueVelocityFields or %NULL
+ * @velocity_timestamp: Pointer to returned time of velocity measurement (Unix timestamp) or %NULL
+ * @speed: Pointer to returned horizontal speed or %NULL
+ * @direction: Pointer to returned horizontal direction (bearing) or %NULL
+ * @climb: Pointer to returned vertical speed or %NULL
+ * @address_timestamp: Pointer to returned time of address measurement (Unix timestamp) or %NULL
+ * @address: Pointer to returned #GHashTable with address details or %NULL
+ * @address_accuracy: Pointer to returned address #GeoclueAccuracy or %NULL
+ * @error: Pointer to returned #GError or %NULL
+ *
+ * Obtains the current status, position, velocity and address in one call.
+ * Values that are not available are reported with 
+ * %GEOCLUE_POSITION_FIELDS_NONE, %GEOCLUE_VELOCITY_FIELDS_NONE or 
+ * an address accuracy level of %GEOCLUE_ACCURACY_LEVEL_NONE.
+ * 
+ * If the caller is not interested in some values, the pointers can be 
+ * left %NULL.
+ * 
+ * Return value: %TRUE on success
+ */
+gboolean
+geoclue_location_get_all (GeoclueLocation        *location,
+			  GeoclueStatus          *status,
+			  GeocluePositionFields  *position_fields,
+			  int                    *position_timestamp,
+			  double                 *latitude,
+			  double                 *longitude,
+			  double                 *altitude,
+			  GeoclueAccuracy       **position_accuracy,
+			  GeoclueVelocityFields  *velocity_fields,
+			  int                    *velocity_timestamp,
+			  double                 *speed,
+			  double                 *direction,
+			  double                 *climb,
+			  int                    *address_timestamp,
+			  GHashTable            **address,
+			  GeoclueAccuracy       **address_accuracy,
+			  GError                **error)
+{
+	GeoclueProvider *provider = GEOCLUE_PROVIDER (location);
+	int st, p_fields, p_ts, v_fields, v_ts, a_ts;
+	double lat, lon, alt, sp, di, cl;
+	GeoclueAccuracy *p_acc, *a_acc;
+	GHashTable *details;
+
+	if (!org_freedesktop_Geoclue_Location_get_all (provider->proxy,
+						       &st,
+						       &p_fields, &p_ts,
+						       &lat, &lon, &alt, &p_acc,
+						       &v_fields, &v_ts,
+						       &sp, &di, &cl,
+						       &a_ts, &details, &a_acc,
+						       error)) {
+		return FALSE;
+	}
+
+	if (status != NULL) {
+		*status = st;
+	}
+
+	if (position_fields != NULL) {
+		*position_fields = p_fields;
+	}
+	if (position_timestamp != NULL) {
+		*position_timestamp = p_ts;
+	}
+	if (latitude != NULL && (p_fields & GEOCLUE_POSITION_FIELDS_LATITUDE)) {
+		*latitude = lat;
+	}
+	if (longitude != NULL && (p_fields & GEOCLUE_POSITION_FIELDS_LONGITUDE)) {
+		*longitude = lon;
+	}
+	if (altitude != NULL && (p_fields & GEOCLUE_POSITION_FIELDS_ALTITUDE)) {
+		*altitude = alt;
+	}
+	if (position_accuracy != NULL) {
+		*position_accuracy = p_acc;
+	} else {
+		geoclue_accuracy_free (p_acc);
+	}
+
+	if (velocity_fields != NULL) {
+		*velocity_fields = v_fields;
+	}
+	if (velocity_timestamp != NULL) {
+		*velocity_timestamp = v_ts;
+	}
+	if (speed != NULL && (v_fields & GEOCLUE_VELOCITY_FIELDS_SPEED)) {
+		*speed = sp;
+	}
+	if (direction != NULL && (v_fields & GEOCLUE_VELOCITY_FIELDS_DIRECTION)) {
+		*direction = di;
+	}
+	if (climb != NULL && (v_fields & GEOCLUE_VELOCITY_FIELDS_CLIMB)) {
+		*climb = cl;
+	}
+
+	if (address_timestamp != NULL) {
+		*address_timestamp = a_ts;
+	}
+	if (address != NULL) {
+		*address = details;
+	} else {
+		g_hash_table_destroy (details);
+	}
+	if (address_accuracy != NULL) {
+		*address_accuracy = a_acc;
+	} else {
+		geoclue_accuracy_free (a_acc);
+	}
+
+	return TRUE;
+}
+
+typedef struct _GeoclueLocationAsyncData {
+	GeoclueLocation *location;
+	GCallback callback;
+	gpointer userdata;
+} GeoclueLocationAsyncData;
+
+static void
+get_all_async_callback (DBusGProxy               *proxy,
+			GeoclueStatus             status,
+			GeocluePositionFields     position_fields,
+			int                       position_timestamp,
+			double                    latitude,
+			double                    longitude,
+			double                    altitude,
+			GeoclueAccuracy          *position_accuracy,
+			GeoclueVelocityFields     velocity_fields,
+			int                       velocity_timestamp,
+			double                    speed,
+			double                    direction,
+			double                    climb,
+			int                       address_timestamp,
+			GHashTable               *address,
+			GeoclueAccuracy          *address_accuracy,
+			GError                   *error,
+			GeoclueLocationAsyncData *data)
+{
+	(*(GeoclueLocationCallback)data->callback) (data->location,
+	                                            status,
+	                                            position_fields,
+	                                            position_timestamp,
+	                                            latitude,
+	                                            longitude,
+	                                            altitude,
+	                                            position_accuracy,
+	                                            velocity_fields,
+	                                            velocity_timestamp,
+	                                            speed,
+	                                            direction,
+	                                            climb,
+	                                            address_timestamp,
+	                                            address,
+	                                            address_accuracy,
+	                                            error,
+	                                            data->userdata);
+	g_free (data);
+}
+
+/**
+ * GeoclueLocationCallback:
+ * @location: A #GeoclueLocation object
+ * @status: Current #GeoclueStatus
+ * @position_fields: A #GeocluePositionFields bitfield representing the validity of the position values
+ * @position_timestamp: Time of position measurement (Unix timestamp)
+ * @latitude: Latitude in degrees
+ * @longitude: Longitude in degrees
+ * @altitude: Altitude in meters
+ * @position_accuracy: Accuracy of the position as #GeoclueAccuracy
+ * @velocity_fields: A #GeoclueVelocityFields bitfield representing the validity of the velocity values
+ * @velocity_timestamp: Time of velocity measurement (Unix timestamp)
+ * @speed: Horizontal speed
+ * @direction: Horizontal direction (bearing)
+ * @climb: Vertical speed
+ * @address_timestamp: Time of address measurement (Unix timestamp)
+ * @address: Address details as #GHashTable
+ * @address_accuracy: Accuracy of the address as #GeoclueAccuracy
+ * @error: Error as #GError (may be %NULL)
+ * @userdata: User data pointer set in geoclue_location_get_all_async()
+ * 
+ * Callback function for geoclue_location_get_all_async().
+ */
+
+/**
+ * geoclue_location_get_all_async:
+ * @location: A #GeoclueLocation object
+ * @callback: A #GeoclueLocationCallback function that should be called when return values are available
+ * @userdata: pointer for user specified data
+ * 
+ * Function returns (essentially) immediately and calls @callback when 
+ * the current location is available or when D-Bus timeouts.
+ */
+void
+geoclue_location_get_all_async (GeoclueLocation         *location,
+				GeoclueLocationCallback  callback,
+				gpointer                 userdata)
+{
+	GeoclueProvider *provider = GEOCLUE_PROVIDER (location);
+	GeoclueLocationAsyncData *data;
+	
+	data = g_new (GeoclueLocationAsyncData, 1);
+	data->location = location;
+	data->callback = G_CALLBACK (callback);
+	data->userdata = userdata;
+	
+	org_freedesktop_Geoclue_Location_get_all_async
+			(provider->proxy,
+			 (org_freedesktop_Geoclue_Location_get_all_reply)get_all_async_callback,
+			 data);
+}
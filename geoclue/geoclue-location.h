@@ -0,0 +1,114 @@
+/*
+ * Geoclue
+ * geoclue-location.h - Client API for accessing GcIfaceLocation
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GEOCLUE_LOCATION_H
+#define _GEOCLUE_LOCATION_H
+
+#include <geoclue/geoclue-provider.h>
+#include <geoclue/geoclue-types.h>
+#include <geoclue/geoclue-accuracy.h>
+#include <geoclue/geoclue-address-details.h>
+
+G_BEGIN_DECLS
+
+#define GEOCLUE_TYPE_LOCATION (geoclue_location_get_type ())
+#define GEOCLUE_LOCATION(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_LOCATION, GeoclueLocation))
+#define GEOCLUE_IS_LOCATION(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GEOCLUE_TYPE_LOCATION))
+
+#define GEOCLUE_LOCATION_INTERFACE_NAME "org.freedesktop.Geoclue.Location"
+
+typedef struct _GeoclueLocation {
+	GeoclueProvider provider;
+} GeoclueLocation;
+
+typedef struct _GeoclueLocationClass {
+	GeoclueProviderClass provider_class;
+
+	void (* location_changed) (GeoclueLocation           *location,
+				   GeoclueLocationChangeFlags changed,
+				   GeoclueStatus              status,
+				   GeocluePositionFields      position_fields,
+				   int                        position_timestamp,
+				   double                     latitude,
+				   double                     longitude,
+				   double                     altitude,
+				   GeoclueAccuracy           *position_accuracy,
+				   GeoclueVelocityFields      velocity_fields,
+				   int                        velocity_timestamp,
+				   double                     speed,
+				   double                     direction,
+				   double                     climb,
+				   int                        address_timestamp,
+				   GHashTable                *address,
+				   GeoclueAccuracy           *address_accuracy);
+} GeoclueLocationClass;
+
+GType geoclue_location_get_type (void);
+
+GeoclueLocation *geoclue_location_new (const char *service,
+				       const char *path);
+
+gboolean geoclue_location_get_all (GeoclueLocation        *location,
+				   GeoclueStatus          *status,
+				   GeocluePositionFields  *position_fields,
+				   int                    *position_timestamp,
+				   double                 *latitude,
+				   double                 *longitude,
+				   double                 *altitude,
+				   GeoclueAccuracy       **position_accuracy,
+				   GeoclueVelocityFields  *velocity_fields,
+				   int                    *velocity_timestamp,
+				   double                 *speed,
+				   double                 *direction,
+				   double                 *climb,
+				   int                    *address_timestamp,
+				   GHashTable            **address,
+				   GeoclueAccuracy       **address_accuracy,
+				   GError                **error);
+
+typedef void (*GeoclueLocationCallback) (GeoclueLocation       *location,
+					 GeoclueStatus          status,
+					 GeocluePositionFields  position_fields,
+					 int                    position_timestamp,
+					 double                 latitude,
+					 double                 longitude,
+					 double                 altitude,
+					 GeoclueAccuracy       *position_accuracy,
+					 GeoclueVelocityFields  velocity_fields,
+					 int                    velocity_timestamp,
+					 double                 speed,
+					 double                 direction,
+					 double                 climb,
+					 int                    address_timestamp,
+					 GHashTable            *address,
+					 GeoclueAccuracy       *address_accuracy,
+					 GError                *error,
+					 gpointer               userdata);
+
+void geoclue_location_get_all_async (GeoclueLocation         *location,
+				     GeoclueLocationCallback  callback,
+				     gpointer                 userdata);
+
+G_END_DECLS
+
+#endif
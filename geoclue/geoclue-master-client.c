@@ -527,6 +527,166 @@ geoclue_master_client_create_position (GeoclueMasterClient *client,
 	return geoclue_position_new (GEOCLUE_MASTER_DBUS_SERVICE, priv->object_path);
 }
 
+/**
+ * geoclue_master_client_create_location:
+ * @client: A #GeoclueMasterClient
+ * @error: A pointer to returned #GError or %NULL.
+ *
+ * Starts the GeoclueMasterClient position and address providers and 
+ * returns a #GeoclueLocation that uses the same D-Bus object as the 
+ * #GeoclueMasterClient. It is enough that one of the providers can be
+ * started: the other part is then reported as not available by
+ * geoclue_location_get_all().
+ *
+ * Return value: New #GeoclueLocation or %NULL on error
+ */
+GeoclueLocation *
+geoclue_master_client_create_location (GeoclueMasterClient *client,
+                                       GError **error)
+{
+	GeoclueMasterClientPrivate *priv;
+	gboolean position_started;
+	
+	priv = GET_PRIVATE (client);
+	
+	position_started = org_freedesktop_Geoclue_MasterClient_position_start (priv->proxy, NULL);
+	if (!org_freedesktop_Geoclue_MasterClient_address_start (priv->proxy,
+	                                                         position_started ? NULL : error) &&
+	    !position_started) {
+		return NULL;
+	}
+	return geoclue_location_new (GEOCLUE_MASTER_DBUS_SERVICE, priv->object_path);
+}
+
+/**
+ * geoclue_master_client_set_coalesce_signals:
+ * @client: A #GeoclueMasterClient
+ * @coalesce: Whether to combine change signals
+ * @error: A pointer to returned #GError or %NULL.
+ *
+ * When @coalesce is %TRUE, all changes caused by a single event (e.g. a
+ * provider switch that changes accuracy, position and address) are 
+ * delivered as one #GeoclueLocation::location-changed signal. The 
+ * position-changed, address-changed and provider-changed signals are 
+ * not emitted while coalescing is on.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+geoclue_master_client_set_coalesce_signals (GeoclueMasterClient  *client,
+                                            gboolean              coalesce,
+                                            GError              **error)
+{
+	GeoclueMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	return org_freedesktop_Geoclue_MasterClient_set_coalesce_signals (priv->proxy,
+	                                                                  coalesce,
+	                                                                  error);
+}
+
+/**
+ * geoclue_position_fixes_from_structs:
+ * @structs: A #GPtrArray of #GEOCLUE_POSITION_FIX_TYPE structs
+ *
+ * Converts positions received over D-Bus to #GeocluePositionFix
+ * structs. @structs is freed.
+ *
+ * Return value: A #GArray of #GeocluePositionFix, free with
+ * g_array_free().
+ */
+GArray *
+geoclue_position_fixes_from_structs (GPtrArray *structs)
+{
+	GArray *fixes;
+	guint i;
+
+	fixes = g_array_sized_new (FALSE, FALSE, sizeof (GeocluePositionFix),
+	                           structs->len);
+	for (i = 0; i < structs->len; i++) {
+		GValueArray *vals = structs->pdata[i];
+		GeocluePositionFix fix;
+
+		fix.fields = g_value_get_int (g_value_array_get_nth (vals, 0));
+		fix.timestamp = g_value_get_int (g_value_array_get_nth (vals, 1));
+		fix.latitude = g_value_get_double (g_value_array_get_nth (vals, 2));
+		fix.longitude = g_value_get_double (g_value_array_get_nth (vals, 3));
+		fix.altitude = g_value_get_double (g_value_array_get_nth (vals, 4));
+		fix.accuracy_level = g_value_get_int (g_value_array_get_nth (vals, 5));
+		fix.horizontal_accuracy = g_value_get_double (g_value_array_get_nth (vals, 6));
+		fix.vertical_accuracy = g_value_get_double (g_value_array_get_nth (vals, 7));
+		g_array_append_val (fixes, fix);
+
+		g_value_array_free (vals);
+	}
+	g_ptr_array_free (structs, TRUE);
+
+	return fixes;
+}
+
+/**
+ * geoclue_master_client_get_position_history:
+ * @client: A #GeoclueMasterClient
+ * @since: Timestamp in seconds since the Epoch
+ * @error: A pointer to returned #GError or %NULL.
+ *
+ * Gets the positions the current position provider has sent after
+ * @since, oldest first, in one call. Geoclue Master keeps a limited
+ * number of positions per provider, so clients that wake up to fetch
+ * the track should do it often enough (a 10 Hz GPS fills the history
+ * in a few minutes). Timestamps are in whole seconds, so a 10 Hz
+ * provider sends several positions with the same timestamp.
+ *
+ * Return value: A #GArray of #GeocluePositionFix, free with
+ * g_array_free(), or %NULL on error.
+ */
+GArray *
+geoclue_master_client_get_position_history (GeoclueMasterClient  *client,
+                                            int                   since,
+                                            GError              **error)
+{
+	GeoclueMasterClientPrivate *priv = GET_PRIVATE (client);
+	GPtrArray *history = NULL;
+
+	if (!org_freedesktop_Geoclue_MasterClient_get_position_history (priv->proxy,
+	                                                                since,
+	                                                                &history,
+	                                                                error)) {
+		return NULL;
+	}
+
+	return geoclue_position_fixes_from_structs (history);
+}
+
+/**
+ * geoclue_master_client_set_prediction:
+ * @client: A #GeoclueMasterClient
+ * @interval: Milliseconds between predicted positions, 0 to turn
+ * predictions off
+ * @error: A pointer to returned #GError or %NULL.
+ *
+ * Makes @client send a predicted position whenever the position
+ * provider has not sent one for @interval milliseconds, so that e.g. a
+ * map can move smoothly with a 1 Hz GPS, or keep moving in a tunnel.
+ * Predictions are extrapolated from the last position and velocity of
+ * the provider. Their accuracy gets worse with time, and their fields
+ * include %GEOCLUE_POSITION_FIELDS_PREDICTED. Predictions stop 30
+ * seconds after the last real position, and are not sent while
+ * signals are coalesced.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+geoclue_master_client_set_prediction (GeoclueMasterClient  *client,
+                                      int                   interval,
+                                      GError              **error)
+{
+	GeoclueMasterClientPrivate *priv = GET_PRIVATE (client);
+
+	return org_freedesktop_Geoclue_MasterClient_set_prediction (priv->proxy,
+	                                                            interval,
+	                                                            error);
+}
+
 
 static void
 position_start_async_callback (DBusGProxy                   *proxy, 
@@ -30,6 +30,7 @@
 #include <geoclue/geoclue-accuracy.h>
 #include <geoclue/geoclue-position.h>
 #include <geoclue/geoclue-address.h>
+#include <geoclue/geoclue-location.h>
 
 G_BEGIN_DECLS
 
@@ -39,6 +40,36 @@ G_BEGIN_DECLS
 #define GEOCLUE_MASTER_CLIENT(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_MASTER_CLIENT, GeoclueMasterClient))
 #define GEOCLUE_IS_MASTER_CLIENT(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GEOCLUE_TYPE_MASTER_CLIENT))
 
+/**
+ * GeocluePositionFix:
+ * @fields: A #GeocluePositionFields bitfield
+ * @timestamp: Time of the fix in seconds since the Epoch
+ * @latitude: Latitude in degrees
+ * @longitude: Longitude in degrees
+ * @altitude: Altitude in meters
+ * @accuracy_level: A #GeoclueAccuracyLevel
+ * @horizontal_accuracy: Horizontal accuracy in meters
+ * @vertical_accuracy: Vertical accuracy in meters
+ *
+ * One position in the history returned by
+ * geoclue_master_client_get_position_history() and
+ * geoclue_master_get_track_log().
+ **/
+typedef struct _GeocluePositionFix {
+	GeocluePositionFields fields;
+	int timestamp;
+	double latitude;
+	double longitude;
+	double altitude;
+	GeoclueAccuracyLevel accuracy_level;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+} GeocluePositionFix;
+
+/* D-Bus type of a GeocluePositionFix, and of the history */
+#define GEOCLUE_POSITION_FIX_TYPE (dbus_g_type_get_struct ("GValueArray", G_TYPE_INT, G_TYPE_INT, G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_INT, G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_INVALID))
+#define GEOCLUE_POSITION_HISTORY_TYPE (dbus_g_type_get_collection ("GPtrArray", GEOCLUE_POSITION_FIX_TYPE))
+
 typedef struct _GeoclueMasterClient {
 	GObject parent;
 } GeoclueMasterClient;
@@ -96,6 +127,19 @@ void geoclue_master_client_create_position_async (GeoclueMasterClient   *client,
 						  CreatePositionCallback  callback,
 						  gpointer               userdata);
 
+GeoclueLocation *geoclue_master_client_create_location (GeoclueMasterClient *client, GError **error);
+gboolean geoclue_master_client_set_coalesce_signals (GeoclueMasterClient  *client,
+                                                     gboolean              coalesce,
+                                                     GError              **error);
+
+GArray *geoclue_master_client_get_position_history (GeoclueMasterClient  *client,
+                                                    int                   since,
+                                                    GError              **error);
+GArray *geoclue_position_fixes_from_structs (GPtrArray *structs);
+gboolean geoclue_master_client_set_prediction (GeoclueMasterClient  *client,
+                                               int                   interval,
+                                               GError              **error);
+
 gboolean geoclue_master_client_get_address_provider (GeoclueMasterClient  *client,
                                                      char                **name,
                                                      char                **description,
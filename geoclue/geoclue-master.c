@@ -218,3 +218,39 @@ geoclue_master_create_client_async (GeoclueMaster              *master,
 			 (org_freedesktop_Geoclue_Master_create_reply)create_client_callback,
 			 data);
 }
+
+/**
+ * geoclue_master_get_track_log:
+ * @master: A #GeoclueMaster object
+ * @start: First timestamp to include, in seconds since the Epoch
+ * @end: Last timestamp to include
+ * @error: Pointer to returned #GError or %NULL
+ *
+ * Gets the positions Geoclue Master has recorded between @start and
+ * @end, oldest first. Recording is enabled with the "track-log"
+ * GSettings key, this fails when it is not set.
+ *
+ * Return value: A #GArray of #GeocluePositionFix, free with
+ * g_array_free(), or %NULL on error.
+ */
+GArray *
+geoclue_master_get_track_log (GeoclueMaster *master,
+			      int            start,
+			      int            end,
+			      GError       **error)
+{
+	GeoclueMasterPrivate *priv;
+	GPtrArray *track = NULL;
+
+	g_return_val_if_fail (GEOCLUE_IS_MASTER (master), NULL);
+
+	priv = GET_PRIVATE (master);
+
+	if (!org_freedesktop_Geoclue_Master_get_track_log (priv->proxy,
+							   start, end,
+							   &track, error)) {
+		return NULL;
+	}
+
+	return geoclue_position_fixes_from_structs (track);
+}
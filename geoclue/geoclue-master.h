@@ -62,6 +62,11 @@ void geoclue_master_create_client_async (GeoclueMaster              *master,
 					 GeoclueCreateClientCallback callback,
 					 gpointer                    userdata);
 
+GArray *geoclue_master_get_track_log (GeoclueMaster *master,
+				      int            start,
+				      int            end,
+				      GError       **error);
+
 G_END_DECLS
 
 #endif
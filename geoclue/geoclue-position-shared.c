@@ -0,0 +1,237 @@
+/*
+ * Geoclue
+ * geoclue-position-shared.c - Shared memory position feed from Geoclue Master
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ * SECTION:geoclue-position-shared
+ * @short_description: Geoclue Master shared memory position feed
+ *
+ * #GeocluePositionShared gives local clients that want every fix
+ * (e.g. map renderers following a 10 Hz GPS) a way to read the current
+ * Master position without going through D-Bus for each update.
+ *
+ * geoclue_position_map_shared() asks Geoclue Master to publish the
+ * position of a master client #GeocluePosition in a shared memory page
+ * and maps that page read-only. After that,
+ * geoclue_position_shared_get_position() reads the latest fix
+ * without any system calls or D-Bus round trips. The page is only
+ * readable by the user Geoclue Master runs as.
+ *
+ * <informalexample>
+ * <programlisting>
+ * GeocluePositionShared *shared;
+ * double lat, lon;
+ *
+ * shared = geoclue_position_map_shared (position, &error);
+ * ...
+ * / * in the render loop * /
+ * if (geoclue_position_shared_has_changed (shared)) {
+ * 	geoclue_position_shared_get_position (shared, NULL, &lat, &lon, NULL, NULL);
+ * 	...
+ * }
+ * </programlisting>
+ * </informalexample>
+ *
+ * Only positions from Geoclue Master clients can be mapped.
+ */
+
+#include <config.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <geoclue/geoclue-position-shared.h>
+#include <geoclue/geoclue-master-client.h>
+#include <geoclue/geoclue-error.h>
+
+#include "gc-iface-master-client-bindings.h"
+
+struct _GeocluePositionShared {
+	const GeocluePositionSharedPage *page;
+	int last_sequence;
+};
+
+/**
+ * geoclue_position_map_shared:
+ * @position: A #GeocluePosition created with geoclue_master_client_create_position()
+ * @error: Pointer to returned #GError or %NULL
+ *
+ * Asks Geoclue Master to publish the client position in shared memory
+ * and maps it. The page is kept up to date for as long as the master
+ * client exists.
+ *
+ * Return value: A new #GeocluePositionShared or %NULL on error. Free with
+ * geoclue_position_shared_unmap().
+ */
+GeocluePositionShared *
+geoclue_position_map_shared (GeocluePosition  *position,
+                             GError          **error)
+{
+	GeoclueProvider *provider = GEOCLUE_PROVIDER (position);
+	GeocluePositionShared *shared;
+	DBusGProxy *proxy;
+	char *name = NULL;
+	void *page;
+	int fd;
+
+	proxy = dbus_g_proxy_new_from_proxy (provider->proxy,
+	                                     GEOCLUE_MASTER_CLIENT_DBUS_INTERFACE,
+	                                     NULL);
+	if (!org_freedesktop_Geoclue_MasterClient_position_map_shared (proxy, &name, error)) {
+		g_object_unref (proxy);
+		return NULL;
+	}
+	g_object_unref (proxy);
+
+	fd = shm_open (name, O_RDONLY, 0);
+	if (fd < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not open shared position %s: %s",
+		             name, g_strerror (errno));
+		g_free (name);
+		return NULL;
+	}
+	page = mmap (NULL, sizeof (GeocluePositionSharedPage),
+	             PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (page == MAP_FAILED) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not map shared position %s: %s",
+		             name, g_strerror (errno));
+		g_free (name);
+		return NULL;
+	}
+	g_free (name);
+
+	if (((GeocluePositionSharedPage *)page)->magic != GEOCLUE_POSITION_SHARED_MAGIC ||
+	    ((GeocluePositionSharedPage *)page)->version != GEOCLUE_POSITION_SHARED_VERSION) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Shared position has unsupported format");
+		munmap (page, sizeof (GeocluePositionSharedPage));
+		return NULL;
+	}
+
+	shared = g_new0 (GeocluePositionShared, 1);
+	shared->page = page;
+	/* first has_changed() call should return TRUE */
+	shared->last_sequence = -1;
+
+	return shared;
+}
+
+/**
+ * geoclue_position_shared_unmap:
+ * @shared: A #GeocluePositionShared
+ *
+ * Unmaps the shared position page and frees @shared.
+ */
+void
+geoclue_position_shared_unmap (GeocluePositionShared *shared)
+{
+	if (!shared) {
+		return;
+	}
+	munmap ((void *)shared->page, sizeof (GeocluePositionSharedPage));
+	g_free (shared);
+}
+
+/**
+ * geoclue_position_shared_has_changed:
+ * @shared: A #GeocluePositionShared
+ *
+ * Checks whether the position has been updated since the last
+ * geoclue_position_shared_get_position() call.
+ *
+ * Return value: %TRUE if there is a new position
+ */
+gboolean
+geoclue_position_shared_has_changed (GeocluePositionShared *shared)
+{
+	return g_atomic_int_get ((gint *)&shared->page->sequence) != shared->last_sequence;
+}
+
+/**
+ * geoclue_position_shared_get_position:
+ * @shared: A #GeocluePositionShared
+ * @timestamp: Pointer to returned time of position measurement (Unix timestamp) or %NULL
+ * @latitude: Pointer to returned latitude in degrees or %NULL
+ * @longitude: Pointer to returned longitude in degrees or %NULL
+ * @altitude: Pointer to returned altitude in meters or %NULL
+ * @accuracy: Pointer to returned #GeoclueAccuracy or %NULL
+ *
+ * Reads the latest position from shared memory. This does not block
+ * or make any system calls; values are always from a single
+ * consistent update. Only the #GeoclueAccuracy, if requested, is
+ * allocated: pass %NULL for @accuracy to avoid that in a render loop.
+ *
+ * Return value: A #GeocluePositionFields bitfield representing the
+ * validity of the position values.
+ */
+GeocluePositionFields
+geoclue_position_shared_get_position (GeocluePositionShared *shared,
+                                      int                   *timestamp,
+                                      double                *latitude,
+                                      double                *longitude,
+                                      double                *altitude,
+                                      GeoclueAccuracy      **accuracy)
+{
+	const GeocluePositionSharedPage *page = shared->page;
+	GeocluePositionSharedPage copy;
+	int sequence;
+
+	/* seqlock read: retry if the master was writing meanwhile */
+	do {
+		sequence = g_atomic_int_get ((gint *)&page->sequence);
+		if (sequence & 1) {
+			continue;
+		}
+		memcpy (&copy, page, sizeof (GeocluePositionSharedPage));
+	} while ((sequence & 1) ||
+	         g_atomic_int_get ((gint *)&page->sequence) != sequence);
+
+	shared->last_sequence = sequence;
+
+	if (timestamp != NULL) {
+		*timestamp = copy.timestamp;
+	}
+	if (latitude != NULL && (copy.fields & GEOCLUE_POSITION_FIELDS_LATITUDE)) {
+		*latitude = copy.latitude;
+	}
+	if (longitude != NULL && (copy.fields & GEOCLUE_POSITION_FIELDS_LONGITUDE)) {
+		*longitude = copy.longitude;
+	}
+	if (altitude != NULL && (copy.fields & GEOCLUE_POSITION_FIELDS_ALTITUDE)) {
+		*altitude = copy.altitude;
+	}
+	if (accuracy != NULL) {
+		*accuracy = geoclue_accuracy_new (copy.accuracy_level,
+		                                  copy.horizontal_accuracy,
+		                                  copy.vertical_accuracy);
+	}
+
+	return copy.fields;
+}
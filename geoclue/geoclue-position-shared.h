@@ -0,0 +1,76 @@
+/*
+ * Geoclue
+ * geoclue-position-shared.h - Shared memory position feed from Geoclue Master
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GEOCLUE_POSITION_SHARED_H
+#define _GEOCLUE_POSITION_SHARED_H
+
+#include <geoclue/geoclue-position.h>
+#include <geoclue/geoclue-types.h>
+#include <geoclue/geoclue-accuracy.h>
+
+G_BEGIN_DECLS
+
+#define GEOCLUE_POSITION_SHARED_MAGIC 0x47435350 /* "GCSP" */
+#define GEOCLUE_POSITION_SHARED_VERSION 1
+
+/**
+ * GeocluePositionSharedPage:
+ *
+ * Layout of the shared memory page. It is only ever written by
+ * Geoclue Master: @sequence is odd while an update is in progress.
+ * Use geoclue_position_shared_get_position() instead of reading
+ * this directly.
+ **/
+typedef struct _GeocluePositionSharedPage {
+	gint32 magic;
+	gint32 version;
+	volatile gint sequence;
+
+	gint32 fields;
+	gint32 timestamp;
+	gint32 accuracy_level;
+	double latitude;
+	double longitude;
+	double altitude;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+} GeocluePositionSharedPage;
+
+typedef struct _GeocluePositionShared GeocluePositionShared;
+
+GeocluePositionShared *geoclue_position_map_shared (GeocluePosition  *position,
+                                                    GError          **error);
+void geoclue_position_shared_unmap (GeocluePositionShared *shared);
+
+gboolean geoclue_position_shared_has_changed (GeocluePositionShared *shared);
+
+GeocluePositionFields geoclue_position_shared_get_position (GeocluePositionShared *shared,
+                                                            int                   *timestamp,
+                                                            double                *latitude,
+                                                            double                *longitude,
+                                                            double                *altitude,
+                                                            GeoclueAccuracy      **accuracy);
+
+G_END_DECLS
+
+#endif
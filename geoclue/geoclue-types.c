@@ -53,6 +53,26 @@ geoclue_types_init (void)
                                            G_TYPE_BOXED,
 					   G_TYPE_INVALID);
 	
+	dbus_g_object_register_marshaller (geoclue_marshal_VOID__INT_INT_INT_INT_DOUBLE_DOUBLE_DOUBLE_BOXED_INT_INT_DOUBLE_DOUBLE_DOUBLE_INT_BOXED_BOXED,
+	                                   G_TYPE_NONE,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_BOXED,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_DOUBLE,
+	                                   G_TYPE_INT,
+	                                   G_TYPE_BOXED,
+	                                   G_TYPE_BOXED,
+	                                   G_TYPE_INVALID);
+
 	dbus_g_object_register_marshaller (geoclue_marshal_VOID__INT_BOXED_BOXED,
 					   G_TYPE_NONE,
 					   G_TYPE_INT,
@@ -70,6 +70,10 @@ typedef enum {
  *
  * #GeocluePositionFields is a bitfield that defines the validity of 
  * Position values.
+ *
+ * %GEOCLUE_POSITION_FIELDS_PREDICTED is not a value: it is set on
+ * positions that Geoclue Master extrapolated from an earlier position
+ * and velocity (see geoclue_master_client_set_prediction()).
  * 
  * Example:
  * <informalexample>
@@ -88,7 +92,8 @@ typedef enum {
 	GEOCLUE_POSITION_FIELDS_NONE = 0,
 	GEOCLUE_POSITION_FIELDS_LATITUDE = 1 << 0,
 	GEOCLUE_POSITION_FIELDS_LONGITUDE = 1 << 1,
-	GEOCLUE_POSITION_FIELDS_ALTITUDE = 1 << 2
+	GEOCLUE_POSITION_FIELDS_ALTITUDE = 1 << 2,
+	GEOCLUE_POSITION_FIELDS_PREDICTED = 1 << 3
 } GeocluePositionFields;
 
 /**
@@ -104,6 +109,23 @@ typedef enum {
 	GEOCLUE_VELOCITY_FIELDS_CLIMB = 1 << 2
 } GeoclueVelocityFields;
 
+/**
+ * GeoclueLocationChangeFlags:
+ *
+ * #GeoclueLocationChangeFlags is a bitfield that tells which parts of 
+ * the location changed in a LocationChanged signal. 
+ * %GEOCLUE_LOCATION_CHANGE_PROVIDER means that the position or address 
+ * provider of a master client was changed.
+ **/
+typedef enum {
+	GEOCLUE_LOCATION_CHANGE_NONE = 0,
+	GEOCLUE_LOCATION_CHANGE_STATUS = 1 << 0,
+	GEOCLUE_LOCATION_CHANGE_POSITION = 1 << 1,
+	GEOCLUE_LOCATION_CHANGE_VELOCITY = 1 << 2,
+	GEOCLUE_LOCATION_CHANGE_ADDRESS = 1 << 3,
+	GEOCLUE_LOCATION_CHANGE_PROVIDER = 1 << 4
+} GeoclueLocationChangeFlags;
+
 /**
  * GEOCLUE_ADDRESS_KEY_COUNTRYCODE:
  * 
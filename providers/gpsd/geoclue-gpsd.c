@@ -34,33 +34,92 @@
 #include <math.h>
 #include <gps.h>
 #include <string.h>
+#include <time.h>
 
 #include <geoclue/geoclue-error.h>
 #include <geoclue/gc-provider.h>
 #include <geoclue/gc-iface-position.h>
 #include <geoclue/gc-iface-velocity.h>
 
+#include "gpsd-json.h"
+
 typedef struct gps_data_t gps_data;
 typedef struct gps_fix_t gps_fix;
 
-/* only listing used tags */
-typedef enum {
-	NMEA_NONE,
-	NMEA_GSA,
-	NMEA_GGA,
-	NMEA_GSV,
-	NMEA_RMC
-} NmeaTag;
+/* User equivalent range errors (m) gpsd uses to turn DOPs into 
+ * error estimates when there's no better figure */
+#define GPSD_H_UERE 15.0
+#define GPSD_V_UERE 23.0
+
+/* used when gpsd does not give any error estimate */
+#define GPSD_DEFAULT_H_ACCURACY 24.0
+#define GPSD_DEFAULT_V_ACCURACY 60.0
+
+/* a receiver whose last fix is this much older (s) than the newest 
+ * fix from any receiver is not used */
+#define GPSD_STALE_FIX 5.0
+
+/* when duty cycling, streaming is restarted this long (s) before 
+ * the next fix is due so that the receiver has time to get it */
+#define GPSD_WAKEUP_LEAD 8
+
+/* after a wakeup, a receiver that had a fix keeps its status for this 
+ * long (s) while it gets the next one */
+#define GPSD_WAKEUP_GRACE 30
+
+#define GPSD_STREAM_FLAGS (WATCH_ENABLE | WATCH_JSON | POLL_NONBLOCK)
 
+typedef struct _GeoclueGpsd GeoclueGpsd;
 
+/* One gpsd endpoint and the last fix from it */
 typedef struct {
-	GcProvider parent;
+	GeoclueGpsd *provider;
 	
 	char *host;
 	char *port;
 	
 	gps_data *gpsdata;
+	GIOChannel *channel;
+	guint watch_id;
 	
+	GeoclueStatus status;
+	int mode;
+	/* when streaming restarted after a duty cycle sleep, 0 once 
+	 * there is a new fix */
+	time_t wakeup_time;
+	
+	double time;
+	double latitude;
+	double longitude;
+	double altitude;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+	
+	double speed;
+	double track;
+	double climb;
+	
+	/* DOPs from the last SKY report, NAN if unknown */
+	double hdop;
+	double vdop;
+} GpsdConnection;
+
+struct _GeoclueGpsd {
+	GcProvider parent;
+	
+	/* option values as given */
+	char *hosts;
+	char *port;
+	
+	GPtrArray *connections;
+	
+	/* seconds between fixes (org.freedesktop.Geoclue.GPSInterval), 
+	 * 0 to stream continuously. While wakeup_id is set streaming 
+	 * is stopped. */
+	int interval;
+	guint wakeup_id;
+	
+	/* the reported fix, from the best connection */
 	gps_fix *last_fix;
 	
 	GeoclueStatus last_status;
@@ -70,7 +129,7 @@ typedef struct {
 	
 	GMainLoop *loop;
 
-} GeoclueGpsd;
+};
 
 typedef struct {
 	GcProviderClass parent_class;
@@ -90,11 +149,13 @@ G_DEFINE_TYPE_WITH_CODE (GeoclueGpsd, geoclue_gpsd, GC_TYPE_PROVIDER,
 
 static void geoclue_gpsd_stop_gpsd (GeoclueGpsd *self);
 static gboolean geoclue_gpsd_start_gpsd (GeoclueGpsd *self);
+static void geoclue_gpsd_sleep (GeoclueGpsd *self);
+static void geoclue_gpsd_wakeup (GeoclueGpsd *self);
 
 
-/* defining global GeoclueGpsd because gpsd does not support "user_data"
- * pointers in callbacks */
-GeoclueGpsd *gpsd;
+/* gpsd does not support "user_data" pointers in callbacks: 
+ * the raw hook finds its connection with the gps_data pointer */
+static GHashTable *connections_by_gpsdata = NULL;
 
 
 
@@ -115,7 +176,10 @@ shutdown (GcProvider *provider)
 {
 	GeoclueGpsd *gpsd = GEOCLUE_GPSD (provider);
 	
-	g_main_loop_quit (gpsd->loop);
+	/* plug-ins have no main loop of their own */
+	if (gpsd->loop) {
+		g_main_loop_quit (gpsd->loop);
+	}
 }
 
 static void
@@ -140,10 +204,18 @@ set_options (GcIfaceGeoclue *gc,
              GError        **error)
 {
 	GeoclueGpsd *gpsd = GEOCLUE_GPSD (gc);
-	GValue *port_value, *host_value;
+	GValue *port_value, *host_value, *interval_value;
 	const char *port, *host;
 	gboolean changed = FALSE;
 
+	interval_value = g_hash_table_lookup (options,
+					      "org.freedesktop.Geoclue.GPSInterval");
+	gpsd->interval = (interval_value && G_VALUE_HOLDS_INT (interval_value)) ?
+		g_value_get_int (interval_value) : 0;
+	if (gpsd->interval <= 0 && gpsd->wakeup_id) {
+		geoclue_gpsd_wakeup (gpsd);
+	}
+
 	host_value = g_hash_table_lookup (options,
 					  "org.freedesktop.Geoclue.GPSHost");
 	host = host_value ? g_value_get_string (host_value) : NULL;
@@ -156,7 +228,7 @@ set_options (GcIfaceGeoclue *gc,
 	}
 	
 	/* new values? */
-	if (g_strcmp0 (host, gpsd->host) != 0 ||
+	if (g_strcmp0 (host, gpsd->hosts) != 0 ||
 	    g_strcmp0 (port, gpsd->port) != 0) {
 		changed = TRUE;
 	}
@@ -168,8 +240,8 @@ set_options (GcIfaceGeoclue *gc,
 	/* update private values with new ones, restart gpsd */
 	g_free (gpsd->port);
 	gpsd->port = NULL;
-	g_free (gpsd->host);
-	gpsd->host = NULL;
+	g_free (gpsd->hosts);
+	gpsd->hosts = NULL;
 
 	geoclue_gpsd_stop_gpsd (gpsd);
 
@@ -178,7 +250,7 @@ set_options (GcIfaceGeoclue *gc,
 	}
 
 	gpsd->port = g_strdup (port);
-	gpsd->host = g_strdup (host);
+	gpsd->hosts = g_strdup (host);
 	if (!geoclue_gpsd_start_gpsd (gpsd)) {
 		geoclue_gpsd_set_status (gpsd, GEOCLUE_STATUS_ERROR);
 		g_set_error (error, GEOCLUE_ERROR,
@@ -194,13 +266,12 @@ finalize (GObject *object)
 	GeoclueGpsd *gpsd = GEOCLUE_GPSD (object);
 	
 	geoclue_gpsd_stop_gpsd (gpsd);
+	g_ptr_array_free (gpsd->connections, TRUE);
 	g_free (gpsd->last_fix);
 	geoclue_accuracy_free (gpsd->last_accuracy);
 	
 	g_free (gpsd->port);
-	if (gpsd->host) {
-		g_free (gpsd->host);
-	}
+	g_free (gpsd->hosts);
 	
 	((GObjectClass *) geoclue_gpsd_parent_class)->finalize (object);
 }
@@ -228,47 +299,59 @@ equal_or_nan (double a, double b)
 	return a == b;
 }
 
-static void
-geoclue_gpsd_update_position (GeoclueGpsd *gpsd, NmeaTag nmea_tag)
+/* Lower is better: HDOP from the last SKY report or, without one, 
+ * the horizontal error converted back to a DOP */
+static double
+gpsd_connection_get_dop (GpsdConnection *conn)
 {
-	gps_fix *fix = &gpsd->gpsdata->fix;
-	gps_fix *last_fix = gpsd->last_fix;
-	
-	last_fix->time = fix->time;
-	
-	/* If a flag is not set, bail out.*/
-	if (!((gpsd->gpsdata->set & LATLON_SET) || (gpsd->gpsdata->set & ALTITUDE_SET))) {
-		return;
+	if (!isnan (conn->hdop)) {
+		return conn->hdop;
 	}
-	gpsd->gpsdata->set &= ~(LATLON_SET | ALTITUDE_SET);
+	return conn->horizontal_accuracy / GPSD_H_UERE;
+}
+
+/* The connection with a current fix and the lowest DOP, or NULL */
+static GpsdConnection *
+geoclue_gpsd_get_best_connection (GeoclueGpsd *gpsd)
+{
+	GpsdConnection *best = NULL;
+	double newest = 0.0;
+	guint i;
 	
-	if (equal_or_nan (fix->latitude, last_fix->latitude) &&
-	    equal_or_nan (fix->longitude, last_fix->longitude) &&
-	    equal_or_nan (fix->altitude, last_fix->altitude)) {
-		/* position has not changed */
-		return;
+	for (i = 0; i < gpsd->connections->len; i++) {
+		GpsdConnection *conn = g_ptr_array_index (gpsd->connections, i);
+		
+		if (conn->status == GEOCLUE_STATUS_AVAILABLE) {
+			newest = MAX (newest, conn->time);
+		}
 	}
 	
-	/* save values */
-	last_fix->latitude = fix->latitude;
-	last_fix->longitude = fix->longitude;
-	last_fix->altitude = fix->altitude;
-	
-	/* Could use fix.eph for accuracy, but eph is 
-	 * often NaN... what then? 
-	 * Could also use fix mode (2d/3d) to decide vertical accuracy, 
-	 * but gpsd updates that so erratically that I couldn't
-	 * be arsed so far */
-	geoclue_accuracy_set_details (gpsd->last_accuracy,
-	                              GEOCLUE_ACCURACY_LEVEL_DETAILED,
-	                              24, 60);
+	for (i = 0; i < gpsd->connections->len; i++) {
+		GpsdConnection *conn = g_ptr_array_index (gpsd->connections, i);
+		
+		if (conn->status != GEOCLUE_STATUS_AVAILABLE ||
+		    conn->time < newest - GPSD_STALE_FIX) {
+			continue;
+		}
+		if (!best || 
+		    gpsd_connection_get_dop (conn) < gpsd_connection_get_dop (best)) {
+			best = conn;
+		}
+	}
+	return best;
+}
+
+static void
+geoclue_gpsd_emit_position (GeoclueGpsd *gpsd)
+{
+	gps_fix *last_fix = gpsd->last_fix;
 	
 	gpsd->last_pos_fields = GEOCLUE_POSITION_FIELDS_NONE;
-	gpsd->last_pos_fields |= (isnan (fix->latitude)) ? 
+	gpsd->last_pos_fields |= (isnan (last_fix->latitude)) ? 
 	                         0 : GEOCLUE_POSITION_FIELDS_LATITUDE;
-	gpsd->last_pos_fields |= (isnan (fix->longitude)) ? 
+	gpsd->last_pos_fields |= (isnan (last_fix->longitude)) ? 
 	                         0 : GEOCLUE_POSITION_FIELDS_LONGITUDE;
-	gpsd->last_pos_fields |= (isnan (fix->altitude)) ? 
+	gpsd->last_pos_fields |= (isnan (last_fix->altitude)) ? 
 	                         0 : GEOCLUE_POSITION_FIELDS_ALTITUDE;
 	
 	gc_iface_position_emit_position_changed 
@@ -276,157 +359,432 @@ geoclue_gpsd_update_position (GeoclueGpsd *gpsd, NmeaTag nmea_tag)
 		 (int)(last_fix->time+0.5), 
 		 last_fix->latitude, last_fix->longitude, last_fix->altitude, 
 		 gpsd->last_accuracy);
+}
+
+static void
+geoclue_gpsd_emit_velocity (GeoclueGpsd *gpsd)
+{
+	gps_fix *last_fix = gpsd->last_fix;
 	
+	gpsd->last_velo_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	gpsd->last_velo_fields |= (isnan (last_fix->track)) ?
+		0 : GEOCLUE_VELOCITY_FIELDS_DIRECTION;
+	gpsd->last_velo_fields |= (isnan (last_fix->speed)) ?
+		0 : GEOCLUE_VELOCITY_FIELDS_SPEED;
+	gpsd->last_velo_fields |= (isnan (last_fix->climb)) ?
+		0 : GEOCLUE_VELOCITY_FIELDS_CLIMB;
+	
+	gc_iface_velocity_emit_velocity_changed 
+		(GC_IFACE_VELOCITY (gpsd), gpsd->last_velo_fields,
+		 (int)(last_fix->time+0.5),
+		 last_fix->speed, last_fix->track, last_fix->climb);
 }
 
+/* Recomputes the provider state from all connections: status is the 
+ * best status of any receiver, position and velocity come from the 
+ * best connection */
 static void
-geoclue_gpsd_update_velocity (GeoclueGpsd *gpsd, NmeaTag nmea_tag)
+geoclue_gpsd_update (GeoclueGpsd *gpsd)
 {
-	gps_fix *fix = &gpsd->gpsdata->fix;
+	GpsdConnection *best;
 	gps_fix *last_fix = gpsd->last_fix;
+	GeoclueStatus status = GEOCLUE_STATUS_ERROR;
+	GeoclueAccuracyLevel level;
+	double horizontal, vertical;
 	gboolean changed = FALSE;
+	guint i;
 	
-	/* at least with my devices, gpsd updates
-	 *  - climb on GGA, GSA and GSV messages (speed and track are set to NaN).
-	 *  - speed and track on RMC message (climb is set to NaN).
-	 * 
-	 * couldn't think of an smart way to handle this, I don't think there is one
-	 */
-	
-	if (((gpsd->gpsdata->set & TRACK_SET) || (gpsd->gpsdata->set & SPEED_SET)) &&
-	    nmea_tag == NMEA_RMC) {
+	for (i = 0; i < gpsd->connections->len; i++) {
+		GpsdConnection *conn = g_ptr_array_index (gpsd->connections, i);
 		
-		gpsd->gpsdata->set &= ~(TRACK_SET | SPEED_SET);
-		
-		last_fix->time = fix->time;
-		
-		if (!equal_or_nan (fix->track, last_fix->track) ||
-		    !equal_or_nan (fix->speed, last_fix->speed)){
-			
-			/* velocity has changed */
-			changed = TRUE;
-			last_fix->track = fix->track;
-			last_fix->speed = fix->speed;
-		}
-	} else if ((gpsd->gpsdata->set & CLIMB_SET) &&
-	           (nmea_tag == NMEA_GGA || 
-	            nmea_tag == NMEA_GSA || 
-	            nmea_tag == NMEA_GSV)) {
-		
-		gpsd->gpsdata->set &= ~(CLIMB_SET);
-		
-		last_fix->time = fix->time;
-		
-		if (!equal_or_nan (fix->climb, last_fix->climb)){
-			
-			/* velocity has changed */
-			changed = TRUE;
-			last_fix->climb = fix->climb;
-		}
+		status = MAX (status, conn->status);
+	}
+	geoclue_gpsd_set_status (gpsd, status);
+	
+	best = geoclue_gpsd_get_best_connection (gpsd);
+	if (!best) {
+		return;
 	}
 	
+	last_fix->time = best->time;
+	
+	geoclue_accuracy_get_details (gpsd->last_accuracy, &level,
+	                              &horizontal, &vertical);
+	if (gpsd->last_pos_fields == GEOCLUE_POSITION_FIELDS_NONE ||
+	    !equal_or_nan (best->latitude, last_fix->latitude) ||
+	    !equal_or_nan (best->longitude, last_fix->longitude) ||
+	    !equal_or_nan (best->altitude, last_fix->altitude) ||
+	    level != GEOCLUE_ACCURACY_LEVEL_DETAILED ||
+	    horizontal != best->horizontal_accuracy ||
+	    vertical != best->vertical_accuracy) {
+		last_fix->latitude = best->latitude;
+		last_fix->longitude = best->longitude;
+		last_fix->altitude = best->altitude;
+		geoclue_accuracy_set_details (gpsd->last_accuracy,
+		                              GEOCLUE_ACCURACY_LEVEL_DETAILED,
+		                              best->horizontal_accuracy,
+		                              best->vertical_accuracy);
+		geoclue_gpsd_emit_position (gpsd);
+	}
+	
+	if (!equal_or_nan (best->speed, last_fix->speed)) {
+		last_fix->speed = best->speed;
+		changed = TRUE;
+	}
+	if (!equal_or_nan (best->track, last_fix->track)) {
+		last_fix->track = best->track;
+		changed = TRUE;
+	}
+	if (!equal_or_nan (best->climb, last_fix->climb)) {
+		last_fix->climb = best->climb;
+		changed = TRUE;
+	}
 	if (changed) {
-		gpsd->last_velo_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
-		gpsd->last_velo_fields |= (isnan (last_fix->track)) ?
-			0 : GEOCLUE_VELOCITY_FIELDS_DIRECTION;
-		gpsd->last_velo_fields |= (isnan (last_fix->speed)) ?
-			0 : GEOCLUE_VELOCITY_FIELDS_SPEED;
-		gpsd->last_velo_fields |= (isnan (last_fix->climb)) ?
-			0 : GEOCLUE_VELOCITY_FIELDS_CLIMB;
-		
-		gc_iface_velocity_emit_velocity_changed 
-			(GC_IFACE_VELOCITY (gpsd), gpsd->last_velo_fields,
-			 (int)(last_fix->time+0.5),
-			 last_fix->speed, last_fix->track, last_fix->climb);
+		geoclue_gpsd_emit_velocity (gpsd);
+	}
+	
+	if (gpsd->interval > 0 && gpsd->wakeup_id == 0 &&
+	    best->status == GEOCLUE_STATUS_AVAILABLE) {
+		geoclue_gpsd_sleep (gpsd);
 	}
 }
 
+/* Error estimates from a TPV report: gpsd's own eph/epv if it sends 
+ * them, the x and y errors or the DOPs from the last SKY report 
+ * otherwise */
 static void
-geoclue_gpsd_update_status (GeoclueGpsd *gpsd, NmeaTag nmea_tag)
+gpsd_connection_update_accuracy (GpsdConnection   *conn,
+                                 const GpsdReport *report)
 {
-	GeoclueStatus status;
+	if (report->set & GPSD_FIELD_EPH) {
+		conn->horizontal_accuracy = report->eph;
+	} else if ((report->set & GPSD_FIELD_EPX) && 
+	           (report->set & GPSD_FIELD_EPY)) {
+		conn->horizontal_accuracy = sqrt (report->epx * report->epx + 
+		                                  report->epy * report->epy);
+	} else if (!isnan (conn->hdop)) {
+		conn->horizontal_accuracy = conn->hdop * GPSD_H_UERE;
+	} else {
+		conn->horizontal_accuracy = GPSD_DEFAULT_H_ACCURACY;
+	}
 	
-	/* gpsdata->online is supposedly always up-to-date */
-	if (gpsd->gpsdata->online <= 0) {
-		status = GEOCLUE_STATUS_UNAVAILABLE;
-	} else if (gpsd->gpsdata->set & STATUS_SET) {
-		gpsd->gpsdata->set &= ~(STATUS_SET);
-		
-		if (gpsd->gpsdata->status > 0) {
-			status = GEOCLUE_STATUS_AVAILABLE;
-		} else {
-			status = GEOCLUE_STATUS_ACQUIRING;
-		}
+	if (report->mode < 3) {
+		/* no altitude in a 2D fix */
+		conn->vertical_accuracy = 0.0;
+	} else if (report->set & GPSD_FIELD_EPV) {
+		conn->vertical_accuracy = report->epv;
+	} else if (!isnan (conn->vdop)) {
+		conn->vertical_accuracy = conn->vdop * GPSD_V_UERE;
 	} else {
-		return;
+		conn->vertical_accuracy = GPSD_DEFAULT_V_ACCURACY;
+	}
+}
+
+/* Returns TRUE if the provider state may have changed */
+static gboolean
+gpsd_connection_handle_tpv (GpsdConnection   *conn,
+                            const GpsdReport *report)
+{
+	if (!(report->set & GPSD_FIELD_MODE)) {
+		return FALSE;
 	}
+	conn->mode = report->mode;
 	
-	geoclue_gpsd_set_status (gpsd, status);
+	/* mode 0 means gpsd has not seen the device report a mode yet */
+	if (report->mode == 1) {
+		if (conn->wakeup_time &&
+		    time (NULL) - conn->wakeup_time < GPSD_WAKEUP_GRACE) {
+			/* still getting the first fix since the sleep */
+			return FALSE;
+		}
+		conn->wakeup_time = 0;
+		conn->status = GEOCLUE_STATUS_ACQUIRING;
+		return TRUE;
+	} else if (report->mode < 2) {
+		return FALSE;
+	}
+	conn->wakeup_time = 0;
+	conn->status = GEOCLUE_STATUS_AVAILABLE;
+	
+	if (report->set & GPSD_FIELD_TIME) {
+		conn->time = report->time;
+	}
+	if ((report->set & GPSD_FIELD_LAT) && (report->set & GPSD_FIELD_LON)) {
+		conn->latitude = report->latitude;
+		conn->longitude = report->longitude;
+		conn->altitude = ((report->set & GPSD_FIELD_ALT) && report->mode >= 3) ? 
+		                 report->altitude : NAN;
+		gpsd_connection_update_accuracy (conn, report);
+	}
+	if (report->set & GPSD_FIELD_SPEED) {
+		conn->speed = report->speed;
+	}
+	if (report->set & GPSD_FIELD_TRACK) {
+		conn->track = report->track;
+	}
+	if (report->set & GPSD_FIELD_CLIMB) {
+		conn->climb = report->climb;
+	}
+	return TRUE;
 }
 
 static void 
 gpsd_raw_hook (struct gps_data_t *gpsdata, char *message, size_t len)
 {
-	char *tag_str = gpsd->gpsdata->tag;
-	NmeaTag nmea_tag = NMEA_NONE;
-	
-	if (tag_str[0] == 'G' && tag_str[1] == 'S' && tag_str[2] == 'A') {
-		nmea_tag = NMEA_GSA;
-	} else if (tag_str[0] == 'G' && tag_str[1] == 'G' && tag_str[2] == 'A') {
-		nmea_tag = NMEA_GGA;
-	} else if (tag_str[0] == 'G' && tag_str[1] == 'S' && tag_str[2] == 'V') {
-		nmea_tag = NMEA_GSV;
-	} else if (tag_str[0] == 'R' && tag_str[1] == 'M' && tag_str[2] == 'C') {
-		nmea_tag = NMEA_RMC;
-	}
-	
-	geoclue_gpsd_update_status (gpsd, nmea_tag);
-	geoclue_gpsd_update_position (gpsd, nmea_tag);
-	geoclue_gpsd_update_velocity (gpsd, nmea_tag);
+	GpsdConnection *conn;
+	GpsdReport report;
+	
+	conn = g_hash_table_lookup (connections_by_gpsdata, gpsdata);
+	if (!conn || !gpsd_json_parse (message, &report)) {
+		return;
+	}
+	
+	switch (report.report_class) {
+		case GPSD_REPORT_SKY:
+			/* only remembered, used with the next TPV */
+			if (report.set & GPSD_FIELD_HDOP) {
+				conn->hdop = report.hdop;
+			}
+			if (report.set & GPSD_FIELD_VDOP) {
+				conn->vdop = report.vdop;
+			}
+			break;
+		case GPSD_REPORT_TPV:
+			if (gpsd_connection_handle_tpv (conn, &report)) {
+				geoclue_gpsd_update (conn->provider);
+			}
+			break;
+		default:
+			break;
+	}
 }
 
 static void
-geoclue_gpsd_stop_gpsd (GeoclueGpsd *self)
+gpsd_connection_close (GpsdConnection *conn)
+{
+	if (conn->watch_id) {
+		g_source_remove (conn->watch_id);
+		conn->watch_id = 0;
+	}
+	if (conn->channel) {
+		g_io_channel_unref (conn->channel);
+		conn->channel = NULL;
+	}
+	if (conn->gpsdata) {
+		g_hash_table_remove (connections_by_gpsdata, conn->gpsdata);
+		gps_close (conn->gpsdata);
+		conn->gpsdata = NULL;
+	}
+	conn->hdop = NAN;
+	conn->vdop = NAN;
+}
+
+static void
+gpsd_connection_free (GpsdConnection *conn)
+{
+	gpsd_connection_close (conn);
+	g_free (conn->host);
+	g_free (conn->port);
+	g_slice_free (GpsdConnection, conn);
+}
+
+static gboolean
+gpsd_socket_cb (GIOChannel   *channel,
+                GIOCondition  condition,
+                gpointer      data)
 {
-	if (self->gpsdata) {
-		gps_close (self->gpsdata);
-		self->gpsdata = NULL;
+	GpsdConnection *conn = data;
+	
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		goto error;
 	}
+	
+	/* libgps handles one report per call: drain everything that 
+	 * has already been read from the socket */
+	do {
+		if (gps_poll (conn->gpsdata) < 0) {
+			goto error;
+		}
+	} while (gps_waiting (conn->gpsdata));
+	
+	return TRUE;
+	
+error:
+	/* the watch is removed by returning FALSE */
+	conn->watch_id = 0;
+	conn->status = GEOCLUE_STATUS_ERROR;
+	gpsd_connection_close (conn);
+	geoclue_gpsd_update (conn->provider);
+	return FALSE;
 }
 
 static gboolean
-geoclue_gpsd_start_gpsd (GeoclueGpsd *self)
+gpsd_connection_open (GpsdConnection *conn)
 {
-	self->gpsdata = gps_open (self->host, self->port);
-	if (self->gpsdata) {
-		gps_stream(self->gpsdata, WATCH_ENABLE | WATCH_NMEA | POLL_NONBLOCK, NULL);
-		gps_set_raw_hook (self->gpsdata, gpsd_raw_hook);
+	conn->gpsdata = gps_open (conn->host, conn->port);
+	if (conn->gpsdata) {
+		gps_stream(conn->gpsdata, GPSD_STREAM_FLAGS, NULL);
+		gps_set_raw_hook (conn->gpsdata, gpsd_raw_hook);
+		g_hash_table_insert (connections_by_gpsdata, conn->gpsdata, conn);
+		
+		/* process reports as soon as they arrive */
+		conn->channel = g_io_channel_unix_new (conn->gpsdata->gps_fd);
+		conn->watch_id = g_io_add_watch (conn->channel,
+		                                 G_IO_IN | G_IO_ERR | G_IO_HUP,
+		                                 gpsd_socket_cb, conn);
+		conn->status = GEOCLUE_STATUS_ACQUIRING;
 		return TRUE;
 	} else {
-		g_warning ("gps_open() failed, is gpsd running (host=%s,port=%s)?", self->host, self->port);
+		g_warning ("gps_open() failed, is gpsd running (host=%s,port=%s)?", conn->host, conn->port);
+		conn->status = GEOCLUE_STATUS_ERROR;
 		return FALSE;
 	}
 }
 
-gboolean
-gpsd_poll(gpointer data)
+static GpsdConnection *
+gpsd_connection_new (GeoclueGpsd *gpsd,
+                     const char  *host,
+                     const char  *port)
 {
-	GeoclueGpsd *self = (GeoclueGpsd*)data;
-	if (self->gpsdata) {
-		if (gps_poll(self->gpsdata) < 0) {
-			geoclue_gpsd_set_status (self, GEOCLUE_STATUS_ERROR);
-			geoclue_gpsd_stop_gpsd(self);
-			return FALSE;
+	GpsdConnection *conn;
+	
+	conn = g_slice_new0 (GpsdConnection);
+	conn->provider = gpsd;
+	conn->host = g_strdup (host);
+	conn->port = g_strdup (port);
+	conn->status = GEOCLUE_STATUS_ERROR;
+	conn->latitude = conn->longitude = conn->altitude = NAN;
+	conn->speed = conn->track = conn->climb = NAN;
+	conn->hdop = conn->vdop = NAN;
+	
+	return conn;
+}
+
+static gboolean
+geoclue_gpsd_wakeup_cb (gpointer data)
+{
+	GeoclueGpsd *self = data;
+	
+	self->wakeup_id = 0;
+	geoclue_gpsd_wakeup (self);
+	return FALSE;
+}
+
+/* Restarts streaming on all connections */
+static void
+geoclue_gpsd_wakeup (GeoclueGpsd *self)
+{
+	guint i;
+	
+	if (self->wakeup_id) {
+		g_source_remove (self->wakeup_id);
+		self->wakeup_id = 0;
+	}
+	for (i = 0; i < self->connections->len; i++) {
+		GpsdConnection *conn = g_ptr_array_index (self->connections, i);
+		
+		if (conn->gpsdata) {
+			gps_stream (conn->gpsdata, GPSD_STREAM_FLAGS, NULL);
+			if (conn->status == GEOCLUE_STATUS_AVAILABLE) {
+				conn->wakeup_time = time (NULL);
+			}
 		}
 	}
-	return TRUE;
+}
+
+/* Stops streaming after a fix until shortly before the next one is 
+ * due: gpsd can then power down a receiver nobody else watches. The 
+ * last fix and the status stay as they are meanwhile. */
+static void
+geoclue_gpsd_sleep (GeoclueGpsd *self)
+{
+	guint i;
+	
+	for (i = 0; i < self->connections->len; i++) {
+		GpsdConnection *conn = g_ptr_array_index (self->connections, i);
+		
+		if (conn->gpsdata) {
+			gps_stream (conn->gpsdata, WATCH_DISABLE, NULL);
+		}
+	}
+	self->wakeup_id = g_timeout_add_seconds 
+		(MAX (self->interval - GPSD_WAKEUP_LEAD, 1),
+		 geoclue_gpsd_wakeup_cb, self);
+}
+
+static void
+geoclue_gpsd_stop_gpsd (GeoclueGpsd *self)
+{
+	if (self->wakeup_id) {
+		g_source_remove (self->wakeup_id);
+		self->wakeup_id = 0;
+	}
+	g_ptr_array_set_size (self->connections, 0);
+}
+
+/* Connects to every host in self->hosts, a list of "host" or 
+ * "host:port" separated by commas, semicolons or spaces (port 
+ * defaults to self->port). Succeeds if any connection does. */
+static gboolean
+geoclue_gpsd_start_gpsd (GeoclueGpsd *self)
+{
+	gboolean connected = FALSE;
+	char **hosts;
+	int i;
+	
+	if (self->hosts == NULL) {
+		/* gpsd default host */
+		g_ptr_array_add (self->connections, 
+		                 gpsd_connection_new (self, NULL, self->port));
+	} else {
+		hosts = g_strsplit_set (self->hosts, ",; ", -1);
+		for (i = 0; hosts[i]; i++) {
+			char *port;
+			
+			if (hosts[i][0] == '\0') {
+				continue;
+			}
+			/* "host:port", but leave IPv6 addresses alone */
+			port = strrchr (hosts[i], ':');
+			if (port && strchr (hosts[i], ':') == port) {
+				*port++ = '\0';
+			} else {
+				port = self->port;
+			}
+			g_ptr_array_add (self->connections, 
+			                 gpsd_connection_new (self, hosts[i], port));
+		}
+		g_strfreev (hosts);
+	}
+	
+	for (i = 0; i < (int) self->connections->len; i++) {
+		if (gpsd_connection_open (g_ptr_array_index (self->connections, i))) {
+			connected = TRUE;
+		}
+	}
+	if (connected) {
+		geoclue_gpsd_update (self);
+	}
+	return connected;
 }
 
 static void
 geoclue_gpsd_init (GeoclueGpsd *self)
 {
-	self->gpsdata = NULL;
+	if (!connections_by_gpsdata) {
+		connections_by_gpsdata = g_hash_table_new (NULL, NULL);
+	}
+	
+	self->connections = g_ptr_array_new_with_free_func 
+		((GDestroyNotify) gpsd_connection_free);
+	self->loop = NULL;
 	self->last_fix = g_new0 (gps_fix, 1);
+	self->last_fix->latitude = NAN;
+	self->last_fix->longitude = NAN;
+	self->last_fix->altitude = NAN;
+	self->last_fix->speed = NAN;
+	self->last_fix->track = NAN;
+	self->last_fix->climb = NAN;
 	
 	self->last_pos_fields = GEOCLUE_POSITION_FIELDS_NONE;
 	self->last_velo_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
@@ -438,7 +796,9 @@ geoclue_gpsd_init (GeoclueGpsd *self)
 				 "Gpsd", "Gpsd provider");
 	
 	self->port = g_strdup (DEFAULT_GPSD_PORT);
-	self->host = NULL;
+	self->hosts = NULL;
+	self->interval = 0;
+	self->wakeup_id = 0;
 	geoclue_gpsd_set_status (self, GEOCLUE_STATUS_ACQUIRING);
 	if (!geoclue_gpsd_start_gpsd (self)) {
 		geoclue_gpsd_set_status (self, GEOCLUE_STATUS_ERROR);
@@ -499,16 +859,23 @@ geoclue_gpsd_velocity_init (GcIfaceVelocityClass *iface)
 	iface->get_velocity = get_velocity;
 }
 
+#ifdef GEOCLUE_PROVIDER_PLUGIN
+
+GC_PROVIDER_PLUGIN_DEFINE (geoclue_gpsd_get_type)
+
+#else
+
 int
 main (int    argc,
       char **argv)
 {
+	GeoclueGpsd *gpsd;
+	
 	g_type_init ();
 	
 	gpsd = g_object_new (GEOCLUE_TYPE_GPSD, NULL);
 	
 	gpsd->loop = g_main_loop_new (NULL, TRUE);
-	g_timeout_add(500, gpsd_poll, (gpointer)gpsd);
 
 	g_main_loop_run (gpsd->loop);
 	
@@ -517,3 +884,5 @@ main (int    argc,
 	
 	return 0;
 }
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Geoclue
+ * gpsd-json.c - Parser for gpsd JSON reports
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Single pass parser for the gpsd report lines the provider cares
+ * about. It scans the line in place and writes into a caller-owned
+ * GpsdReport, so it does not allocate anything: gpsd may send several
+ * reports per second per receiver. Members that are not used
+ * (e.g. the satellite list in SKY) are skipped without being parsed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gpsd-json.h"
+
+typedef struct {
+	const char *key;
+	GpsdReportFields field;
+	glong offset;
+} GpsdNumberField;
+
+static const GpsdNumberField number_fields[] = {
+	{ "lat",   GPSD_FIELD_LAT,   G_STRUCT_OFFSET (GpsdReport, latitude) },
+	{ "lon",   GPSD_FIELD_LON,   G_STRUCT_OFFSET (GpsdReport, longitude) },
+	{ "alt",   GPSD_FIELD_ALT,   G_STRUCT_OFFSET (GpsdReport, altitude) },
+	{ "eph",   GPSD_FIELD_EPH,   G_STRUCT_OFFSET (GpsdReport, eph) },
+	{ "epv",   GPSD_FIELD_EPV,   G_STRUCT_OFFSET (GpsdReport, epv) },
+	{ "epx",   GPSD_FIELD_EPX,   G_STRUCT_OFFSET (GpsdReport, epx) },
+	{ "epy",   GPSD_FIELD_EPY,   G_STRUCT_OFFSET (GpsdReport, epy) },
+	{ "speed", GPSD_FIELD_SPEED, G_STRUCT_OFFSET (GpsdReport, speed) },
+	{ "track", GPSD_FIELD_TRACK, G_STRUCT_OFFSET (GpsdReport, track) },
+	{ "climb", GPSD_FIELD_CLIMB, G_STRUCT_OFFSET (GpsdReport, climb) },
+	{ "hdop",  GPSD_FIELD_HDOP,  G_STRUCT_OFFSET (GpsdReport, hdop) },
+	{ "vdop",  GPSD_FIELD_VDOP,  G_STRUCT_OFFSET (GpsdReport, vdop) },
+	{ "pdop",  GPSD_FIELD_PDOP,  G_STRUCT_OFFSET (GpsdReport, pdop) },
+	/* gpsd before 2.96 sends time as a number */
+	{ "time",  GPSD_FIELD_TIME,  G_STRUCT_OFFSET (GpsdReport, time) },
+};
+
+static gboolean
+key_is (const char *key, gsize len, const char *name)
+{
+	return strncmp (key, name, len) == 0 && name[len] == '\0';
+}
+
+static const char *
+skip_whitespace (const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+		p++;
+	}
+	return p;
+}
+
+/* 'p' points to the opening quote. Escapes are left in place, none
+ * of the values we use contain any. Returns the position after the
+ * closing quote or NULL if the string does not end. */
+static const char *
+scan_string (const char  *p,
+             const char **start,
+             gsize       *len)
+{
+	*start = ++p;
+	while (*p != '"') {
+		if (*p == '\0') {
+			return NULL;
+		}
+		if (*p == '\\' && p[1] != '\0') {
+			p++;
+		}
+		p++;
+	}
+	*len = p - *start;
+	return p + 1;
+}
+
+/* Skips a value of any type. Returns the position of the ',' or '}'
+ * that ends it, or NULL on error */
+static const char *
+skip_value (const char *p)
+{
+	const char *start;
+	gsize len;
+	int depth = 0;
+
+	while (*p != '\0') {
+		switch (*p) {
+			case '"':
+				p = scan_string (p, &start, &len);
+				if (!p) {
+					return NULL;
+				}
+				continue;
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (depth == 0) {
+					return p;
+				}
+				depth--;
+				break;
+			case ',':
+				if (depth == 0) {
+					return p;
+				}
+				break;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+/* "2011-03-01T12:00:00.000Z" to seconds since the epoch */
+static gboolean
+parse_iso8601 (const char *str,
+               double     *time)
+{
+	int year, month, day, hour, min;
+	double sec;
+	long days;
+
+	if (sscanf (str, "%4d-%2d-%2dT%2d:%2d:%lf",
+	            &year, &month, &day, &hour, &min, &sec) != 6) {
+		return FALSE;
+	}
+
+	/* days from civil date, March based year */
+	if (month <= 2) {
+		year--;
+		month += 12;
+	}
+	days = 365L * year + year / 4 - year / 100 + year / 400 +
+	       (153 * (month - 3) + 2) / 5 + day - 719469;
+
+	*time = days * 86400.0 + hour * 3600 + min * 60 + sec;
+	return TRUE;
+}
+
+static void
+set_string (GpsdReport *report,
+            const char *key,
+            gsize       key_len,
+            const char *value,
+            gsize       len)
+{
+	if (key_is (key, key_len, "class")) {
+		if (len == 3 && strncmp (value, "TPV", 3) == 0) {
+			report->report_class = GPSD_REPORT_TPV;
+		} else if (len == 3 && strncmp (value, "SKY", 3) == 0) {
+			report->report_class = GPSD_REPORT_SKY;
+		}
+	} else if (key_is (key, key_len, "tag")) {
+		len = MIN (len, sizeof (report->tag) - 1);
+		memcpy (report->tag, value, len);
+		report->tag[len] = '\0';
+		report->set |= GPSD_FIELD_TAG;
+	} else if (key_is (key, key_len, "time")) {
+		if (parse_iso8601 (value, &report->time)) {
+			report->set |= GPSD_FIELD_TIME;
+		}
+	}
+}
+
+static void
+set_number (GpsdReport *report,
+            const char *key,
+            gsize       key_len,
+            double      value)
+{
+	guint i;
+
+	if (key_is (key, key_len, "mode")) {
+		report->mode = (int) value;
+		report->set |= GPSD_FIELD_MODE;
+		return;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (number_fields); i++) {
+		if (key_is (key, key_len, number_fields[i].key)) {
+			G_STRUCT_MEMBER (double, report, number_fields[i].offset) = value;
+			report->set |= number_fields[i].field;
+			return;
+		}
+	}
+}
+
+/**
+ * gpsd_json_parse:
+ * @json: a nul-terminated report line from gpsd
+ * @report: report to fill in
+ *
+ * Return value: %TRUE if @json was a well-formed JSON object.
+ * report->report_class tells if it was one of the reports we use.
+ */
+gboolean
+gpsd_json_parse (const char *json,
+                 GpsdReport *report)
+{
+	const char *p, *key, *str;
+	gsize key_len, str_len;
+
+	report->report_class = GPSD_REPORT_OTHER;
+	report->set = 0;
+
+	p = skip_whitespace (json);
+	if (*p != '{') {
+		return FALSE;
+	}
+	p = skip_whitespace (p + 1);
+	if (*p == '}') {
+		return TRUE;
+	}
+
+	while (TRUE) {
+		if (*p != '"') {
+			return FALSE;
+		}
+		p = scan_string (p, &key, &key_len);
+		if (!p) {
+			return FALSE;
+		}
+		p = skip_whitespace (p);
+		if (*p != ':') {
+			return FALSE;
+		}
+		p = skip_whitespace (p + 1);
+
+		if (*p == '"') {
+			p = scan_string (p, &str, &str_len);
+			if (!p) {
+				return FALSE;
+			}
+			set_string (report, key, key_len, str, str_len);
+		} else if (*p == '-' || g_ascii_isdigit (*p)) {
+			char *end;
+			double value;
+
+			value = g_ascii_strtod (p, &end);
+			if (end == p) {
+				return FALSE;
+			}
+			p = end;
+			set_number (report, key, key_len, value);
+		} else {
+			p = skip_value (p);
+			if (!p) {
+				return FALSE;
+			}
+		}
+
+		p = skip_whitespace (p);
+		if (*p == '}') {
+			return TRUE;
+		} else if (*p != ',') {
+			return FALSE;
+		}
+		p = skip_whitespace (p + 1);
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * Geoclue
+ * gpsd-json.h - Parser for gpsd JSON reports
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GPSD_JSON_H
+#define _GPSD_JSON_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	GPSD_REPORT_OTHER,
+	GPSD_REPORT_TPV,
+	GPSD_REPORT_SKY
+} GpsdReportClass;
+
+/* bits in GpsdReport.set */
+typedef enum {
+	GPSD_FIELD_TAG   = 1 << 0,
+	GPSD_FIELD_MODE  = 1 << 1,
+	GPSD_FIELD_TIME  = 1 << 2,
+	GPSD_FIELD_LAT   = 1 << 3,
+	GPSD_FIELD_LON   = 1 << 4,
+	GPSD_FIELD_ALT   = 1 << 5,
+	GPSD_FIELD_EPH   = 1 << 6,
+	GPSD_FIELD_EPV   = 1 << 7,
+	GPSD_FIELD_EPX   = 1 << 8,
+	GPSD_FIELD_EPY   = 1 << 9,
+	GPSD_FIELD_SPEED = 1 << 10,
+	GPSD_FIELD_TRACK = 1 << 11,
+	GPSD_FIELD_CLIMB = 1 << 12,
+	GPSD_FIELD_HDOP  = 1 << 13,
+	GPSD_FIELD_VDOP  = 1 << 14,
+	GPSD_FIELD_PDOP  = 1 << 15
+} GpsdReportFields;
+
+/* The fields of a TPV or SKY report that the provider uses.
+ * Values are only valid if their bit is in 'set'. */
+typedef struct {
+	GpsdReportClass report_class;
+	guint set;
+
+	char tag[8];
+	int mode;
+	double time;
+
+	double latitude;
+	double longitude;
+	double altitude;
+	double eph;
+	double epv;
+	double epx;
+	double epy;
+
+	double speed;
+	double track;
+	double climb;
+
+	double hdop;
+	double vdop;
+	double pdop;
+} GpsdReport;
+
+gboolean gpsd_json_parse (const char *json, GpsdReport *report);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Geoclue
+ * test-gpsd-latency.c - Fix latency of the gpsd provider against a fake gpsd
+ *
+ * Runs the gpsd provider in-process and points it at a fake gpsd on
+ * a local socket. The fake sends a TPV report with a new position at
+ * random intervals and the time until the provider emits
+ * position-changed is measured.
+ *
+ * Usage: test-gpsd-latency [reports]
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <geoclue/gc-provider.h>
+#include <geoclue/gc-iface-position.h>
+
+/* a fix should be handled right away, not on the next poll */
+#define MAX_LATENCY 0.1
+
+GType geoclue_gpsd_get_type (void);
+
+static GMainLoop *loop;
+static GTimer *timer;
+static GMutex *sent_lock;
+static double sent_at;
+
+static int n_reports = 20;
+static int received = 0;
+static double total_latency = 0.0, max_latency = 0.0;
+
+static gpointer
+fake_gpsd (gpointer data)
+{
+	int listen_fd = GPOINTER_TO_INT (data);
+	int fd, i;
+	char buf[512];
+
+	fd = accept (listen_fd, NULL, NULL);
+	if (fd < 0) {
+		g_warning ("accept() failed");
+		return NULL;
+	}
+
+	/* wait for the ?WATCH command from libgps */
+	if (read (fd, buf, sizeof (buf)) <= 0) {
+		g_warning ("fake gpsd: client did not send anything");
+		close (fd);
+		return NULL;
+	}
+
+	snprintf (buf, sizeof (buf),
+	          "{\"class\":\"VERSION\",\"release\":\"fake\",\"rev\":\"fake\","
+	          "\"proto_major\":3,\"proto_minor\":1}\r\n");
+	if (write (fd, buf, strlen (buf)) < 0) {
+		close (fd);
+		return NULL;
+	}
+
+	for (i = 0; i < n_reports; i++) {
+		g_usleep (g_random_int_range (50, 300) * 1000);
+
+		snprintf (buf, sizeof (buf),
+		          "{\"class\":\"TPV\",\"tag\":\"GGA\",\"device\":\"/dev/fake\","
+		          "\"time\":%d.000,\"ept\":0.005,"
+		          "\"lat\":60.%06d,\"lon\":24.%06d,\"alt\":12.0,\"mode\":3}\r\n",
+		          1300000000 + i, i, i);
+
+		g_mutex_lock (sent_lock);
+		sent_at = g_timer_elapsed (timer, NULL);
+		g_mutex_unlock (sent_lock);
+
+		if (write (fd, buf, strlen (buf)) < 0) {
+			g_warning ("fake gpsd: write failed");
+			break;
+		}
+	}
+
+	/* keep the connection open until the test is done */
+	g_usleep (G_USEC_PER_SEC);
+	close (fd);
+	return NULL;
+}
+
+static void
+position_changed (GcIfacePosition      *position,
+                  GeocluePositionFields fields,
+                  int                   timestamp,
+                  double                latitude,
+                  double                longitude,
+                  double                altitude,
+                  GeoclueAccuracy      *accuracy,
+                  gpointer              data)
+{
+	double latency;
+
+	g_mutex_lock (sent_lock);
+	latency = g_timer_elapsed (timer, NULL) - sent_at;
+	g_mutex_unlock (sent_lock);
+
+	total_latency += latency;
+	max_latency = MAX (max_latency, latency);
+
+	if (++received == n_reports) {
+		g_main_loop_quit (loop);
+	}
+}
+
+static gboolean
+timeout (gpointer data)
+{
+	g_warning ("Only %d of %d reports received", received, n_reports);
+	g_main_loop_quit (loop);
+	return FALSE;
+}
+
+static GValue *
+string_value_new (const char *str)
+{
+	GValue *value;
+
+	value = g_new0 (GValue, 1);
+	g_value_init (value, G_TYPE_STRING);
+	g_value_set_string (value, str);
+	return value;
+}
+
+static void
+value_free (GValue *value)
+{
+	g_value_unset (value);
+	g_free (value);
+}
+
+int main (int argc, char **argv)
+{
+	GObject *provider;
+	GHashTable *options;
+	GError *error = NULL;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof (addr);
+	int listen_fd;
+	char *port;
+
+	if (argc > 1) {
+		n_reports = MAX (1, atoi (argv[1]));
+	}
+
+	g_type_init ();
+	if (!g_thread_supported ()) {
+		g_thread_init (NULL);
+	}
+
+	listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind (listen_fd, (struct sockaddr *)&addr, sizeof (addr)) < 0 ||
+	    listen (listen_fd, 1) < 0 ||
+	    getsockname (listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+		g_printerr ("Could not create fake gpsd socket\n");
+		return 1;
+	}
+	port = g_strdup_printf ("%d", ntohs (addr.sin_port));
+
+	loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+	sent_lock = g_mutex_new ();
+
+	g_thread_create (fake_gpsd, GINT_TO_POINTER (listen_fd), FALSE, NULL);
+
+	gc_provider_set_plugin_mode (TRUE);
+	provider = g_object_new (geoclue_gpsd_get_type (), NULL);
+	g_signal_connect (provider, "position-changed",
+	                  G_CALLBACK (position_changed), NULL);
+
+	options = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                 NULL, (GDestroyNotify)value_free);
+	g_hash_table_insert (options, "org.freedesktop.Geoclue.GPSHost",
+	                     string_value_new ("127.0.0.1"));
+	g_hash_table_insert (options, "org.freedesktop.Geoclue.GPSPort",
+	                     string_value_new (port));
+	if (!GC_IFACE_GEOCLUE_GET_CLASS (provider)->set_options
+		(GC_IFACE_GEOCLUE (provider), options, &error)) {
+		g_printerr ("Could not connect to fake gpsd: %s\n", error->message);
+		return 1;
+	}
+	g_hash_table_destroy (options);
+
+	g_timeout_add_seconds (n_reports, timeout, NULL);
+	g_main_loop_run (loop);
+
+	if (received > 0) {
+		g_print ("%d reports, latency mean %.1f ms, max %.1f ms\n",
+		         received, 1000 * total_latency / received,
+		         1000 * max_latency);
+	}
+
+	g_object_unref (provider);
+	g_free (port);
+	close (listen_fd);
+
+	return (received == n_reports && max_latency < MAX_LATENCY) ? 0 : 1;
+}
@@ -32,6 +32,7 @@
 #include <dbus/dbus-glib-bindings.h>
 
 #include "geoclue-gsmloc-mm.h"
+#include "gsmloc-celldb.h"
 
 #include "mm-marshal.h"
 
@@ -41,6 +42,7 @@
 #define MM_DBUS_LOC_INTERFACE "org.freedesktop.ModemManager.Modem.Location"
 #define DBUS_PROPS_INTERFACE  "org.freedesktop.DBus.Properties"
 #define MM_DBUS_MODEM_INTERFACE "org.freedesktop.ModemManager.Modem"
+#define MM_DBUS_GSM_NETWORK_INTERFACE "org.freedesktop.ModemManager.Modem.Gsm.Network"
 
 G_DEFINE_TYPE (GeoclueGsmlocMm, geoclue_gsmloc_mm, G_TYPE_OBJECT)
 
@@ -52,6 +54,7 @@ typedef struct {
 	DBusGProxy *loc_proxy;
 	DBusGProxy *props_proxy;
 	DBusGProxy *modem_proxy;
+	DBusGProxy *net_proxy;
 
 	gboolean got_enabled;
 	gboolean enabled;
@@ -67,9 +70,18 @@ typedef struct {
 	 */
 	gboolean signals;
 	guint loc_idle;
+	gboolean loc_polling;
+	/* seconds, grows while the cell stays the same */
+	guint poll_interval;
 
 	gboolean has_location;
 
+	/* serving cell; ModemManager does not list neighbours */
+	gboolean has_key;
+	guint64 key;
+	/* dBm, 0 if not known */
+	int strength;
+
 	gpointer owner;
 } Modem;
 
@@ -83,6 +95,9 @@ typedef struct {
 
 	/* List of Modem objects */
 	GSList *modems;
+
+	/* Whether anyone wants positions: modems are not polled if not */
+	gboolean active;
 } GeoclueGsmlocMmPrivate;
 
 enum {
@@ -92,12 +107,18 @@ enum {
 
 enum {
 	NETWORK_DATA_CHANGED,
+	CELLS_CHANGED,
 	LAST_SIGNAL
 };
 static guint signals[LAST_SIGNAL] = {0};
 
 #define LOC_CAP_GSM_LACCI 0x02
 
+/* Location polling interval in seconds: it starts at the minimum after
+ * a handover and doubles every time the cell has not changed */
+#define MIN_POLL_INTERVAL 5
+#define MAX_POLL_INTERVAL 300
+
 gboolean mm_debug = FALSE;
 
 #define debugmsg(fmt, args...) \
@@ -145,11 +166,30 @@ recheck_available (GeoclueGsmlocMm *self)
 }
 
 static void
-location_update (GeoclueGsmlocMm *self, const char *loc)
+emit_cells_changed (Modem *modem)
+{
+	GArray *cells;
+
+	cells = g_array_new (FALSE, FALSE, sizeof (GsmlocCellSignal));
+	if (modem->has_key) {
+		GsmlocCellSignal cell;
+
+		cell.key = modem->key;
+		cell.rssi = modem->strength;
+		g_array_append_val (cells, cell);
+	}
+
+	g_signal_emit (G_OBJECT (modem->owner), signals[CELLS_CHANGED], 0, cells);
+	g_array_free (cells, TRUE);
+}
+
+static void
+location_update (Modem *modem, const char *loc)
 {
+	GeoclueGsmlocMm *self = modem->owner;
 	char **components = NULL;
 	char *dec_lac = NULL, *dec_cid = NULL;
-	unsigned long int num;
+	unsigned long int num, lac;
 
 	components = g_strsplit (loc, ",", 0);
 	if (!components || g_strv_length (components) < 4) {
@@ -166,6 +206,7 @@ location_update (GeoclueGsmlocMm *self, const char *loc)
 		goto out;
 	}
 	dec_lac = g_strdup_printf ("%u", num);
+	lac = num;
 
 	/* convert cell id to decimal */
 	errno = 0;
@@ -177,6 +218,10 @@ location_update (GeoclueGsmlocMm *self, const char *loc)
 	}
 	dec_cid = g_strdup_printf ("%u", num);
 
+	modem->has_key = gsmloc_cell_get_key (strtoul (components[0], NULL, 10),
+	                                      strtoul (components[1], NULL, 10),
+	                                      lac, num, &modem->key);
+
 	debugmsg ("%s: emitting location: %s/%s/%s/%s",
 	           __func__, components[0], components[1], dec_lac, dec_cid);
 	g_signal_emit (G_OBJECT (self), signals[NETWORK_DATA_CHANGED], 0,
@@ -184,6 +229,7 @@ location_update (GeoclueGsmlocMm *self, const char *loc)
 	               components[1],  /* MNC */
 	               dec_lac,        /* LAC */
 	               dec_cid);       /* CID */
+	emit_cells_changed (modem);
 
 out:
 	if (components)
@@ -207,18 +253,64 @@ modem_location_update (Modem *modem, GHashTable *locations)
 	}
 
 	debugmsg ("%s: GSM LAC/CI: %s", __func__, g_value_get_string (lacci));
-	location_update (modem->owner, g_value_get_string (lacci));
+	location_update (modem, g_value_get_string (lacci));
 }
 
 #define DBUS_TYPE_LOCATIONS (dbus_g_type_get_map ("GHashTable", G_TYPE_UINT, G_TYPE_VALUE))
 #define DBUS_TYPE_G_MAP_OF_VARIANT (dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE))
 
+static gboolean
+modem_needs_poll (Modem *modem)
+{
+	GeoclueGsmlocMmPrivate *priv = GEOCLUE_GSMLOC_MM_GET_PRIVATE (modem->owner);
+
+	return priv->active && !modem->signals &&
+	       modem->enabled && modem->loc_enabled && modem->has_location;
+}
+
+static void modem_loc_poll (Modem *modem);
+
+static gboolean
+modem_loc_poll_timeout (gpointer user_data)
+{
+	Modem *modem = user_data;
+
+	modem->loc_idle = 0;
+	modem_loc_poll (modem);
+	return FALSE;
+}
+
+static void
+modem_schedule_poll (Modem *modem, gboolean cell_changed)
+{
+	if (modem->loc_idle) {
+		g_source_remove (modem->loc_idle);
+		modem->loc_idle = 0;
+	}
+	if (!modem_needs_poll (modem))
+		return;
+
+	if (cell_changed)
+		modem->poll_interval = MIN_POLL_INTERVAL;
+	else
+		modem->poll_interval = MIN (modem->poll_interval * 2, MAX_POLL_INTERVAL);
+
+	debugmsg ("%s: (%s) next location poll in %u s",
+	          __func__, modem->path, modem->poll_interval);
+	modem->loc_idle = g_timeout_add_seconds (modem->poll_interval,
+	                                         modem_loc_poll_timeout, modem);
+}
+
 static void
 loc_poll_cb (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
 {
+	Modem *modem = user_data;
 	GError *error = NULL;
 	GHashTable *locations = NULL;
+	gboolean had_key = modem->has_key;
+	guint64 old_key = modem->key;
 
+	modem->loc_polling = FALSE;
 	if (!dbus_g_proxy_end_call (proxy, call, &error,
 	                            DBUS_TYPE_LOCATIONS, &locations,
 	                            G_TYPE_INVALID)) {
@@ -227,23 +319,82 @@ loc_poll_cb (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
 		           error ? error->code : -1,
 		           error && error->message ? error->message : "(unknown)");
 		g_clear_error (&error);
+		modem_schedule_poll (modem, FALSE);
 		return;
 	}
 
-	modem_location_update ((Modem *) user_data, locations);
+	modem_location_update (modem, locations);
 	g_hash_table_destroy (locations);
+
+	modem_schedule_poll (modem, modem->has_key != had_key ||
+	                            modem->key != old_key);
 }
 
-static gboolean
-modem_loc_poll (gpointer user_data)
+static void
+signal_quality_changed (DBusGProxy *proxy, guint quality, gpointer user_data)
 {
 	Modem *modem = user_data;
+	int strength;
+
+	strength = GSMLOC_PERCENT_TO_DBM (MIN (quality, 100));
+	if (strength == modem->strength)
+		return;
+
+	modem->strength = strength;
+	if (modem->has_key)
+		emit_cells_changed (modem);
+}
 
+static void
+signal_quality_cb (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+	GError *error = NULL;
+	guint quality;
+
+	/* CDMA modems and disabled modems have no GSM signal quality */
+	if (!dbus_g_proxy_end_call (proxy, call, &error,
+	                            G_TYPE_UINT, &quality,
+	                            G_TYPE_INVALID)) {
+		debugmsg ("%s: failed to get signal quality: %s", __func__,
+		          error && error->message ? error->message : "(unknown)");
+		g_clear_error (&error);
+		return;
+	}
+
+	signal_quality_changed (proxy, quality, user_data);
+}
+
+static void
+modem_loc_poll (Modem *modem)
+{
+	if (modem->loc_polling)
+		return;
+
+	modem->loc_polling = TRUE;
 	dbus_g_proxy_begin_call (modem->loc_proxy, "GetLocation",
 	                         loc_poll_cb, modem, NULL,
 	                         G_TYPE_INVALID);
+}
+
+/* Starts or stops polling the location of a modem that does not
+ * signal it */
+static void
+modem_update_polling (Modem *modem)
+{
+	if (!modem_needs_poll (modem)) {
+		if (modem->loc_idle) {
+			g_source_remove (modem->loc_idle);
+			modem->loc_idle = 0;
+		}
+		return;
+	}
 
-	return TRUE;
+	/* Kick off a quick location request, the reply schedules the
+	 * next one */
+	if (!modem->loc_idle && !modem->loc_polling) {
+		modem->poll_interval = MIN_POLL_INTERVAL;
+		modem_loc_poll (modem);
+	}
 }
 
 static void
@@ -362,19 +513,10 @@ modem_properties_changed (DBusGProxy *proxy,
 	new_avail = modem->enabled && modem->loc_enabled && modem->has_location;
 
 	/* If the modem doesn't signal its location, start polling for the
-	 * location now.
-	 */
-	if (new_avail && !modem->signals && !modem->loc_idle) {
-		modem->loc_idle = g_timeout_add_seconds (20, modem_loc_poll, modem);
-		/* Kick off a quick location request */
-		modem_loc_poll (modem);
-	}
-
-	/* If the modem is no longer enabled, or it now signals its location
-	 * then we no longer need to poll.
+	 * location now. If the modem is no longer enabled, or it now signals
+	 * its location then we no longer need to poll.
 	 */
-	if ((!new_avail || modem->signals) && modem->loc_idle)
-		g_source_remove (modem->loc_idle);
+	modem_update_polling (modem);
 
 	/* Tell the manager to recheck availability of location info */
 	if (old_avail != new_avail)
@@ -400,6 +542,9 @@ modem_properties_changed (DBusGProxy *proxy,
 	if (modem->has_location && modem->loc_enabled && !modem->got_initial_loc) {
 		modem->got_initial_loc = TRUE;
 		modem_loc_poll (modem);
+		dbus_g_proxy_begin_call (modem->net_proxy, "GetSignalQuality",
+		                         signal_quality_cb, modem, NULL,
+		                         G_TYPE_INVALID);
 	}
 }
 
@@ -473,6 +618,17 @@ modem_new (DBusGConnection *bus, const char *path, gpointer owner)
 	                                                path,
 	                                                MM_DBUS_MODEM_INTERFACE);
 
+	modem->net_proxy = dbus_g_proxy_new_for_name (bus,
+	                                              MM_DBUS_SERVICE,
+	                                              path,
+	                                              MM_DBUS_GSM_NETWORK_INTERFACE);
+	dbus_g_proxy_add_signal (modem->net_proxy, "SignalQuality",
+	                         G_TYPE_UINT, G_TYPE_INVALID);
+	dbus_g_proxy_connect_signal (modem->net_proxy, "SignalQuality",
+	                             G_CALLBACK (signal_quality_changed),
+	                             modem,
+	                             NULL);
+
 	/* Listen for property changes */
 	modem->props_proxy = dbus_g_proxy_new_for_name (bus,
 	                                                MM_DBUS_SERVICE,
@@ -512,6 +668,10 @@ modem_free (Modem *modem)
 	g_free (modem->path);
 	g_object_unref (modem->loc_proxy);
 	g_object_unref (modem->modem_proxy);
+	dbus_g_proxy_disconnect_signal (modem->net_proxy, "SignalQuality",
+	                                G_CALLBACK (signal_quality_changed),
+	                                modem);
+	g_object_unref (modem->net_proxy);
 	g_object_unref (modem->props_proxy);
 
 	if (modem->loc_idle)
@@ -638,6 +798,31 @@ geoclue_gsmloc_mm_new (void)
 	return (GeoclueGsmlocMm *) g_object_new (GEOCLUE_TYPE_GSMLOC_MM, NULL);
 }
 
+/* Modems that do not signal their location are only polled while
+ * active. Becoming active polls right away. */
+void
+geoclue_gsmloc_mm_set_active (GeoclueGsmlocMm *self, gboolean active)
+{
+	GeoclueGsmlocMmPrivate *priv = GEOCLUE_GSMLOC_MM_GET_PRIVATE (self);
+	GSList *iter;
+
+	if (priv->active == active)
+		return;
+
+	debugmsg ("%s: %s location polling", __func__,
+	          active ? "resuming" : "stopping");
+	priv->active = active;
+	for (iter = priv->modems; iter; iter = g_slist_next (iter)) {
+		Modem *modem = iter->data;
+
+		if (modem->loc_idle) {
+			g_source_remove (modem->loc_idle);
+			modem->loc_idle = 0;
+		}
+		modem_update_polling (modem);
+	}
+}
+
 static gboolean
 mm_alive (DBusGProxy *proxy)
 {
@@ -665,6 +850,8 @@ geoclue_gsmloc_mm_init (GeoclueGsmlocMm *self)
 	if (getenv ("GEOCLUE_GSMLOC_MM_DEBUG"))
 		mm_debug = TRUE;
 
+	priv->active = TRUE;
+
 	priv->bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, NULL);
 	if (!priv->bus) {
 		g_warning ("Failed to acquire a connection to the D-Bus system bus.");
@@ -775,5 +962,15 @@ geoclue_gsmloc_mm_class_init (GeoclueGsmlocMmClass *klass)
 		              mm_marshal_VOID__STRING_STRING_STRING_STRING,
 		              G_TYPE_NONE, 4,
 		              G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+
+	/* a GArray of GsmlocCellSignal, serving cell first */
+	signals[CELLS_CHANGED] =
+		g_signal_new ("cells-changed",
+		              G_OBJECT_CLASS_TYPE (klass),
+		              G_SIGNAL_RUN_LAST, 0,
+		              NULL, NULL,
+		              g_cclosure_marshal_VOID__BOXED,
+		              G_TYPE_NONE, 1,
+		              G_TYPE_ARRAY);
 }
 
@@ -49,6 +49,7 @@ typedef struct _GeoclueGsmlocMmClass {
 GType geoclue_gsmloc_mm_get_type (void);
 
 GeoclueGsmlocMm *geoclue_gsmloc_mm_new (void);
+void geoclue_gsmloc_mm_set_active (GeoclueGsmlocMm *self, gboolean active);
 
 G_END_DECLS
 
@@ -34,6 +34,7 @@
 #include <dbus/dbus-glib-bindings.h>
 
 #include "geoclue-gsmloc-ofono.h"
+#include "gsmloc-celldb.h"
 
 /* generated ofono bindings */
 #include "ofono-marshal.h"
@@ -54,6 +55,7 @@ typedef struct _GeoclueGsmlocOfonoPrivate {
 
 enum {
 	NETWORK_DATA_CHANGED,
+	CELLS_CHANGED,
 	LAST_SIGNAL
 };
 static guint signals[LAST_SIGNAL] = {0};
@@ -63,7 +65,11 @@ enum {
 	PROP_AVAILABLE,
 };
 
+#define DBUS_TYPE_G_MAP_OF_VARIANT (dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE))
+#define DBUS_TYPE_CELL_LIST (dbus_g_type_get_collection ("GPtrArray", DBUS_TYPE_G_MAP_OF_VARIANT))
+
 static void emit_network_data_changed (GeoclueGsmlocOfono *ofono);
+static void emit_cells_changed (GeoclueGsmlocOfono *ofono);
 
 
 typedef struct _NetOp {
@@ -74,14 +80,31 @@ typedef struct _NetOp {
 	char *mnc;
 } NetOp;
 
+/* A neighbour cell from NetworkMonitor */
+typedef struct _NeighbourCell {
+	/* zero when on the network of the serving cell */
+	guint mcc;
+	guint mnc;
+	guint lac;
+	guint cid;
+	int rssi;
+} NeighbourCell;
+
 typedef struct _Modem {
 	GeoclueGsmlocOfono *ofono;
 	DBusGProxy *proxy;
 	DBusGProxy *netreg_proxy;
+	DBusGProxy *netmon_proxy;
+	DBusGProxyCall *netmon_call;
+	/* older oFono has no neighbour information */
+	gboolean netmon_supported;
 	GList *netops;
 
 	char *lac;
 	char *cid;
+	/* dBm, 0 if not known */
+	int strength;
+	GArray *neighbours;
 } Modem;
 
 static gboolean
@@ -165,6 +188,111 @@ modem_set_cid (Modem *modem, const char *cid)
 	return TRUE;
 }
 
+static gboolean
+neighbour_cell_from_props (GHashTable *props, NeighbourCell *cell)
+{
+	GValue *val;
+
+	memset (cell, 0, sizeof (NeighbourCell));
+
+	/* LTE cells have tracking areas, no location area */
+	val = g_hash_table_lookup (props, "LocationAreaCode");
+	if (!val || !G_VALUE_HOLDS_UINT (val)) {
+		return FALSE;
+	}
+	cell->lac = g_value_get_uint (val);
+	val = g_hash_table_lookup (props, "CellId");
+	if (!val || !G_VALUE_HOLDS_UINT (val)) {
+		return FALSE;
+	}
+	cell->cid = g_value_get_uint (val);
+
+	val = g_hash_table_lookup (props, "MobileCountryCode");
+	if (val && G_VALUE_HOLDS_STRING (val)) {
+		cell->mcc = g_ascii_strtoull (g_value_get_string (val), NULL, 10);
+	}
+	val = g_hash_table_lookup (props, "MobileNetworkCode");
+	if (val && G_VALUE_HOLDS_STRING (val)) {
+		cell->mnc = g_ascii_strtoull (g_value_get_string (val), NULL, 10);
+	}
+
+	/* 27.007 <rxlev> and <rscp> steps are 1 dB */
+	val = g_hash_table_lookup (props, "ReceivedSignalStrength");
+	if (val && G_VALUE_HOLDS_UCHAR (val)) {
+		cell->rssi = -111 + g_value_get_uchar (val);
+	}
+	val = g_hash_table_lookup (props, "ReceivedSignalCodePower");
+	if (val && G_VALUE_HOLDS_UCHAR (val)) {
+		cell->rssi = -121 + g_value_get_uchar (val);
+	}
+	return TRUE;
+}
+
+static void
+netmon_neighbours_cb (DBusGProxy *proxy,
+                      DBusGProxyCall *call,
+                      gpointer user_data)
+{
+	Modem *modem = user_data;
+	GPtrArray *cells = NULL;
+	GError *error = NULL;
+	int i;
+
+	modem->netmon_call = NULL;
+	if (!dbus_g_proxy_end_call (proxy, call, &error,
+	                            DBUS_TYPE_CELL_LIST, &cells,
+	                            G_TYPE_INVALID)) {
+		if (error && dbus_g_error_has_name (error, "org.freedesktop.DBus.Error.UnknownMethod")) {
+			modem->netmon_supported = FALSE;
+		} else {
+			g_warning ("oFono NetworkMonitor.GetNeighbouringCellInformation failed: %s",
+			           error ? error->message : "(unknown)");
+		}
+		g_clear_error (&error);
+		return;
+	}
+
+	g_array_set_size (modem->neighbours, 0);
+	for (i = 0; i < cells->len; i++) {
+		GHashTable *props = g_ptr_array_index (cells, i);
+		NeighbourCell cell;
+
+		if (neighbour_cell_from_props (props, &cell)) {
+			g_array_append_val (modem->neighbours, cell);
+		}
+		g_hash_table_destroy (props);
+	}
+	g_ptr_array_free (cells, TRUE);
+
+	emit_cells_changed (modem->ofono);
+}
+
+static void
+modem_query_neighbours (Modem *modem)
+{
+	if (!modem->netmon_proxy || !modem->netmon_supported) {
+		return;
+	}
+
+	if (modem->netmon_call) {
+		dbus_g_proxy_cancel_call (modem->netmon_proxy, modem->netmon_call);
+	}
+	modem->netmon_call =
+		dbus_g_proxy_begin_call (modem->netmon_proxy,
+		                         "GetNeighbouringCellInformation",
+		                         netmon_neighbours_cb, modem, NULL,
+		                         G_TYPE_INVALID);
+}
+
+/* The serving cell changed: the old neighbours are of no use */
+static void
+modem_cell_changed (Modem *modem)
+{
+	g_array_set_size (modem->neighbours, 0);
+	modem_query_neighbours (modem);
+	emit_network_data_changed (modem->ofono);
+}
+
 static void
 get_netop_properties_cb (DBusGProxy *proxy,
                          GHashTable *props,
@@ -240,7 +368,7 @@ net_reg_get_properties_cb (DBusGProxy *proxy,
                            GError *error,
                            Modem *modem)
 {
-	GValue *lac_val, *cid_val, *ops_val;
+	GValue *lac_val, *cid_val, *ops_val, *strength_val;
 
 	if (error) {
 		g_warning ("oFono NetworkRegistration.GetProperties failed: %s", error->message);
@@ -251,6 +379,11 @@ net_reg_get_properties_cb (DBusGProxy *proxy,
 	lac_val = g_hash_table_lookup (props, "LocationAreaCode");
 	cid_val = g_hash_table_lookup (props, "CellId");
 	ops_val = g_hash_table_lookup (props, "AvailableOperators");
+	strength_val = g_hash_table_lookup (props, "Strength");
+
+	if (strength_val) {
+		modem->strength = GSMLOC_PERCENT_TO_DBM (g_value_get_uchar (strength_val));
+	}
 
 	if (lac_val && cid_val) {
 		gboolean changed;
@@ -264,7 +397,7 @@ net_reg_get_properties_cb (DBusGProxy *proxy,
 		g_free (str);
 
 		if (changed) {
-			emit_network_data_changed (modem->ofono);
+			modem_cell_changed (modem);
 		}
 	}
 
@@ -287,15 +420,20 @@ netreg_property_changed_cb (DBusGProxy *proxy,
 	if (g_strcmp0 ("LocationAreaCode", name) == 0) {
 		str = g_strdup_printf ("%u", g_value_get_uint (value));
 		if (modem_set_lac (modem, str)) {
-			emit_network_data_changed (modem->ofono);
+			modem_cell_changed (modem);
 		}
 		g_free (str);
 	} else if (g_strcmp0 ("CellId", name) == 0) {
 		str = g_strdup_printf ("%u", g_value_get_uint (value));
 		if (modem_set_cid (modem, str)) {
-			emit_network_data_changed (modem->ofono);
+			modem_cell_changed (modem);
 		}
 		g_free (str);
+	} else if (g_strcmp0 ("Strength", name) == 0) {
+		modem->strength = GSMLOC_PERCENT_TO_DBM (g_value_get_uchar (value));
+		/* the neighbours have moved too */
+		modem_query_neighbours (modem);
+		emit_cells_changed (modem->ofono);
 	} else if (g_strcmp0 ("AvailableOperators", name) == 0) {
 		modem_set_net_ops (modem, g_value_get_boxed (value));
 	}
@@ -310,6 +448,8 @@ modem_set_net_reg (Modem *modem, gboolean net_reg)
 	modem->cid = NULL;
 	g_free (modem->lac);
 	modem->lac = NULL;
+	modem->strength = 0;
+	g_array_set_size (modem->neighbours, 0);
 
 	if (modem->netreg_proxy) {
 		dbus_g_proxy_disconnect_signal (modem->netreg_proxy, "PropertyChanged",
@@ -345,21 +485,48 @@ modem_set_net_reg (Modem *modem, gboolean net_reg)
 	}
 }
 
+static void
+modem_set_net_mon (Modem *modem, gboolean net_mon)
+{
+	if (modem->netmon_proxy) {
+		if (modem->netmon_call) {
+			dbus_g_proxy_cancel_call (modem->netmon_proxy, modem->netmon_call);
+			modem->netmon_call = NULL;
+		}
+		g_object_unref (modem->netmon_proxy);
+		modem->netmon_proxy = NULL;
+	}
+
+	if (net_mon) {
+		modem->netmon_proxy = dbus_g_proxy_new_from_proxy (modem->proxy,
+		                                                   "org.ofono.NetworkMonitor",
+		                                                   dbus_g_proxy_get_path (modem->proxy));
+		modem->netmon_supported = TRUE;
+		modem_query_neighbours (modem);
+	}
+}
+
 static void
 modem_set_interfaces (Modem *modem, char **ifaces)
 {
+	gboolean net_reg = FALSE, net_mon = FALSE;
 	int i = 0;
 
 	while (ifaces[i]) {
 		if (g_strcmp0 ("org.ofono.NetworkRegistration", ifaces[i]) == 0) {
-			if (!modem->netreg_proxy) {
-				modem_set_net_reg (modem, TRUE);
-			}
-			return;
+			net_reg = TRUE;
+		} else if (g_strcmp0 ("org.ofono.NetworkMonitor", ifaces[i]) == 0) {
+			net_mon = TRUE;
 		}
 		i++;
 	}
-	modem_set_net_reg (modem, FALSE);
+
+	if (!net_reg || !modem->netreg_proxy) {
+		modem_set_net_reg (modem, net_reg);
+	}
+	if (net_mon != (modem->netmon_proxy != NULL)) {
+		modem_set_net_mon (modem, net_mon);
+	}
 }
 
 static void
@@ -399,7 +566,9 @@ modem_free (Modem *modem)
 
 	g_free (modem->cid);
 	g_free (modem->lac);
+	g_array_free (modem->neighbours, TRUE);
 
+	modem_set_net_mon (modem, FALSE);
 	if (modem->netreg_proxy) {
 		dbus_g_proxy_disconnect_signal (modem->netreg_proxy, "PropertyChanged",
 		                                G_CALLBACK (netreg_property_changed_cb),
@@ -423,39 +592,91 @@ modem_free (Modem *modem)
 }
 
 
-static void 
-emit_network_data_changed (GeoclueGsmlocOfono *ofono)
+/* finds the first complete cell data we have */
+static gboolean
+find_serving_cell (GeoclueGsmlocOfono *ofono, Modem **modem, NetOp **netop)
 {
 	GeoclueGsmlocOfonoPrivate *priv = GET_PRIVATE (ofono);
-	const char *mcc, *mnc, *lac, *cid; 
 	GList *modems, *netops;
 
-	mcc = mnc = lac = cid = NULL;
-
-	/* find the first complete cell data we have */
 	for (modems = priv->modems; modems; modems = modems->next) {
-		Modem *modem = (Modem*)modems->data;
-
-		if (modem->lac && modem->cid) {
-			for (netops = modem->netops; netops; netops = netops->next) {
-				NetOp *netop = (NetOp*)netops->data;
-
-				if (netop->mnc && netop->mcc) {
-					mcc = netop->mcc;
-					mnc = netop->mnc;
-					lac = modem->lac;
-					cid = modem->cid;
-					break;
+		Modem *m = (Modem*)modems->data;
+
+		if (m->lac && m->cid) {
+			for (netops = m->netops; netops; netops = netops->next) {
+				NetOp *op = (NetOp*)netops->data;
+
+				if (op->mnc && op->mcc) {
+					*modem = m;
+					*netop = op;
+					return TRUE;
 				}
 			}
 		}
-		if (cid) {
-			break;
-		}
+	}
+	return FALSE;
+}
+
+static void 
+emit_network_data_changed (GeoclueGsmlocOfono *ofono)
+{
+	const char *mcc, *mnc, *lac, *cid; 
+	Modem *modem;
+	NetOp *netop;
+
+	mcc = mnc = lac = cid = NULL;
+
+	if (find_serving_cell (ofono, &modem, &netop)) {
+		mcc = netop->mcc;
+		mnc = netop->mnc;
+		lac = modem->lac;
+		cid = modem->cid;
 	}
 
 	g_signal_emit (ofono, signals[NETWORK_DATA_CHANGED], 0,
 	               mcc, mnc, lac, cid);
+	emit_cells_changed (ofono);
+}
+
+/* Serving cell first, then the neighbours */
+static void
+emit_cells_changed (GeoclueGsmlocOfono *ofono)
+{
+	GArray *cells;
+	Modem *modem;
+	NetOp *netop;
+
+	cells = g_array_new (FALSE, FALSE, sizeof (GsmlocCellSignal));
+
+	if (find_serving_cell (ofono, &modem, &netop)) {
+		GsmlocCellSignal cell;
+		guint mcc, mnc, i;
+
+		mcc = g_ascii_strtoull (netop->mcc, NULL, 10);
+		mnc = g_ascii_strtoull (netop->mnc, NULL, 10);
+		if (gsmloc_cell_get_key (mcc, mnc,
+		                         g_ascii_strtoull (modem->lac, NULL, 10),
+		                         g_ascii_strtoull (modem->cid, NULL, 10),
+		                         &cell.key)) {
+			cell.rssi = modem->strength;
+			g_array_append_val (cells, cell);
+		}
+
+		for (i = 0; i < modem->neighbours->len; i++) {
+			NeighbourCell *n = &g_array_index (modem->neighbours,
+			                                   NeighbourCell, i);
+
+			if (gsmloc_cell_get_key (n->mcc ? n->mcc : mcc,
+			                         n->mcc ? n->mnc : mnc,
+			                         n->lac, n->cid, &cell.key)) {
+				cell.rssi = n->rssi;
+				g_array_append_val (cells, cell);
+			}
+		}
+	}
+
+	g_signal_emit (ofono, signals[CELLS_CHANGED], 0, cells);
+	g_array_free (cells, TRUE);
 }
 
 
@@ -487,6 +708,7 @@ geoclue_gsmloc_ofono_set_modems (GeoclueGsmlocOfono *ofono, GPtrArray *modems)
 		modem->ofono = ofono;
 		modem->lac = NULL;
 		modem->cid = NULL;
+		modem->neighbours = g_array_new (FALSE, FALSE, sizeof (NeighbourCell));
 		modem->proxy = dbus_g_proxy_new_from_proxy (priv->ofono_manager,
 		                                            "org.ofono.Modem",
 		                                            str);
@@ -616,6 +838,16 @@ geoclue_gsmloc_ofono_class_init (GeoclueGsmlocOfonoClass *klass)
 			G_TYPE_NONE, 4,
 			G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
 
+	/* a GArray of GsmlocCellSignal, serving cell first */
+	signals[CELLS_CHANGED] = g_signal_new (
+			"cells-changed",
+			G_OBJECT_CLASS_TYPE (klass),
+			G_SIGNAL_RUN_LAST, 0,
+			NULL, NULL,
+			g_cclosure_marshal_VOID__BOXED,
+			G_TYPE_NONE, 1,
+			G_TYPE_ARRAY);
+
 	pspec = g_param_spec_boolean ("available",
 	                              "Available",
 	                              "Is oFono available",
@@ -34,11 +34,21 @@
   * 
   * Gsmloc requires the oFono or ModemManager telephony stacks to work -- more
   * IMSI data sources could be added fairly easily.
+  *
+  * With the org.freedesktop.Geoclue.CellDatabase option set to a database
+  * made by gsmloc-celldb-convert, cells are looked up there first and the
+  * web service is only used for cells that are missing from it.
+  *
+  * When the modem reports neighbour cells and signal strengths, the
+  * position is the signal weighted centroid of all the cells that
+  * can be located without the web service, with an error radius
+  * in meters.
   **/
   
 #include <config.h>
 
 #include <time.h>
+#include <math.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -61,6 +71,9 @@
 /* country code list */
 #include "mcc.h"
 
+#include "gsmloc-celldb.h"
+#include "gsmloc-cellcache.h"
+
 #define GEOCLUE_DBUS_SERVICE_GSMLOC "org.freedesktop.Geoclue.Providers.Gsmloc"
 #define GEOCLUE_DBUS_PATH_GSMLOC "/org/freedesktop/Geoclue/Providers/Gsmloc"
 
@@ -69,6 +82,20 @@
 #define OPENCELLID_LON "/rsp/cell/@lon"
 #define OPENCELLID_CID "/rsp/cell/@cellId"
 
+/* cells remembered between runs */
+#define CELL_CACHE_SIZE 1024
+#define CELL_CACHE_NAME "gsmloc-cells"
+
+/* meters, for positions that come without a range */
+#define CELL_RANGE 2000.0
+#define AREA_RANGE 10000.0
+/* dBm, for cells without a signal strength */
+#define DEFAULT_RSSI -90
+/* neighbours further than this from the serving cell have a
+ * wrong position in the database */
+#define MAX_NEIGHBOUR_DISTANCE 35000.0
+#define MAX_CELLS 16
+
 #define GEOCLUE_TYPE_GSMLOC (geoclue_gsmloc_get_type ())
 #define GEOCLUE_GSMLOC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_GSMLOC, GeoclueGsmloc))
 
@@ -77,7 +104,16 @@ typedef struct _GeoclueGsmloc GeoclueGsmloc;
 struct _GeoclueGsmloc {
 	GcProvider parent;
 	GMainLoop *loop;
+	/* only used in the lookup thread */
 	GcWebService *web_service;
+	GThreadPool *lookup_pool;
+	/* incremented for every new lookup */
+	volatile gint lookup_serial;
+	gboolean lookup_pending;
+
+	char *cell_db_filename;
+	GsmlocCellDb *cell_db;
+	GsmlocCellCache *cell_cache;
 
 	GeoclueGsmlocOfono *ofono;
 	GeoclueGsmlocMm *mm;
@@ -87,8 +123,16 @@ struct _GeoclueGsmloc {
 	char *mnc;
 	char *lac;
 	char *cid;
+	/* GsmlocCellSignal, serving cell first */
+	GArray *cells;
+	GeocluePositionFields serving_fields;
+	double serving_lat;
+	double serving_lon;
+	double serving_range;
+
 	GeocluePositionFields last_position_fields;
 	GeoclueAccuracyLevel last_accuracy_level;
+	double last_accuracy;
 	double last_lat;
 	double last_lon;
 
@@ -143,75 +187,429 @@ shutdown (GcProvider *provider)
 }
 
 static gboolean
-geoclue_gsmloc_query_opencellid (GeoclueGsmloc *gsmloc)
+geoclue_gsmloc_set_options (GcIfaceGeoclue *gc,
+                            GHashTable     *options,
+                            GError        **error)
 {
-	double lat, lon;
-	GeocluePositionFields fields = GEOCLUE_POSITION_FIELDS_NONE;
-	GeoclueAccuracyLevel level = GEOCLUE_ACCURACY_LEVEL_NONE;
-
-	if (gsmloc->mcc && gsmloc->mnc &&
-	    gsmloc->lac && gsmloc->cid) {
-
-		if (gc_web_service_query (gsmloc->web_service, NULL,
-		                          "mcc", gsmloc->mcc,
-		                          "mnc", gsmloc->mnc,
-		                          "lac", gsmloc->lac,
-		                          "cellid", gsmloc->cid,
-		                          (char *)0)) {
-
-			if (gc_web_service_get_double (gsmloc->web_service, 
-			                               &lat, OPENCELLID_LAT)) {
-				fields |= GEOCLUE_POSITION_FIELDS_LATITUDE;
-			}
-			if (gc_web_service_get_double (gsmloc->web_service, 
-			                               &lon, OPENCELLID_LON)) {
-				fields |= GEOCLUE_POSITION_FIELDS_LONGITUDE;
-			}
+	GeoclueGsmloc *gsmloc = GEOCLUE_GSMLOC (gc);
+	GValue *value;
+	const char *filename = NULL;
+	GError *db_error = NULL;
+
+	/* without a master every request is a client */
+	value = g_hash_table_lookup (options, "org.freedesktop.Geoclue.Clients");
+	geoclue_gsmloc_mm_set_active (gsmloc->mm,
+	                              !value || !G_VALUE_HOLDS_INT (value) ||
+	                              g_value_get_int (value) > 0);
+
+	value = g_hash_table_lookup (options,
+	                             "org.freedesktop.Geoclue.CellDatabase");
+	if (value && G_VALUE_HOLDS_STRING (value)) {
+		filename = g_value_get_string (value);
+	}
+	if (filename && *filename == '\0') {
+		filename = NULL;
+	}
 
-			if (fields != GEOCLUE_POSITION_FIELDS_NONE) {
-				char *retval_cid;
-				/* if cellid is not present, location is for the local area code.
-				 * the accuracy might be an overstatement -- I have no idea how 
-				 * big LACs typically are */
-				level = GEOCLUE_ACCURACY_LEVEL_LOCALITY;
-				if (gc_web_service_get_string (gsmloc->web_service, 
-				                               &retval_cid, OPENCELLID_CID)) {
-					if (retval_cid && strlen (retval_cid) != 0) {
-						level = GEOCLUE_ACCURACY_LEVEL_POSTALCODE;
-					}
-					g_free (retval_cid);
-				}
-			}
+	/* cell_db_filename is only set while that database is open */
+	if (g_strcmp0 (filename, gsmloc->cell_db_filename) == 0) {
+		return TRUE;
+	}
+
+	if (gsmloc->cell_db) {
+		gsmloc_cell_db_close (gsmloc->cell_db);
+		gsmloc->cell_db = NULL;
+	}
+	g_free (gsmloc->cell_db_filename);
+	gsmloc->cell_db_filename = NULL;
+
+	if (filename) {
+		gsmloc->cell_db = gsmloc_cell_db_open (filename, &db_error);
+		if (gsmloc->cell_db == NULL) {
+			/* the web services still work without it */
+			g_warning ("Gsmloc: not using cell database %s: %s",
+			           filename, db_error->message);
+			g_error_free (db_error);
+			return TRUE;
 		}
+		gsmloc->cell_db_filename = g_strdup (filename);
 	}
+	return TRUE;
+}
 
-	if (fields != gsmloc->last_position_fields ||
-	    (fields != GEOCLUE_POSITION_FIELDS_NONE &&
-	     (lat != gsmloc->last_lat ||
-	      lon != gsmloc->last_lon ||
-	      level != gsmloc->last_accuracy_level))) {
-		GeoclueAccuracy *acc;
+/* Database and cache key of the current cell */
+static gboolean
+geoclue_gsmloc_get_cell_key (GeoclueGsmloc *gsmloc,
+                             guint64       *key)
+{
+	return gsmloc_cell_get_key (g_ascii_strtoull (gsmloc->mcc, NULL, 10),
+	                            g_ascii_strtoull (gsmloc->mnc, NULL, 10),
+	                            g_ascii_strtoull (gsmloc->lac, NULL, 10),
+	                            g_ascii_strtoull (gsmloc->cid, NULL, 10),
+	                            key);
+}
 
-		/* position changed */
+/* Range in meters of a position with only an accuracy level */
+static double
+geoclue_gsmloc_get_level_range (GeoclueAccuracyLevel level)
+{
+	return level == GEOCLUE_ACCURACY_LEVEL_POSTALCODE ? CELL_RANGE : AREA_RANGE;
+}
 
-		gsmloc->last_position_fields = fields;
-		gsmloc->last_accuracy_level = level;
-		gsmloc->last_lat = lat;
-		gsmloc->last_lon = lon;
+static GeoclueAccuracyLevel
+geoclue_gsmloc_get_range_level (double range)
+{
+	if (range <= 1000.0) {
+		return GEOCLUE_ACCURACY_LEVEL_STREET;
+	} else if (range <= 5000.0) {
+		return GEOCLUE_ACCURACY_LEVEL_POSTALCODE;
+	} else if (range <= 10000.0) {
+		return GEOCLUE_ACCURACY_LEVEL_LOCALITY;
+	} else if (range <= 100000.0) {
+		return GEOCLUE_ACCURACY_LEVEL_REGION;
+	}
+	return GEOCLUE_ACCURACY_LEVEL_COUNTRY;
+}
 
-		acc = geoclue_accuracy_new (gsmloc->last_accuracy_level, 0.0, 0.0);
-		gc_iface_position_emit_position_changed (GC_IFACE_POSITION (gsmloc),
-		                                         fields,
-		                                         time (NULL),
-		                                         lat, lon, 0.0,
-		                                         acc);
-		geoclue_accuracy_free (acc);
+/* Looks a cell up in the offline database. With 'area' the position
+ * is the center of the cell's location area instead. */
+static gboolean
+geoclue_gsmloc_lookup_cell_db (GeoclueGsmloc *gsmloc,
+                               guint64        key,
+                               gboolean       area,
+                               double        *lat,
+                               double        *lon,
+                               double        *range)
+{
+	GsmlocCell cell;
+	gboolean found;
+
+	if (!gsmloc->cell_db) {
+		return FALSE;
+	}
+
+	if (area) {
+		found = gsmloc_cell_db_lookup_area (gsmloc->cell_db, key, &cell);
+	} else {
+		found = gsmloc_cell_db_lookup (gsmloc->cell_db, key, &cell);
+	}
+	if (found) {
+		*lat = cell.latitude;
+		*lon = cell.longitude;
+		*range = cell.range;
+		if (*range <= 0.0) {
+			*range = area ? AREA_RANGE : CELL_RANGE;
+		}
+	}
+	return found;
+}
+
+static void
+geoclue_gsmloc_set_position (GeoclueGsmloc         *gsmloc,
+                             GeocluePositionFields  fields,
+                             double                 lat,
+                             double                 lon,
+                             GeoclueAccuracyLevel   level,
+                             double                 accuracy)
+{
+	GeoclueAccuracy *acc;
+
+	if (fields == gsmloc->last_position_fields &&
+	    (fields == GEOCLUE_POSITION_FIELDS_NONE ||
+	     (lat == gsmloc->last_lat &&
+	      lon == gsmloc->last_lon &&
+	      level == gsmloc->last_accuracy_level &&
+	      accuracy == gsmloc->last_accuracy))) {
+		return;
+	}
+
+	gsmloc->last_position_fields = fields;
+	gsmloc->last_accuracy_level = level;
+	gsmloc->last_accuracy = accuracy;
+	gsmloc->last_lat = lat;
+	gsmloc->last_lon = lon;
+
+	acc = geoclue_accuracy_new (gsmloc->last_accuracy_level,
+	                            gsmloc->last_accuracy, 0.0);
+	gc_iface_position_emit_position_changed (GC_IFACE_POSITION (gsmloc),
+	                                         fields,
+	                                         time (NULL),
+	                                         lat, lon, 0.0,
+	                                         acc);
+	geoclue_accuracy_free (acc);
+}
+
+/* Locates a cell from the cache or the offline database */
+static gboolean
+geoclue_gsmloc_lookup_cell (GeoclueGsmloc *gsmloc,
+                            guint64        key,
+                            GsmlocCell    *cell)
+{
+	GeoclueAccuracyLevel level;
+
+	cell->key = key;
+	if (gsmloc_cell_cache_lookup (gsmloc->cell_cache, key,
+	                              &cell->latitude, &cell->longitude,
+	                              &level)) {
+		cell->range = geoclue_gsmloc_get_level_range (level);
 		return TRUE;
 	}
+	return geoclue_gsmloc_lookup_cell_db (gsmloc, key, FALSE,
+	                                      &cell->latitude, &cell->longitude,
+	                                      &cell->range);
+}
+
+/* Combines the serving cell with the neighbours that can be located,
+ * weighting the cells by received signal amplitude */
+static void
+geoclue_gsmloc_update_position (GeoclueGsmloc *gsmloc)
+{
+	GsmlocCell cells[MAX_CELLS], serving, centroid;
+	double weights[MAX_CELLS];
+	guint64 serving_key = 0;
+	gboolean has_serving;
+	guint i, n = 0;
+
+	has_serving = gsmloc->serving_fields == (GEOCLUE_POSITION_FIELDS_LATITUDE |
+	                                         GEOCLUE_POSITION_FIELDS_LONGITUDE);
+	if (gsmloc->mcc && gsmloc->mnc && gsmloc->lac && gsmloc->cid) {
+		geoclue_gsmloc_get_cell_key (gsmloc, &serving_key);
+	}
+
+	if (has_serving) {
+		serving.key = serving_key;
+		serving.latitude = gsmloc->serving_lat;
+		serving.longitude = gsmloc->serving_lon;
+		serving.range = gsmloc->serving_range;
+		cells[n] = serving;
+		weights[n] = pow (10.0, DEFAULT_RSSI / 20.0);
+		n++;
+	}
+
+	for (i = 0; i < gsmloc->cells->len && n < MAX_CELLS; i++) {
+		GsmlocCellSignal *signal = &g_array_index (gsmloc->cells,
+		                                           GsmlocCellSignal, i);
+		int rssi = signal->rssi ? signal->rssi : DEFAULT_RSSI;
 
+		if (signal->key == serving_key) {
+			if (has_serving) {
+				weights[0] = pow (10.0, rssi / 20.0);
+			}
+			continue;
+		}
+		if (!geoclue_gsmloc_lookup_cell (gsmloc, signal->key, &cells[n])) {
+			continue;
+		}
+		if (has_serving &&
+		    gsmloc_cell_get_distance (&serving, &cells[n]) > MAX_NEIGHBOUR_DISTANCE) {
+			continue;
+		}
+		weights[n] = pow (10.0, rssi / 20.0);
+		n++;
+	}
+
+	if (!gsmloc_cell_get_centroid (cells, weights, n, &centroid)) {
+		/* keep the old position until the lookup is done */
+		if (!gsmloc->lookup_pending) {
+			geoclue_gsmloc_set_position (gsmloc, GEOCLUE_POSITION_FIELDS_NONE,
+			                             0.0, 0.0,
+			                             GEOCLUE_ACCURACY_LEVEL_NONE, 0.0);
+		}
+		return;
+	}
+
+	geoclue_gsmloc_set_position (gsmloc,
+	                             GEOCLUE_POSITION_FIELDS_LATITUDE |
+	                             GEOCLUE_POSITION_FIELDS_LONGITUDE,
+	                             centroid.latitude, centroid.longitude,
+	                             geoclue_gsmloc_get_range_level (centroid.range),
+	                             centroid.range);
+}
+
+static void
+geoclue_gsmloc_set_serving (GeoclueGsmloc         *gsmloc,
+                            GeocluePositionFields  fields,
+                            double                 lat,
+                            double                 lon,
+                            double                 range)
+{
+	gsmloc->serving_fields = fields;
+	gsmloc->serving_lat = lat;
+	gsmloc->serving_lon = lon;
+	gsmloc->serving_range = range;
+
+	geoclue_gsmloc_update_position (gsmloc);
+}
+
+/* A web service lookup, run in the lookup thread */
+typedef struct {
+	GeoclueGsmloc *gsmloc;
+	guint serial;
+
+	char *mcc;
+	char *mnc;
+	char *lac;
+	char *cid;
+	guint64 key;
+	gboolean has_key;
+
+	GeocluePositionFields fields;
+	GeoclueAccuracyLevel level;
+	double lat;
+	double lon;
+} GsmlocLookup;
+
+static void
+gsmloc_lookup_free (GsmlocLookup *lookup)
+{
+	g_object_unref (lookup->gsmloc);
+	g_free (lookup->mcc);
+	g_free (lookup->mnc);
+	g_free (lookup->lac);
+	g_free (lookup->cid);
+	g_slice_free (GsmlocLookup, lookup);
+}
+
+/* Back in the main loop: use the result unless the cell has changed
+ * since the lookup was started */
+static gboolean
+gsmloc_lookup_done (gpointer data)
+{
+	GsmlocLookup *lookup = data;
+	GeoclueGsmloc *gsmloc = lookup->gsmloc;
+	double range;
+
+	if (lookup->serial == (guint) g_atomic_int_get (&gsmloc->lookup_serial)) {
+		gsmloc->lookup_pending = FALSE;
+
+		if (lookup->fields == (GEOCLUE_POSITION_FIELDS_LATITUDE |
+		                       GEOCLUE_POSITION_FIELDS_LONGITUDE) &&
+		    lookup->has_key) {
+			gsmloc_cell_cache_insert (gsmloc->cell_cache, lookup->key,
+			                          lookup->lat, lookup->lon,
+			                          lookup->level);
+		}
+
+		/* the web service is not reachable or does not know the
+		 * area either */
+		range = geoclue_gsmloc_get_level_range (lookup->level);
+		if (lookup->fields == GEOCLUE_POSITION_FIELDS_NONE &&
+		    lookup->has_key &&
+		    geoclue_gsmloc_lookup_cell_db (gsmloc, lookup->key, TRUE,
+		                                   &lookup->lat, &lookup->lon,
+		                                   &range)) {
+			lookup->fields = GEOCLUE_POSITION_FIELDS_LATITUDE |
+			                 GEOCLUE_POSITION_FIELDS_LONGITUDE;
+		}
+
+		geoclue_gsmloc_set_serving (gsmloc, lookup->fields,
+		                            lookup->lat, lookup->lon, range);
+	}
+
+	gsmloc_lookup_free (lookup);
 	return FALSE;
 }
 
+/* GFunc for the lookup thread pool: queries opencellid.org. Lookups
+ * for cells that are no longer current are skipped. */
+static void
+gsmloc_lookup_run (gpointer data, gpointer user_data)
+{
+	GsmlocLookup *lookup = data;
+	GeoclueGsmloc *gsmloc = lookup->gsmloc;
+	double lat, lon;
+
+	if (lookup->serial != (guint) g_atomic_int_get (&gsmloc->lookup_serial)) {
+		g_idle_add (gsmloc_lookup_done, lookup);
+		return;
+	}
+
+	if (gc_web_service_query (gsmloc->web_service, NULL,
+	                          "mcc", lookup->mcc,
+	                          "mnc", lookup->mnc,
+	                          "lac", lookup->lac,
+	                          "cellid", lookup->cid,
+	                          (char *)0)) {
+
+		if (gc_web_service_get_double (gsmloc->web_service, 
+		                               &lat, OPENCELLID_LAT)) {
+			lookup->fields |= GEOCLUE_POSITION_FIELDS_LATITUDE;
+			lookup->lat = lat;
+		}
+		if (gc_web_service_get_double (gsmloc->web_service, 
+		                               &lon, OPENCELLID_LON)) {
+			lookup->fields |= GEOCLUE_POSITION_FIELDS_LONGITUDE;
+			lookup->lon = lon;
+		}
+
+		if (lookup->fields != GEOCLUE_POSITION_FIELDS_NONE) {
+			char *retval_cid;
+			/* if cellid is not present, location is for the local area code.
+			 * the accuracy might be an overstatement -- I have no idea how 
+			 * big LACs typically are */
+			lookup->level = GEOCLUE_ACCURACY_LEVEL_LOCALITY;
+			if (gc_web_service_get_string (gsmloc->web_service, 
+			                               &retval_cid, OPENCELLID_CID)) {
+				if (retval_cid && strlen (retval_cid) != 0) {
+					lookup->level = GEOCLUE_ACCURACY_LEVEL_POSTALCODE;
+				}
+				g_free (retval_cid);
+			}
+		}
+	}
+
+	g_idle_add (gsmloc_lookup_done, lookup);
+}
+
+/* Locates the current cell from the cache or the offline database, or
+ * starts a web service lookup that replaces any earlier one */
+static void
+geoclue_gsmloc_locate_cell (GeoclueGsmloc *gsmloc)
+{
+	GsmlocLookup *lookup;
+	GsmlocCell cell;
+	guint64 key;
+	gboolean has_key;
+
+	/* results of earlier lookups are not wanted any more */
+	g_atomic_int_inc (&gsmloc->lookup_serial);
+	gsmloc->lookup_pending = FALSE;
+	gsmloc->serving_fields = GEOCLUE_POSITION_FIELDS_NONE;
+
+	if (!gsmloc->mcc || !gsmloc->mnc ||
+	    !gsmloc->lac || !gsmloc->cid) {
+		geoclue_gsmloc_set_serving (gsmloc, GEOCLUE_POSITION_FIELDS_NONE,
+		                            0.0, 0.0, 0.0);
+		return;
+	}
+
+	has_key = geoclue_gsmloc_get_cell_key (gsmloc, &key);
+	if (has_key && geoclue_gsmloc_lookup_cell (gsmloc, key, &cell)) {
+		geoclue_gsmloc_set_serving (gsmloc,
+		                            GEOCLUE_POSITION_FIELDS_LATITUDE |
+		                            GEOCLUE_POSITION_FIELDS_LONGITUDE,
+		                            cell.latitude, cell.longitude,
+		                            cell.range);
+		return;
+	}
+
+	lookup = g_slice_new0 (GsmlocLookup);
+	lookup->gsmloc = g_object_ref (gsmloc);
+	lookup->serial = g_atomic_int_get (&gsmloc->lookup_serial);
+	lookup->mcc = g_strdup (gsmloc->mcc);
+	lookup->mnc = g_strdup (gsmloc->mnc);
+	lookup->lac = g_strdup (gsmloc->lac);
+	lookup->cid = g_strdup (gsmloc->cid);
+	lookup->key = key;
+	lookup->has_key = has_key;
+
+	gsmloc->lookup_pending = TRUE;
+	g_thread_pool_push (gsmloc->lookup_pool, lookup, NULL);
+
+	/* the neighbours may be known already */
+	geoclue_gsmloc_update_position (gsmloc);
+}
+
 static void
 geoclue_gsmloc_update_address (GeoclueGsmloc *gsmloc)
 {
@@ -270,7 +668,7 @@ geoclue_gsmloc_set_cell (GeoclueGsmloc *gsmloc,
 	gsmloc->cid = g_strdup (cid);
 
 	geoclue_gsmloc_update_address (gsmloc);
-	geoclue_gsmloc_query_opencellid (gsmloc);
+	geoclue_gsmloc_locate_cell (gsmloc);
 }
 
 static void
@@ -284,11 +682,22 @@ network_data_changed_cb (gpointer connection_manager,
 	    g_strcmp0 (lac, gsmloc->lac) != 0 ||
 	    g_strcmp0 (cid, gsmloc->cid) != 0) {
 
-		/* new cell data, do a opencellid lookup */
+		/* new cell data, look it up */
 		geoclue_gsmloc_set_cell (gsmloc, mcc, mnc, lac, cid);
 	}
 }
 
+static void
+cells_changed_cb (gpointer connection_manager,
+                  GArray *cells,
+                  GeoclueGsmloc *gsmloc)
+{
+	g_array_set_size (gsmloc->cells, 0);
+	g_array_append_vals (gsmloc->cells, cells->data, cells->len);
+
+	geoclue_gsmloc_update_position (gsmloc);
+}
+
 /* Position interface implementation */
 
 static gboolean 
@@ -305,9 +714,11 @@ geoclue_gsmloc_get_position (GcIfacePosition        *iface,
 
 	gsmloc = (GEOCLUE_GSMLOC (iface));
 
-	if (gsmloc->last_position_fields == GEOCLUE_POSITION_FIELDS_NONE) {
-		/* re-query in case there was a network problem */
-		geoclue_gsmloc_query_opencellid (gsmloc);
+	if (gsmloc->last_position_fields == GEOCLUE_POSITION_FIELDS_NONE &&
+	    !gsmloc->lookup_pending) {
+		/* try again in case there was a network problem: the
+		 * result comes in a PositionChanged signal */
+		geoclue_gsmloc_locate_cell (gsmloc);
 	}
 
 	if (timestamp) {
@@ -324,7 +735,8 @@ geoclue_gsmloc_get_position (GcIfacePosition        *iface,
 		*longitude = gsmloc->last_lon;
 	}
 	if (accuracy) {
-		*accuracy = geoclue_accuracy_new (gsmloc->last_accuracy_level, 0, 0);
+		*accuracy = geoclue_accuracy_new (gsmloc->last_accuracy_level,
+		                                  gsmloc->last_accuracy, 0);
 	}
 
 	return TRUE;
@@ -367,6 +779,9 @@ geoclue_gsmloc_dispose (GObject *obj)
 		g_signal_handlers_disconnect_by_func (gsmloc->ofono,
 		                                      network_data_changed_cb,
 		                                      gsmloc);
+		g_signal_handlers_disconnect_by_func (gsmloc->ofono,
+		                                      cells_changed_cb,
+		                                      gsmloc);
 		g_object_unref (gsmloc->ofono);
 		gsmloc->ofono = NULL;
 	}
@@ -375,6 +790,9 @@ geoclue_gsmloc_dispose (GObject *obj)
 		g_signal_handlers_disconnect_by_func (gsmloc->mm,
 		                                      network_data_changed_cb,
 		                                      gsmloc);
+		g_signal_handlers_disconnect_by_func (gsmloc->mm,
+		                                      cells_changed_cb,
+		                                      gsmloc);
 		g_object_unref (gsmloc->mm);
 		gsmloc->mm = NULL;
 	}
@@ -384,6 +802,33 @@ geoclue_gsmloc_dispose (GObject *obj)
 		gsmloc->address = NULL;
 	}
 
+	if (gsmloc->cell_db) {
+		gsmloc_cell_db_close (gsmloc->cell_db);
+		gsmloc->cell_db = NULL;
+	}
+	g_free (gsmloc->cell_db_filename);
+	gsmloc->cell_db_filename = NULL;
+
+	if (gsmloc->cell_cache) {
+		gsmloc_cell_cache_free (gsmloc->cell_cache);
+		gsmloc->cell_cache = NULL;
+	}
+
+	if (gsmloc->cells) {
+		g_array_free (gsmloc->cells, TRUE);
+		gsmloc->cells = NULL;
+	}
+
+	/* lookups keep a reference: the pool is idle by now */
+	if (gsmloc->lookup_pool) {
+		g_thread_pool_free (gsmloc->lookup_pool, TRUE, TRUE);
+		gsmloc->lookup_pool = NULL;
+	}
+	if (gsmloc->web_service) {
+		g_object_unref (gsmloc->web_service);
+		gsmloc->web_service = NULL;
+	}
+
 	((GObjectClass *) geoclue_gsmloc_parent_class)->dispose (obj);
 }
 
@@ -398,6 +843,7 @@ geoclue_gsmloc_class_init (GeoclueGsmlocClass *klass)
 
 	p_class->shutdown = shutdown;
 	p_class->get_status = geoclue_gsmloc_get_status;
+	p_class->set_options = geoclue_gsmloc_set_options;
 
 	o_class->dispose = geoclue_gsmloc_dispose;
 }
@@ -405,6 +851,8 @@ geoclue_gsmloc_class_init (GeoclueGsmlocClass *klass)
 static void
 geoclue_gsmloc_init (GeoclueGsmloc *gsmloc)
 {
+	char *dir, *filename;
+
 	gsmloc->address = geoclue_address_details_new ();
 
 	gc_provider_set_details (GC_PROVIDER (gsmloc), 
@@ -414,7 +862,18 @@ geoclue_gsmloc_init (GeoclueGsmloc *gsmloc)
 
 	gsmloc->web_service = g_object_new (GC_TYPE_WEB_SERVICE, NULL);
 	gc_web_service_set_base_url (gsmloc->web_service, OPENCELLID_URL);
-
+	/* one thread: lookups are done in order, obsolete ones skipped */
+	gsmloc->lookup_pool = g_thread_pool_new (gsmloc_lookup_run, NULL,
+	                                         1, FALSE, NULL);
+
+	dir = g_build_filename (g_get_user_cache_dir (), "geoclue", NULL);
+	g_mkdir_with_parents (dir, 0755);
+	filename = g_build_filename (dir, CELL_CACHE_NAME, NULL);
+	gsmloc->cell_cache = gsmloc_cell_cache_new (filename, CELL_CACHE_SIZE);
+	g_free (filename);
+	g_free (dir);
+
+	gsmloc->cells = g_array_new (FALSE, FALSE, sizeof (GsmlocCellSignal));
 	geoclue_gsmloc_set_cell (gsmloc, NULL, NULL, NULL, NULL);
 
 	gsmloc->address = geoclue_address_details_new ();
@@ -423,11 +882,15 @@ geoclue_gsmloc_init (GeoclueGsmloc *gsmloc)
 	gsmloc->ofono = geoclue_gsmloc_ofono_new ();
 	g_signal_connect (gsmloc->ofono, "network-data-changed",
 	                  G_CALLBACK (network_data_changed_cb), gsmloc);
+	g_signal_connect (gsmloc->ofono, "cells-changed",
+	                  G_CALLBACK (cells_changed_cb), gsmloc);
 
 	/* init mm */
 	gsmloc->mm = geoclue_gsmloc_mm_new ();
 	g_signal_connect (gsmloc->mm, "network-data-changed",
 	                  G_CALLBACK (network_data_changed_cb), gsmloc);
+	g_signal_connect (gsmloc->mm, "cells-changed",
+	                  G_CALLBACK (cells_changed_cb), gsmloc);
 }
 
 static void
@@ -446,6 +909,9 @@ int
 main()
 {
 	g_type_init();
+#if !GLIB_CHECK_VERSION(2,31,0)
+	g_thread_init (NULL);
+#endif
 
 	GeoclueGsmloc *o = g_object_new (GEOCLUE_TYPE_GSMLOC, NULL);
 	o->loop = g_main_loop_new (NULL, TRUE);
@@ -0,0 +1,295 @@
+/*
+ * Geoclue
+ * gsmloc-cellcache.c - Persistent cache of cell positions
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Remembers the positions the web service gave for the most recently
+ * seen cells, so that cells seen every day are located without any
+ * network traffic. The cache is saved a while after it changes and
+ * when it is freed, most recently used cell first, little endian:
+ *   header  "GCCCACH\1", guint32 number of records, guint32 0
+ *   record  guint64 key (see gsmloc-celldb.c), gint32 latitude,
+ *           gint32 longitude (1e-7 degrees), guint32 fetch time,
+ *           guint8 accuracy level, 3 bytes 0
+ */
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <geoclue/geoclue-error.h>
+
+#include "gsmloc-cellcache.h"
+
+#define CACHE_MAGIC "GCCCACH\1"
+#define CACHE_MAGIC_LENGTH 8
+#define CACHE_HEADER_LENGTH 16
+#define CACHE_RECORD_LENGTH 24
+
+/* cells are fetched again after this long (s): they do get moved */
+#define CACHE_MAX_AGE (30 * 24 * 3600)
+/* changes are saved this long (s) after the first one */
+#define CACHE_SAVE_DELAY 60
+
+typedef struct {
+	guint64 key;
+	double latitude;
+	double longitude;
+	GeoclueAccuracyLevel level;
+	guint32 fetched;
+	GList *link; /* in cache->lru */
+} CacheEntry;
+
+struct _GsmlocCellCache {
+	char *filename;
+	guint size;
+
+	GHashTable *entries; /* guint64 key -> CacheEntry */
+	GQueue lru; /* most recently used first */
+
+	guint save_id;
+};
+
+static guint32
+read_uint32 (const guchar *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static void
+append_uint32 (GString *str, guint32 value)
+{
+	g_string_append_c (str, value & 0xff);
+	g_string_append_c (str, (value >> 8) & 0xff);
+	g_string_append_c (str, (value >> 16) & 0xff);
+	g_string_append_c (str, (value >> 24) & 0xff);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_slice_free (CacheEntry, entry);
+}
+
+static void
+gsmloc_cell_cache_remove (GsmlocCellCache *cache, CacheEntry *entry)
+{
+	g_queue_delete_link (&cache->lru, entry->link);
+	g_hash_table_remove (cache->entries, &entry->key);
+}
+
+/* Adds an entry as the least recently used one, replacing an older
+ * entry for the same cell */
+static CacheEntry *
+gsmloc_cell_cache_add (GsmlocCellCache *cache, guint64 key)
+{
+	CacheEntry *entry;
+
+	entry = g_hash_table_lookup (cache->entries, &key);
+	if (entry) {
+		gsmloc_cell_cache_remove (cache, entry);
+	}
+	while (g_queue_get_length (&cache->lru) >= cache->size) {
+		gsmloc_cell_cache_remove (cache, g_queue_peek_tail (&cache->lru));
+	}
+
+	entry = g_slice_new0 (CacheEntry);
+	entry->key = key;
+	g_queue_push_tail (&cache->lru, entry);
+	entry->link = g_queue_peek_tail_link (&cache->lru);
+	g_hash_table_insert (cache->entries, &entry->key, entry);
+	return entry;
+}
+
+static void
+gsmloc_cell_cache_load (GsmlocCellCache *cache)
+{
+	char *contents;
+	gsize length;
+	const guchar *p;
+	guint n, i;
+
+	if (!g_file_get_contents (cache->filename, &contents, &length, NULL)) {
+		return;
+	}
+
+	if (length < CACHE_HEADER_LENGTH ||
+	    memcmp (contents, CACHE_MAGIC, CACHE_MAGIC_LENGTH) != 0) {
+		g_warning ("Ignoring invalid cell cache %s", cache->filename);
+		g_free (contents);
+		return;
+	}
+
+	p = (const guchar *) contents + CACHE_MAGIC_LENGTH;
+	n = MIN (read_uint32 (p),
+	         (length - CACHE_HEADER_LENGTH) / CACHE_RECORD_LENGTH);
+	n = MIN (n, cache->size);
+	p = (const guchar *) contents + CACHE_HEADER_LENGTH;
+	for (i = 0; i < n; i++, p += CACHE_RECORD_LENGTH) {
+		CacheEntry *entry;
+		guint64 key;
+
+		key = read_uint32 (p) | ((guint64) read_uint32 (p + 4) << 32);
+		entry = gsmloc_cell_cache_add (cache, key);
+		entry->latitude = (gint32) read_uint32 (p + 8) / 1e7;
+		entry->longitude = (gint32) read_uint32 (p + 12) / 1e7;
+		entry->fetched = read_uint32 (p + 16);
+		entry->level = MIN (p[20], GEOCLUE_ACCURACY_LEVEL_DETAILED);
+	}
+	g_free (contents);
+}
+
+static gboolean
+save_timeout (gpointer data)
+{
+	GsmlocCellCache *cache = data;
+	GError *error = NULL;
+
+	cache->save_id = 0;
+	if (!gsmloc_cell_cache_save (cache, &error)) {
+		g_warning ("Could not save cell cache: %s", error->message);
+		g_error_free (error);
+	}
+	return FALSE;
+}
+
+/**
+ * gsmloc_cell_cache_new:
+ * @filename: file the cache is loaded from and saved to
+ * @size: number of cells to remember
+ *
+ * Return value: a new cache with the cells saved in @filename.
+ */
+GsmlocCellCache *
+gsmloc_cell_cache_new (const char *filename,
+                       guint       size)
+{
+	GsmlocCellCache *cache;
+
+	cache = g_slice_new0 (GsmlocCellCache);
+	cache->filename = g_strdup (filename);
+	cache->size = MAX (size, 1);
+	cache->entries = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+	                                        NULL,
+	                                        (GDestroyNotify) cache_entry_free);
+	g_queue_init (&cache->lru);
+
+	gsmloc_cell_cache_load (cache);
+	return cache;
+}
+
+/* Saves unsaved changes and frees the cache */
+void
+gsmloc_cell_cache_free (GsmlocCellCache *cache)
+{
+	if (cache->save_id) {
+		g_source_remove (cache->save_id);
+		save_timeout (cache);
+	}
+	g_queue_clear (&cache->lru);
+	g_hash_table_destroy (cache->entries);
+	g_free (cache->filename);
+	g_slice_free (GsmlocCellCache, cache);
+}
+
+gboolean
+gsmloc_cell_cache_lookup (GsmlocCellCache      *cache,
+                          guint64               key,
+                          double               *latitude,
+                          double               *longitude,
+                          GeoclueAccuracyLevel *level)
+{
+	CacheEntry *entry;
+
+	entry = g_hash_table_lookup (cache->entries, &key);
+	if (entry == NULL) {
+		return FALSE;
+	}
+	if ((guint32) time (NULL) - entry->fetched > CACHE_MAX_AGE) {
+		gsmloc_cell_cache_remove (cache, entry);
+		return FALSE;
+	}
+
+	/* most recently used; the order is saved with the next change */
+	g_queue_unlink (&cache->lru, entry->link);
+	g_queue_push_head_link (&cache->lru, entry->link);
+
+	*latitude = entry->latitude;
+	*longitude = entry->longitude;
+	*level = entry->level;
+	return TRUE;
+}
+
+void
+gsmloc_cell_cache_insert (GsmlocCellCache     *cache,
+                          guint64              key,
+                          double               latitude,
+                          double               longitude,
+                          GeoclueAccuracyLevel level)
+{
+	CacheEntry *entry;
+
+	entry = gsmloc_cell_cache_add (cache, key);
+	entry->latitude = latitude;
+	entry->longitude = longitude;
+	entry->level = level;
+	entry->fetched = time (NULL);
+
+	g_queue_unlink (&cache->lru, entry->link);
+	g_queue_push_head_link (&cache->lru, entry->link);
+
+	if (cache->save_id == 0) {
+		cache->save_id = g_timeout_add_seconds (CACHE_SAVE_DELAY,
+		                                        save_timeout, cache);
+	}
+}
+
+gboolean
+gsmloc_cell_cache_save (GsmlocCellCache *cache,
+                        GError         **error)
+{
+	GString *str;
+	GList *l;
+	gboolean ret;
+
+	str = g_string_sized_new (CACHE_HEADER_LENGTH +
+	                          g_queue_get_length (&cache->lru) * CACHE_RECORD_LENGTH);
+	g_string_append_len (str, CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+	append_uint32 (str, g_queue_get_length (&cache->lru));
+	append_uint32 (str, 0);
+
+	for (l = cache->lru.head; l; l = l->next) {
+		CacheEntry *entry = l->data;
+
+		append_uint32 (str, entry->key & G_MAXUINT32);
+		append_uint32 (str, entry->key >> 32);
+		append_uint32 (str, (guint32) (gint32) floor (entry->latitude * 1e7 + 0.5));
+		append_uint32 (str, (guint32) (gint32) floor (entry->longitude * 1e7 + 0.5));
+		append_uint32 (str, entry->fetched);
+		g_string_append_c (str, entry->level);
+		g_string_append_len (str, "\0\0\0", 3);
+	}
+
+	ret = g_file_set_contents (cache->filename, str->str, str->len, error);
+	g_string_free (str, TRUE);
+	return ret;
+}
@@ -0,0 +1,53 @@
+/*
+ * Geoclue
+ * gsmloc-cellcache.h - Persistent cache of cell positions
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GSMLOC_CELLCACHE_H
+#define _GSMLOC_CELLCACHE_H
+
+#include <glib.h>
+#include <geoclue/geoclue-types.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GsmlocCellCache GsmlocCellCache;
+
+GsmlocCellCache *gsmloc_cell_cache_new (const char *filename,
+                                        guint       size);
+void gsmloc_cell_cache_free (GsmlocCellCache *cache);
+
+gboolean gsmloc_cell_cache_lookup (GsmlocCellCache      *cache,
+                                   guint64               key,
+                                   double               *latitude,
+                                   double               *longitude,
+                                   GeoclueAccuracyLevel *level);
+void gsmloc_cell_cache_insert (GsmlocCellCache     *cache,
+                               guint64              key,
+                               double               latitude,
+                               double               longitude,
+                               GeoclueAccuracyLevel level);
+gboolean gsmloc_cell_cache_save (GsmlocCellCache *cache,
+                                 GError         **error);
+
+G_END_DECLS
+
+#endif
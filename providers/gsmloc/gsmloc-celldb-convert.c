@@ -0,0 +1,161 @@
+/*
+ * Geoclue
+ * gsmloc-celldb-convert.c - Convert OpenCellID CSV dumps to cell databases
+ *
+ * The columns are found by name from the header line, so both the
+ * current dump format (radio,mcc,net,area,cell,unit,lon,lat,range,...)
+ * and the older one (id,lat,lon,mcc,mnc,lac,cellid,range,...) work.
+ *
+ * Usage: gsmloc-celldb-convert cells.csv cells.db
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gsmloc-celldb.h"
+
+enum {
+	COLUMN_MCC,
+	COLUMN_MNC,
+	COLUMN_LAC,
+	COLUMN_CID,
+	COLUMN_LAT,
+	COLUMN_LON,
+	COLUMN_RANGE,
+	N_COLUMNS
+};
+
+static const char *column_names[N_COLUMNS][2] = {
+	{ "mcc", NULL },
+	{ "net", "mnc" },
+	{ "area", "lac" },
+	{ "cell", "cellid" },
+	{ "lat", NULL },
+	{ "lon", NULL },
+	{ "range", NULL }
+};
+
+/* when the dump has no range */
+#define DEFAULT_RANGE 1000.0
+
+static gboolean
+find_columns (const char *header, int *columns)
+{
+	char **names;
+	int i, j;
+
+	names = g_strsplit (header, ",", -1);
+	for (i = 0; i < N_COLUMNS; i++) {
+		columns[i] = -1;
+		for (j = 0; names[j]; j++) {
+			g_strstrip (names[j]);
+			if (g_strcmp0 (names[j], column_names[i][0]) == 0 ||
+			    g_strcmp0 (names[j], column_names[i][1]) == 0) {
+				columns[i] = j;
+				break;
+			}
+		}
+	}
+	g_strfreev (names);
+
+	for (i = 0; i < COLUMN_RANGE; i++) {
+		if (columns[i] < 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static gboolean
+parse_cell (char **fields, guint n_fields, int *columns, GsmlocCell *cell)
+{
+	guint i;
+
+	for (i = 0; i < COLUMN_RANGE; i++) {
+		if ((guint) columns[i] >= n_fields) {
+			return FALSE;
+		}
+	}
+
+	if (!gsmloc_cell_get_key (atoi (fields[columns[COLUMN_MCC]]),
+	                          atoi (fields[columns[COLUMN_MNC]]),
+	                          atoi (fields[columns[COLUMN_LAC]]),
+	                          atoi (fields[columns[COLUMN_CID]]),
+	                          &cell->key)) {
+		return FALSE;
+	}
+	cell->latitude = g_ascii_strtod (fields[columns[COLUMN_LAT]], NULL);
+	cell->longitude = g_ascii_strtod (fields[columns[COLUMN_LON]], NULL);
+	cell->range = DEFAULT_RANGE;
+	if (columns[COLUMN_RANGE] >= 0 && (guint) columns[COLUMN_RANGE] < n_fields &&
+	    *fields[columns[COLUMN_RANGE]] != '\0') {
+		cell->range = g_ascii_strtod (fields[columns[COLUMN_RANGE]], NULL);
+	}
+
+	return (cell->latitude != 0.0 || cell->longitude != 0.0) &&
+	       ABS (cell->latitude) <= 90.0 && ABS (cell->longitude) <= 180.0;
+}
+
+int main (int argc, char **argv)
+{
+	GIOChannel *channel;
+	GString *line;
+	GArray *cells;
+	GError *error = NULL;
+	int columns[N_COLUMNS];
+	guint skipped = 0;
+	GIOStatus status;
+
+	if (argc != 3) {
+		g_printerr ("Usage: %s cells.csv cells.db\n", argv[0]);
+		return 1;
+	}
+
+	channel = g_io_channel_new_file (argv[1], "r", &error);
+	if (channel == NULL) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_io_channel_set_encoding (channel, NULL, NULL);
+
+	line = g_string_new (NULL);
+	if (g_io_channel_read_line_string (channel, line, NULL, &error) != G_IO_STATUS_NORMAL ||
+	    !find_columns (line->str, columns)) {
+		g_printerr ("%s: no OpenCellID header line\n", argv[1]);
+		return 1;
+	}
+
+	cells = g_array_new (FALSE, FALSE, sizeof (GsmlocCell));
+	while ((status = g_io_channel_read_line_string (channel, line, NULL, &error)) == G_IO_STATUS_NORMAL) {
+		GsmlocCell cell;
+		char **fields;
+
+		fields = g_strsplit (line->str, ",", -1);
+		if (parse_cell (fields, g_strv_length (fields), columns, &cell)) {
+			g_array_append_val (cells, cell);
+		} else {
+			skipped++;
+		}
+		g_strfreev (fields);
+	}
+	if (status == G_IO_STATUS_ERROR) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_io_channel_unref (channel);
+	g_string_free (line, TRUE);
+
+	if (!gsmloc_cell_db_save (cells, argv[2], &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_print ("%u cells read, %u lines skipped\n", cells->len, skipped);
+	g_array_free (cells, TRUE);
+
+	return 0;
+}
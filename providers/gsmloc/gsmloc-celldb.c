@@ -0,0 +1,387 @@
+/*
+ * Geoclue
+ * gsmloc-celldb.c - Offline cell tower database
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Cell positions for looking up cells without the web service, made
+ * from an OpenCellID dump with gsmloc-celldb-convert. The file is
+ * mapped and searched in place, records sorted by key, little endian:
+ *   header  "GCCELLS\1", guint32 number of records, guint32 0
+ *   record  guint64 key, gint32 latitude, gint32 longitude
+ *           (1e-7 degrees), guint16 range (10 m), guint16 0
+ * Keys pack mcc (10 bits), mnc (10 bits), lac (16 bits) and cid
+ * (28 bits) in that order, so the cells of an area are adjacent.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <geoclue/geoclue-error.h>
+#include <geoclue/gc-geo.h>
+
+#include "gsmloc-celldb.h"
+
+#define CELLDB_MAGIC "GCCELLS\1"
+#define CELLDB_MAGIC_LENGTH 8
+#define CELLDB_HEADER_LENGTH 16
+#define CELLDB_RECORD_LENGTH 20
+
+#define CID_BITS 28
+#define LAC_BITS 16
+#define MNC_BITS 10
+#define MCC_BITS 10
+#define AREA_MASK ((G_GUINT64_CONSTANT (1) << CID_BITS) - 1)
+
+/* interpolation steps before falling back to binary search: keys
+ * are not evenly spread across countries and networks */
+#define MAX_INTERPOLATION_PROBES 4
+/* cells used for an area position */
+#define MAX_AREA_CELLS 256
+
+struct _GsmlocCellDb {
+	GMappedFile *file;
+	const guchar *records;
+	guint n_cells;
+};
+
+static guint32
+read_uint32 (const guchar *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static guint64
+read_uint64 (const guchar *p)
+{
+	return read_uint32 (p) | ((guint64) read_uint32 (p + 4) << 32);
+}
+
+static void
+append_uint32 (GString *str, guint32 value)
+{
+	g_string_append_c (str, value & 0xff);
+	g_string_append_c (str, (value >> 8) & 0xff);
+	g_string_append_c (str, (value >> 16) & 0xff);
+	g_string_append_c (str, (value >> 24) & 0xff);
+}
+
+/* Packs a cell id into a database key. Returns FALSE if a number is
+ * too big for the key. */
+gboolean
+gsmloc_cell_get_key (guint mcc, guint mnc, guint lac, guint cid,
+                     guint64 *key)
+{
+	if (mcc >> MCC_BITS || mnc >> MNC_BITS ||
+	    lac >> LAC_BITS || cid >> CID_BITS) {
+		return FALSE;
+	}
+	*key = ((guint64) mcc << (MNC_BITS + LAC_BITS + CID_BITS)) |
+	       ((guint64) mnc << (LAC_BITS + CID_BITS)) |
+	       ((guint64) lac << CID_BITS) |
+	       cid;
+	return TRUE;
+}
+
+GsmlocCellDb *
+gsmloc_cell_db_open (const char *filename, GError **error)
+{
+	GsmlocCellDb *db;
+	GMappedFile *file;
+	const guchar *contents;
+	gsize length;
+	guint n_cells;
+
+	file = g_mapped_file_new (filename, FALSE, error);
+	if (file == NULL) {
+		return NULL;
+	}
+
+	contents = (const guchar *) g_mapped_file_get_contents (file);
+	length = g_mapped_file_get_length (file);
+	if (length < CELLDB_HEADER_LENGTH ||
+	    memcmp (contents, CELLDB_MAGIC, CELLDB_MAGIC_LENGTH) != 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "%s is not a cell database", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+	n_cells = read_uint32 (contents + CELLDB_MAGIC_LENGTH);
+	if ((length - CELLDB_HEADER_LENGTH) / CELLDB_RECORD_LENGTH < n_cells) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Cell database %s is truncated", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	db = g_slice_new (GsmlocCellDb);
+	db->file = file;
+	db->records = contents + CELLDB_HEADER_LENGTH;
+	db->n_cells = n_cells;
+	return db;
+}
+
+void
+gsmloc_cell_db_close (GsmlocCellDb *db)
+{
+	g_mapped_file_unref (db->file);
+	g_slice_free (GsmlocCellDb, db);
+}
+
+static guint64
+gsmloc_cell_db_get_key (GsmlocCellDb *db, guint i)
+{
+	return read_uint64 (db->records + (gsize) i * CELLDB_RECORD_LENGTH);
+}
+
+static void
+gsmloc_cell_db_get_cell (GsmlocCellDb *db, guint i, GsmlocCell *cell)
+{
+	const guchar *p = db->records + (gsize) i * CELLDB_RECORD_LENGTH;
+
+	cell->key = read_uint64 (p);
+	cell->latitude = (gint32) read_uint32 (p + 8) / 1e7;
+	cell->longitude = (gint32) read_uint32 (p + 12) / 1e7;
+	cell->range = (p[16] | (p[17] << 8)) * 10.0;
+}
+
+/* Index of the first record with a key not smaller than 'key' */
+static guint
+gsmloc_cell_db_lower_bound (GsmlocCellDb *db, guint64 key)
+{
+	guint lo = 0, hi = db->n_cells;
+	int probes = 0;
+
+	/* keys before lo are smaller than key, keys from hi on are not */
+	while (lo < hi) {
+		guint mid;
+
+		if (hi - lo > 8 && probes < MAX_INTERPOLATION_PROBES) {
+			guint64 first, last;
+
+			first = gsmloc_cell_db_get_key (db, lo);
+			last = gsmloc_cell_db_get_key (db, hi - 1);
+			if (key <= first) {
+				return lo;
+			} else if (key > last) {
+				return hi;
+			}
+			mid = lo + (guint) ((double) (key - first) / (last - first) *
+			                    (hi - 1 - lo));
+			mid = MIN (mid, hi - 1);
+			probes++;
+		} else {
+			mid = lo + (hi - lo) / 2;
+		}
+
+		if (gsmloc_cell_db_get_key (db, mid) < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+gboolean
+gsmloc_cell_db_lookup (GsmlocCellDb *db,
+                       guint64       key,
+                       GsmlocCell   *cell)
+{
+	guint i;
+
+	i = gsmloc_cell_db_lower_bound (db, key);
+	if (i == db->n_cells || gsmloc_cell_db_get_key (db, i) != key) {
+		return FALSE;
+	}
+	gsmloc_cell_db_get_cell (db, i, cell);
+	return TRUE;
+}
+
+/* Center of the known cells in the location area of 'key', with a
+ * range that covers them all. For cells missing from the database. */
+gboolean
+gsmloc_cell_db_lookup_area (GsmlocCellDb *db,
+                            guint64       key,
+                            GsmlocCell   *area)
+{
+	guint first, last, step, i, n = 0;
+	double lat = 0.0, lon = 0.0, range = 0.0;
+	double lon_scale;
+
+	first = gsmloc_cell_db_lower_bound (db, key & ~AREA_MASK);
+	last = gsmloc_cell_db_lower_bound (db, (key | AREA_MASK) + 1);
+	if (first == last) {
+		return FALSE;
+	}
+
+	/* big areas are sampled */
+	step = (last - first + MAX_AREA_CELLS - 1) / MAX_AREA_CELLS;
+	for (i = first; i < last; i += step) {
+		GsmlocCell cell;
+
+		gsmloc_cell_db_get_cell (db, i, &cell);
+		lat += cell.latitude;
+		lon += cell.longitude;
+		n++;
+	}
+	lat /= n;
+	lon /= n;
+
+	lon_scale = cos (lat * G_PI / 180.0);
+	for (i = first; i < last; i += step) {
+		GsmlocCell cell;
+		double dx, dy;
+
+		gsmloc_cell_db_get_cell (db, i, &cell);
+		dx = (cell.longitude - lon) * lon_scale * GC_METERS_PER_DEGREE;
+		dy = (cell.latitude - lat) * GC_METERS_PER_DEGREE;
+		range = MAX (range, sqrt (dx * dx + dy * dy) + cell.range);
+	}
+
+	area->key = key & ~AREA_MASK;
+	area->latitude = lat;
+	area->longitude = lon;
+	area->range = range;
+	return TRUE;
+}
+
+/* Weighted centroid of 'cells'. The range is the weighted RMS distance
+ * from the centroid to a point anywhere in one of the cells, so a
+ * single cell keeps its own range and cells that disagree add up. */
+gboolean
+gsmloc_cell_get_centroid (const GsmlocCell *cells,
+                          const double     *weights,
+                          guint             n_cells,
+                          GsmlocCell       *centroid)
+{
+	double lat = 0.0, lon = 0.0, sum = 0.0, spread = 0.0;
+	double lon_scale;
+	guint i;
+
+	for (i = 0; i < n_cells; i++) {
+		lat += weights[i] * cells[i].latitude;
+		lon += weights[i] * cells[i].longitude;
+		sum += weights[i];
+	}
+	if (sum <= 0.0) {
+		return FALSE;
+	}
+	lat /= sum;
+	lon /= sum;
+
+	lon_scale = cos (lat * G_PI / 180.0);
+	for (i = 0; i < n_cells; i++) {
+		double dx, dy;
+
+		dx = (cells[i].longitude - lon) * lon_scale * GC_METERS_PER_DEGREE;
+		dy = (cells[i].latitude - lat) * GC_METERS_PER_DEGREE;
+		spread += weights[i] * (dx * dx + dy * dy +
+		                        cells[i].range * cells[i].range);
+	}
+
+	centroid->key = 0;
+	centroid->latitude = lat;
+	centroid->longitude = lon;
+	centroid->range = sqrt (spread / sum);
+	return TRUE;
+}
+
+/* Distance in meters, good enough between nearby cells */
+double
+gsmloc_cell_get_distance (const GsmlocCell *a,
+                          const GsmlocCell *b)
+{
+	double dx, dy;
+
+	dx = (a->longitude - b->longitude) * GC_METERS_PER_DEGREE *
+	     cos ((a->latitude + b->latitude) * G_PI / 360.0);
+	dy = (a->latitude - b->latitude) * GC_METERS_PER_DEGREE;
+	return sqrt (dx * dx + dy * dy);
+}
+
+static int
+compare_cells (gconstpointer a, gconstpointer b)
+{
+	guint64 key_a = ((const GsmlocCell *) a)->key;
+	guint64 key_b = ((const GsmlocCell *) b)->key;
+
+	return key_a < key_b ? -1 : (key_a > key_b ? 1 : 0);
+}
+
+/**
+ * gsmloc_cell_db_save:
+ * @cells: #GArray of #GsmlocCell, sorted in place
+ * @filename: file to write
+ * @error: return location for a #GError
+ *
+ * Writes a cell database. Of cells with the same key only the first
+ * one is kept.
+ *
+ * Return value: %TRUE on success.
+ */
+gboolean
+gsmloc_cell_db_save (GArray     *cells,
+                     const char *filename,
+                     GError    **error)
+{
+	GString *str;
+	gboolean ret;
+	guint i, n = 0;
+
+	g_array_sort (cells, compare_cells);
+
+	str = g_string_sized_new (CELLDB_HEADER_LENGTH +
+	                          cells->len * CELLDB_RECORD_LENGTH);
+	g_string_append_len (str, CELLDB_MAGIC, CELLDB_MAGIC_LENGTH);
+	append_uint32 (str, 0);
+	append_uint32 (str, 0);
+
+	for (i = 0; i < cells->len; i++) {
+		GsmlocCell *cell = &g_array_index (cells, GsmlocCell, i);
+		guint range;
+
+		if (i > 0 && cell->key == g_array_index (cells, GsmlocCell, i - 1).key) {
+			continue;
+		}
+		range = (guint) CLAMP (cell->range / 10.0 + 0.5, 0, G_MAXUINT16);
+
+		append_uint32 (str, cell->key & G_MAXUINT32);
+		append_uint32 (str, cell->key >> 32);
+		append_uint32 (str, (guint32) (gint32) floor (cell->latitude * 1e7 + 0.5));
+		append_uint32 (str, (guint32) (gint32) floor (cell->longitude * 1e7 + 0.5));
+		g_string_append_c (str, range & 0xff);
+		g_string_append_c (str, range >> 8);
+		g_string_append_c (str, 0);
+		g_string_append_c (str, 0);
+		n++;
+	}
+
+	/* the record count */
+	str->str[8] = n & 0xff;
+	str->str[9] = (n >> 8) & 0xff;
+	str->str[10] = (n >> 16) & 0xff;
+	str->str[11] = (n >> 24) & 0xff;
+
+	ret = g_file_set_contents (filename, str->str, str->len, error);
+	g_string_free (str, TRUE);
+	return ret;
+}
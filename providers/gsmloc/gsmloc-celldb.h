@@ -0,0 +1,76 @@
+/*
+ * Geoclue
+ * gsmloc-celldb.h - Offline cell tower database
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _GSMLOC_CELLDB_H
+#define _GSMLOC_CELLDB_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+	guint64 key;
+	double latitude;
+	double longitude;
+	/* meters */
+	double range;
+} GsmlocCell;
+
+/* A cell heard by the modem, the serving cell or a neighbour */
+typedef struct {
+	guint64 key;
+	/* received signal strength in dBm, 0 if not known */
+	int rssi;
+} GsmlocCellSignal;
+
+/* oFono and ModemManager signal quality is the AT+CSQ rssi (0-31,
+ * -113 to -51 dBm) scaled to 0-100 */
+#define GSMLOC_PERCENT_TO_DBM(percent) (-113 + (int) (percent) * 62 / 100)
+
+typedef struct _GsmlocCellDb GsmlocCellDb;
+
+gboolean gsmloc_cell_get_key (guint mcc, guint mnc, guint lac, guint cid,
+                              guint64 *key);
+gboolean gsmloc_cell_get_centroid (const GsmlocCell *cells,
+                                   const double     *weights,
+                                   guint             n_cells,
+                                   GsmlocCell       *centroid);
+double gsmloc_cell_get_distance (const GsmlocCell *a,
+                                 const GsmlocCell *b);
+
+GsmlocCellDb *gsmloc_cell_db_open (const char *filename, GError **error);
+void gsmloc_cell_db_close (GsmlocCellDb *db);
+gboolean gsmloc_cell_db_lookup (GsmlocCellDb *db,
+                                guint64       key,
+                                GsmlocCell   *cell);
+gboolean gsmloc_cell_db_lookup_area (GsmlocCellDb *db,
+                                     guint64       key,
+                                     GsmlocCell   *area);
+
+gboolean gsmloc_cell_db_save (GArray     *cells,
+                              const char *filename,
+                              GError    **error);
+
+G_END_DECLS
+
+#endif
@@ -34,6 +34,10 @@
 #include <geoclue/gc-iface-position.h>
 #include <geoclue/gc-iface-velocity.h>
 
+/* when duty cycling, the device is restarted this long (s) before 
+ * the next fix is due so that it has time to get it */
+#define GYPSY_WAKEUP_LEAD 8
+
 typedef struct {
 	GcProvider parent;
 
@@ -64,6 +68,12 @@ typedef struct {
 	double climb;
 
 	GeoclueAccuracy *accuracy;
+
+	/* seconds between fixes (org.freedesktop.Geoclue.GPSInterval),
+	 * 0 to run continuously. The device is stopped while wakeup_id 
+	 * is set. */
+	int interval;
+	guint wakeup_id;
 } GeoclueGypsy;
 
 typedef struct {
@@ -143,6 +153,46 @@ gypsy_course_to_geoclue (GypsyCourseFields fields)
 	return gc_fields;
 }
 
+static gboolean
+wakeup_cb (gpointer data)
+{
+	GeoclueGypsy *gypsy = data;
+	GError *error = NULL;
+
+	gypsy->wakeup_id = 0;
+	if (gypsy->device && !gypsy_device_start (gypsy->device, &error)) {
+		g_warning ("Error restarting device: %s", error->message);
+		g_error_free (error);
+	}
+	return FALSE;
+}
+
+static void
+cancel_wakeup (GeoclueGypsy *gypsy)
+{
+	if (gypsy->wakeup_id) {
+		g_source_remove (gypsy->wakeup_id);
+		gypsy->wakeup_id = 0;
+	}
+}
+
+/* Stops the device after a fix until shortly before the next one is
+ * due. Status and the last fix stay as they are meanwhile. */
+static void
+sleep_until_next_fix (GeoclueGypsy *gypsy)
+{
+	GError *error = NULL;
+
+	if (!gypsy_device_stop (gypsy->device, &error)) {
+		g_warning ("Error stopping device: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+	gypsy->wakeup_id = g_timeout_add_seconds 
+		(MAX (gypsy->interval - GYPSY_WAKEUP_LEAD, 1),
+		 wakeup_cb, gypsy);
+}
+
 static void
 position_changed (GypsyPosition      *position,
 		  GypsyPositionFields fields,
@@ -193,6 +243,11 @@ position_changed (GypsyPosition      *position,
 			 timestamp, gypsy->latitude, gypsy->longitude, 
 			 gypsy->altitude, gypsy->accuracy);
 	}
+
+	if (gypsy->interval > 0 && gypsy->wakeup_id == 0 &&
+	    gypsy->status == GEOCLUE_STATUS_AVAILABLE) {
+		sleep_until_next_fix (gypsy);
+	}
 }
 
 static void
@@ -295,6 +350,11 @@ connection_changed (GypsyDevice  *device,
 		    gboolean      connected,
 		    GeoclueGypsy *gypsy)
 {
+	/* stopped on purpose */
+	if (gypsy->wakeup_id) {
+		return;
+	}
+
 	if (connected == FALSE && 
 	    gypsy->status != GEOCLUE_STATUS_UNAVAILABLE) {
 		gypsy->status = GEOCLUE_STATUS_UNAVAILABLE;
@@ -310,6 +370,10 @@ fix_status_changed (GypsyDevice         *device,
 {
 	gboolean changed = FALSE;
 
+	if (gypsy->wakeup_id) {
+		return;
+	}
+
 	switch (status) {
 	case GYPSY_DEVICE_FIX_STATUS_INVALID:
 		if (gypsy->status != GEOCLUE_STATUS_UNAVAILABLE) {
@@ -379,11 +443,20 @@ set_options (GcIfaceGeoclue *gc,
              GError        **error)
 {
         GeoclueGypsy *gypsy = GEOCLUE_GYPSY (gc);
-        GValue *device_value, *baud_rate_value;
+        GValue *device_value, *baud_rate_value, *interval_value;
         const char *device_name;
         char *path;
         int baud_rate;
 
+	interval_value = g_hash_table_lookup (options,
+					      "org.freedesktop.Geoclue.GPSInterval");
+	gypsy->interval = (interval_value && G_VALUE_HOLDS_INT (interval_value)) ?
+		g_value_get_int (interval_value) : 0;
+	if (gypsy->interval <= 0 && gypsy->wakeup_id) {
+		cancel_wakeup (gypsy);
+		wakeup_cb (gypsy);
+	}
+
 	device_value = g_hash_table_lookup (options,
 					    "org.freedesktop.Geoclue.GPSDevice");
 	device_name = device_value ? g_value_get_string (device_value) : NULL;
@@ -396,6 +469,7 @@ set_options (GcIfaceGeoclue *gc,
 		return TRUE;
 
 	/* Disconnect from the old device, if any */
+	cancel_wakeup (gypsy);
 	if (gypsy->device != NULL) {
 		g_object_unref (gypsy->device);
 		gypsy->device = NULL;
@@ -494,6 +568,8 @@ dispose (GObject *object)
 {
 	GeoclueGypsy *gypsy = GEOCLUE_GYPSY (object);
 
+	cancel_wakeup (gypsy);
+
 	if (gypsy->control) {
 		g_object_unref (gypsy->control);
 		gypsy->control = NULL;
@@ -0,0 +1,149 @@
+/*
+ * Geoclue
+ * bench-nmea.c - Throughput of the NMEA ring buffer parser
+ *
+ * Feeds a recorded-like stream of GGA/RMC/GSA/GSV sentences (plus a
+ * few broken ones) through the ring buffer in read()-sized chunks and
+ * decodes the fields the provider uses, as fast as possible.
+ *
+ * Usage: bench-nmea [seconds]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "nmea-parser.h"
+
+/* like a read() from a fast serial port or a pty */
+#define CHUNK_SIZE 512
+
+static void
+add_sentence (GString    *stream,
+              const char *body)
+{
+	const char *p;
+	guchar checksum = 0;
+
+	for (p = body; *p; p++) {
+		checksum ^= *p;
+	}
+	g_string_append_printf (stream, "$%s*%02X\r\n", body, checksum);
+}
+
+static GString *
+build_stream (void)
+{
+	GString *stream, *body;
+	int i;
+
+	stream = g_string_new (NULL);
+	body = g_string_new (NULL);
+
+	for (i = 0; i < 1000; i++) {
+		int hhmmss = 120000 + (i / 60) * 100 + i % 60;
+
+		g_string_printf (body, "GPGGA,%06d.00,4807.%04d,N,01131.%04d,E,1,08,0.9,%d.4,M,46.9,M,,",
+		                 hhmmss, i, i, 500 + i % 50);
+		add_sentence (stream, body->str);
+		g_string_printf (body, "GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1");
+		add_sentence (stream, body->str);
+		g_string_printf (body, "GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00");
+		add_sentence (stream, body->str);
+		g_string_printf (body, "GPRMC,%06d.00,A,4807.%04d,N,01131.%04d,E,%d.4,084.4,230394,003.1,W",
+		                 hhmmss, i, i, 20 + i % 5);
+		add_sentence (stream, body->str);
+
+		if (i % 100 == 0) {
+			/* line noise and a bad checksum */
+			g_string_append (stream, "\x13\x07garbage\r\n$GPGGA,1,2,3*00\r\n");
+		}
+	}
+	g_string_free (body, TRUE);
+	return stream;
+}
+
+static guint
+drain (NmeaRing *ring,
+       double   *sink)
+{
+	NmeaSentence sentence;
+	double value;
+	guint n = 0;
+
+	while (nmea_ring_next_sentence (ring, &sentence)) {
+		n++;
+		switch (sentence.type) {
+			case NMEA_SENTENCE_GGA:
+				nmea_sentence_get_time (&sentence, 1, &value);
+				*sink += value;
+				nmea_sentence_get_coordinate (&sentence, 2, &value);
+				*sink += value;
+				nmea_sentence_get_coordinate (&sentence, 4, &value);
+				*sink += value;
+				nmea_sentence_get_double (&sentence, 9, &value);
+				*sink += value;
+				break;
+			case NMEA_SENTENCE_RMC:
+				nmea_sentence_get_coordinate (&sentence, 3, &value);
+				*sink += value;
+				nmea_sentence_get_coordinate (&sentence, 5, &value);
+				*sink += value;
+				nmea_sentence_get_double (&sentence, 7, &value);
+				*sink += value;
+				break;
+			case NMEA_SENTENCE_GSA:
+				nmea_sentence_get_double (&sentence, 16, &value);
+				*sink += value;
+				break;
+			default:
+				break;
+		}
+	}
+	return n;
+}
+
+int main (int argc, char **argv)
+{
+	NmeaRing ring;
+	GString *stream;
+	GTimer *timer;
+	guint64 sentences = 0, bytes = 0;
+	gsize offset = 0;
+	double seconds = 5.0, elapsed, sink = 0.0;
+
+	if (argc > 1) {
+		seconds = MAX (1, atoi (argv[1]));
+	}
+
+	stream = build_stream ();
+	nmea_ring_init (&ring);
+	timer = g_timer_new ();
+
+	do {
+		int i;
+
+		/* check the clock only every now and then */
+		for (i = 0; i < 1000; i++) {
+			gsize len;
+
+			len = nmea_ring_append (&ring, stream->str + offset,
+			                        MIN (CHUNK_SIZE, stream->len - offset));
+			offset = (offset + len) % stream->len;
+			bytes += len;
+			sentences += drain (&ring, &sink);
+		}
+		elapsed = g_timer_elapsed (timer, NULL);
+	} while (elapsed < seconds);
+
+	g_print ("%" G_GUINT64_FORMAT " sentences in %.1f s: %.0f sentences/s, %.1f MB/s\n",
+	         sentences, elapsed, sentences / elapsed, bytes / elapsed / (1024 * 1024));
+	g_print ("%u bad checksums, %u overruns (checksum %g)\n",
+	         ring.n_bad_checksums, ring.n_overruns, sink);
+
+	g_timer_destroy (timer);
+	g_string_free (stream, TRUE);
+
+	return 0;
+}
@@ -0,0 +1,626 @@
+/*
+ * Geoclue
+ * geoclue-nmea.c - Geoclue Position backend for NMEA 0183 serial devices
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Reads a GPS receiver (or a pty) directly, for devices that run
+ * neither gpsd nor gypsy. The device is set with the
+ * org.freedesktop.Geoclue.NMEADevice option, the speed with
+ * org.freedesktop.Geoclue.GPSBaudRate.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <geoclue/geoclue-error.h>
+#include <geoclue/gc-provider.h>
+#include <geoclue/gc-iface-position.h>
+#include <geoclue/gc-iface-velocity.h>
+
+#include "nmea-parser.h"
+
+#define DEFAULT_BAUD_RATE 4800
+
+/* User equivalent range errors (m) turning the DOPs from GGA and
+ * GSA into error estimates */
+#define NMEA_H_UERE 15.0
+#define NMEA_V_UERE 23.0
+
+/* used for a GGA fix without HDOP */
+#define NMEA_DEFAULT_H_ACCURACY 24.0
+
+#define KNOTS_TO_MPS 0.514444
+
+typedef struct {
+	GcProvider parent;
+
+	char *device_name;
+	int baud_rate;
+
+	int fd;
+	GIOChannel *channel;
+	guint watch_id;
+	NmeaRing ring;
+
+	GeoclueStatus status;
+
+	/* date from the last RMC, -1 if none yet */
+	int days;
+	double timestamp;
+
+	GeocluePositionFields position_fields;
+	double latitude;
+	double longitude;
+	double altitude;
+	GeoclueAccuracy *accuracy;
+
+	GeoclueVelocityFields velocity_fields;
+	double speed;
+	double direction;
+
+	/* from GSA, 0 or NAN if not known */
+	int fix_mode;
+	double hdop;
+	double vdop;
+
+	GMainLoop *loop;
+} GeoclueNmea;
+
+typedef struct {
+	GcProviderClass parent_class;
+} GeoclueNmeaClass;
+
+static void geoclue_nmea_position_init (GcIfacePositionClass *iface);
+static void geoclue_nmea_velocity_init (GcIfaceVelocityClass *iface);
+
+#define GEOCLUE_TYPE_NMEA (geoclue_nmea_get_type ())
+#define GEOCLUE_NMEA(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_NMEA, GeoclueNmea))
+
+G_DEFINE_TYPE_WITH_CODE (GeoclueNmea, geoclue_nmea, GC_TYPE_PROVIDER,
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_POSITION,
+                                                geoclue_nmea_position_init)
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_VELOCITY,
+                                                geoclue_nmea_velocity_init))
+
+
+static void
+geoclue_nmea_set_status (GeoclueNmea   *nmea,
+                         GeoclueStatus  status)
+{
+	if (status == nmea->status) {
+		return;
+	}
+	nmea->status = status;
+
+	/* make position and velocity invalid if no fix */
+	if (status != GEOCLUE_STATUS_AVAILABLE) {
+		nmea->position_fields = GEOCLUE_POSITION_FIELDS_NONE;
+		nmea->velocity_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	}
+	gc_iface_geoclue_emit_status_changed (GC_IFACE_GEOCLUE (nmea), status);
+}
+
+static void
+geoclue_nmea_close (GeoclueNmea *nmea)
+{
+	if (nmea->watch_id) {
+		g_source_remove (nmea->watch_id);
+		nmea->watch_id = 0;
+	}
+	if (nmea->channel) {
+		g_io_channel_unref (nmea->channel);
+		nmea->channel = NULL;
+	}
+	if (nmea->fd >= 0) {
+		close (nmea->fd);
+		nmea->fd = -1;
+	}
+	nmea->fix_mode = 0;
+	nmea->hdop = NAN;
+	nmea->vdop = NAN;
+}
+
+/* seconds since the epoch from the time of day in a sentence */
+static double
+geoclue_nmea_get_timestamp (GeoclueNmea *nmea,
+                            double       time_of_day)
+{
+	time_t now;
+	double day;
+
+	if (nmea->days >= 0) {
+		return nmea->days * 86400.0 + time_of_day;
+	}
+
+	/* no RMC yet: assume the fix is from within the last 12 h */
+	now = time (NULL);
+	day = (now / 86400) * 86400.0;
+	if (day + time_of_day > now + 12 * 3600) {
+		day -= 86400.0;
+	}
+	return day + time_of_day;
+}
+
+static void
+geoclue_nmea_update_accuracy (GeoclueNmea *nmea)
+{
+	double horizontal, vertical;
+
+	horizontal = isnan (nmea->hdop) ?
+	             NMEA_DEFAULT_H_ACCURACY : nmea->hdop * NMEA_H_UERE;
+	/* without a GSA VDOP the vertical error is not known, and there
+	 * is no altitude in a 2D fix */
+	if (nmea->fix_mode == 2 || isnan (nmea->vdop)) {
+		vertical = 0.0;
+	} else {
+		vertical = nmea->vdop * NMEA_V_UERE;
+	}
+	geoclue_accuracy_set_details (nmea->accuracy,
+	                              GEOCLUE_ACCURACY_LEVEL_DETAILED,
+	                              horizontal, vertical);
+}
+
+static void
+geoclue_nmea_set_position (GeoclueNmea          *nmea,
+                           GeocluePositionFields fields,
+                           double                latitude,
+                           double                longitude,
+                           double                altitude)
+{
+	if (fields == nmea->position_fields &&
+	    latitude == nmea->latitude &&
+	    longitude == nmea->longitude &&
+	    (!(fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) ||
+	     altitude == nmea->altitude)) {
+		return;
+	}
+
+	nmea->position_fields = fields;
+	nmea->latitude = latitude;
+	nmea->longitude = longitude;
+	if (fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) {
+		nmea->altitude = altitude;
+	}
+	geoclue_nmea_update_accuracy (nmea);
+
+	gc_iface_position_emit_position_changed
+		(GC_IFACE_POSITION (nmea), nmea->position_fields,
+		 (int)(nmea->timestamp + 0.5),
+		 nmea->latitude, nmea->longitude, nmea->altitude,
+		 nmea->accuracy);
+}
+
+/* $--GGA,time,lat,N,lon,E,quality,sats,hdop,alt,M,geoid,M,age,station */
+static void
+geoclue_nmea_handle_gga (GeoclueNmea        *nmea,
+                         const NmeaSentence *sentence)
+{
+	GeocluePositionFields fields = GEOCLUE_POSITION_FIELDS_NONE;
+	double time_of_day, latitude, longitude, altitude = 0.0;
+	int quality;
+
+	if (!nmea_sentence_get_int (sentence, 6, &quality) || quality == 0) {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ACQUIRING);
+		return;
+	}
+	if (!nmea_sentence_get_coordinate (sentence, 2, &latitude) ||
+	    !nmea_sentence_get_coordinate (sentence, 4, &longitude)) {
+		return;
+	}
+	fields = GEOCLUE_POSITION_FIELDS_LATITUDE | GEOCLUE_POSITION_FIELDS_LONGITUDE;
+
+	if (nmea->fix_mode != 2 &&
+	    nmea_sentence_get_double (sentence, 9, &altitude)) {
+		fields |= GEOCLUE_POSITION_FIELDS_ALTITUDE;
+	}
+	if (nmea_sentence_get_time (sentence, 1, &time_of_day)) {
+		nmea->timestamp = geoclue_nmea_get_timestamp (nmea, time_of_day);
+	}
+	/* prefer the DOPs from GSA, but not all devices send it */
+	if (nmea->fix_mode == 0 &&
+	    !nmea_sentence_get_double (sentence, 8, &nmea->hdop)) {
+		nmea->hdop = NAN;
+	}
+
+	geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_AVAILABLE);
+	geoclue_nmea_set_position (nmea, fields, latitude, longitude, altitude);
+}
+
+/* $--RMC,time,status,lat,N,lon,E,speed,track,date,variation,E */
+static void
+geoclue_nmea_handle_rmc (GeoclueNmea        *nmea,
+                         const NmeaSentence *sentence)
+{
+	GeoclueVelocityFields fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	double time_of_day, latitude, longitude;
+	double speed = 0.0, direction = 0.0;
+	int days;
+
+	if (nmea_sentence_get_char (sentence, 2) != 'A') {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ACQUIRING);
+		return;
+	}
+	if (nmea_sentence_get_date (sentence, 9, &days)) {
+		nmea->days = days;
+	}
+	if (nmea_sentence_get_time (sentence, 1, &time_of_day)) {
+		nmea->timestamp = geoclue_nmea_get_timestamp (nmea, time_of_day);
+	}
+
+	geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_AVAILABLE);
+
+	if (nmea_sentence_get_coordinate (sentence, 3, &latitude) &&
+	    nmea_sentence_get_coordinate (sentence, 5, &longitude)) {
+		/* RMC has no altitude: keep the one from GGA */
+		geoclue_nmea_set_position (nmea,
+		                           (nmea->position_fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) |
+		                           GEOCLUE_POSITION_FIELDS_LATITUDE |
+		                           GEOCLUE_POSITION_FIELDS_LONGITUDE,
+		                           latitude, longitude, nmea->altitude);
+	}
+
+	if (nmea_sentence_get_double (sentence, 7, &speed)) {
+		speed *= KNOTS_TO_MPS;
+		fields |= GEOCLUE_VELOCITY_FIELDS_SPEED;
+	}
+	if (nmea_sentence_get_double (sentence, 8, &direction)) {
+		fields |= GEOCLUE_VELOCITY_FIELDS_DIRECTION;
+	}
+	if (fields != nmea->velocity_fields ||
+	    speed != nmea->speed || direction != nmea->direction) {
+		nmea->velocity_fields = fields;
+		nmea->speed = speed;
+		nmea->direction = direction;
+
+		gc_iface_velocity_emit_velocity_changed
+			(GC_IFACE_VELOCITY (nmea), nmea->velocity_fields,
+			 (int)(nmea->timestamp + 0.5),
+			 nmea->speed, nmea->direction, 0.0);
+	}
+}
+
+/* $--GSA,selection,mode,12 x prn,pdop,hdop,vdop */
+static void
+geoclue_nmea_handle_gsa (GeoclueNmea        *nmea,
+                         const NmeaSentence *sentence)
+{
+	if (!nmea_sentence_get_int (sentence, 2, &nmea->fix_mode)) {
+		return;
+	}
+	if (nmea->fix_mode < 2) {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ACQUIRING);
+		return;
+	}
+	/* used with the next position */
+	if (!nmea_sentence_get_double (sentence, 16, &nmea->hdop)) {
+		nmea->hdop = NAN;
+	}
+	if (!nmea_sentence_get_double (sentence, 17, &nmea->vdop)) {
+		nmea->vdop = NAN;
+	}
+}
+
+/* $--GSV,messages,number,satellites in view,4 x (prn,elevation,azimuth,snr) */
+static void
+geoclue_nmea_handle_gsv (GeoclueNmea        *nmea,
+                         const NmeaSentence *sentence)
+{
+	int satellites;
+
+	/* the receiver is talking: at least it is trying */
+	if (nmea->status != GEOCLUE_STATUS_AVAILABLE &&
+	    nmea_sentence_get_int (sentence, 3, &satellites)) {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ACQUIRING);
+	}
+}
+
+static gboolean
+nmea_device_cb (GIOChannel   *channel,
+                GIOCondition  condition,
+                gpointer      data)
+{
+	GeoclueNmea *nmea = data;
+	NmeaSentence sentence;
+	gssize len;
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		goto error;
+	}
+
+	len = nmea_ring_read (&nmea->ring, nmea->fd);
+	if (len == 0 || (len < 0 && errno != EAGAIN)) {
+		goto error;
+	}
+
+	while (nmea_ring_next_sentence (&nmea->ring, &sentence)) {
+		switch (sentence.type) {
+			case NMEA_SENTENCE_GGA:
+				geoclue_nmea_handle_gga (nmea, &sentence);
+				break;
+			case NMEA_SENTENCE_RMC:
+				geoclue_nmea_handle_rmc (nmea, &sentence);
+				break;
+			case NMEA_SENTENCE_GSA:
+				geoclue_nmea_handle_gsa (nmea, &sentence);
+				break;
+			case NMEA_SENTENCE_GSV:
+				geoclue_nmea_handle_gsv (nmea, &sentence);
+				break;
+			default:
+				break;
+		}
+	}
+	return TRUE;
+
+error:
+	g_warning ("Lost NMEA device %s", nmea->device_name);
+	/* the watch is removed by returning FALSE */
+	nmea->watch_id = 0;
+	geoclue_nmea_close (nmea);
+	geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ERROR);
+	return FALSE;
+}
+
+static speed_t
+get_speed (int baud_rate)
+{
+	switch (baud_rate) {
+		case 9600:
+			return B9600;
+		case 19200:
+			return B19200;
+		case 38400:
+			return B38400;
+		case 57600:
+			return B57600;
+		case 115200:
+			return B115200;
+		default:
+			return B4800;
+	}
+}
+
+static gboolean
+geoclue_nmea_open (GeoclueNmea *nmea,
+                   GError     **error)
+{
+	struct termios tio;
+
+	nmea->fd = open (nmea->device_name, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if (nmea->fd < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not open %s: %s",
+		             nmea->device_name, g_strerror (errno));
+		return FALSE;
+	}
+
+	/* a pty or a file works as is */
+	if (isatty (nmea->fd) && tcgetattr (nmea->fd, &tio) == 0) {
+		cfmakeraw (&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		cfsetispeed (&tio, get_speed (nmea->baud_rate));
+		cfsetospeed (&tio, get_speed (nmea->baud_rate));
+		tcsetattr (nmea->fd, TCSANOW, &tio);
+	}
+
+	nmea_ring_init (&nmea->ring);
+	nmea->channel = g_io_channel_unix_new (nmea->fd);
+	nmea->watch_id = g_io_add_watch (nmea->channel,
+	                                 G_IO_IN | G_IO_ERR | G_IO_HUP,
+	                                 nmea_device_cb, nmea);
+	return TRUE;
+}
+
+/* Geoclue interface */
+static gboolean
+get_status (GcIfaceGeoclue *gc,
+            GeoclueStatus  *status,
+            GError        **error)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (gc);
+
+	*status = nmea->status;
+	return TRUE;
+}
+
+static gboolean
+set_options (GcIfaceGeoclue *gc,
+             GHashTable     *options,
+             GError        **error)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (gc);
+	GValue *device_value, *baud_rate_value;
+	const char *device_name;
+	int baud_rate;
+
+	device_value = g_hash_table_lookup (options,
+	                                    "org.freedesktop.Geoclue.NMEADevice");
+	device_name = device_value ? g_value_get_string (device_value) : NULL;
+	baud_rate_value = g_hash_table_lookup (options,
+	                                       "org.freedesktop.Geoclue.GPSBaudRate");
+	baud_rate = baud_rate_value ? g_value_get_int (baud_rate_value) : DEFAULT_BAUD_RATE;
+
+	if (g_strcmp0 (nmea->device_name, device_name) == 0 &&
+	    nmea->baud_rate == baud_rate) {
+		return TRUE;
+	}
+
+	geoclue_nmea_close (nmea);
+	g_free (nmea->device_name);
+	nmea->device_name = NULL;
+	nmea->baud_rate = baud_rate;
+
+	if (device_name == NULL || *device_name == '\0') {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_UNAVAILABLE);
+		return TRUE;
+	}
+
+	nmea->device_name = g_strdup (device_name);
+	if (!geoclue_nmea_open (nmea, error)) {
+		geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ERROR);
+		return FALSE;
+	}
+	geoclue_nmea_set_status (nmea, GEOCLUE_STATUS_ACQUIRING);
+	return TRUE;
+}
+
+static void
+shutdown (GcProvider *provider)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (provider);
+
+	/* only the standalone provider has a main loop to quit */
+	if (nmea->loop) {
+		g_main_loop_quit (nmea->loop);
+	}
+}
+
+static void
+finalize (GObject *object)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (object);
+
+	geoclue_nmea_close (nmea);
+	g_free (nmea->device_name);
+	geoclue_accuracy_free (nmea->accuracy);
+
+	((GObjectClass *) geoclue_nmea_parent_class)->finalize (object);
+}
+
+static void
+geoclue_nmea_class_init (GeoclueNmeaClass *klass)
+{
+	GObjectClass *o_class = (GObjectClass *) klass;
+	GcProviderClass *p_class = (GcProviderClass *) klass;
+
+	o_class->finalize = finalize;
+
+	p_class->get_status = get_status;
+	p_class->set_options = set_options;
+	p_class->shutdown = shutdown;
+}
+
+static void
+geoclue_nmea_init (GeoclueNmea *nmea)
+{
+	nmea->fd = -1;
+	nmea->days = -1;
+	nmea->baud_rate = DEFAULT_BAUD_RATE;
+	nmea->hdop = NAN;
+	nmea->vdop = NAN;
+	nmea->status = GEOCLUE_STATUS_UNAVAILABLE;
+	nmea->position_fields = GEOCLUE_POSITION_FIELDS_NONE;
+	nmea->velocity_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	nmea->accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0, 0);
+
+	gc_provider_set_details (GC_PROVIDER (nmea),
+	                         "org.freedesktop.Geoclue.Providers.Nmea",
+	                         "/org/freedesktop/Geoclue/Providers/Nmea",
+	                         "Nmea", "NMEA serial device provider");
+}
+
+static gboolean
+get_position (GcIfacePosition       *gc,
+              GeocluePositionFields *fields,
+              int                   *timestamp,
+              double                *latitude,
+              double                *longitude,
+              double                *altitude,
+              GeoclueAccuracy      **accuracy,
+              GError               **error)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (gc);
+
+	*timestamp = (int)(nmea->timestamp + 0.5);
+	*latitude = nmea->latitude;
+	*longitude = nmea->longitude;
+	*altitude = nmea->altitude;
+	*fields = nmea->position_fields;
+	*accuracy = geoclue_accuracy_copy (nmea->accuracy);
+
+	return TRUE;
+}
+
+static void
+geoclue_nmea_position_init (GcIfacePositionClass *iface)
+{
+	iface->get_position = get_position;
+}
+
+static gboolean
+get_velocity (GcIfaceVelocity       *gc,
+              GeoclueVelocityFields *fields,
+              int                   *timestamp,
+              double                *speed,
+              double                *direction,
+              double                *climb,
+              GError               **error)
+{
+	GeoclueNmea *nmea = GEOCLUE_NMEA (gc);
+
+	*timestamp = (int)(nmea->timestamp + 0.5);
+	*speed = nmea->speed;
+	*direction = nmea->direction;
+	*climb = 0.0;
+	*fields = nmea->velocity_fields;
+
+	return TRUE;
+}
+
+static void
+geoclue_nmea_velocity_init (GcIfaceVelocityClass *iface)
+{
+	iface->get_velocity = get_velocity;
+}
+
+#ifdef GEOCLUE_PROVIDER_PLUGIN
+
+GC_PROVIDER_PLUGIN_DEFINE (geoclue_nmea_get_type)
+
+#else
+
+int
+main (int    argc,
+      char **argv)
+{
+	GeoclueNmea *nmea;
+
+	g_type_init ();
+
+	nmea = g_object_new (GEOCLUE_TYPE_NMEA, NULL);
+
+	nmea->loop = g_main_loop_new (NULL, TRUE);
+	g_main_loop_run (nmea->loop);
+
+	g_main_loop_unref (nmea->loop);
+	g_object_unref (nmea);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * Geoclue
+ * nmea-parser.c - In-place NMEA 0183 sentence parser on a ring buffer
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * The device is read straight into the ring buffer and sentences are
+ * parsed where they are: finding a sentence is a single pass that
+ * checks the checksum and records where each field starts, and field
+ * values are only decoded when the provider asks for them. Nothing is
+ * copied or allocated per sentence, sentences that wrap around the end
+ * of the buffer included.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "nmea-parser.h"
+
+/* the standard says 82 including "$" and "\r\n", allow some slack */
+#define NMEA_MAX_LENGTH 128
+
+#define RING_CHAR(ring, i) ((ring)->data[(i) & NMEA_RING_MASK])
+
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12
+};
+
+void
+nmea_ring_init (NmeaRing *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->n_bad_checksums = 0;
+	ring->n_overruns = 0;
+}
+
+/* Reads whatever is available from 'fd' into the free part of the
+ * ring, in one system call. Returns the result of readv(). */
+gssize
+nmea_ring_read (NmeaRing *ring,
+                int       fd)
+{
+	struct iovec iov[2];
+	guint free_space, offset;
+	gssize len;
+
+	free_space = NMEA_RING_SIZE - (ring->head - ring->tail);
+	if (free_space == 0) {
+		/* next_sentence() drops a full ring without a sentence,
+		 * so this is only reached if sentences were not consumed */
+		ring->n_overruns++;
+		ring->tail = ring->head;
+		free_space = NMEA_RING_SIZE;
+	}
+
+	offset = ring->head & NMEA_RING_MASK;
+	iov[0].iov_base = ring->data + offset;
+	iov[0].iov_len = MIN (free_space, NMEA_RING_SIZE - offset);
+	iov[1].iov_base = ring->data;
+	iov[1].iov_len = free_space - iov[0].iov_len;
+
+	do {
+		len = readv (fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+	} while (len < 0 && errno == EINTR);
+
+	if (len > 0) {
+		ring->head += len;
+	}
+	return len;
+}
+
+/* Copies 'data' into the ring, for input that does not come from a
+ * file descriptor. Returns the number of bytes that fit. */
+gsize
+nmea_ring_append (NmeaRing   *ring,
+                  const char *data,
+                  gsize       len)
+{
+	guint free_space, offset, first;
+
+	free_space = NMEA_RING_SIZE - (ring->head - ring->tail);
+	len = MIN (len, free_space);
+
+	offset = ring->head & NMEA_RING_MASK;
+	first = MIN (len, NMEA_RING_SIZE - offset);
+	memcpy (ring->data + offset, data, first);
+	memcpy (ring->data, data + first, len - first);
+
+	ring->head += len;
+	return len;
+}
+
+static int
+hex_value (char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+static NmeaSentenceType
+get_sentence_type (const NmeaRing *ring,
+                   guint           address)
+{
+	char a, b, c;
+
+	/* "$ttSSS": any talker, SSS is the sentence */
+	if (RING_CHAR (ring, address) == 'P') {
+		return NMEA_SENTENCE_OTHER;
+	}
+	a = RING_CHAR (ring, address + 2);
+	b = RING_CHAR (ring, address + 3);
+	c = RING_CHAR (ring, address + 4);
+
+	if (a == 'G' && b == 'G' && c == 'A') {
+		return NMEA_SENTENCE_GGA;
+	} else if (a == 'R' && b == 'M' && c == 'C') {
+		return NMEA_SENTENCE_RMC;
+	} else if (a == 'G' && b == 'S' && c == 'A') {
+		return NMEA_SENTENCE_GSA;
+	} else if (a == 'G' && b == 'S' && c == 'V') {
+		return NMEA_SENTENCE_GSV;
+	}
+	return NMEA_SENTENCE_OTHER;
+}
+
+/**
+ * nmea_ring_next_sentence:
+ * @ring: ring buffer
+ * @sentence: returned sentence
+ *
+ * Finds the next complete sentence with a valid checksum and consumes
+ * it from the ring. Garbage and broken sentences are skipped.
+ *
+ * Return value: %FALSE if there is no complete sentence in the ring.
+ */
+gboolean
+nmea_ring_next_sentence (NmeaRing     *ring,
+                         NmeaSentence *sentence)
+{
+	guint pos;
+	guchar checksum;
+	char c = '\0';
+	int high, low;
+
+	while (TRUE) {
+		while (ring->tail != ring->head && RING_CHAR (ring, ring->tail) != '$') {
+			ring->tail++;
+		}
+		if (ring->tail == ring->head) {
+			return FALSE;
+		}
+
+		pos = ring->tail + 1;
+		checksum = 0;
+		sentence->n_fields = 1;
+		sentence->start[0] = pos;
+
+		while (pos != ring->head) {
+			c = RING_CHAR (ring, pos);
+			if (c == '*' || c == '\r' || c == '\n' || c == '$' ||
+			    pos - ring->tail > NMEA_MAX_LENGTH) {
+				break;
+			}
+			if (c == ',') {
+				if (sentence->n_fields == NMEA_MAX_FIELDS) {
+					break;
+				}
+				sentence->start[sentence->n_fields++] = pos + 1;
+			}
+			checksum ^= c;
+			pos++;
+		}
+
+		if (pos == ring->head || (c == '*' && ring->head - pos < 3)) {
+			/* incomplete: wait for more, unless it can't fit */
+			if (ring->head - ring->tail >= NMEA_MAX_LENGTH) {
+				ring->tail++;
+				continue;
+			}
+			return FALSE;
+		}
+
+		if (c != '*') {
+			/* no checksum, too long or too many fields */
+			ring->tail = pos;
+			continue;
+		}
+
+		high = hex_value (RING_CHAR (ring, pos + 1));
+		low = hex_value (RING_CHAR (ring, pos + 2));
+		if (high < 0 || low < 0 || high * 16 + low != checksum) {
+			ring->n_bad_checksums++;
+			ring->tail = pos;
+			continue;
+		}
+
+		sentence->ring = ring;
+		sentence->start[sentence->n_fields] = pos + 1;
+		sentence->type = get_sentence_type (ring, sentence->start[0]);
+		ring->tail = pos + 3;
+		return TRUE;
+	}
+}
+
+gboolean
+nmea_sentence_field_is_empty (const NmeaSentence *sentence,
+                              guint               field)
+{
+	return field >= sentence->n_fields ||
+	       sentence->start[field + 1] - 1 == sentence->start[field];
+}
+
+/* first character of the field, '\0' if it is empty */
+char
+nmea_sentence_get_char (const NmeaSentence *sentence,
+                        guint               field)
+{
+	if (nmea_sentence_field_is_empty (sentence, field)) {
+		return '\0';
+	}
+	return RING_CHAR (sentence->ring, sentence->start[field]);
+}
+
+gboolean
+nmea_sentence_field_equals (const NmeaSentence *sentence,
+                            guint               field,
+                            const char         *str)
+{
+	guint pos, end;
+
+	if (field >= sentence->n_fields) {
+		return FALSE;
+	}
+	end = sentence->start[field + 1] - 1;
+	for (pos = sentence->start[field]; pos != end; pos++, str++) {
+		if (*str != RING_CHAR (sentence->ring, pos)) {
+			return FALSE;
+		}
+	}
+	return *str == '\0';
+}
+
+/* a newly allocated copy of the field, for the odd string value */
+char *
+nmea_sentence_dup_field (const NmeaSentence *sentence,
+                         guint               field)
+{
+	guint pos, end;
+	char *str, *p;
+
+	if (field >= sentence->n_fields) {
+		return NULL;
+	}
+	pos = sentence->start[field];
+	end = sentence->start[field + 1] - 1;
+
+	p = str = g_malloc (end - pos + 1);
+	for (; pos != end; pos++) {
+		*p++ = RING_CHAR (sentence->ring, pos);
+	}
+	*p = '\0';
+	return str;
+}
+
+gboolean
+nmea_sentence_get_double (const NmeaSentence *sentence,
+                          guint               field,
+                          double             *value)
+{
+	const NmeaRing *ring = sentence->ring;
+	guint pos, end;
+	double mantissa = 0.0;
+	int decimals = -1;
+	gboolean negative = FALSE;
+	char c;
+
+	if (nmea_sentence_field_is_empty (sentence, field)) {
+		return FALSE;
+	}
+	pos = sentence->start[field];
+	end = sentence->start[field + 1] - 1;
+
+	if (RING_CHAR (ring, pos) == '-') {
+		negative = TRUE;
+		pos++;
+	}
+	for (; pos != end; pos++) {
+		c = RING_CHAR (ring, pos);
+		if (c >= '0' && c <= '9') {
+			mantissa = mantissa * 10 + (c - '0');
+			if (decimals >= 0) {
+				decimals++;
+			}
+		} else if (c == '.' && decimals < 0) {
+			decimals = 0;
+		} else {
+			return FALSE;
+		}
+	}
+	if (decimals > 0) {
+		mantissa /= powers_of_ten[MIN (decimals, (int) G_N_ELEMENTS (powers_of_ten) - 1)];
+	}
+	*value = negative ? -mantissa : mantissa;
+	return TRUE;
+}
+
+gboolean
+nmea_sentence_get_int (const NmeaSentence *sentence,
+                       guint               field,
+                       int                *value)
+{
+	double d;
+
+	if (!nmea_sentence_get_double (sentence, field, &d)) {
+		return FALSE;
+	}
+	*value = (int) d;
+	return TRUE;
+}
+
+/* "ddmm.mmmm" or "dddmm.mmmm" in 'field' with the hemisphere in
+ * the next field, to signed degrees */
+gboolean
+nmea_sentence_get_coordinate (const NmeaSentence *sentence,
+                              guint               field,
+                              double             *degrees)
+{
+	double value, whole;
+	char hemisphere;
+
+	if (!nmea_sentence_get_double (sentence, field, &value)) {
+		return FALSE;
+	}
+	whole = (int) (value / 100);
+	value = whole + (value - whole * 100) / 60;
+
+	hemisphere = nmea_sentence_get_char (sentence, field + 1);
+	if (hemisphere == 'S' || hemisphere == 'W') {
+		value = -value;
+	} else if (hemisphere != 'N' && hemisphere != 'E') {
+		return FALSE;
+	}
+	*degrees = value;
+	return TRUE;
+}
+
+/* "hhmmss.ss" to seconds since midnight UTC */
+gboolean
+nmea_sentence_get_time (const NmeaSentence *sentence,
+                        guint               field,
+                        double             *seconds)
+{
+	double value;
+	int hhmmss;
+
+	if (!nmea_sentence_get_double (sentence, field, &value)) {
+		return FALSE;
+	}
+	hhmmss = (int) value;
+	*seconds = (hhmmss / 10000) * 3600 +
+	           (hhmmss / 100 % 100) * 60 +
+	           (hhmmss % 100) + (value - hhmmss);
+	return TRUE;
+}
+
+/* "ddmmyy" to days since the epoch */
+gboolean
+nmea_sentence_get_date (const NmeaSentence *sentence,
+                        guint               field,
+                        int                *days)
+{
+	int ddmmyy, day, month, year;
+
+	if (!nmea_sentence_get_int (sentence, field, &ddmmyy)) {
+		return FALSE;
+	}
+	day = ddmmyy / 10000;
+	month = ddmmyy / 100 % 100;
+	year = ddmmyy % 100;
+	year += year < 80 ? 2000 : 1900;
+
+	if (month < 1 || month > 12 || day < 1 || day > 31) {
+		return FALSE;
+	}
+
+	/* days from civil date, March based year */
+	if (month <= 2) {
+		year--;
+		month += 12;
+	}
+	*days = 365 * year + year / 4 - year / 100 + year / 400 +
+	        (153 * (month - 3) + 2) / 5 + day - 719469;
+	return TRUE;
+}
@@ -0,0 +1,86 @@
+/*
+ * Geoclue
+ * nmea-parser.h - In-place NMEA 0183 sentence parser on a ring buffer
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _NMEA_PARSER_H
+#define _NMEA_PARSER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* must be a power of two, and longer than the longest sentence (82) */
+#define NMEA_RING_SIZE 4096
+#define NMEA_RING_MASK (NMEA_RING_SIZE - 1)
+
+/* GSV has the most fields: address + 3 + 4 * 4 */
+#define NMEA_MAX_FIELDS 24
+
+typedef enum {
+	NMEA_SENTENCE_OTHER,
+	NMEA_SENTENCE_GGA,
+	NMEA_SENTENCE_RMC,
+	NMEA_SENTENCE_GSA,
+	NMEA_SENTENCE_GSV
+} NmeaSentenceType;
+
+/* Bytes are written at 'head' and consumed from 'tail'. Both count
+ * up freely and are masked on access, so head - tail is the fill. */
+typedef struct {
+	char data[NMEA_RING_SIZE];
+	guint head;
+	guint tail;
+
+	guint n_bad_checksums;
+	guint n_overruns;
+} NmeaRing;
+
+/* A sentence that is still in the ring. Fields are only located
+ * (as ring positions) when the sentence is found, and decoded when
+ * asked for. Valid until the ring is written to again. */
+typedef struct {
+	const NmeaRing *ring;
+	NmeaSentenceType type;
+	guint n_fields;
+	/* field i is ring[start[i] .. start[i + 1] - 1), the
+	 * separator (',' or '*') is not included */
+	guint start[NMEA_MAX_FIELDS + 1];
+} NmeaSentence;
+
+void nmea_ring_init (NmeaRing *ring);
+gssize nmea_ring_read (NmeaRing *ring, int fd);
+gsize nmea_ring_append (NmeaRing *ring, const char *data, gsize len);
+gboolean nmea_ring_next_sentence (NmeaRing *ring, NmeaSentence *sentence);
+
+gboolean nmea_sentence_field_is_empty (const NmeaSentence *sentence, guint field);
+char nmea_sentence_get_char (const NmeaSentence *sentence, guint field);
+gboolean nmea_sentence_field_equals (const NmeaSentence *sentence, guint field, const char *str);
+char *nmea_sentence_dup_field (const NmeaSentence *sentence, guint field);
+gboolean nmea_sentence_get_int (const NmeaSentence *sentence, guint field, int *value);
+gboolean nmea_sentence_get_double (const NmeaSentence *sentence, guint field, double *value);
+gboolean nmea_sentence_get_coordinate (const NmeaSentence *sentence, guint field, double *degrees);
+gboolean nmea_sentence_get_time (const NmeaSentence *sentence, guint field, double *seconds);
+gboolean nmea_sentence_get_date (const NmeaSentence *sentence, guint field, int *days);
+
+G_END_DECLS
+
+#endif
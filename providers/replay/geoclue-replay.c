@@ -0,0 +1,538 @@
+/*
+ * Geoclue
+ * geoclue-replay.c - Geoclue backend replaying recorded traces
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Replays an NMEA log or a binary trace (see replay-trace.c) as
+ * Position, Velocity and Address signals, for testing and as a load
+ * generator for benchmarking geoclue-master and its clients without
+ * hardware. Options:
+ *
+ * org.freedesktop.Geoclue.ReplayFile: the trace
+ * org.freedesktop.Geoclue.ReplaySpeed: factor to the recorded speed,
+ *     default 1. With 0 the records are sent as fast as the main loop
+ *     goes, one per iteration.
+ * org.freedesktop.Geoclue.ReplayRepeat: how many times to replay the
+ *     trace, default 1. 0 repeats forever.
+ *
+ * Timestamps are the time of sending, not the recorded ones, so that
+ * receivers can tell the latency. Standalone the same can be given as
+ * "geoclue-replay [file [speed [repeat]]]".
+ */
+
+#include <config.h>
+
+#include <time.h>
+#include <stdlib.h>
+
+#include <geoclue/geoclue-error.h>
+#include <geoclue/geoclue-address-details.h>
+#include <geoclue/gc-provider.h>
+#include <geoclue/gc-iface-position.h>
+#include <geoclue/gc-iface-velocity.h>
+#include <geoclue/gc-iface-address.h>
+
+#include "replay-trace.h"
+
+typedef struct {
+	GcProvider parent;
+
+	char *filename;
+	double speed_factor;
+	guint repeat;
+
+	ReplayTrace *trace;
+	guint index;
+	guint pass;
+	/* real time since the start of the pass */
+	GTimer *timer;
+	guint source_id;
+
+	GeoclueStatus status;
+
+	int timestamp;
+	GeocluePositionFields position_fields;
+	double latitude;
+	double longitude;
+	double altitude;
+	GeoclueAccuracy *accuracy;
+
+	GeoclueVelocityFields velocity_fields;
+	double speed;
+	double direction;
+	double climb;
+
+	int address_timestamp;
+	GHashTable *address;
+	GeoclueAccuracy *address_accuracy;
+
+	GMainLoop *loop;
+} GeoclueReplay;
+
+typedef struct {
+	GcProviderClass parent_class;
+} GeoclueReplayClass;
+
+static void geoclue_replay_position_init (GcIfacePositionClass *iface);
+static void geoclue_replay_velocity_init (GcIfaceVelocityClass *iface);
+static void geoclue_replay_address_init (GcIfaceAddressClass *iface);
+
+#define GEOCLUE_TYPE_REPLAY (geoclue_replay_get_type ())
+#define GEOCLUE_REPLAY(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_REPLAY, GeoclueReplay))
+
+G_DEFINE_TYPE_WITH_CODE (GeoclueReplay, geoclue_replay, GC_TYPE_PROVIDER,
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_POSITION,
+                                                geoclue_replay_position_init)
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_VELOCITY,
+                                                geoclue_replay_velocity_init)
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_ADDRESS,
+                                                geoclue_replay_address_init))
+
+static void geoclue_replay_schedule (GeoclueReplay *replay);
+
+static void
+geoclue_replay_set_status (GeoclueReplay *replay,
+                           GeoclueStatus  status)
+{
+	if (status == replay->status) {
+		return;
+	}
+	replay->status = status;
+	gc_iface_geoclue_emit_status_changed (GC_IFACE_GEOCLUE (replay), status);
+}
+
+static void
+geoclue_replay_stop (GeoclueReplay *replay)
+{
+	if (replay->source_id) {
+		g_source_remove (replay->source_id);
+		replay->source_id = 0;
+	}
+	if (replay->trace) {
+		replay_trace_free (replay->trace);
+		replay->trace = NULL;
+	}
+}
+
+static void
+geoclue_replay_send (GeoclueReplay *replay,
+                     ReplayRecord  *record)
+{
+	if (record->type == REPLAY_RECORD_ADDRESS) {
+		replay->address_timestamp = time (NULL);
+		g_hash_table_destroy (replay->address);
+		replay->address = geoclue_address_details_copy (record->address);
+		geoclue_accuracy_set_details (replay->address_accuracy,
+		                              geoclue_address_details_get_accuracy_level (replay->address),
+		                              0, 0);
+
+		gc_iface_address_emit_address_changed
+			(GC_IFACE_ADDRESS (replay), replay->address_timestamp,
+			 replay->address, replay->address_accuracy);
+		return;
+	}
+
+	replay->timestamp = time (NULL);
+
+	if (record->position_fields != GEOCLUE_POSITION_FIELDS_NONE) {
+		replay->position_fields = record->position_fields;
+		replay->latitude = record->latitude;
+		replay->longitude = record->longitude;
+		replay->altitude = record->altitude;
+		geoclue_accuracy_set_details (replay->accuracy,
+		                              GEOCLUE_ACCURACY_LEVEL_DETAILED,
+		                              record->horizontal_accuracy,
+		                              record->vertical_accuracy);
+
+		gc_iface_position_emit_position_changed
+			(GC_IFACE_POSITION (replay), replay->position_fields,
+			 replay->timestamp,
+			 replay->latitude, replay->longitude, replay->altitude,
+			 replay->accuracy);
+	}
+
+	if (record->velocity_fields != GEOCLUE_VELOCITY_FIELDS_NONE) {
+		replay->velocity_fields = record->velocity_fields;
+		replay->speed = record->speed;
+		replay->direction = record->direction;
+		replay->climb = record->climb;
+
+		gc_iface_velocity_emit_velocity_changed
+			(GC_IFACE_VELOCITY (replay), replay->velocity_fields,
+			 replay->timestamp,
+			 replay->speed, replay->direction, replay->climb);
+	}
+}
+
+/* trace time that should have been reached by now */
+static double
+geoclue_replay_get_trace_time (GeoclueReplay *replay)
+{
+	if (replay->speed_factor <= 0) {
+		/* as fast as possible: whatever is next */
+		return replay->trace->records[replay->index].time;
+	}
+	return g_timer_elapsed (replay->timer, NULL) * replay->speed_factor +
+	       replay->trace->records[0].time;
+}
+
+static gboolean
+geoclue_replay_tick (gpointer data)
+{
+	GeoclueReplay *replay = data;
+	ReplayTrace *trace = replay->trace;
+	double now;
+	double elapsed;
+
+	replay->source_id = 0;
+
+	now = geoclue_replay_get_trace_time (replay);
+	while (replay->index < trace->n_records &&
+	       trace->records[replay->index].time <= now) {
+		geoclue_replay_send (replay, &trace->records[replay->index]);
+		replay->index++;
+
+		if (replay->speed_factor <= 0) {
+			/* let the main loop send it */
+			break;
+		}
+	}
+
+	if (replay->index == trace->n_records) {
+		elapsed = g_timer_elapsed (replay->timer, NULL);
+		g_message ("Replayed %u records of %s in %.2f s (%.0f/s)",
+		           trace->n_records, replay->filename, elapsed,
+		           elapsed > 0 ? trace->n_records / elapsed : 0.0);
+
+		replay->pass++;
+		if (replay->repeat > 0 && replay->pass >= replay->repeat) {
+			/* keep the last values */
+			return FALSE;
+		}
+		replay->index = 0;
+		g_timer_start (replay->timer);
+	}
+
+	geoclue_replay_schedule (replay);
+	return FALSE;
+}
+
+static void
+geoclue_replay_schedule (GeoclueReplay *replay)
+{
+	double delay;
+
+	delay = (replay->trace->records[replay->index].time -
+	         geoclue_replay_get_trace_time (replay));
+	if (replay->speed_factor > 0) {
+		delay /= replay->speed_factor;
+	}
+
+	if (delay < 0.001) {
+		/* accelerated traces have many records per millisecond */
+		replay->source_id = g_idle_add (geoclue_replay_tick, replay);
+	} else {
+		replay->source_id = g_timeout_add ((guint) (delay * 1000),
+		                                   geoclue_replay_tick, replay);
+	}
+}
+
+static gboolean
+geoclue_replay_start (GeoclueReplay *replay,
+                      GError       **error)
+{
+	replay->trace = replay_trace_load (replay->filename, error);
+	if (!replay->trace) {
+		return FALSE;
+	}
+
+	replay->index = 0;
+	replay->pass = 0;
+	g_timer_start (replay->timer);
+	geoclue_replay_schedule (replay);
+	return TRUE;
+}
+
+static void
+geoclue_replay_configure (GeoclueReplay *replay,
+                          const char    *filename,
+                          double         speed_factor,
+                          guint          repeat,
+                          GError       **error)
+{
+	geoclue_replay_stop (replay);
+	g_free (replay->filename);
+	replay->filename = g_strdup (filename);
+	replay->speed_factor = speed_factor;
+	replay->repeat = repeat;
+
+	if (filename == NULL || *filename == '\0') {
+		geoclue_replay_set_status (replay, GEOCLUE_STATUS_UNAVAILABLE);
+	} else if (geoclue_replay_start (replay, error)) {
+		geoclue_replay_set_status (replay, GEOCLUE_STATUS_AVAILABLE);
+	} else {
+		geoclue_replay_set_status (replay, GEOCLUE_STATUS_ERROR);
+	}
+}
+
+/* options come as strings from gconf but may be numbers over D-Bus */
+static double
+get_number_option (GHashTable *options,
+                   const char *key,
+                   double      default_value)
+{
+	GValue *value;
+
+	value = g_hash_table_lookup (options, key);
+	if (value == NULL) {
+		return default_value;
+	} else if (G_VALUE_HOLDS_STRING (value)) {
+		return g_value_get_string (value) ?
+		       g_ascii_strtod (g_value_get_string (value), NULL) : default_value;
+	} else if (G_VALUE_HOLDS_INT (value)) {
+		return g_value_get_int (value);
+	} else if (G_VALUE_HOLDS_DOUBLE (value)) {
+		return g_value_get_double (value);
+	}
+	return default_value;
+}
+
+/* Geoclue interface */
+static gboolean
+get_status (GcIfaceGeoclue *gc,
+            GeoclueStatus  *status,
+            GError        **error)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (gc);
+
+	*status = replay->status;
+	return TRUE;
+}
+
+static gboolean
+set_options (GcIfaceGeoclue *gc,
+             GHashTable     *options,
+             GError        **error)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (gc);
+	GValue *file_value;
+	const char *filename;
+	double speed_factor;
+	guint repeat;
+
+	file_value = g_hash_table_lookup (options,
+	                                  "org.freedesktop.Geoclue.ReplayFile");
+	filename = file_value ? g_value_get_string (file_value) : NULL;
+	speed_factor = get_number_option (options,
+	                                  "org.freedesktop.Geoclue.ReplaySpeed", 1.0);
+	repeat = (guint) get_number_option (options,
+	                                    "org.freedesktop.Geoclue.ReplayRepeat", 1);
+
+	if (g_strcmp0 (replay->filename, filename) == 0 &&
+	    replay->speed_factor == speed_factor &&
+	    replay->repeat == repeat) {
+		return TRUE;
+	}
+
+	geoclue_replay_configure (replay, filename, speed_factor, repeat, error);
+	return replay->status != GEOCLUE_STATUS_ERROR;
+}
+
+static void
+shutdown (GcProvider *provider)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (provider);
+
+	/* only the standalone provider has a main loop to quit */
+	if (replay->loop) {
+		g_main_loop_quit (replay->loop);
+	}
+}
+
+static void
+finalize (GObject *object)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (object);
+
+	geoclue_replay_stop (replay);
+	g_timer_destroy (replay->timer);
+	g_free (replay->filename);
+	geoclue_accuracy_free (replay->accuracy);
+	geoclue_accuracy_free (replay->address_accuracy);
+	g_hash_table_destroy (replay->address);
+
+	((GObjectClass *) geoclue_replay_parent_class)->finalize (object);
+}
+
+static void
+geoclue_replay_class_init (GeoclueReplayClass *klass)
+{
+	GObjectClass *o_class = (GObjectClass *) klass;
+	GcProviderClass *p_class = (GcProviderClass *) klass;
+
+	o_class->finalize = finalize;
+
+	p_class->get_status = get_status;
+	p_class->set_options = set_options;
+	p_class->shutdown = shutdown;
+}
+
+static void
+geoclue_replay_init (GeoclueReplay *replay)
+{
+	replay->speed_factor = 1.0;
+	replay->repeat = 1;
+	replay->timer = g_timer_new ();
+	replay->status = GEOCLUE_STATUS_UNAVAILABLE;
+	replay->position_fields = GEOCLUE_POSITION_FIELDS_NONE;
+	replay->velocity_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	replay->accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0, 0);
+	replay->address = geoclue_address_details_new ();
+	replay->address_accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0, 0);
+
+	gc_provider_set_details (GC_PROVIDER (replay),
+	                         "org.freedesktop.Geoclue.Providers.Replay",
+	                         "/org/freedesktop/Geoclue/Providers/Replay",
+	                         "Replay", "Replays recorded position traces");
+}
+
+static gboolean
+get_position (GcIfacePosition       *gc,
+              GeocluePositionFields *fields,
+              int                   *timestamp,
+              double                *latitude,
+              double                *longitude,
+              double                *altitude,
+              GeoclueAccuracy      **accuracy,
+              GError               **error)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (gc);
+
+	*timestamp = replay->timestamp;
+	*latitude = replay->latitude;
+	*longitude = replay->longitude;
+	*altitude = replay->altitude;
+	*fields = replay->position_fields;
+	*accuracy = geoclue_accuracy_copy (replay->accuracy);
+
+	return TRUE;
+}
+
+static void
+geoclue_replay_position_init (GcIfacePositionClass *iface)
+{
+	iface->get_position = get_position;
+}
+
+static gboolean
+get_velocity (GcIfaceVelocity       *gc,
+              GeoclueVelocityFields *fields,
+              int                   *timestamp,
+              double                *speed,
+              double                *direction,
+              double                *climb,
+              GError               **error)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (gc);
+
+	*timestamp = replay->timestamp;
+	*speed = replay->speed;
+	*direction = replay->direction;
+	*climb = replay->climb;
+	*fields = replay->velocity_fields;
+
+	return TRUE;
+}
+
+static void
+geoclue_replay_velocity_init (GcIfaceVelocityClass *iface)
+{
+	iface->get_velocity = get_velocity;
+}
+
+static gboolean
+get_address (GcIfaceAddress   *gc,
+             int              *timestamp,
+             GHashTable      **address,
+             GeoclueAccuracy **accuracy,
+             GError          **error)
+{
+	GeoclueReplay *replay = GEOCLUE_REPLAY (gc);
+
+	if (timestamp) {
+		*timestamp = replay->address_timestamp;
+	}
+	if (address) {
+		*address = geoclue_address_details_copy (replay->address);
+	}
+	if (accuracy) {
+		*accuracy = geoclue_accuracy_copy (replay->address_accuracy);
+	}
+	return TRUE;
+}
+
+static void
+geoclue_replay_address_init (GcIfaceAddressClass *iface)
+{
+	iface->get_address = get_address;
+}
+
+#ifdef GEOCLUE_PROVIDER_PLUGIN
+
+GC_PROVIDER_PLUGIN_DEFINE (geoclue_replay_get_type)
+
+#else
+
+int
+main (int    argc,
+      char **argv)
+{
+	GeoclueReplay *replay;
+	GError *error = NULL;
+
+	g_type_init ();
+
+	replay = g_object_new (GEOCLUE_TYPE_REPLAY, NULL);
+
+	if (argc > 1) {
+		geoclue_replay_configure (replay, argv[1],
+		                          argc > 2 ? g_ascii_strtod (argv[2], NULL) : 1.0,
+		                          argc > 3 ? atoi (argv[3]) : 1,
+		                          &error);
+		if (error) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			g_object_unref (replay);
+			return 1;
+		}
+	}
+
+	replay->loop = g_main_loop_new (NULL, TRUE);
+	g_main_loop_run (replay->loop);
+
+	g_main_loop_unref (replay->loop);
+	g_object_unref (replay);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Geoclue
+ * replay-convert.c - Convert NMEA logs to binary replay traces
+ *
+ * Binary traces are about a third of the size of the NMEA log and
+ * load without parsing, which matters for long or synthetic traces.
+ *
+ * Usage: replay-convert input.nmea output.trace
+ */
+
+#include <glib-object.h>
+
+#include "replay-trace.h"
+
+int main (int argc, char **argv)
+{
+	ReplayTrace *trace;
+	GError *error = NULL;
+
+	if (argc != 3) {
+		g_printerr ("Usage: %s input output\n", argv[0]);
+		return 1;
+	}
+
+	g_type_init ();
+
+	trace = replay_trace_load (argv[1], &error);
+	if (!trace || !replay_trace_save (trace, argv[2], &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_print ("%u records, %.1f s\n", trace->n_records, trace->duration);
+	replay_trace_free (trace);
+
+	return 0;
+}
@@ -0,0 +1,492 @@
+/*
+ * Geoclue
+ * replay-trace.c - Recorded position traces for the replay provider
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * A trace is read completely when it is loaded, so that replaying it
+ * does no parsing or I/O. Two formats are understood:
+ *
+ * NMEA 0183 as logged from a receiver. GGA, RMC and GSA sentences of
+ * the same time of day make up one fix. Addresses can be added with
+ * the proprietary sentence "$PGCADR,key,value,key,value*hh".
+ *
+ * A compact binary format, little endian:
+ *   header  "GCTRACE\1"
+ *   record  guint32 time (ms from start), guint8 type,
+ *           guint8 position fields, guint8 velocity fields, guint8 0
+ *   fix     gint32 latitude, gint32 longitude (1e-7 degrees),
+ *           gint32 altitude (cm), guint16 horizontal and vertical
+ *           accuracy (dm), guint16 speed (cm/s), guint16 direction
+ *           (1/100 degrees), gint16 climb (cm/s), guint16 0
+ *   address guint16 length, "key=value\n" pairs
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <geoclue/geoclue-error.h>
+#include <geoclue/geoclue-address-details.h>
+
+#include "nmea-parser.h"
+#include "replay-trace.h"
+
+#define TRACE_MAGIC "GCTRACE\1"
+#define TRACE_MAGIC_LENGTH 8
+#define TRACE_HEADER_LENGTH 8
+#define TRACE_FIX_LENGTH 24
+
+/* see geoclue-nmea.c */
+#define NMEA_H_UERE 15.0
+#define NMEA_V_UERE 23.0
+#define NMEA_DEFAULT_H_ACCURACY 24.0
+#define NMEA_DEFAULT_V_ACCURACY 60.0
+#define KNOTS_TO_MPS 0.514444
+
+typedef struct {
+	GArray *records;
+
+	/* the fix being put together */
+	ReplayRecord fix;
+	double fix_time_of_day;
+
+	double first_time;
+	double last_time;
+	double day_offset;
+
+	int fix_mode;
+	double hdop;
+	double vdop;
+} NmeaLoader;
+
+static double
+nmea_loader_get_time (NmeaLoader *loader,
+                      double      time_of_day)
+{
+	double time;
+
+	time = loader->day_offset + time_of_day;
+	if (loader->first_time < 0) {
+		loader->first_time = time;
+	} else if (time < loader->last_time - 12 * 3600) {
+		/* past midnight */
+		loader->day_offset += 86400;
+		time += 86400;
+	}
+	loader->last_time = time;
+	return time - loader->first_time;
+}
+
+static void
+nmea_loader_flush (NmeaLoader *loader)
+{
+	ReplayRecord *fix = &loader->fix;
+
+	if (fix->position_fields != GEOCLUE_POSITION_FIELDS_NONE ||
+	    fix->velocity_fields != GEOCLUE_VELOCITY_FIELDS_NONE) {
+		fix->horizontal_accuracy = isnan (loader->hdop) ?
+			NMEA_DEFAULT_H_ACCURACY : loader->hdop * NMEA_H_UERE;
+		if (fix->position_fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) {
+			fix->vertical_accuracy = isnan (loader->vdop) ?
+				NMEA_DEFAULT_V_ACCURACY : loader->vdop * NMEA_V_UERE;
+		}
+		g_array_append_val (loader->records, *fix);
+	}
+
+	memset (fix, 0, sizeof (ReplayRecord));
+	fix->type = REPLAY_RECORD_FIX;
+	loader->fix_time_of_day = -1;
+}
+
+/* GGA and RMC of a new time of day start a new fix */
+static gboolean
+nmea_loader_start_fix (NmeaLoader         *loader,
+                       const NmeaSentence *sentence)
+{
+	double time_of_day;
+
+	if (!nmea_sentence_get_time (sentence, 1, &time_of_day)) {
+		return FALSE;
+	}
+	if (time_of_day != loader->fix_time_of_day) {
+		nmea_loader_flush (loader);
+		loader->fix_time_of_day = time_of_day;
+		loader->fix.time = nmea_loader_get_time (loader, time_of_day);
+	}
+	return TRUE;
+}
+
+static void
+nmea_loader_add_sentence (NmeaLoader         *loader,
+                          const NmeaSentence *sentence)
+{
+	ReplayRecord *fix = &loader->fix;
+	int quality;
+
+	switch (sentence->type) {
+		case NMEA_SENTENCE_GGA:
+			if (!nmea_sentence_get_int (sentence, 6, &quality) || quality == 0 ||
+			    !nmea_loader_start_fix (loader, sentence)) {
+				return;
+			}
+			if (nmea_sentence_get_coordinate (sentence, 2, &fix->latitude) &&
+			    nmea_sentence_get_coordinate (sentence, 4, &fix->longitude)) {
+				fix->position_fields |= GEOCLUE_POSITION_FIELDS_LATITUDE |
+				                        GEOCLUE_POSITION_FIELDS_LONGITUDE;
+			}
+			if (loader->fix_mode != 2 &&
+			    nmea_sentence_get_double (sentence, 9, &fix->altitude)) {
+				fix->position_fields |= GEOCLUE_POSITION_FIELDS_ALTITUDE;
+			}
+			if (loader->fix_mode == 0 &&
+			    !nmea_sentence_get_double (sentence, 8, &loader->hdop)) {
+				loader->hdop = NAN;
+			}
+			break;
+		case NMEA_SENTENCE_RMC:
+			if (nmea_sentence_get_char (sentence, 2) != 'A' ||
+			    !nmea_loader_start_fix (loader, sentence)) {
+				return;
+			}
+			if (!(fix->position_fields & GEOCLUE_POSITION_FIELDS_LATITUDE) &&
+			    nmea_sentence_get_coordinate (sentence, 3, &fix->latitude) &&
+			    nmea_sentence_get_coordinate (sentence, 5, &fix->longitude)) {
+				fix->position_fields |= GEOCLUE_POSITION_FIELDS_LATITUDE |
+				                        GEOCLUE_POSITION_FIELDS_LONGITUDE;
+			}
+			if (nmea_sentence_get_double (sentence, 7, &fix->speed)) {
+				fix->speed *= KNOTS_TO_MPS;
+				fix->velocity_fields |= GEOCLUE_VELOCITY_FIELDS_SPEED;
+			}
+			if (nmea_sentence_get_double (sentence, 8, &fix->direction)) {
+				fix->velocity_fields |= GEOCLUE_VELOCITY_FIELDS_DIRECTION;
+			}
+			break;
+		case NMEA_SENTENCE_GSA:
+			if (!nmea_sentence_get_int (sentence, 2, &loader->fix_mode)) {
+				return;
+			}
+			if (!nmea_sentence_get_double (sentence, 16, &loader->hdop)) {
+				loader->hdop = NAN;
+			}
+			if (!nmea_sentence_get_double (sentence, 17, &loader->vdop)) {
+				loader->vdop = NAN;
+			}
+			break;
+		case NMEA_SENTENCE_OTHER:
+			if (nmea_sentence_field_equals (sentence, 0, "PGCADR")) {
+				ReplayRecord address;
+				guint i;
+
+				/* at the time of the fix before it */
+				nmea_loader_flush (loader);
+				memset (&address, 0, sizeof (ReplayRecord));
+				address.type = REPLAY_RECORD_ADDRESS;
+				address.time = loader->records->len ?
+					g_array_index (loader->records, ReplayRecord,
+					               loader->records->len - 1).time : 0;
+				address.address = geoclue_address_details_new ();
+				for (i = 1; i + 1 < sentence->n_fields; i += 2) {
+					g_hash_table_insert (address.address,
+					                     nmea_sentence_dup_field (sentence, i),
+					                     nmea_sentence_dup_field (sentence, i + 1));
+				}
+				g_array_append_val (loader->records, address);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+load_nmea (GArray     *records,
+           const char *contents,
+           gsize       length)
+{
+	NmeaLoader loader;
+	NmeaRing *ring;
+	NmeaSentence sentence;
+	gsize offset = 0;
+
+	memset (&loader, 0, sizeof (NmeaLoader));
+	loader.records = records;
+	loader.first_time = -1;
+	loader.hdop = NAN;
+	loader.vdop = NAN;
+	nmea_loader_flush (&loader);
+
+	ring = g_new (NmeaRing, 1);
+	nmea_ring_init (ring);
+	while (offset < length) {
+		offset += nmea_ring_append (ring, contents + offset, length - offset);
+		while (nmea_ring_next_sentence (ring, &sentence)) {
+			nmea_loader_add_sentence (&loader, &sentence);
+		}
+	}
+	nmea_loader_flush (&loader);
+	g_free (ring);
+}
+
+static guint32
+read_uint32 (const guchar *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static guint16
+read_uint16 (const guchar *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static gboolean
+load_binary (GArray      *records,
+             const char  *contents,
+             gsize        length,
+             GError     **error)
+{
+	const guchar *p, *end;
+
+	p = (const guchar *) contents + TRACE_MAGIC_LENGTH;
+	end = (const guchar *) contents + length;
+
+	while (p + TRACE_HEADER_LENGTH <= end) {
+		ReplayRecord record;
+
+		memset (&record, 0, sizeof (ReplayRecord));
+		record.time = read_uint32 (p) / 1000.0;
+		record.type = p[4];
+		record.position_fields = p[5];
+		record.velocity_fields = p[6];
+		p += TRACE_HEADER_LENGTH;
+
+		if (record.type == REPLAY_RECORD_FIX) {
+			if (p + TRACE_FIX_LENGTH > end) {
+				break;
+			}
+			record.latitude = (gint32) read_uint32 (p) / 1e7;
+			record.longitude = (gint32) read_uint32 (p + 4) / 1e7;
+			record.altitude = (gint32) read_uint32 (p + 8) / 100.0;
+			record.horizontal_accuracy = read_uint16 (p + 12) / 10.0;
+			record.vertical_accuracy = read_uint16 (p + 14) / 10.0;
+			record.speed = read_uint16 (p + 16) / 100.0;
+			record.direction = read_uint16 (p + 18) / 100.0;
+			record.climb = (gint16) read_uint16 (p + 20) / 100.0;
+			p += TRACE_FIX_LENGTH;
+		} else if (record.type == REPLAY_RECORD_ADDRESS) {
+			char *text, **pairs;
+			guint len, i;
+
+			if (p + 2 > end || p + 2 + read_uint16 (p) > end) {
+				break;
+			}
+			len = read_uint16 (p);
+			record.address = geoclue_address_details_new ();
+			text = g_strndup ((const char *) p + 2, len);
+			pairs = g_strsplit (text, "\n", 0);
+			g_free (text);
+			for (i = 0; pairs[i]; i++) {
+				char *value = strchr (pairs[i], '=');
+
+				if (value) {
+					*value++ = '\0';
+					geoclue_address_details_insert (record.address,
+					                                pairs[i], value);
+				}
+			}
+			g_strfreev (pairs);
+			p += 2 + len;
+		} else {
+			break;
+		}
+		g_array_append_val (records, record);
+	}
+
+	if (p != end) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Broken trace record at offset %lu",
+		             (unsigned long) (p - (const guchar *) contents));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * replay_trace_load:
+ * @filename: NMEA log or binary trace
+ * @error: return location for errors
+ *
+ * Return value: the trace, or %NULL if it could not be read.
+ */
+ReplayTrace *
+replay_trace_load (const char *filename,
+                   GError    **error)
+{
+	ReplayTrace *trace;
+	GArray *records;
+	char *contents;
+	gsize length;
+
+	if (!g_file_get_contents (filename, &contents, &length, error)) {
+		return NULL;
+	}
+
+	records = g_array_new (FALSE, FALSE, sizeof (ReplayRecord));
+	if (length >= TRACE_MAGIC_LENGTH &&
+	    memcmp (contents, TRACE_MAGIC, TRACE_MAGIC_LENGTH) == 0) {
+		if (!load_binary (records, contents, length, error)) {
+			trace = g_new0 (ReplayTrace, 1);
+			trace->n_records = records->len;
+			trace->records = (ReplayRecord *) g_array_free (records, FALSE);
+			replay_trace_free (trace);
+			g_free (contents);
+			return NULL;
+		}
+	} else {
+		load_nmea (records, contents, length);
+	}
+	g_free (contents);
+
+	if (records->len == 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "No positions in %s", filename);
+		g_array_free (records, TRUE);
+		return NULL;
+	}
+
+	trace = g_new0 (ReplayTrace, 1);
+	trace->n_records = records->len;
+	trace->duration = g_array_index (records, ReplayRecord, records->len - 1).time;
+	trace->records = (ReplayRecord *) g_array_free (records, FALSE);
+	return trace;
+}
+
+static void
+append_uint32 (GString *str,
+               guint32  value)
+{
+	g_string_append_c (str, value & 0xff);
+	g_string_append_c (str, (value >> 8) & 0xff);
+	g_string_append_c (str, (value >> 16) & 0xff);
+	g_string_append_c (str, (value >> 24) & 0xff);
+}
+
+static void
+append_uint16 (GString *str,
+               guint16  value)
+{
+	g_string_append_c (str, value & 0xff);
+	g_string_append_c (str, (value >> 8) & 0xff);
+}
+
+static gint32
+round_int32 (double value)
+{
+	return (gint32) (value < 0 ? value - 0.5 : value + 0.5);
+}
+
+static guint16
+clamp_uint16 (double value)
+{
+	return (guint16) CLAMP (value + 0.5, 0, G_MAXUINT16);
+}
+
+static void
+append_address_pair (gpointer key,
+                     gpointer value,
+                     gpointer data)
+{
+	g_string_append_printf (data, "%s=%s\n",
+	                        (const char *) key, (const char *) value);
+}
+
+/**
+ * replay_trace_save:
+ * @trace: trace
+ * @filename: file to write
+ * @error: return location for errors
+ *
+ * Writes @trace in the binary format.
+ *
+ * Return value: %TRUE on success.
+ */
+gboolean
+replay_trace_save (ReplayTrace *trace,
+                   const char  *filename,
+                   GError     **error)
+{
+	GString *str, *pairs;
+	gboolean ret;
+	guint i;
+
+	str = g_string_new_len (TRACE_MAGIC, TRACE_MAGIC_LENGTH);
+	pairs = g_string_new (NULL);
+
+	for (i = 0; i < trace->n_records; i++) {
+		ReplayRecord *record = &trace->records[i];
+
+		append_uint32 (str, (guint32) (record->time * 1000 + 0.5));
+		g_string_append_c (str, record->type);
+		g_string_append_c (str, record->position_fields);
+		g_string_append_c (str, record->velocity_fields);
+		g_string_append_c (str, 0);
+
+		if (record->type == REPLAY_RECORD_FIX) {
+			append_uint32 (str, round_int32 (record->latitude * 1e7));
+			append_uint32 (str, round_int32 (record->longitude * 1e7));
+			append_uint32 (str, round_int32 (record->altitude * 100));
+			append_uint16 (str, clamp_uint16 (record->horizontal_accuracy * 10));
+			append_uint16 (str, clamp_uint16 (record->vertical_accuracy * 10));
+			append_uint16 (str, clamp_uint16 (record->speed * 100));
+			append_uint16 (str, clamp_uint16 (record->direction * 100));
+			append_uint16 (str, (gint16) CLAMP (round_int32 (record->climb * 100),
+			                                    G_MININT16, G_MAXINT16));
+			append_uint16 (str, 0);
+		} else {
+			g_string_truncate (pairs, 0);
+			g_hash_table_foreach (record->address, append_address_pair, pairs);
+			g_string_truncate (pairs, MIN (pairs->len, G_MAXUINT16));
+			append_uint16 (str, pairs->len);
+			g_string_append_len (str, pairs->str, pairs->len);
+		}
+	}
+
+	ret = g_file_set_contents (filename, str->str, str->len, error);
+
+	g_string_free (pairs, TRUE);
+	g_string_free (str, TRUE);
+	return ret;
+}
+
+void
+replay_trace_free (ReplayTrace *trace)
+{
+	guint i;
+
+	for (i = 0; i < trace->n_records; i++) {
+		if (trace->records[i].address) {
+			g_hash_table_destroy (trace->records[i].address);
+		}
+	}
+	g_free (trace->records);
+	g_free (trace);
+}
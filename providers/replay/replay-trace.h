@@ -0,0 +1,71 @@
+/*
+ * Geoclue
+ * replay-trace.h - Recorded position traces for the replay provider
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _REPLAY_TRACE_H
+#define _REPLAY_TRACE_H
+
+#include <glib.h>
+#include <geoclue/geoclue-types.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	REPLAY_RECORD_FIX = 1,
+	REPLAY_RECORD_ADDRESS = 2
+} ReplayRecordType;
+
+typedef struct {
+	ReplayRecordType type;
+	/* seconds from the start of the trace */
+	double time;
+
+	GeocluePositionFields position_fields;
+	double latitude;
+	double longitude;
+	double altitude;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+
+	GeoclueVelocityFields velocity_fields;
+	double speed;
+	double direction;
+	double climb;
+
+	/* REPLAY_RECORD_ADDRESS only */
+	GHashTable *address;
+} ReplayRecord;
+
+typedef struct {
+	ReplayRecord *records;
+	guint n_records;
+	/* time of the last record */
+	double duration;
+} ReplayTrace;
+
+ReplayTrace *replay_trace_load (const char *filename, GError **error);
+gboolean replay_trace_save (ReplayTrace *trace, const char *filename, GError **error);
+void replay_trace_free (ReplayTrace *trace);
+
+G_END_DECLS
+
+#endif
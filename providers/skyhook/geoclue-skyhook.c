@@ -23,6 +23,7 @@
 #include <geoclue/gc-iface-position.h>
 
 #include "connectivity.h"
+#include "skyhook-cache.h"
 
 #define GEOCLUE_DBUS_SERVICE_SKYHOOK "org.freedesktop.Geoclue.Providers.Skyhook"
 #define GEOCLUE_DBUS_PATH_SKYHOOK "/org/freedesktop/Geoclue/Providers/Skyhook"
@@ -35,14 +36,36 @@
 #define GEOCLUE_SKYHOOK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_SKYHOOK, GeoclueSkyhook))
 
 #define QUERY_START "<?xml version=\'1.0\'?><LocationRQ xmlns=\'http://skyhookwireless.com/wps/2005\' version=\'2.6\' street-address-lookup=\'full\'><authentication version=\'2.0\'><simple><username>beta</username><realm>js.loki.com</realm></simple></authentication>"
-#define QUERY_AP "<access-point><mac>%s</mac><signal-strength>%d</signal-strength></access-point>"
+#define QUERY_AP_START "<access-point><mac>"
+#define QUERY_AP_MIDDLE "</mac><signal-strength>"
+#define QUERY_AP_END "</signal-strength></access-point>"
 #define QUERY_END "</LocationRQ>"
+/* room for the query of a typical scan */
+#define QUERY_SIZE 4096
+
+/* recent scans whose answer can be reused */
+#define CACHE_SIZE 16
+/* seconds between checks for new access points */
+#define SCAN_INTERVAL 20
 
 typedef struct _GeoclueSkyhook {
 	GcProvider parent;
 	GMainLoop *loop;
 	SoupSession *session;
 	GeoclueConnectivity *conn;
+	SkyhookCache *cache;
+
+	/* the query in flight, other calls wait for its answer */
+	SoupMessage *pending;
+	GHashTable *pending_aps;
+	GString *query;
+	/* access points version of the last position or query */
+	guint aps_version;
+	guint scan_id;
+
+	GeocluePositionFields last_position_fields;
+	double last_lat;
+	double last_lon;
 } GeoclueSkyhook;
 
 typedef struct _GeoclueSkyhookClass {
@@ -77,38 +100,59 @@ _shutdown (GcProvider *provider)
 	g_main_loop_quit (skyhook->loop);
 }
 
+/* Appends a MAC address without the ":" */
+static void
+append_mac (GString    *str,
+            const char *mac)
+{
+	for (; *mac != '\0'; mac++) {
+		if (*mac != ':') {
+			g_string_append_c (str, *mac);
+		}
+	}
+}
+
+static void
+append_int (GString *str,
+            int      value)
+{
+	char buf[16];
+	char *p = buf + sizeof (buf);
+	guint n = ABS (value);
+
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	if (value < 0) {
+		*--p = '-';
+	}
+	g_string_append_len (str, p, buf + sizeof (buf) - p);
+}
+
 static void
 add_ap (gpointer key,
 	gpointer value,
 	gpointer data)
 {
-	char *mac;
-	char **split;
+	GString *str = data;
 
-	/* Remove the ":" */
-	split = g_strsplit (key, ":", -1);
-	mac = g_strjoinv ("", split);
-	g_strfreev (split);
-
-	g_string_append_printf (data, QUERY_AP, mac, GPOINTER_TO_INT (value));
-	g_free (mac);
+	g_string_append (str, QUERY_AP_START);
+	append_mac (str, key);
+	g_string_append (str, QUERY_AP_MIDDLE);
+	append_int (str, GPOINTER_TO_INT (value));
+	g_string_append (str, QUERY_AP_END);
 }
 
-static char *
-create_post_query (GeoclueConnectivity *conn)
+/* Builds the query in the buffer kept for it */
+static void
+create_post_query (GString    *str,
+                   GHashTable *aps)
 {
-	GHashTable *ht;
-	GString *str;
-
-	ht = geoclue_connectivity_get_aps (conn);
-	if (ht == NULL)
-		return NULL;
-	str = g_string_new (QUERY_START);
-	g_hash_table_foreach (ht, add_ap, str);
+	g_string_truncate (str, 0);
+	g_string_append (str, QUERY_START);
+	g_hash_table_foreach (aps, add_ap, str);
 	g_string_append (str, QUERY_END);
-	g_hash_table_destroy (ht);
-
-	return g_string_free (str, FALSE);
 }
 
 static gboolean
@@ -155,82 +199,181 @@ parse_response (const char *body, gdouble *latitude, gdouble *longitude)
 	return ret;
 }
 
-/* Position interface implementation */
+static void
+geoclue_skyhook_set_position (GeoclueSkyhook *skyhook,
+                              double          lat,
+                              double          lon)
+{
+	GeoclueAccuracy *accuracy;
+	GeocluePositionFields fields;
+
+	fields = GEOCLUE_POSITION_FIELDS_LATITUDE |
+	         GEOCLUE_POSITION_FIELDS_LONGITUDE;
+	if (fields == skyhook->last_position_fields &&
+	    lat == skyhook->last_lat && lon == skyhook->last_lon) {
+		return;
+	}
 
-static gboolean 
-geoclue_skyhook_get_position (GcIfacePosition        *iface,
-                             GeocluePositionFields  *fields,
-                             int                    *timestamp,
-                             double                 *latitude,
-                             double                 *longitude,
-                             double                 *altitude,
-                             GeoclueAccuracy       **accuracy,
-                             GError                **error)
+	skyhook->last_position_fields = fields;
+	skyhook->last_lat = lat;
+	skyhook->last_lon = lon;
+
+	/* Educated guess. Skyhook are typically hand pointed on
+	 * a map, or geocoded from address, so should be fairly
+	 * accurate */
+	accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_STREET, 0, 0);
+	gc_iface_position_emit_position_changed (GC_IFACE_POSITION (skyhook),
+	                                         fields, time (NULL),
+	                                         lat, lon, 0.0,
+	                                         accuracy);
+	geoclue_accuracy_free (accuracy);
+}
+
+static void
+query_done (SoupSession *session,
+            SoupMessage *msg,
+            gpointer     user_data)
+{
+	GeoclueSkyhook *skyhook = GEOCLUE_SKYHOOK (user_data);
+	GHashTable *aps;
+	double lat, lon;
+
+	aps = skyhook->pending_aps;
+	skyhook->pending_aps = NULL;
+	skyhook->pending = NULL;
+
+	if (msg->status_code == SOUP_STATUS_CANCELLED) {
+		/* shutting down */
+	} else if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code) ||
+	           msg->response_body->data == NULL) {
+		g_debug ("Failed to query web service: %s", msg->reason_phrase);
+	} else if (strstr (msg->response_body->data, "<error>") != NULL) {
+		g_debug ("Web service returned an error");
+	} else if (!parse_response (msg->response_body->data, &lat, &lon)) {
+		g_debug ("Couldn't parse response from web service");
+	} else {
+		skyhook_cache_insert (skyhook->cache, aps, lat, lon);
+		geoclue_skyhook_set_position (skyhook, lat, lon);
+	}
+
+	g_hash_table_unref (aps);
+	/* the session unrefs msg */
+}
+
+/* Starts a query for the access points, unless one is already in
+ * flight: its answer will do for both. Takes aps. Returns TRUE if
+ * the query was started. */
+static gboolean
+geoclue_skyhook_query (GeoclueSkyhook *skyhook,
+                       GHashTable     *aps)
 {
-	GeoclueSkyhook *skyhook;
-	char *query;
 	SoupMessage *msg;
-	
-	skyhook = (GEOCLUE_SKYHOOK (iface));
-	
-	*fields = GEOCLUE_POSITION_FIELDS_NONE;
-	if (timestamp)
-		*timestamp = time (NULL);
-	
-	query = create_post_query (skyhook->conn);
-	if (query == NULL) {
-		g_set_error (error, GEOCLUE_ERROR, 
-			     GEOCLUE_ERROR_NOT_AVAILABLE,
-			     "Router mac address query failed");
-		/* TODO: set status == error ? */
+
+	if (skyhook->pending) {
+		g_hash_table_unref (aps);
 		return FALSE;
 	}
 
+	create_post_query (skyhook->query, aps);
+
 	msg = soup_message_new ("POST", SKYHOOK_URL);
 	soup_message_headers_append (msg->request_headers, "User-Agent", USER_AGENT);
+	/* the buffer is not touched again before query_done */
 	soup_message_set_request (msg,
 				  "text/xml",
-				  SOUP_MEMORY_TAKE,
-				  query,
-				  strlen (query));
-	soup_session_send_message (skyhook->session, msg);
-	if (msg->response_body == NULL || msg->response_body->data == NULL) {
-		g_object_unref (msg);
-		g_set_error (error, GEOCLUE_ERROR,
+				  SOUP_MEMORY_STATIC,
+				  skyhook->query->str,
+				  skyhook->query->len);
+
+	skyhook->pending = msg;
+	skyhook->pending_aps = aps;
+	soup_session_queue_message (skyhook->session, msg, query_done, skyhook);
+	return TRUE;
+}
+
+/* Updates the position if the access points have changed, from the
+ * cache or with a query whose answer comes in a PositionChanged
+ * signal */
+static gboolean
+geoclue_skyhook_update (GeoclueSkyhook *skyhook,
+                        GError        **error)
+{
+	GHashTable *aps;
+	double lat, lon;
+	guint version;
+
+	/* the access points have not changed since the last answer, or
+	 * the query in flight */
+	version = geoclue_connectivity_get_aps_version (skyhook->conn);
+	if (version != 0 && version == skyhook->aps_version &&
+	    (skyhook->pending ||
+	     skyhook->last_position_fields != GEOCLUE_POSITION_FIELDS_NONE)) {
+		return TRUE;
+	}
+	
+	aps = geoclue_connectivity_get_aps (skyhook->conn);
+	if (aps == NULL) {
+		g_set_error (error, GEOCLUE_ERROR, 
 			     GEOCLUE_ERROR_NOT_AVAILABLE,
-			     "Failed to query web service");
+			     "Router mac address query failed");
+		/* TODO: set status == error ? */
 		return FALSE;
 	}
 
-	if (strstr (msg->response_body->data, "<error>") != NULL) {
-		g_object_unref (msg);
-		g_set_error (error, GEOCLUE_ERROR,
-			     GEOCLUE_ERROR_NOT_AVAILABLE,
-			     "Web service returned an error");
-		return FALSE;
+	/* about the same access points as a recent query */
+	if (skyhook_cache_lookup (skyhook->cache, aps, &lat, &lon)) {
+		g_hash_table_unref (aps);
+		geoclue_skyhook_set_position (skyhook, lat, lon);
+		skyhook->aps_version = version;
+	} else if (geoclue_skyhook_query (skyhook, aps)) {
+		skyhook->aps_version = version;
 	}
+	return TRUE;
+}
 
-	if (parse_response (msg->response_body->data, latitude, longitude) == FALSE) {
-		g_object_unref (msg);
-		g_set_error (error, GEOCLUE_ERROR,
-			     GEOCLUE_ERROR_NOT_AVAILABLE,
-			     "Couldn't parse response from web service");
+/* The master only calls GetPosition once and then waits for
+ * PositionChanged, so look for new access points on our own */
+static gboolean
+scan_timeout (gpointer data)
+{
+	geoclue_skyhook_update (GEOCLUE_SKYHOOK (data), NULL);
+	return TRUE;
+}
+
+/* Position interface implementation */
+
+static gboolean 
+geoclue_skyhook_get_position (GcIfacePosition        *iface,
+                             GeocluePositionFields  *fields,
+                             int                    *timestamp,
+                             double                 *latitude,
+                             double                 *longitude,
+                             double                 *altitude,
+                             GeoclueAccuracy       **accuracy,
+                             GError                **error)
+{
+	GeoclueSkyhook *skyhook;
+	
+	skyhook = (GEOCLUE_SKYHOOK (iface));
+
+	if (!geoclue_skyhook_update (skyhook, error)) {
 		return FALSE;
 	}
 
+	if (timestamp)
+		*timestamp = time (NULL);
+	if (fields)
+		*fields = skyhook->last_position_fields;
 	if (latitude)
-		*fields |= GEOCLUE_POSITION_FIELDS_LATITUDE;
+		*latitude = skyhook->last_lat;
 	if (longitude)
-		*fields |= GEOCLUE_POSITION_FIELDS_LONGITUDE;
+		*longitude = skyhook->last_lon;
 
 	if (accuracy) {
-		if (*fields == GEOCLUE_POSITION_FIELDS_NONE) {
+		if (skyhook->last_position_fields == GEOCLUE_POSITION_FIELDS_NONE) {
 			*accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE,
 							  0, 0);
 		} else {
-			/* Educated guess. Skyhook are typically hand pointed on 
-			 * a map, or geocoded from address, so should be fairly 
-			 * accurate */
 			*accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_STREET,
 							  0, 0);
 		}
@@ -244,11 +387,21 @@ geoclue_skyhook_finalize (GObject *obj)
 {
 	GeoclueSkyhook *skyhook = GEOCLUE_SKYHOOK (obj);
 
+	if (skyhook->scan_id) {
+		g_source_remove (skyhook->scan_id);
+		skyhook->scan_id = 0;
+	}
+
+	/* runs query_done for the query in flight */
+	soup_session_abort (skyhook->session);
+
 	if (skyhook->conn != NULL) {
 		g_object_unref (skyhook->conn);
 		skyhook->conn = NULL;
 	}
 	g_object_unref (skyhook->session);
+	skyhook_cache_free (skyhook->cache);
+	g_string_free (skyhook->query, TRUE);
 	
 	((GObjectClass *) geoclue_skyhook_parent_class)->finalize (obj);
 }
@@ -275,8 +428,12 @@ geoclue_skyhook_init (GeoclueSkyhook *skyhook)
 	                         GEOCLUE_DBUS_SERVICE_SKYHOOK,
 	                         GEOCLUE_DBUS_PATH_SKYHOOK,
 	                         "Skyhook", "Skyhook.com based provider, uses gateway mac address to locate");
-	skyhook->session = soup_session_sync_new ();
+	skyhook->session = soup_session_async_new ();
 	skyhook->conn = geoclue_connectivity_new ();
+	skyhook->cache = skyhook_cache_new (CACHE_SIZE);
+	skyhook->query = g_string_sized_new (QUERY_SIZE);
+	skyhook->scan_id = g_timeout_add_seconds (SCAN_INTERVAL,
+	                                          scan_timeout, skyhook);
 }
 
 static void
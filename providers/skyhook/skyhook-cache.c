@@ -0,0 +1,185 @@
+/*
+ * Geoclue
+ * skyhook-cache.c - Recent Skyhook answers by access point scan
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Skyhook answers for the most recent access point scans. A new scan
+ * reuses the answer of a cached scan that is similar enough, so a
+ * user who stays put makes next to no queries even though the signal
+ * strengths and the weakest access points change from scan to scan.
+ *
+ * Scans are GHashTables of MAC address -> signal strength in dBm
+ * (GINT_TO_POINTER), as returned by geoclue_connectivity_get_aps().
+ */
+
+#include <time.h>
+
+#include "skyhook-cache.h"
+
+/* scans at least this similar get the same answer */
+#define MIN_SIMILARITY 0.7
+/* access points do get moved: answers are not reused after this (s) */
+#define CACHE_MAX_AGE 3600
+
+typedef struct {
+	GHashTable *aps;
+	double latitude;
+	double longitude;
+	time_t fetched;
+} CacheEntry;
+
+struct _SkyhookCache {
+	guint size;
+	/* most recently used first */
+	GQueue entries;
+};
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_hash_table_unref (entry->aps);
+	g_slice_free (CacheEntry, entry);
+}
+
+SkyhookCache *
+skyhook_cache_new (guint size)
+{
+	SkyhookCache *cache;
+
+	cache = g_slice_new0 (SkyhookCache);
+	cache->size = size;
+	g_queue_init (&cache->entries);
+	return cache;
+}
+
+void
+skyhook_cache_free (SkyhookCache *cache)
+{
+	CacheEntry *entry;
+
+	while ((entry = g_queue_pop_head (&cache->entries)) != NULL) {
+		cache_entry_free (entry);
+	}
+	g_slice_free (SkyhookCache, cache);
+}
+
+/* An access point counts more the stronger it is heard: one at the
+ * noise floor may or may not show up in the next scan */
+static double
+ap_weight (gpointer dbm)
+{
+	return CLAMP (GPOINTER_TO_INT (dbm) + 100, 1, 100);
+}
+
+/* Weighted Jaccard similarity of two scans: the sum of the smaller
+ * weight of each access point over the sum of the larger one, 1.0
+ * for identical scans and 0.0 for scans with no access point in
+ * common */
+double
+skyhook_cache_get_similarity (GHashTable *a,
+                              GHashTable *b)
+{
+	GHashTableIter iter;
+	gpointer mac, dbm, other;
+	double min_sum = 0.0, max_sum = 0.0;
+
+	g_hash_table_iter_init (&iter, a);
+	while (g_hash_table_iter_next (&iter, &mac, &dbm)) {
+		double w = ap_weight (dbm);
+
+		if (g_hash_table_lookup_extended (b, mac, NULL, &other)) {
+			double w_other = ap_weight (other);
+
+			min_sum += MIN (w, w_other);
+			max_sum += MAX (w, w_other);
+		} else {
+			max_sum += w;
+		}
+	}
+
+	g_hash_table_iter_init (&iter, b);
+	while (g_hash_table_iter_next (&iter, &mac, &dbm)) {
+		if (!g_hash_table_lookup_extended (a, mac, NULL, NULL)) {
+			max_sum += ap_weight (dbm);
+		}
+	}
+
+	return max_sum > 0.0 ? min_sum / max_sum : 0.0;
+}
+
+gboolean
+skyhook_cache_lookup (SkyhookCache *cache,
+                      GHashTable   *aps,
+                      double       *latitude,
+                      double       *longitude)
+{
+	GList *l, *best = NULL;
+	double best_similarity = MIN_SIMILARITY;
+	time_t now = time (NULL);
+
+	for (l = cache->entries.head; l; l = l->next) {
+		CacheEntry *entry = l->data;
+		double similarity;
+
+		if (now - entry->fetched > CACHE_MAX_AGE) {
+			continue;
+		}
+		similarity = skyhook_cache_get_similarity (aps, entry->aps);
+		if (similarity >= best_similarity) {
+			best_similarity = similarity;
+			best = l;
+		}
+	}
+
+	if (best == NULL) {
+		return FALSE;
+	}
+
+	g_queue_unlink (&cache->entries, best);
+	g_queue_push_head_link (&cache->entries, best);
+
+	*latitude = ((CacheEntry *) best->data)->latitude;
+	*longitude = ((CacheEntry *) best->data)->longitude;
+	return TRUE;
+}
+
+void
+skyhook_cache_insert (SkyhookCache *cache,
+                      GHashTable   *aps,
+                      double        latitude,
+                      double        longitude)
+{
+	CacheEntry *entry;
+
+	entry = g_slice_new (CacheEntry);
+	/* the scan is shared: callers release theirs with
+	 * g_hash_table_unref(), as g_hash_table_destroy() would empty it */
+	entry->aps = g_hash_table_ref (aps);
+	entry->latitude = latitude;
+	entry->longitude = longitude;
+	entry->fetched = time (NULL);
+	g_queue_push_head (&cache->entries, entry);
+
+	while (g_queue_get_length (&cache->entries) > cache->size) {
+		cache_entry_free (g_queue_pop_tail (&cache->entries));
+	}
+}
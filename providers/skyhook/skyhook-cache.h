@@ -0,0 +1,50 @@
+/*
+ * Geoclue
+ * skyhook-cache.h - Recent Skyhook answers by access point scan
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _SKYHOOK_CACHE_H
+#define _SKYHOOK_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SkyhookCache SkyhookCache;
+
+SkyhookCache *skyhook_cache_new (guint size);
+void skyhook_cache_free (SkyhookCache *cache);
+
+gboolean skyhook_cache_lookup (SkyhookCache *cache,
+                               GHashTable   *aps,
+                               double       *latitude,
+                               double       *longitude);
+void skyhook_cache_insert (SkyhookCache *cache,
+                           GHashTable   *aps,
+                           double        latitude,
+                           double        longitude);
+
+double skyhook_cache_get_similarity (GHashTable *a,
+                                     GHashTable *b);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Geoclue
+ * test-skyhook-cache.c - Checks that similar scans reuse a cached answer
+ *
+ * Inserts an answer for a scan, releases the scan the way the provider
+ * does and looks up an identical, a similar and an unrelated scan.
+ */
+
+#include <config.h>
+
+#include <stdarg.h>
+
+#include "skyhook-cache.h"
+
+#define LATITUDE 60.1699
+#define LONGITUDE 24.9384
+
+static GHashTable *
+scan_new (const char *mac,
+          ...)
+{
+	GHashTable *aps;
+	va_list args;
+
+	aps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	va_start (args, mac);
+	for (; mac != NULL; mac = va_arg (args, const char *)) {
+		g_hash_table_insert (aps, g_strdup (mac),
+		                     GINT_TO_POINTER (va_arg (args, int)));
+	}
+	va_end (args);
+	return aps;
+}
+
+static gboolean
+check_lookup (SkyhookCache *cache,
+              GHashTable   *aps,
+              gboolean      expected,
+              const char   *what)
+{
+	double lat = 0.0, lon = 0.0;
+	gboolean found;
+
+	found = skyhook_cache_lookup (cache, aps, &lat, &lon);
+	g_hash_table_unref (aps);
+
+	if (found != expected ||
+	    (found && (lat != LATITUDE || lon != LONGITUDE))) {
+		g_printerr ("%s scan: %s\n", what,
+		            found ? "wrong answer from the cache" :
+		                    "not answered from the cache");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	SkyhookCache *cache;
+	GHashTable *aps;
+	gboolean ok = TRUE;
+
+	cache = skyhook_cache_new (4);
+
+	aps = scan_new ("00:11:22:33:44:55", -50,
+	                "00:11:22:33:44:66", -65,
+	                "00:11:22:33:44:77", -80,
+	                NULL);
+	skyhook_cache_insert (cache, aps, LATITUDE, LONGITUDE);
+	g_hash_table_unref (aps);
+
+	ok &= check_lookup (cache,
+	                    scan_new ("00:11:22:33:44:55", -50,
+	                              "00:11:22:33:44:66", -65,
+	                              "00:11:22:33:44:77", -80,
+	                              NULL),
+	                    TRUE, "Identical");
+	ok &= check_lookup (cache,
+	                    scan_new ("00:11:22:33:44:55", -52,
+	                              "00:11:22:33:44:66", -63,
+	                              "00:11:22:33:44:88", -95,
+	                              NULL),
+	                    TRUE, "Similar");
+	ok &= check_lookup (cache,
+	                    scan_new ("66:77:88:99:aa:bb", -50,
+	                              NULL),
+	                    FALSE, "Unrelated");
+
+	skyhook_cache_free (cache);
+
+	return ok ? 0 : 1;
+}
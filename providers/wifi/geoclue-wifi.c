@@ -0,0 +1,557 @@
+/*
+ * Geoclue
+ * geoclue-wifi.c - Self-learning WiFi fingerprint position provider
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * The provider learns where access point scans are taken from the
+ * accurate positions the GPS providers send on the bus while it runs,
+ * and locates later scans from what it learnt, without asking a web
+ * service. Only the GPS providers are trusted to say where the user
+ * is: positions from anyone else (e.g. Replay) would poison the
+ * fingerprints for good.
+ */
+
+#include <config.h>
+
+#include <time.h>
+#include <string.h>
+
+#include <glib-object.h>
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include <geoclue/gc-provider.h>
+#include <geoclue/geoclue-error.h>
+#include <geoclue/gc-iface-position.h>
+
+#include "connectivity.h"
+#include "wifi-fingerprints.h"
+
+#define GEOCLUE_DBUS_SERVICE_WIFI "org.freedesktop.Geoclue.Providers.Wifi"
+#define GEOCLUE_DBUS_PATH_WIFI "/org/freedesktop/Geoclue/Providers/Wifi"
+#define GEOCLUE_POSITION_INTERFACE "org.freedesktop.Geoclue.Position"
+/* exports the in-process providers at their own paths */
+#define GEOCLUE_MASTER_SERVICE "org.freedesktop.Geoclue.Master"
+
+#define POSITION_MATCH_RULE "type='signal',interface='" GEOCLUE_POSITION_INTERFACE "',member='PositionChanged'"
+#define OWNER_MATCH_RULE "type='signal',sender='" DBUS_SERVICE_DBUS "',interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged',arg0='%s'"
+
+/* the providers positions are learnt from, the last one is the master 
+ * that may run the others in-process */
+static const struct {
+	const char *service;
+	const char *path;
+} learn_sources[] = {
+	{ "org.freedesktop.Geoclue.Providers.Gpsd", "/org/freedesktop/Geoclue/Providers/Gpsd" },
+	{ "org.freedesktop.Geoclue.Providers.Gypsy", "/org/freedesktop/Geoclue/Providers/Gypsy" },
+	{ "org.freedesktop.Geoclue.Providers.Nmea", "/org/freedesktop/Geoclue/Providers/Nmea" },
+	{ GEOCLUE_MASTER_SERVICE, NULL }
+};
+#define N_LEARN_SOURCES G_N_ELEMENTS (learn_sources)
+
+#define FINGERPRINTS_NAME "wifi-fingerprints"
+#define FINGERPRINTS_SIZE 5000
+
+/* seconds between scans */
+#define SCAN_INTERVAL 20
+/* seconds between learnt fingerprints */
+#define LEARN_INTERVAL 10
+/* meters, positions less accurate than this are not learnt */
+#define LEARN_MAX_ACCURACY 50.0
+
+#define GEOCLUE_TYPE_WIFI (geoclue_wifi_get_type ())
+#define GEOCLUE_WIFI(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GEOCLUE_TYPE_WIFI, GeoclueWifi))
+
+typedef struct _GeoclueWifi {
+	GcProvider parent;
+	GMainLoop *loop;
+	GeoclueConnectivity *conn;
+	WifiFingerprints *fingerprints;
+	gboolean filtering;
+	/* unique names owning learn_sources */
+	char *owners[N_LEARN_SOURCES];
+	time_t last_learnt;
+	guint scan_id;
+	/* access points version of the last located scan */
+	guint aps_version;
+
+	GeocluePositionFields last_position_fields;
+	double last_lat;
+	double last_lon;
+	double last_accuracy;
+} GeoclueWifi;
+
+typedef struct _GeoclueWifiClass {
+	GcProviderClass parent_class;
+} GeoclueWifiClass;
+
+
+static void geoclue_wifi_init (GeoclueWifi *wifi);
+static void geoclue_wifi_position_init (GcIfacePositionClass  *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GeoclueWifi, geoclue_wifi, GC_TYPE_PROVIDER,
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_POSITION,
+                                                geoclue_wifi_position_init))
+
+
+/* Geoclue interface implementation */
+static gboolean
+geoclue_wifi_get_status (GcIfaceGeoclue *iface,
+                         GeoclueStatus  *status,
+                         GError        **error)
+{
+	GeoclueWifi *wifi = GEOCLUE_WIFI (iface);
+
+	if (wifi->conn == NULL) {
+		*status = GEOCLUE_STATUS_ERROR;
+	} else if (wifi->last_position_fields == GEOCLUE_POSITION_FIELDS_NONE) {
+		*status = GEOCLUE_STATUS_ACQUIRING;
+	} else {
+		*status = GEOCLUE_STATUS_AVAILABLE;
+	}
+	return TRUE;
+}
+
+static void
+shutdown (GcProvider *provider)
+{
+	GeoclueWifi *wifi = GEOCLUE_WIFI (provider);
+	g_main_loop_quit (wifi->loop);
+}
+
+static void
+geoclue_wifi_set_position (GeoclueWifi          *wifi,
+                           GeocluePositionFields fields,
+                           double                lat,
+                           double                lon,
+                           double                accuracy)
+{
+	GeoclueAccuracy *acc;
+
+	if (fields == wifi->last_position_fields &&
+	    (fields == GEOCLUE_POSITION_FIELDS_NONE ||
+	     (lat == wifi->last_lat &&
+	      lon == wifi->last_lon &&
+	      accuracy == wifi->last_accuracy))) {
+		return;
+	}
+
+	wifi->last_position_fields = fields;
+	wifi->last_lat = lat;
+	wifi->last_lon = lon;
+	wifi->last_accuracy = accuracy;
+
+	acc = geoclue_accuracy_new (fields == GEOCLUE_POSITION_FIELDS_NONE ?
+	                            GEOCLUE_ACCURACY_LEVEL_NONE :
+	                            GEOCLUE_ACCURACY_LEVEL_STREET,
+	                            accuracy, 0.0);
+	gc_iface_position_emit_position_changed (GC_IFACE_POSITION (wifi),
+	                                         fields,
+	                                         time (NULL),
+	                                         lat, lon, 0.0,
+	                                         acc);
+	geoclue_accuracy_free (acc);
+}
+
+static void
+geoclue_wifi_locate (GeoclueWifi *wifi)
+{
+	GHashTable *aps;
+	double lat, lon, accuracy;
+	guint version;
+
+	if (wifi->conn == NULL) {
+		return;
+	}
+
+	version = geoclue_connectivity_get_aps_version (wifi->conn);
+	if (version != 0 && version == wifi->aps_version) {
+		return;
+	}
+
+	aps = geoclue_connectivity_get_aps (wifi->conn);
+	if (aps == NULL) {
+		return;
+	}
+	wifi->aps_version = version;
+
+	/* somewhere not learnt yet keeps the old position, it is the
+	 * best guess there is */
+	if (wifi_fingerprints_locate (wifi->fingerprints, aps,
+	                              &lat, &lon, &accuracy)) {
+		geoclue_wifi_set_position (wifi,
+		                           GEOCLUE_POSITION_FIELDS_LATITUDE |
+		                           GEOCLUE_POSITION_FIELDS_LONGITUDE,
+		                           lat, lon, accuracy);
+	}
+	g_hash_table_unref (aps);
+}
+
+static gboolean
+scan_timeout (gpointer data)
+{
+	geoclue_wifi_locate (GEOCLUE_WIFI (data));
+	return TRUE;
+}
+
+static void
+geoclue_wifi_learn (GeoclueWifi *wifi,
+                    double       lat,
+                    double       lon)
+{
+	GHashTable *aps;
+	time_t now;
+
+	now = time (NULL);
+	if (wifi->conn == NULL || now - wifi->last_learnt < LEARN_INTERVAL) {
+		return;
+	}
+
+	aps = geoclue_connectivity_get_aps (wifi->conn);
+	if (aps == NULL) {
+		return;
+	}
+	wifi_fingerprints_learn (wifi->fingerprints, aps, lat, lon);
+	g_hash_table_unref (aps);
+	wifi->last_learnt = now;
+	/* the same scan may be located now */
+	wifi->aps_version = 0;
+}
+
+/* Reads a PositionChanged (i fields, i timestamp, d latitude,
+ * d longitude, d altitude, (i level, d horizontal, d vertical)) */
+static gboolean
+parse_position_changed (DBusMessage *message,
+                        double      *lat,
+                        double      *lon,
+                        double      *accuracy)
+{
+	DBusMessageIter iter, acc_iter;
+	dbus_int32_t fields, level;
+
+	if (!dbus_message_has_signature (message, "iiddd(idd)")) {
+		return FALSE;
+	}
+
+	dbus_message_iter_init (message, &iter);
+	dbus_message_iter_get_basic (&iter, &fields);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_get_basic (&iter, lat);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_get_basic (&iter, lon);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_recurse (&iter, &acc_iter);
+	dbus_message_iter_get_basic (&acc_iter, &level);
+	dbus_message_iter_next (&acc_iter);
+	dbus_message_iter_get_basic (&acc_iter, accuracy);
+
+	return (fields & GEOCLUE_POSITION_FIELDS_LATITUDE) &&
+	       (fields & GEOCLUE_POSITION_FIELDS_LONGITUDE) &&
+	       level >= GEOCLUE_ACCURACY_LEVEL_DETAILED;
+}
+
+/* Unique name owning 'service', NULL if none */
+static char *
+get_name_owner (DBusConnection *connection,
+                const char     *service)
+{
+	DBusMessage *message, *reply;
+	const char *owner;
+	char *ret = NULL;
+
+	message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+	                                        DBUS_PATH_DBUS,
+	                                        DBUS_INTERFACE_DBUS,
+	                                        "GetNameOwner");
+	dbus_message_append_args (message,
+	                          DBUS_TYPE_STRING, &service,
+	                          DBUS_TYPE_INVALID);
+	reply = dbus_connection_send_with_reply_and_block (connection, message,
+	                                                   -1, NULL);
+	dbus_message_unref (message);
+	if (reply == NULL) {
+		/* not running */
+		return NULL;
+	}
+	if (dbus_message_get_args (reply, NULL,
+	                           DBUS_TYPE_STRING, &owner,
+	                           DBUS_TYPE_INVALID)) {
+		ret = g_strdup (owner);
+	}
+	dbus_message_unref (reply);
+	return ret;
+}
+
+static void
+name_owner_changed (GeoclueWifi *wifi,
+                    DBusMessage *message)
+{
+	const char *name, *old_owner, *new_owner;
+	guint i;
+
+	if (!dbus_message_get_args (message, NULL,
+	                            DBUS_TYPE_STRING, &name,
+	                            DBUS_TYPE_STRING, &old_owner,
+	                            DBUS_TYPE_STRING, &new_owner,
+	                            DBUS_TYPE_INVALID)) {
+		return;
+	}
+	for (i = 0; i < N_LEARN_SOURCES; i++) {
+		if (strcmp (name, learn_sources[i].service) == 0) {
+			g_free (wifi->owners[i]);
+			wifi->owners[i] = *new_owner ? g_strdup (new_owner) : NULL;
+		}
+	}
+}
+
+/* TRUE if 'sender' is a GPS provider, out of process or in the master */
+static gboolean
+is_learn_source (GeoclueWifi *wifi,
+                 const char  *sender,
+                 const char  *path)
+{
+	const char *master = wifi->owners[N_LEARN_SOURCES - 1];
+	guint i;
+
+	if (sender == NULL || path == NULL) {
+		return FALSE;
+	}
+	for (i = 0; i < N_LEARN_SOURCES - 1; i++) {
+		if (strcmp (path, learn_sources[i].path) == 0) {
+			return g_strcmp0 (sender, wifi->owners[i]) == 0 ||
+			       g_strcmp0 (sender, master) == 0;
+		}
+	}
+	return FALSE;
+}
+
+/* Learns from the accurate positions of the GPS providers */
+static DBusHandlerResult
+position_filter (DBusConnection *connection,
+                 DBusMessage    *message,
+                 void           *user_data)
+{
+	GeoclueWifi *wifi = GEOCLUE_WIFI (user_data);
+	double lat, lon, accuracy;
+
+	if (dbus_message_is_signal (message, DBUS_INTERFACE_DBUS,
+	                            "NameOwnerChanged") &&
+	    g_strcmp0 (dbus_message_get_sender (message), DBUS_SERVICE_DBUS) == 0) {
+		name_owner_changed (wifi, message);
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	if (!dbus_message_is_signal (message, GEOCLUE_POSITION_INTERFACE,
+	                             "PositionChanged") ||
+	    !is_learn_source (wifi, dbus_message_get_sender (message),
+	                      dbus_message_get_path (message))) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	/* an accuracy of 0 is not known, the level is enough then */
+	if (parse_position_changed (message, &lat, &lon, &accuracy) &&
+	    accuracy <= LEARN_MAX_ACCURACY) {
+		geoclue_wifi_learn (wifi, lat, lon);
+	}
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Position interface implementation */
+
+static gboolean
+geoclue_wifi_get_position (GcIfacePosition        *iface,
+                           GeocluePositionFields  *fields,
+                           int                    *timestamp,
+                           double                 *latitude,
+                           double                 *longitude,
+                           double                 *altitude,
+                           GeoclueAccuracy       **accuracy,
+                           GError                **error)
+{
+	GeoclueWifi *wifi = GEOCLUE_WIFI (iface);
+
+	if (wifi->conn == NULL) {
+		g_set_error (error, GEOCLUE_ERROR,
+		             GEOCLUE_ERROR_NOT_AVAILABLE,
+		             "No access point information available");
+		return FALSE;
+	}
+
+	geoclue_wifi_locate (wifi);
+
+	if (timestamp) {
+		*timestamp = time (NULL);
+	}
+	if (fields) {
+		*fields = wifi->last_position_fields;
+	}
+	if (latitude) {
+		*latitude = wifi->last_lat;
+	}
+	if (longitude) {
+		*longitude = wifi->last_lon;
+	}
+	if (accuracy) {
+		*accuracy = geoclue_accuracy_new (wifi->last_position_fields == GEOCLUE_POSITION_FIELDS_NONE ?
+		                                  GEOCLUE_ACCURACY_LEVEL_NONE :
+		                                  GEOCLUE_ACCURACY_LEVEL_STREET,
+		                                  wifi->last_accuracy, 0);
+	}
+
+	return TRUE;
+}
+
+static void
+geoclue_wifi_dispose (GObject *obj)
+{
+	GeoclueWifi *wifi = GEOCLUE_WIFI (obj);
+	GcProvider *provider = GC_PROVIDER (obj);
+	guint i;
+
+	if (wifi->filtering) {
+		DBusConnection *connection;
+
+		connection = dbus_g_connection_get_connection (provider->connection);
+		dbus_connection_remove_filter (connection, position_filter, wifi);
+		dbus_bus_remove_match (connection, POSITION_MATCH_RULE, NULL);
+		for (i = 0; i < N_LEARN_SOURCES; i++) {
+			char *rule;
+
+			rule = g_strdup_printf (OWNER_MATCH_RULE,
+			                        learn_sources[i].service);
+			dbus_bus_remove_match (connection, rule, NULL);
+			g_free (rule);
+			g_free (wifi->owners[i]);
+			wifi->owners[i] = NULL;
+		}
+		wifi->filtering = FALSE;
+	}
+
+	if (wifi->scan_id) {
+		g_source_remove (wifi->scan_id);
+		wifi->scan_id = 0;
+	}
+
+	if (wifi->conn != NULL) {
+		g_object_unref (wifi->conn);
+		wifi->conn = NULL;
+	}
+
+	/* saves what was learnt */
+	if (wifi->fingerprints) {
+		wifi_fingerprints_free (wifi->fingerprints);
+		wifi->fingerprints = NULL;
+	}
+
+	((GObjectClass *) geoclue_wifi_parent_class)->dispose (obj);
+}
+
+
+/* Initialization */
+
+static void
+geoclue_wifi_class_init (GeoclueWifiClass *klass)
+{
+	GcProviderClass *p_class = (GcProviderClass *)klass;
+	GObjectClass *o_class = (GObjectClass *)klass;
+
+	p_class->shutdown = shutdown;
+	p_class->get_status = geoclue_wifi_get_status;
+
+	o_class->dispose = geoclue_wifi_dispose;
+}
+
+static void
+geoclue_wifi_init (GeoclueWifi *wifi)
+{
+	GcProvider *provider = GC_PROVIDER (wifi);
+	char *dir, *filename;
+	guint i;
+
+	gc_provider_set_details (provider,
+	                         GEOCLUE_DBUS_SERVICE_WIFI,
+	                         GEOCLUE_DBUS_PATH_WIFI,
+	                         "Wifi", "Locates access point scans from the positions of other providers");
+
+	dir = g_build_filename (g_get_user_data_dir (), "geoclue", NULL);
+	g_mkdir_with_parents (dir, 0700);
+	filename = g_build_filename (dir, FINGERPRINTS_NAME, NULL);
+	wifi->fingerprints = wifi_fingerprints_new (filename, FINGERPRINTS_SIZE);
+	g_free (filename);
+	g_free (dir);
+
+	wifi->conn = geoclue_connectivity_new ();
+	if (wifi->conn == NULL) {
+		return;
+	}
+
+	if (provider->connection) {
+		DBusConnection *connection;
+
+		connection = dbus_g_connection_get_connection (provider->connection);
+		/* watch the owners before asking for them, not to miss a 
+		 * change in between */
+		for (i = 0; i < N_LEARN_SOURCES; i++) {
+			char *rule;
+
+			rule = g_strdup_printf (OWNER_MATCH_RULE,
+			                        learn_sources[i].service);
+			dbus_bus_add_match (connection, rule, NULL);
+			g_free (rule);
+		}
+		dbus_bus_add_match (connection, POSITION_MATCH_RULE, NULL);
+		dbus_connection_add_filter (connection, position_filter, wifi, NULL);
+		for (i = 0; i < N_LEARN_SOURCES; i++) {
+			wifi->owners[i] = get_name_owner (connection,
+			                                  learn_sources[i].service);
+		}
+		wifi->filtering = TRUE;
+	}
+
+	wifi->scan_id = g_timeout_add_seconds (SCAN_INTERVAL, scan_timeout, wifi);
+	geoclue_wifi_locate (wifi);
+}
+
+static void
+geoclue_wifi_position_init (GcIfacePositionClass  *iface)
+{
+	iface->get_position = geoclue_wifi_get_position;
+}
+
+int
+main()
+{
+	g_type_init();
+
+	GeoclueWifi *o = g_object_new (GEOCLUE_TYPE_WIFI, NULL);
+	o->loop = g_main_loop_new (NULL, TRUE);
+
+	g_main_loop_run (o->loop);
+
+	g_main_loop_unref (o->loop);
+	g_object_unref (o);
+
+	return 0;
+}
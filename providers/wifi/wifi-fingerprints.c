@@ -0,0 +1,666 @@
+/*
+ * Geoclue
+ * wifi-fingerprints.c - Access point scans recorded at known positions
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Fingerprints are access point scans taken where a GPS fix said the
+ * receiver was. A new scan is located with the k nearest fingerprints
+ * in signal space, found through an index of fingerprints by access
+ * point. Scans are GHashTables of MAC address -> signal strength in
+ * dBm (GINT_TO_POINTER), as returned by geoclue_connectivity_get_aps().
+ *
+ * The file keeps the index: the fingerprints, oldest first, then one
+ * entry per access point in each fingerprint sorted by MAC address,
+ * little endian:
+ *   header       "GCWIFIF\1", guint32 number of fingerprints,
+ *                guint32 number of entries
+ *   fingerprint  gint32 latitude, gint32 longitude (1e-7 degrees),
+ *                guint32 time recorded, guint32 0
+ *   entry        guint32 low and guint16 high bits of the MAC address,
+ *                gint8 signal strength (dBm), guint8 0,
+ *                guint32 fingerprint
+ */
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <geoclue/gc-geo.h>
+
+#include "wifi-fingerprints.h"
+
+#define DB_MAGIC "GCWIFIF\1"
+#define DB_MAGIC_LENGTH 8
+#define DB_HEADER_LENGTH 16
+#define DB_FINGERPRINT_LENGTH 16
+#define DB_ENTRY_LENGTH 12
+
+/* changes are saved this long (s) after the first one */
+#define DB_SAVE_DELAY 60
+
+/* strongest access points kept from a scan */
+#define MAX_SAMPLES 32
+/* a fingerprint this close (m) to the last one adds nothing */
+#define MIN_SPACING 10.0
+/* dBm of an access point missing from a scan */
+#define MISSING_RSSI -100
+/* fingerprints needing fewer access points in common are ignored */
+#define MIN_COMMON 2
+#define K_NEAREST 4
+/* meters, error of a position from a single perfect match */
+#define FINGERPRINT_ERROR 20.0
+
+typedef struct {
+	guint64 bssid;
+	int rssi;
+} Sample;
+
+typedef struct {
+	double latitude;
+	double longitude;
+	guint32 recorded;
+	guint first; /* in db->samples */
+	guint n_samples;
+} Fingerprint;
+
+struct _WifiFingerprints {
+	char *filename;
+	guint size;
+
+	GArray *fingerprints; /* oldest first */
+	GArray *samples;
+	/* guint64 bssid -> GArray of fingerprint indices */
+	GHashTable *index;
+
+	guint save_id;
+};
+
+static guint32
+read_uint32 (const guchar *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static void
+append_uint32 (GString *str, guint32 value)
+{
+	g_string_append_c (str, value & 0xff);
+	g_string_append_c (str, (value >> 8) & 0xff);
+	g_string_append_c (str, (value >> 16) & 0xff);
+	g_string_append_c (str, (value >> 24) & 0xff);
+}
+
+static gboolean
+parse_bssid (const char *mac, guint64 *bssid)
+{
+	int i;
+
+	*bssid = 0;
+	for (i = 0; i < 6; i++) {
+		int hi, lo;
+
+		hi = g_ascii_xdigit_value (mac[0]);
+		lo = hi < 0 ? -1 : g_ascii_xdigit_value (mac[1]);
+		if (lo < 0 || (i < 5 ? mac[2] != ':' : mac[2] != '\0')) {
+			return FALSE;
+		}
+		*bssid = (*bssid << 8) | (hi << 4) | lo;
+		mac += 3;
+	}
+	return TRUE;
+}
+
+static int
+compare_samples_by_rssi (gconstpointer a, gconstpointer b)
+{
+	return ((const Sample *) b)->rssi - ((const Sample *) a)->rssi;
+}
+
+/* The strongest access points of a scan, strongest first */
+static GArray *
+scan_get_samples (GHashTable *aps)
+{
+	GArray *samples;
+	GHashTableIter iter;
+	gpointer mac, dbm;
+
+	samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+	g_hash_table_iter_init (&iter, aps);
+	while (g_hash_table_iter_next (&iter, &mac, &dbm)) {
+		Sample sample;
+
+		if (parse_bssid (mac, &sample.bssid)) {
+			sample.rssi = CLAMP (GPOINTER_TO_INT (dbm), -127, 0);
+			g_array_append_val (samples, sample);
+		}
+	}
+	g_array_sort (samples, compare_samples_by_rssi);
+	if (samples->len > MAX_SAMPLES) {
+		g_array_set_size (samples, MAX_SAMPLES);
+	}
+	return samples;
+}
+
+static double
+get_distance (double lat1, double lon1, double lat2, double lon2)
+{
+	double dx, dy;
+
+	dx = (lon1 - lon2) * GC_METERS_PER_DEGREE *
+	     cos ((lat1 + lat2) * G_PI / 360.0);
+	dy = (lat1 - lat2) * GC_METERS_PER_DEGREE;
+	return sqrt (dx * dx + dy * dy);
+}
+
+static void
+index_free (GArray *fingerprints)
+{
+	g_array_free (fingerprints, TRUE);
+}
+
+static GArray *
+wifi_fingerprints_get_index (WifiFingerprints *db, guint64 bssid)
+{
+	GArray *fingerprints;
+	guint64 *key;
+
+	fingerprints = g_hash_table_lookup (db->index, &bssid);
+	if (fingerprints == NULL) {
+		key = g_new (guint64, 1);
+		*key = bssid;
+		fingerprints = g_array_new (FALSE, FALSE, sizeof (guint));
+		g_hash_table_insert (db->index, key, fingerprints);
+	}
+	return fingerprints;
+}
+
+static void
+wifi_fingerprints_index (WifiFingerprints *db, guint i)
+{
+	Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint, i);
+	guint j;
+
+	for (j = fp->first; j < fp->first + fp->n_samples; j++) {
+		Sample *sample = &g_array_index (db->samples, Sample, j);
+
+		g_array_append_val (wifi_fingerprints_get_index (db, sample->bssid), i);
+	}
+}
+
+/* Forgets the 'n' oldest fingerprints */
+static void
+wifi_fingerprints_forget (WifiFingerprints *db, guint n)
+{
+	guint first_sample, i;
+
+	n = MIN (n, db->fingerprints->len);
+	if (n == 0) {
+		return;
+	}
+
+	if (n < db->fingerprints->len) {
+		first_sample = g_array_index (db->fingerprints, Fingerprint, n).first;
+	} else {
+		first_sample = db->samples->len;
+	}
+	g_array_remove_range (db->fingerprints, 0, n);
+	g_array_remove_range (db->samples, 0, first_sample);
+
+	g_hash_table_remove_all (db->index);
+	for (i = 0; i < db->fingerprints->len; i++) {
+		g_array_index (db->fingerprints, Fingerprint, i).first -= first_sample;
+		wifi_fingerprints_index (db, i);
+	}
+}
+
+static void
+wifi_fingerprints_load (WifiFingerprints *db)
+{
+	char *contents;
+	gsize length;
+	const guchar *p, *entries;
+	guint n_fingerprints, n_entries, i;
+	guint *fill;
+
+	if (!g_file_get_contents (db->filename, &contents, &length, NULL)) {
+		return;
+	}
+
+	if (length < DB_HEADER_LENGTH ||
+	    memcmp (contents, DB_MAGIC, DB_MAGIC_LENGTH) != 0) {
+		g_warning ("Ignoring invalid fingerprint database %s", db->filename);
+		g_free (contents);
+		return;
+	}
+
+	p = (const guchar *) contents + DB_MAGIC_LENGTH;
+	n_fingerprints = MIN (read_uint32 (p),
+	                      (length - DB_HEADER_LENGTH) / DB_FINGERPRINT_LENGTH);
+	n_entries = MIN (read_uint32 (p + 4),
+	                 (length - DB_HEADER_LENGTH -
+	                  n_fingerprints * DB_FINGERPRINT_LENGTH) / DB_ENTRY_LENGTH);
+
+	p = (const guchar *) contents + DB_HEADER_LENGTH;
+	entries = p + n_fingerprints * DB_FINGERPRINT_LENGTH;
+
+	g_array_set_size (db->fingerprints, n_fingerprints);
+	for (i = 0; i < n_fingerprints; i++, p += DB_FINGERPRINT_LENGTH) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint, i);
+
+		fp->latitude = (gint32) read_uint32 (p) / 1e7;
+		fp->longitude = (gint32) read_uint32 (p + 4) / 1e7;
+		fp->recorded = read_uint32 (p + 8);
+		fp->first = 0;
+		fp->n_samples = 0;
+	}
+
+	/* samples are kept grouped by fingerprint, the entries are
+	 * already in index order */
+	for (i = 0, p = entries; i < n_entries; i++, p += DB_ENTRY_LENGTH) {
+		guint fp = read_uint32 (p + 8);
+
+		if (fp < n_fingerprints) {
+			g_array_index (db->fingerprints, Fingerprint, fp).n_samples++;
+		}
+	}
+	fill = g_new (guint, n_fingerprints);
+	for (i = 0; i < n_fingerprints; i++) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint, i);
+
+		fp->first = db->samples->len;
+		fill[i] = fp->first;
+		g_array_set_size (db->samples, db->samples->len + fp->n_samples);
+	}
+
+	for (i = 0, p = entries; i < n_entries; i++, p += DB_ENTRY_LENGTH) {
+		guint fp = read_uint32 (p + 8);
+		Sample *sample;
+
+		if (fp >= n_fingerprints) {
+			continue;
+		}
+		sample = &g_array_index (db->samples, Sample, fill[fp]++);
+		sample->bssid = read_uint32 (p) | ((guint64) (p[4] | (p[5] << 8)) << 32);
+		sample->rssi = (gint8) p[6];
+		g_array_append_val (wifi_fingerprints_get_index (db, sample->bssid), fp);
+	}
+	g_free (fill);
+	g_free (contents);
+
+	if (db->fingerprints->len > db->size) {
+		wifi_fingerprints_forget (db, db->fingerprints->len - db->size);
+	}
+}
+
+static gboolean
+save_timeout (gpointer data)
+{
+	WifiFingerprints *db = data;
+	GError *error = NULL;
+
+	db->save_id = 0;
+	if (!wifi_fingerprints_save (db, &error)) {
+		g_warning ("Could not save fingerprint database: %s", error->message);
+		g_error_free (error);
+	}
+	return FALSE;
+}
+
+/**
+ * wifi_fingerprints_new:
+ * @filename: file the fingerprints are loaded from and saved to
+ * @size: number of fingerprints to remember
+ *
+ * Return value: a new fingerprint database with the fingerprints
+ * saved in @filename.
+ */
+WifiFingerprints *
+wifi_fingerprints_new (const char *filename,
+                       guint       size)
+{
+	WifiFingerprints *db;
+
+	db = g_slice_new0 (WifiFingerprints);
+	db->filename = g_strdup (filename);
+	db->size = MAX (size, 1);
+	db->fingerprints = g_array_new (FALSE, FALSE, sizeof (Fingerprint));
+	db->samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+	db->index = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+	                                   g_free, (GDestroyNotify) index_free);
+
+	wifi_fingerprints_load (db);
+	return db;
+}
+
+/* Saves unsaved changes and frees the database */
+void
+wifi_fingerprints_free (WifiFingerprints *db)
+{
+	if (db->save_id) {
+		g_source_remove (db->save_id);
+		save_timeout (db);
+	}
+	g_hash_table_destroy (db->index);
+	g_array_free (db->samples, TRUE);
+	g_array_free (db->fingerprints, TRUE);
+	g_free (db->filename);
+	g_slice_free (WifiFingerprints, db);
+}
+
+/* Records a scan taken at a known position. The oldest quarter of the
+ * fingerprints is forgotten when the database is full. */
+void
+wifi_fingerprints_learn (WifiFingerprints *db,
+                         GHashTable       *aps,
+                         double            latitude,
+                         double            longitude)
+{
+	GArray *samples;
+	Fingerprint fp;
+
+	if (db->fingerprints->len > 0) {
+		Fingerprint *last = &g_array_index (db->fingerprints, Fingerprint,
+		                                    db->fingerprints->len - 1);
+
+		if (get_distance (last->latitude, last->longitude,
+		                  latitude, longitude) < MIN_SPACING) {
+			return;
+		}
+	}
+
+	samples = scan_get_samples (aps);
+	if (samples->len == 0) {
+		g_array_free (samples, TRUE);
+		return;
+	}
+
+	if (db->fingerprints->len >= db->size) {
+		wifi_fingerprints_forget (db, MAX (db->size / 4, 1));
+	}
+
+	fp.latitude = latitude;
+	fp.longitude = longitude;
+	fp.recorded = time (NULL);
+	fp.first = db->samples->len;
+	fp.n_samples = samples->len;
+	g_array_append_vals (db->samples, samples->data, samples->len);
+	g_array_append_val (db->fingerprints, fp);
+	wifi_fingerprints_index (db, db->fingerprints->len - 1);
+	g_array_free (samples, TRUE);
+
+	if (db->save_id == 0) {
+		db->save_id = g_timeout_add_seconds (DB_SAVE_DELAY,
+		                                     save_timeout, db);
+	}
+}
+
+typedef struct {
+	guint fingerprint;
+	double distance;
+} Neighbour;
+
+/* Locates a scan with the K_NEAREST fingerprints that share access
+ * points with it, nearest by RMS signal difference over the access
+ * points of both (a missing one counts as MISSING_RSSI), weighted by
+ * 1 / (1 + distance). The accuracy is the weighted spread of their
+ * positions, plus FINGERPRINT_ERROR. */
+gboolean
+wifi_fingerprints_locate (WifiFingerprints *db,
+                          GHashTable       *aps,
+                          double           *latitude,
+                          double           *longitude,
+                          double           *accuracy)
+{
+	GArray *samples;
+	GHashTable *scan, *candidates;
+	GHashTableIter iter;
+	gpointer key, value;
+	Neighbour nearest[K_NEAREST];
+	guint n_nearest = 0, min_common, i, j;
+	double missing = 0.0, lat = 0.0, lon = 0.0, sum = 0.0, spread = 0.0;
+
+	samples = scan_get_samples (aps);
+	if (samples->len == 0) {
+		g_array_free (samples, TRUE);
+		return FALSE;
+	}
+	min_common = MIN (MIN_COMMON, samples->len);
+
+	/* bssid -> Sample, and fingerprint -> access points in common */
+	scan = g_hash_table_new (g_int64_hash, g_int64_equal);
+	candidates = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = 0; i < samples->len; i++) {
+		Sample *sample = &g_array_index (samples, Sample, i);
+		GArray *fingerprints;
+
+		g_hash_table_insert (scan, &sample->bssid, sample);
+		missing += (sample->rssi - MISSING_RSSI) * (sample->rssi - MISSING_RSSI);
+
+		fingerprints = g_hash_table_lookup (db->index, &sample->bssid);
+		for (j = 0; fingerprints && j < fingerprints->len; j++) {
+			key = GUINT_TO_POINTER (g_array_index (fingerprints, guint, j));
+			value = g_hash_table_lookup (candidates, key);
+			g_hash_table_insert (candidates, key,
+			                     GUINT_TO_POINTER (GPOINTER_TO_UINT (value) + 1));
+		}
+	}
+
+	g_hash_table_iter_init (&iter, candidates);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		Fingerprint *fp;
+		Neighbour neighbour;
+		guint common = GPOINTER_TO_UINT (value);
+		double d2 = missing;
+
+		if (common < min_common) {
+			continue;
+		}
+
+		neighbour.fingerprint = GPOINTER_TO_UINT (key);
+		fp = &g_array_index (db->fingerprints, Fingerprint, neighbour.fingerprint);
+		for (j = fp->first; j < fp->first + fp->n_samples; j++) {
+			Sample *sample = &g_array_index (db->samples, Sample, j);
+			Sample *match = g_hash_table_lookup (scan, &sample->bssid);
+
+			if (match) {
+				d2 += (match->rssi - sample->rssi) * (match->rssi - sample->rssi) -
+				      (match->rssi - MISSING_RSSI) * (match->rssi - MISSING_RSSI);
+			} else {
+				d2 += (sample->rssi - MISSING_RSSI) * (sample->rssi - MISSING_RSSI);
+			}
+		}
+		neighbour.distance = sqrt (MAX (d2, 0.0) /
+		                           (samples->len + fp->n_samples - common));
+
+		/* insertion into the sorted nearest list */
+		for (j = n_nearest; j > 0 && nearest[j - 1].distance > neighbour.distance; j--) {
+			if (j < K_NEAREST) {
+				nearest[j] = nearest[j - 1];
+			}
+		}
+		if (j < K_NEAREST) {
+			nearest[j] = neighbour;
+			n_nearest = MIN (n_nearest + 1, K_NEAREST);
+		}
+	}
+
+	g_hash_table_destroy (candidates);
+	g_hash_table_destroy (scan);
+	g_array_free (samples, TRUE);
+
+	if (n_nearest == 0) {
+		return FALSE;
+	}
+
+	for (i = 0; i < n_nearest; i++) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint,
+		                                  nearest[i].fingerprint);
+		double w = 1.0 / (1.0 + nearest[i].distance);
+
+		lat += w * fp->latitude;
+		lon += w * fp->longitude;
+		sum += w;
+	}
+	lat /= sum;
+	lon /= sum;
+
+	for (i = 0; i < n_nearest; i++) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint,
+		                                  nearest[i].fingerprint);
+		double d = get_distance (fp->latitude, fp->longitude, lat, lon);
+
+		spread += d * d / (1.0 + nearest[i].distance);
+	}
+
+	*latitude = lat;
+	*longitude = lon;
+	*accuracy = sqrt (spread / sum + FINGERPRINT_ERROR * FINGERPRINT_ERROR);
+	return TRUE;
+}
+
+typedef struct {
+	guint64 bssid;
+	guint fingerprint;
+	int rssi;
+} Entry;
+
+static int
+compare_entries (gconstpointer a, gconstpointer b)
+{
+	const Entry *entry_a = a, *entry_b = b;
+
+	if (entry_a->bssid != entry_b->bssid) {
+		return entry_a->bssid < entry_b->bssid ? -1 : 1;
+	}
+	return entry_a->fingerprint < entry_b->fingerprint ? -1 :
+	       (entry_a->fingerprint > entry_b->fingerprint ? 1 : 0);
+}
+
+/* Replaces 'filename' with a file only the user can read: the
+ * fingerprints are a history of where the user has been */
+static gboolean
+write_private_file (const char *filename,
+                    const char *contents,
+                    gsize       length,
+                    GError    **error)
+{
+	char *tmp;
+	int fd;
+	int saved_errno;
+	gsize written = 0;
+
+	/* g_mkstemp() creates it 0600 */
+	tmp = g_strconcat (filename, ".XXXXXX", NULL);
+	fd = g_mkstemp (tmp);
+	if (fd < 0) {
+		saved_errno = errno;
+		goto fail;
+	}
+	while (written < length) {
+		gssize n = write (fd, contents + written, length - written);
+
+		if (n < 0 && errno != EINTR) {
+			saved_errno = errno;
+			close (fd);
+			g_unlink (tmp);
+			goto fail;
+		}
+		if (n > 0) {
+			written += n;
+		}
+	}
+	if (close (fd) < 0 || g_rename (tmp, filename) < 0) {
+		saved_errno = errno;
+		g_unlink (tmp);
+		goto fail;
+	}
+	g_free (tmp);
+	return TRUE;
+
+ fail:
+	g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+	             "Could not write %s: %s", filename, g_strerror (saved_errno));
+	g_free (tmp);
+	return FALSE;
+}
+
+gboolean
+wifi_fingerprints_save (WifiFingerprints *db,
+                        GError          **error)
+{
+	GString *str;
+	GArray *entries;
+	guint i, j;
+	gboolean ret;
+
+	entries = g_array_sized_new (FALSE, FALSE, sizeof (Entry), db->samples->len);
+	for (i = 0; i < db->fingerprints->len; i++) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint, i);
+
+		for (j = fp->first; j < fp->first + fp->n_samples; j++) {
+			Sample *sample = &g_array_index (db->samples, Sample, j);
+			Entry entry;
+
+			entry.bssid = sample->bssid;
+			entry.fingerprint = i;
+			entry.rssi = sample->rssi;
+			g_array_append_val (entries, entry);
+		}
+	}
+	g_array_sort (entries, compare_entries);
+
+	str = g_string_sized_new (DB_HEADER_LENGTH +
+	                          db->fingerprints->len * DB_FINGERPRINT_LENGTH +
+	                          entries->len * DB_ENTRY_LENGTH);
+	g_string_append_len (str, DB_MAGIC, DB_MAGIC_LENGTH);
+	append_uint32 (str, db->fingerprints->len);
+	append_uint32 (str, entries->len);
+
+	for (i = 0; i < db->fingerprints->len; i++) {
+		Fingerprint *fp = &g_array_index (db->fingerprints, Fingerprint, i);
+
+		append_uint32 (str, (guint32) (gint32) floor (fp->latitude * 1e7 + 0.5));
+		append_uint32 (str, (guint32) (gint32) floor (fp->longitude * 1e7 + 0.5));
+		append_uint32 (str, fp->recorded);
+		append_uint32 (str, 0);
+	}
+
+	for (i = 0; i < entries->len; i++) {
+		Entry *entry = &g_array_index (entries, Entry, i);
+
+		append_uint32 (str, entry->bssid & G_MAXUINT32);
+		g_string_append_c (str, (entry->bssid >> 32) & 0xff);
+		g_string_append_c (str, (entry->bssid >> 40) & 0xff);
+		g_string_append_c (str, (gint8) entry->rssi);
+		g_string_append_c (str, 0);
+		append_uint32 (str, entry->fingerprint);
+	}
+	g_array_free (entries, TRUE);
+
+	ret = write_private_file (db->filename, str->str, str->len, error);
+	g_string_free (str, TRUE);
+	return ret;
+}
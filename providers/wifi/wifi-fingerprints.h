@@ -0,0 +1,51 @@
+/*
+ * Geoclue
+ * wifi-fingerprints.h - Access point scans recorded at known positions
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _WIFI_FINGERPRINTS_H
+#define _WIFI_FINGERPRINTS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _WifiFingerprints WifiFingerprints;
+
+WifiFingerprints *wifi_fingerprints_new (const char *filename,
+                                         guint       size);
+void wifi_fingerprints_free (WifiFingerprints *db);
+
+void wifi_fingerprints_learn (WifiFingerprints *db,
+                              GHashTable       *aps,
+                              double            latitude,
+                              double            longitude);
+gboolean wifi_fingerprints_locate (WifiFingerprints *db,
+                                   GHashTable       *aps,
+                                   double           *latitude,
+                                   double           *longitude,
+                                   double           *accuracy);
+gboolean wifi_fingerprints_save (WifiFingerprints *db,
+                                 GError          **error);
+
+G_END_DECLS
+
+#endif
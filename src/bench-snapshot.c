@@ -0,0 +1,149 @@
+/*
+ * Geoclue
+ * bench-snapshot.c - Stress test for the master cache snapshot publisher
+ *
+ * Runs a number of reader threads that continuously grab the current
+ * snapshot while the main thread publishes a new one at 10 Hz, like a
+ * GPS provider would. Every snapshot is self-consistent, so a torn or
+ * freed read shows up as a mismatch.
+ *
+ * Usage: bench-snapshot [readers] [seconds]
+ */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#include "master-snapshot.h"
+
+typedef struct {
+	GcSnapshot snapshot;
+	int timestamp;
+	double latitude;
+	double longitude;
+	int check; /* ~timestamp */
+} BenchFix;
+
+static volatile gint running = 1;
+static volatile gint freed = 0;
+
+static void
+bench_fix_free (BenchFix *fix)
+{
+	fix->check = fix->timestamp;
+	g_atomic_int_inc (&freed);
+	g_slice_free (BenchFix, fix);
+}
+
+static BenchFix *
+bench_fix_new (int timestamp)
+{
+	BenchFix *fix;
+
+	fix = g_slice_new (BenchFix);
+	gc_snapshot_init (&fix->snapshot, (GDestroyNotify)bench_fix_free);
+	fix->timestamp = timestamp;
+	fix->latitude = 60.0 + timestamp * 1e-5;
+	fix->longitude = 24.0 - timestamp * 1e-5;
+	fix->check = ~timestamp;
+	return fix;
+}
+
+typedef struct {
+	GcSnapshotPublisher *publisher;
+	guint64 reads;
+	guint64 errors;
+} ReaderData;
+
+static gpointer
+reader_thread (ReaderData *data)
+{
+	while (g_atomic_int_get (&running)) {
+		BenchFix *fix;
+
+		fix = gc_snapshot_publisher_acquire (data->publisher);
+		if (fix->check != ~fix->timestamp) {
+			data->errors++;
+		}
+		gc_snapshot_unref (fix);
+		data->reads++;
+	}
+	return NULL;
+}
+
+static gboolean
+publish_fix (GcSnapshotPublisher *publisher)
+{
+	static int timestamp = 1;
+
+	gc_snapshot_publisher_publish (publisher, bench_fix_new (timestamp++));
+	return TRUE;
+}
+
+static gboolean
+stop (GMainLoop *loop)
+{
+	g_main_loop_quit (loop);
+	return FALSE;
+}
+
+int main (int argc, char **argv)
+{
+	GMainLoop *loop;
+	GcSnapshotPublisher *publisher;
+	ReaderData *readers;
+	GThread **threads;
+	GTimer *timer;
+	guint64 reads = 0, errors = 0;
+	int n_readers = 8, seconds = 10, i;
+	double elapsed;
+
+	if (argc > 1) {
+		n_readers = MAX (1, atoi (argv[1]));
+	}
+	if (argc > 2) {
+		seconds = MAX (1, atoi (argv[2]));
+	}
+
+	if (!g_thread_supported ()) {
+		g_thread_init (NULL);
+	}
+
+	loop = g_main_loop_new (NULL, FALSE);
+	publisher = gc_snapshot_publisher_new (bench_fix_new (0));
+
+	readers = g_new0 (ReaderData, n_readers);
+	threads = g_new0 (GThread *, n_readers);
+	timer = g_timer_new ();
+
+	for (i = 0; i < n_readers; i++) {
+		readers[i].publisher = publisher;
+		threads[i] = g_thread_create ((GThreadFunc)reader_thread,
+		                              &readers[i], TRUE, NULL);
+	}
+
+	g_timeout_add (100, (GSourceFunc)publish_fix, publisher);
+	g_timeout_add_seconds (seconds, (GSourceFunc)stop, loop);
+	g_main_loop_run (loop);
+
+	g_atomic_int_set (&running, 0);
+	for (i = 0; i < n_readers; i++) {
+		g_thread_join (threads[i]);
+		reads += readers[i].reads;
+		errors += readers[i].errors;
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_print ("%d readers, %d snapshots freed in %.1f s\n",
+	         n_readers, g_atomic_int_get (&freed), elapsed);
+	g_print ("%" G_GUINT64_FORMAT " reads (%.0f reads/s), "
+	         "%" G_GUINT64_FORMAT " inconsistent\n",
+	         reads, reads / elapsed, errors);
+
+	gc_snapshot_publisher_free (publisher);
+	g_timer_destroy (timer);
+	g_free (threads);
+	g_free (readers);
+	g_main_loop_unref (loop);
+
+	return errors > 0 ? 1 : 0;
+}
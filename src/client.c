@@ -34,14 +34,27 @@
 
 #include <config.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
 #include <geoclue/geoclue-error.h>
 #include <geoclue/geoclue-marshal.h>
 
 #include <geoclue/gc-provider.h>
 #include <geoclue/gc-iface-position.h>
 #include <geoclue/gc-iface-address.h>
+#include <geoclue/gc-iface-location.h>
+#include <geoclue/geoclue-position-shared.h>
+#include <geoclue/geoclue-master-client.h>
 
 #include "client.h"
+#include "master-history.h"
+#include "master-fusion.h"
+#include "master-predict.h"
+#include "master-duty.h"
 
 #define GEOCLUE_POSITION_INTERFACE_NAME "org.freedesktop.Geoclue.Position"
 #define GEOCLUE_ADDRESS_INTERFACE_NAME "org.freedesktop.Geoclue.Address"
@@ -57,6 +70,7 @@ static guint32 signals[LAST_SIGNAL] = {0, };
 enum {
 	POSITION_CHANGED, /* signal id of current provider */
 	ADDRESS_CHANGED, /* signal id of current provider */
+	VELOCITY_CHANGED, /* signal id of current position provider */
 	LAST_PRIVATE_SIGNAL
 };
 
@@ -67,6 +81,10 @@ typedef struct _GcMasterClientPrivate {
 	int min_time;
 	gboolean require_updates;
 	GeoclueResourceFlags allowed_resources;
+	/* seconds the client allows between GPS fixes, see set_options */
+	int gps_interval;
+	/* started by the master itself, see gc_master_client_start_position */
+	gboolean internal;
 
 	gboolean position_started;
 	GcMasterProvider *position_provider;
@@ -80,6 +98,20 @@ typedef struct _GcMasterClientPrivate {
 	gboolean address_provider_choice_in_progress;
 	time_t last_address_changed;
 
+	/* shared memory position feed, see PositionMapShared */
+	GeocluePositionSharedPage *shared_position;
+	char *shared_position_name;
+
+	/* LocationChanged coalescing, see SetCoalesceSignals */
+	gboolean coalesce_signals;
+	GeoclueLocationChangeFlags pending_changes;
+	guint location_changed_id;
+
+	/* predicted positions between fixes, see SetPrediction */
+	GcPredictor predictor;
+	int prediction_interval;
+	guint prediction_id;
+
 } GcMasterClientPrivate;
 
 #define GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GC_TYPE_MASTER_CLIENT, GcMasterClientPrivate))
@@ -106,10 +138,24 @@ static gboolean gc_iface_master_client_get_position_provider (GcMasterClient  *c
                                                               char           **service,
                                                               char           **path,
                                                               GError         **error);
+static gboolean gc_iface_master_client_position_map_shared (GcMasterClient  *client,
+                                                            char           **name,
+                                                            GError         **error);
+static gboolean gc_iface_master_client_set_coalesce_signals (GcMasterClient  *client,
+                                                             gboolean         coalesce,
+                                                             GError         **error);
+static gboolean gc_iface_master_client_get_position_history (GcMasterClient  *client,
+                                                             int              since,
+                                                             GPtrArray      **history,
+                                                             GError         **error);
+static gboolean gc_iface_master_client_set_prediction (GcMasterClient  *client,
+                                                       int              interval,
+                                                       GError         **error);
 
 static void gc_master_client_geoclue_init (GcIfaceGeoclueClass *iface);
 static void gc_master_client_position_init (GcIfacePositionClass *iface);
 static void gc_master_client_address_init (GcIfaceAddressClass *iface);
+static void gc_master_client_location_init (GcIfaceLocationClass *iface);
 
 G_DEFINE_TYPE_WITH_CODE (GcMasterClient, gc_master_client, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE(GC_TYPE_IFACE_GEOCLUE,
@@ -117,7 +163,9 @@ G_DEFINE_TYPE_WITH_CODE (GcMasterClient, gc_master_client, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_POSITION,
 						gc_master_client_position_init)
 			 G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_ADDRESS,
-						gc_master_client_address_init))
+						gc_master_client_address_init)
+			 G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_LOCATION,
+						gc_master_client_location_init))
 
 #include "gc-iface-master-client-glue.h"
 
@@ -132,6 +180,8 @@ static gboolean gc_master_client_choose_position_provider (GcMasterClient  *clie
                                                            GList           *providers);
 static gboolean gc_master_client_choose_address_provider (GcMasterClient  *client, 
                                                           GList           *providers);
+static gboolean gc_master_client_queue_location_changed (GcMasterClient             *client,
+                                                         GeoclueLocationChangeFlags  changes);
 
 
 static void
@@ -143,6 +193,11 @@ status_changed (GcMasterProvider *provider,
 	
 	g_debug ("client: provider %s status changed: %d", gc_master_provider_get_name (provider), status);
 	
+	if (provider == priv->position_provider ||
+	    provider == priv->address_provider) {
+		gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_STATUS);
+	}
+	
 	/* change providers if needed (and if we're not choosing provider already) */
 	
 	if (!priv->position_provider_choice_in_progress &&
@@ -216,6 +271,115 @@ accuracy_changed (GcMasterProvider     *provider,
 	g_free (accuracy_data);
 }
 
+static double
+get_current_time (void)
+{
+	GTimeVal now;
+
+	g_get_current_time (&now);
+	return now.tv_sec + now.tv_usec / 1e6;
+}
+
+/* seqlock write, readers retry while sequence is odd or has changed */
+static void
+gc_master_client_update_shared_position (GcMasterClient        *client,
+                                         GeocluePositionFields  fields,
+                                         int                    timestamp,
+                                         double                 latitude,
+                                         double                 longitude,
+                                         double                 altitude,
+                                         GeoclueAccuracy       *accuracy)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	GeocluePositionSharedPage *page = priv->shared_position;
+	GeoclueAccuracyLevel level;
+	double hor_acc, vert_acc;
+	
+	if (page == NULL) {
+		return;
+	}
+	
+	geoclue_accuracy_get_details (accuracy, &level, &hor_acc, &vert_acc);
+	
+	g_atomic_int_inc (&page->sequence);
+	page->fields = fields;
+	page->timestamp = timestamp;
+	page->latitude = latitude;
+	page->longitude = longitude;
+	page->altitude = altitude;
+	page->accuracy_level = level;
+	page->horizontal_accuracy = hor_acc;
+	page->vertical_accuracy = vert_acc;
+	g_atomic_int_inc (&page->sequence);
+}
+
+/* Sends a predicted position when the provider has not sent a fix
+ * within the prediction interval. Stops once there is nothing left to
+ * predict from, position_changed starts it again. */
+static gboolean
+prediction_timeout (GcMasterClient *client)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	GeocluePositionFields fields;
+	GeoclueAccuracy *accuracy;
+	double now, latitude, longitude, altitude, horizontal, vertical;
+	
+	now = get_current_time ();
+	if (priv->position_provider == NULL ||
+	    now - priv->predictor.time > GC_MAX_PREDICTION) {
+		priv->prediction_id = 0;
+		return FALSE;
+	}
+	if (priv->coalesce_signals ||
+	    now - priv->predictor.time < priv->prediction_interval / 1000.0) {
+		return TRUE;
+	}
+	
+	fields = gc_predictor_predict (&priv->predictor, now,
+	                               &latitude, &longitude, &altitude,
+	                               &horizontal, &vertical);
+	if (fields == GEOCLUE_POSITION_FIELDS_NONE) {
+		return TRUE;
+	}
+	
+	accuracy = geoclue_accuracy_new (gc_accuracy_level_for_radius (horizontal),
+	                                 horizontal, vertical);
+	gc_master_client_update_shared_position (client, fields, (int) now,
+	                                         latitude, longitude, altitude,
+	                                         accuracy);
+	gc_iface_position_emit_position_changed (GC_IFACE_POSITION (client),
+	                                         fields, (int) now,
+	                                         latitude, longitude, altitude,
+	                                         accuracy);
+	geoclue_accuracy_free (accuracy);
+	
+	return TRUE;
+}
+
+static void
+gc_master_client_start_prediction (GcMasterClient *client)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	if (priv->prediction_interval > 0 && priv->prediction_id == 0) {
+		priv->prediction_id = g_timeout_add (MAX (priv->prediction_interval,
+		                                          GC_MIN_PREDICTION_INTERVAL),
+		                                     (GSourceFunc) prediction_timeout,
+		                                     client);
+	}
+}
+
+static void
+gc_master_client_stop_prediction (GcMasterClient *client)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	if (priv->prediction_id > 0) {
+		g_source_remove (priv->prediction_id);
+		priv->prediction_id = 0;
+	}
+}
+
 static void
 position_changed (GcMasterProvider     *provider,
                   GeocluePositionFields fields,
@@ -227,8 +391,22 @@ position_changed (GcMasterProvider     *provider,
                   GcMasterClient       *client)
 {
 	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	GeoclueAccuracyLevel level;
+	double horizontal, vertical;
 	time_t now;
 
+	geoclue_accuracy_get_details (accuracy, &level, &horizontal, &vertical);
+	gc_predictor_set_position (&priv->predictor, get_current_time (), fields,
+	                           latitude, longitude, altitude,
+	                           level, horizontal, vertical);
+	gc_master_client_start_prediction (client);
+
+	/* shared memory readers get every update, min_time only
+	 * limits the signals */
+	gc_master_client_update_shared_position (client, fields, timestamp,
+	                                         latitude, longitude, altitude,
+	                                         accuracy);
+
 	now = time (NULL);
 	if (priv->min_time > (now - priv->last_position_changed)) {
 		/* NOTE: currently no-one makes sure there is an emit
@@ -237,6 +415,10 @@ position_changed (GcMasterProvider     *provider,
 	}
 	priv->last_position_changed = now;
 
+	if (gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_POSITION)) {
+		return;
+	}
+
 	gc_iface_position_emit_position_changed
 		(GC_IFACE_POSITION (client),
 		 fields,
@@ -263,6 +445,10 @@ address_changed (GcMasterProvider     *provider,
 	}
 	priv->last_address_changed = now;
 
+	if (gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_ADDRESS)) {
+		return;
+	}
+
 	gc_iface_address_emit_address_changed
 		(GC_IFACE_ADDRESS (client),
 		 timestamp,
@@ -270,6 +456,24 @@ address_changed (GcMasterProvider     *provider,
 		 accuracy);
 }
 
+/* the master client has no Velocity interface of its own, velocity
+ * is only delivered with LocationChanged */
+static void
+velocity_changed (GcMasterProvider     *provider,
+                  GeoclueVelocityFields fields,
+                  int                   timestamp,
+                  double                speed,
+                  double                direction,
+                  double                climb,
+                  GcMasterClient       *client)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+
+	gc_predictor_set_velocity (&priv->predictor, fields,
+	                           speed, direction, climb);
+	gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_VELOCITY);
+}
+
 /*if changed_provider status changes, do we need to choose a new provider? */
 static gboolean
 status_change_requires_provider_change (GList            *provider_list,
@@ -400,13 +604,23 @@ gc_master_client_emit_position_changed (GcMasterClient *client)
 	
 	
 	if (priv->position_provider == NULL) {
+		timestamp = time (NULL);
 		accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
-		gc_iface_position_emit_position_changed
-			(GC_IFACE_POSITION (client),
-			 GEOCLUE_POSITION_FIELDS_NONE,
-			 time (NULL),
-			 0.0, 0.0, 0.0,
-			 accuracy);
+		gc_master_client_update_shared_position (client,
+		                                         GEOCLUE_POSITION_FIELDS_NONE,
+		                                         timestamp,
+		                                         0.0, 0.0, 0.0,
+		                                         accuracy);
+		if (!gc_master_client_queue_location_changed (client,
+		                                              GEOCLUE_LOCATION_CHANGE_POSITION |
+		                                              GEOCLUE_LOCATION_CHANGE_VELOCITY)) {
+			gc_iface_position_emit_position_changed
+				(GC_IFACE_POSITION (client),
+				 GEOCLUE_POSITION_FIELDS_NONE,
+				 timestamp,
+				 0.0, 0.0, 0.0,
+				 accuracy);
+		}
 		geoclue_accuracy_free (accuracy);
 		return;
 	}
@@ -425,12 +639,20 @@ gc_master_client_emit_position_changed (GcMasterClient *client)
 		g_error_free (error);
 		return;
 	}
-	gc_iface_position_emit_position_changed
-		(GC_IFACE_POSITION (client),
-		 fields,
-		 timestamp,
-		 latitude, longitude, altitude,
-		 accuracy);
+	gc_master_client_update_shared_position (client, fields, timestamp,
+	                                         latitude, longitude, altitude,
+	                                         accuracy);
+	if (!gc_master_client_queue_location_changed (client,
+	                                              GEOCLUE_LOCATION_CHANGE_POSITION |
+	                                              GEOCLUE_LOCATION_CHANGE_VELOCITY)) {
+		gc_iface_position_emit_position_changed
+			(GC_IFACE_POSITION (client),
+			 fields,
+			 timestamp,
+			 latitude, longitude, altitude,
+			 accuracy);
+	}
+	geoclue_accuracy_free (accuracy);
 }
 
 static void 
@@ -442,6 +664,10 @@ gc_master_client_emit_address_changed (GcMasterClient *client)
 	GeoclueAccuracy *accuracy = NULL;
 	GError *error = NULL;
 	
+	if (gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_ADDRESS)) {
+		return;
+	}
+	
 	if (priv->address_provider == NULL) {
 		accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
 		details = g_hash_table_new (g_str_hash, g_str_equal);
@@ -498,27 +724,43 @@ gc_master_client_choose_position_provider (GcMasterClient *client,
 		                             priv->signals[POSITION_CHANGED]);
 		priv->signals[POSITION_CHANGED] = 0;
 	}
+	if (priv->signals[VELOCITY_CHANGED] > 0) {
+		g_signal_handler_disconnect (priv->position_provider, 
+		                             priv->signals[VELOCITY_CHANGED]);
+		priv->signals[VELOCITY_CHANGED] = 0;
+	}
 	
 	priv->position_provider = new_p;
+	gc_predictor_reset (&priv->predictor);
+	gc_master_client_stop_prediction (client);
 	
 	if (priv->position_provider == NULL) {
 		g_debug ("client: position provider changed (to NULL)");
-		g_signal_emit (client, signals[POSITION_PROVIDER_CHANGED], 0, 
-		               NULL, NULL, NULL, NULL);
+		if (!gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_PROVIDER)) {
+			g_signal_emit (client, signals[POSITION_PROVIDER_CHANGED], 0, 
+			               NULL, NULL, NULL, NULL);
+		}
 		return TRUE;
 	}
 	
 	g_debug ("client: position provider changed (to %s)", gc_master_provider_get_name (priv->position_provider));
-	g_signal_emit (client, signals[POSITION_PROVIDER_CHANGED], 0, 
-		       gc_master_provider_get_name (priv->position_provider),
-		       gc_master_provider_get_description (priv->position_provider),
-		       gc_master_provider_get_service (priv->position_provider),
-		       gc_master_provider_get_path (priv->position_provider));
+	if (!gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_PROVIDER)) {
+		g_signal_emit (client, signals[POSITION_PROVIDER_CHANGED], 0, 
+			       gc_master_provider_get_name (priv->position_provider),
+			       gc_master_provider_get_description (priv->position_provider),
+			       gc_master_provider_get_service (priv->position_provider),
+			       gc_master_provider_get_path (priv->position_provider));
+	}
 	priv->signals[POSITION_CHANGED] =
 		g_signal_connect (G_OBJECT (priv->position_provider),
 				  "position-changed",
 				  G_CALLBACK (position_changed),
 				  client);
+	priv->signals[VELOCITY_CHANGED] =
+		g_signal_connect (G_OBJECT (priv->position_provider),
+				  "velocity-changed",
+				  G_CALLBACK (velocity_changed),
+				  client);
 	return TRUE;
 }
 
@@ -553,17 +795,21 @@ gc_master_client_choose_address_provider (GcMasterClient *client,
 	
 	if (priv->address_provider == NULL) {
 		g_debug ("client: address provider changed (to NULL)");
-		g_signal_emit (client, signals[ADDRESS_PROVIDER_CHANGED], 0, 
-		               NULL, NULL, NULL, NULL);
+		if (!gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_PROVIDER)) {
+			g_signal_emit (client, signals[ADDRESS_PROVIDER_CHANGED], 0, 
+			               NULL, NULL, NULL, NULL);
+		}
 		return TRUE;
 	}
 	
 	g_debug ("client: address provider changed (to %s)", gc_master_provider_get_name (priv->address_provider));
-	g_signal_emit (client, signals[ADDRESS_PROVIDER_CHANGED], 0, 
-		       gc_master_provider_get_name (priv->address_provider),
-		       gc_master_provider_get_description (priv->address_provider),
-		       gc_master_provider_get_service (priv->address_provider),
-		       gc_master_provider_get_path (priv->address_provider));
+	if (!gc_master_client_queue_location_changed (client, GEOCLUE_LOCATION_CHANGE_PROVIDER)) {
+		g_signal_emit (client, signals[ADDRESS_PROVIDER_CHANGED], 0, 
+			       gc_master_provider_get_name (priv->address_provider),
+			       gc_master_provider_get_description (priv->address_provider),
+			       gc_master_provider_get_service (priv->address_provider),
+			       gc_master_provider_get_path (priv->address_provider));
+	}
 	priv->signals[ADDRESS_CHANGED] = 
 		g_signal_connect (G_OBJECT (priv->address_provider),
 				  "address-changed",
@@ -676,6 +922,9 @@ gc_iface_master_client_set_requirements (GcMasterClient        *client,
 	
 	gc_master_client_init_position_providers (client);
 	gc_master_client_init_address_providers (client);
+	if (priv->position_provider) {
+		gc_master_provider_update_duty_cycle (priv->position_provider);
+	}
 	
 	return TRUE;
 }
@@ -703,6 +952,46 @@ gc_iface_master_client_position_start (GcMasterClient *client,
 	return TRUE;
 }
 
+/* Used by the master itself for clients that are not on the bus */
+gboolean
+gc_master_client_start_position (GcMasterClient        *client,
+                                 GeoclueAccuracyLevel   min_accuracy,
+                                 GeoclueResourceFlags   allowed_resources,
+                                 GError               **error)
+{
+	GET_PRIVATE (client)->internal = TRUE;
+	gc_iface_master_client_set_requirements (client, min_accuracy, 0, TRUE,
+	                                         allowed_resources, NULL);
+	return gc_iface_master_client_position_start (client, error);
+}
+
+void
+gc_master_client_get_requirements (GcMasterClient       *client,
+                                   GeoclueAccuracyLevel *min_accuracy,
+                                   int                  *min_time)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	*min_accuracy = priv->min_accuracy;
+	*min_time = priv->min_time;
+}
+
+/* The seconds between GPS fixes the client opted in to, 0 if it wants
+ * every fix. FALSE for clients that should not slow the GPS down or
+ * hold it up: the master's own and shared memory readers */
+gboolean
+gc_master_client_get_gps_interval (GcMasterClient *client,
+                                   int            *gps_interval)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+
+	if (priv->internal || priv->shared_position) {
+		return FALSE;
+	}
+	*gps_interval = priv->gps_interval;
+	return TRUE;
+}
+
 static gboolean 
 gc_iface_master_client_address_start (GcMasterClient *client,
                                       GError         **error)
@@ -791,12 +1080,160 @@ gc_iface_master_client_get_position_provider (GcMasterClient  *client,
 	return TRUE;
 }
 
+static gboolean
+gc_iface_master_client_position_map_shared (GcMasterClient  *client,
+                                            char           **name,
+                                            GError         **error)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	static guint32 serial = 0;
+	GeocluePositionSharedPage *page;
+	int fd;
+	
+	if (priv->shared_position) {
+		*name = g_strdup (priv->shared_position_name);
+		return TRUE;
+	}
+	
+	priv->shared_position_name = g_strdup_printf ("/geoclue-master-%d-%u", 
+	                                              getpid (), serial++);
+	
+	/* the name is easy to guess: only the user running the master
+	 * (and so the session bus master's clients) may read the page */
+	fd = shm_open (priv->shared_position_name, 
+	               O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 ||
+	    ftruncate (fd, sizeof (GeocluePositionSharedPage)) < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not create shared position: %s",
+		             g_strerror (errno));
+		goto fail;
+	}
+	page = mmap (NULL, sizeof (GeocluePositionSharedPage),
+	             PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not map shared position: %s",
+		             g_strerror (errno));
+		goto fail;
+	}
+	close (fd);
+	
+	page->magic = GEOCLUE_POSITION_SHARED_MAGIC;
+	page->version = GEOCLUE_POSITION_SHARED_VERSION;
+	page->sequence = 0;
+	priv->shared_position = page;
+	
+	if (priv->position_provider) {
+		GeocluePositionFields fields;
+		int timestamp;
+		double latitude, longitude, altitude;
+		GeoclueAccuracy *accuracy = NULL;
+		
+		fields = gc_master_provider_get_position (priv->position_provider,
+		                                          &timestamp,
+		                                          &latitude, &longitude, &altitude,
+		                                          &accuracy, NULL);
+		if (accuracy) {
+			gc_master_client_update_shared_position (client, fields, timestamp,
+			                                         latitude, longitude, altitude,
+			                                         accuracy);
+			geoclue_accuracy_free (accuracy);
+		}
+		gc_master_provider_update_duty_cycle (priv->position_provider);
+	}
+	
+	*name = g_strdup (priv->shared_position_name);
+	return TRUE;
+	
+ fail:
+	if (fd >= 0) {
+		close (fd);
+		shm_unlink (priv->shared_position_name);
+	}
+	g_free (priv->shared_position_name);
+	priv->shared_position_name = NULL;
+	return FALSE;
+}
+
+static gboolean
+gc_iface_master_client_set_coalesce_signals (GcMasterClient  *client,
+                                             gboolean         coalesce,
+                                             GError         **error)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	priv->coalesce_signals = coalesce;
+	if (!coalesce && priv->location_changed_id > 0) {
+		g_source_remove (priv->location_changed_id);
+		priv->location_changed_id = 0;
+		priv->pending_changes = GEOCLUE_LOCATION_CHANGE_NONE;
+	}
+	return TRUE;
+}
+
+/* Predicted positions are not part of LocationChanged, so they are
+ * not sent while coalescing */
+static gboolean
+gc_iface_master_client_set_prediction (GcMasterClient  *client,
+                                       int              interval,
+                                       GError         **error)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	if (interval < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Invalid prediction interval %d", interval);
+		return FALSE;
+	}
+	
+	gc_master_client_stop_prediction (client);
+	priv->prediction_interval = interval;
+	gc_master_client_start_prediction (client);
+	return TRUE;
+}
+
+static gboolean
+gc_iface_master_client_get_position_history (GcMasterClient  *client,
+                                             int              since,
+                                             GPtrArray      **history,
+                                             GError         **error)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	GArray *fixes;
+	
+	if (priv->position_provider == NULL) {
+		*history = g_ptr_array_new ();
+		return TRUE;
+	}
+	
+	fixes = gc_master_provider_get_position_history (priv->position_provider,
+	                                                 since);
+	*history = gc_position_fixes_to_structs (fixes);
+	g_array_free (fixes, TRUE);
+	
+	return TRUE;
+}
+
 static void
 finalize (GObject *object)
 {
 	GcMasterClient *client = GC_MASTER_CLIENT (object);
 	GcMasterClientPrivate *priv = GET_PRIVATE (object);
 	
+	if (priv->location_changed_id > 0) {
+		g_source_remove (priv->location_changed_id);
+		priv->location_changed_id = 0;
+	}
+	gc_master_client_stop_prediction (client);
+	
+	if (priv->shared_position) {
+		munmap (priv->shared_position, sizeof (GeocluePositionSharedPage));
+		shm_unlink (priv->shared_position_name);
+		g_free (priv->shared_position_name);
+		priv->shared_position = NULL;
+	}
+	
 	/* do not free contents of the lists, Master takes care of them */
 	if (priv->position_providers) {
 		gc_master_client_unsubscribe_providers (client, priv->position_providers, GC_IFACE_ALL);
@@ -859,6 +1296,17 @@ gc_master_client_init (GcMasterClient *client)
 	priv->address_started = FALSE;
 	priv->address_provider = NULL;
 	priv->address_providers = NULL;
+	
+	priv->shared_position = NULL;
+	priv->shared_position_name = NULL;
+	
+	priv->coalesce_signals = FALSE;
+	priv->pending_changes = GEOCLUE_LOCATION_CHANGE_NONE;
+	priv->location_changed_id = 0;
+	
+	gc_predictor_reset (&priv->predictor);
+	priv->prediction_interval = 0;
+	priv->prediction_id = 0;
 }
 
 static gboolean
@@ -919,6 +1367,160 @@ get_address (GcIfaceAddress   *iface,
 		 error);
 }
 
+/* Everything a client would otherwise ask with GetStatus, GetPosition,
+ * GetVelocity and GetAddress, in one call. Parts that are not available
+ * are returned as NONE instead of failing the whole call. */
+static gboolean
+get_all (GcIfaceLocation       *iface,
+         GeoclueStatus         *status,
+         GeocluePositionFields *position_fields,
+         int                   *position_timestamp,
+         double                *latitude,
+         double                *longitude,
+         double                *altitude,
+         GeoclueAccuracy      **position_accuracy,
+         GeoclueVelocityFields *velocity_fields,
+         int                   *velocity_timestamp,
+         double                *speed,
+         double                *direction,
+         double                *climb,
+         int                   *address_timestamp,
+         GHashTable           **address,
+         GeoclueAccuracy      **address_accuracy,
+         GError               **error)
+{
+	GcMasterClient *client = GC_MASTER_CLIENT (iface);
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	*status = GEOCLUE_STATUS_UNAVAILABLE;
+	*position_fields = GEOCLUE_POSITION_FIELDS_NONE;
+	*position_timestamp = 0;
+	*latitude = *longitude = *altitude = 0.0;
+	*position_accuracy = NULL;
+	*velocity_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	*velocity_timestamp = 0;
+	*speed = *direction = *climb = 0.0;
+	*address_timestamp = 0;
+	*address = NULL;
+	*address_accuracy = NULL;
+	
+	if (priv->position_provider) {
+		GError *pos_error = NULL;
+		
+		*status = gc_master_provider_get_status (priv->position_provider);
+		*position_fields = gc_master_provider_get_position
+			(priv->position_provider,
+			 position_timestamp,
+			 latitude, longitude, altitude,
+			 position_accuracy,
+			 &pos_error);
+		if (pos_error) {
+			*position_fields = GEOCLUE_POSITION_FIELDS_NONE;
+			g_error_free (pos_error);
+		}
+		
+		*velocity_fields = gc_master_provider_get_velocity
+			(priv->position_provider,
+			 velocity_timestamp,
+			 speed, direction, climb);
+	}
+	
+	if (priv->address_provider) {
+		if (*status == GEOCLUE_STATUS_UNAVAILABLE) {
+			*status = gc_master_provider_get_status (priv->address_provider);
+		}
+		if (!gc_master_provider_get_address (priv->address_provider,
+		                                     address_timestamp,
+		                                     address,
+		                                     address_accuracy,
+		                                     NULL)) {
+			if (*address) {
+				g_hash_table_destroy (*address);
+				*address = NULL;
+			}
+			if (*address_accuracy) {
+				geoclue_accuracy_free (*address_accuracy);
+				*address_accuracy = NULL;
+			}
+		}
+	}
+	
+	if (*position_accuracy == NULL) {
+		*position_accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
+	}
+	if (*address == NULL) {
+		*address = geoclue_address_details_new ();
+	}
+	if (*address_accuracy == NULL) {
+		*address_accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
+	}
+	return TRUE;
+}
+
+static gboolean
+gc_master_client_emit_location_changed (GcMasterClient *client)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	GeoclueLocationChangeFlags changed = priv->pending_changes;
+	GeoclueStatus status;
+	GeocluePositionFields position_fields;
+	GeoclueVelocityFields velocity_fields;
+	int position_timestamp, velocity_timestamp, address_timestamp;
+	double latitude, longitude, altitude, speed, direction, climb;
+	GeoclueAccuracy *position_accuracy, *address_accuracy;
+	GHashTable *address;
+	
+	priv->location_changed_id = 0;
+	priv->pending_changes = GEOCLUE_LOCATION_CHANGE_NONE;
+	
+	get_all (GC_IFACE_LOCATION (client), &status,
+	         &position_fields, &position_timestamp,
+	         &latitude, &longitude, &altitude, &position_accuracy,
+	         &velocity_fields, &velocity_timestamp,
+	         &speed, &direction, &climb,
+	         &address_timestamp, &address, &address_accuracy,
+	         NULL);
+	
+	gc_iface_location_emit_location_changed (GC_IFACE_LOCATION (client),
+	                                         changed, status,
+	                                         position_fields, position_timestamp,
+	                                         latitude, longitude, altitude,
+	                                         position_accuracy,
+	                                         velocity_fields, velocity_timestamp,
+	                                         speed, direction, climb,
+	                                         address_timestamp, address,
+	                                         address_accuracy);
+	
+	geoclue_accuracy_free (position_accuracy);
+	geoclue_accuracy_free (address_accuracy);
+	g_hash_table_destroy (address);
+	
+	return FALSE;
+}
+
+/* In coalescing mode changes are only collected here, and a single 
+ * LocationChanged is emitted when the main loop has dispatched 
+ * everything caused by the same event. Returns FALSE if the caller
+ * should emit its own signal instead. */
+static gboolean
+gc_master_client_queue_location_changed (GcMasterClient             *client,
+                                         GeoclueLocationChangeFlags  changes)
+{
+	GcMasterClientPrivate *priv = GET_PRIVATE (client);
+	
+	if (!priv->coalesce_signals) {
+		return FALSE;
+	}
+	
+	priv->pending_changes |= changes;
+	if (priv->location_changed_id == 0) {
+		priv->location_changed_id = 
+			g_idle_add ((GSourceFunc)gc_master_client_emit_location_changed,
+			            client);
+	}
+	return TRUE;
+}
+
 static gboolean
 get_status (GcIfaceGeoclue *geoclue,
             GeoclueStatus  *status,
@@ -934,7 +1536,17 @@ set_options (GcIfaceGeoclue *geoclue,
              GHashTable     *options,
              GError        **error)
 {
-	/* not meaningful, options come from master */
+	GcMasterClientPrivate *priv = GET_PRIVATE (geoclue);
+	GValue *value;
+	
+	/* other options come from master */
+	value = g_hash_table_lookup (options, GC_DUTY_CYCLE_OPTION);
+	if (value && G_VALUE_HOLDS_INT (value)) {
+		priv->gps_interval = g_value_get_int (value);
+		if (priv->position_provider) {
+			gc_master_provider_update_duty_cycle (priv->position_provider);
+		}
+	}
 	
 	/* It is not an error to not have a SetOptions implementation */
 	return TRUE;
@@ -992,3 +1604,9 @@ gc_master_client_address_init (GcIfaceAddressClass *iface)
 {
 	iface->get_address = get_address;
 }
+
+static void
+gc_master_client_location_init (GcIfaceLocationClass *iface)
+{
+	iface->get_all = get_all;
+}
@@ -33,6 +33,7 @@
 
 #define GC_TYPE_MASTER_CLIENT (gc_master_client_get_type ())
 #define GC_MASTER_CLIENT(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GC_TYPE_MASTER_CLIENT, GcMasterClient))
+#define GC_IS_MASTER_CLIENT(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GC_TYPE_MASTER_CLIENT))
 
 typedef struct {
 	GObject parent;
@@ -43,5 +44,14 @@ typedef struct {
 } GcMasterClientClass;
 
 GType gc_master_client_get_type (void);
+gboolean gc_master_client_start_position (GcMasterClient        *client,
+                                          GeoclueAccuracyLevel   min_accuracy,
+                                          GeoclueResourceFlags   allowed_resources,
+                                          GError               **error);
+void gc_master_client_get_requirements (GcMasterClient       *client,
+                                        GeoclueAccuracyLevel *min_accuracy,
+                                        int                  *min_time);
+gboolean gc_master_client_get_gps_interval (GcMasterClient *client,
+                                            int            *gps_interval);
 
 #endif
@@ -44,8 +44,6 @@ typedef void (*ConnmanFunc) (GeoclueConnman *self,
 static void geoclue_connman_connectivity_init (GeoclueConnectivityInterface *iface);
 
 static int _strength_to_dbm (int strength);
-static char *_get_mac_for_gateway (const char *gateway);
-static char *_mac_strup (char *mac);
 static gchar *_get_gateway (GeoclueConnman *self, const gchar *service);
 static void _get_best_ap (GeoclueConnman *self, const gchar *network);
 static void _get_aps_info (GeoclueConnman *self, const gchar *network, GHashTable **out);
@@ -105,17 +103,17 @@ _get_router_mac (GeoclueConnectivity *iface)
 	/* to get the MAC of the connected router. */
 	servs = _get_services (self, &props);
 	if (servs != NULL) {
-		for (i = 0; gateway == NULL && servs->len; i++) {
+		for (i = 0; gateway == NULL && i < servs->len; i++) {
 			serv = g_ptr_array_index (servs, i);
 			gateway = _get_gateway (self, serv);
 		}
 	}
 
-	/* Check the result. */
-	if (gateway != NULL) {
-		mac = _get_mac_for_gateway (gateway);
-		g_free (gateway);
+	/* Without a gateway from Connman, the kernel default route is used. */
+	if (self->netlink != NULL) {
+		mac = geoclue_netlink_get_router_mac (self->netlink, gateway);
 	}
+	g_free (gateway);
 
 	/* Free */
 	g_hash_table_destroy (props);
@@ -138,6 +136,11 @@ dispose (GObject *object)
 	g_free (self->cache_ap_mac);
 	self->cache_ap_mac = NULL;
 
+	if (self->netlink != NULL) {
+		geoclue_netlink_free (self->netlink);
+		self->netlink = NULL;
+	}
+
 	((GObjectClass *) geoclue_connman_parent_class)->dispose (object);
 }
 
@@ -158,50 +161,6 @@ _strength_to_dbm (int strength)
 	return (strength * 0.7) - 90;
 }
 
-static char *
-_get_mac_for_gateway (const char *gateway)
-{
-	char *cmd, *out, *mac, **split;
-
-	cmd = g_strdup_printf ("ip neigh show %s", gateway);
-
-	if (g_spawn_command_line_sync (cmd, &out, NULL, NULL, NULL) == FALSE) {
-		g_free (out);
-		g_free (cmd);
-		return NULL;
-	}
-	g_free (cmd);
-
-	/* 192.168.1.1 dev eth0 lladdr 00:00:00:00:00:00 STALE */
-	split = g_strsplit (out, " ", -1);
-	g_free (out);
-
-	if (split == NULL)
-		return NULL;
-	if (g_strv_length (split) != 6) {
-		g_strfreev (split);
-		return NULL;
-	}
-	mac = g_strdup (split[4]);
-	g_strfreev (split);
-
-	return _mac_strup (mac);
-}
-
-static char *
-_mac_strup (char *mac)
-{
-	guint i;
-
-	g_assert (mac != NULL);
-
-	for (i = 0; mac[i] != '\0' ; i++) {
-		if (g_ascii_isalpha (mac[i]))
-			mac[i] = g_ascii_toupper (mac[i]);
-	}
-	return mac;
-}
-
 static GeoclueNetworkStatus
 connmanstatus_to_geocluenetworkstatus (const gchar *status)
 {
@@ -687,6 +646,8 @@ geoclue_connman_init (GeoclueConnman *self)
 {
 	GError *error = NULL;
 
+	self->netlink = geoclue_netlink_new ();
+
 	/* Get DBus connection to the System bus. */
 	self->conn = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
 	if (self->conn == NULL) {
@@ -28,6 +28,7 @@
 #include <glib-object.h>
 #include <dbus/dbus-glib.h>
 #include "connectivity.h"
+#include "connectivity-netlink.h"
 
 G_BEGIN_DECLS
 
@@ -41,6 +42,7 @@ typedef struct {
 	GeoclueNetworkStatus status;
 	DBusGConnection *conn;
 	DBusGProxy *client;
+	GeoclueNetlink *netlink;
 	gchar *cache_ap_mac;
 	int ap_strength;
 } GeoclueConnman;
@@ -0,0 +1,422 @@
+/*
+ * Geoclue
+ * connectivity-netlink.c - Router MAC address from the kernel
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * Looks the router up in the kernel neighbour table over rtnetlink
+ * (and the router in the routing table when the connection manager
+ * does not tell), instead of running "ip neigh". The answer is cached
+ * until the kernel notifies a change in the neighbour entry of the
+ * router or in the IPv4 or IPv6 routes.
+ */
+
+#include <config.h>
+
+#if defined(HAVE_NETWORK_MANAGER) || defined(HAVE_CONNMAN)
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include "connectivity-netlink.h"
+
+#define BUFFER_SIZE 8192
+
+struct _GeoclueNetlink {
+	int fd;          /* for queries */
+	int monitor_fd;  /* for change notifications */
+	guint monitor_id;
+	guint32 seq;
+
+	/* the last answer, valid until a change */
+	gboolean cached;
+	char *cache_gateway;     /* as asked, NULL for the default route */
+	int family;
+	guchar address[16];      /* of the router */
+	char *mac;
+};
+
+typedef struct {
+	int family;
+	guchar address[16];
+	guint32 priority;
+	gboolean found;
+} RouteQuery;
+
+typedef struct {
+	int family;
+	const guchar *address;
+	char *mac;
+} NeighQuery;
+
+typedef void (*NetlinkFunc) (struct nlmsghdr *msg, gpointer data);
+
+static int
+address_length (int family)
+{
+	return family == AF_INET6 ? 16 : 4;
+}
+
+static char *
+format_mac (const guchar *lladdr)
+{
+	return g_strdup_printf ("%02X:%02X:%02X:%02X:%02X:%02X",
+	                        lladdr[0], lladdr[1], lladdr[2],
+	                        lladdr[3], lladdr[4], lladdr[5]);
+}
+
+static int
+netlink_socket (guint32 groups)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0) {
+		return -1;
+	}
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	memset (&addr, 0, sizeof (addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = groups;
+	if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Dumps a kernel table, calling func for each entry */
+static gboolean
+netlink_dump (GeoclueNetlink *netlink,
+              int             type,
+              int             family,
+              NetlinkFunc     func,
+              gpointer        data)
+{
+	struct {
+		struct nlmsghdr hdr;
+		struct rtgenmsg gen;
+	} request;
+	guchar buf[BUFFER_SIZE];
+	guint32 seq;
+	int len;
+
+	seq = ++netlink->seq;
+	memset (&request, 0, sizeof (request));
+	request.hdr.nlmsg_len = NLMSG_LENGTH (sizeof (struct rtgenmsg));
+	request.hdr.nlmsg_type = type;
+	request.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.hdr.nlmsg_seq = seq;
+	request.gen.rtgen_family = family;
+
+	if (send (netlink->fd, &request, request.hdr.nlmsg_len, 0) < 0) {
+		return FALSE;
+	}
+
+	for (;;) {
+		struct nlmsghdr *msg;
+		struct sockaddr_nl addr;
+		socklen_t addr_len = sizeof (addr);
+
+		len = recvfrom (netlink->fd, buf, sizeof (buf), 0,
+		                (struct sockaddr *) &addr, &addr_len);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		/* only the kernel sends from port 0 */
+		if (addr_len != sizeof (addr) || addr.nl_pid != 0) {
+			continue;
+		}
+
+		for (msg = (struct nlmsghdr *) buf;
+		     NLMSG_OK (msg, len);
+		     msg = NLMSG_NEXT (msg, len)) {
+			if (msg->nlmsg_seq != seq) {
+				continue;
+			}
+			if (msg->nlmsg_type == NLMSG_DONE) {
+				return TRUE;
+			}
+			if (msg->nlmsg_type == NLMSG_ERROR) {
+				return FALSE;
+			}
+			func (msg, data);
+		}
+	}
+}
+
+/* Finds the gateway of the default route with the lowest metric */
+static void
+route_func (struct nlmsghdr *msg, gpointer data)
+{
+	RouteQuery *query = data;
+	struct rtmsg *rtm = NLMSG_DATA (msg);
+	struct rtattr *attr;
+	int len;
+	const guchar *gateway = NULL;
+	guint32 priority = 0;
+
+	if (msg->nlmsg_type != RTM_NEWROUTE ||
+	    rtm->rtm_family != query->family ||
+	    rtm->rtm_table != RT_TABLE_MAIN ||
+	    rtm->rtm_type != RTN_UNICAST ||
+	    rtm->rtm_dst_len != 0) {
+		return;
+	}
+
+	len = RTM_PAYLOAD (msg);
+	for (attr = RTM_RTA (rtm); RTA_OK (attr, len); attr = RTA_NEXT (attr, len)) {
+		if (attr->rta_type == RTA_GATEWAY &&
+		    RTA_PAYLOAD (attr) == address_length (query->family)) {
+			gateway = RTA_DATA (attr);
+		} else if (attr->rta_type == RTA_PRIORITY &&
+		           RTA_PAYLOAD (attr) == sizeof (guint32)) {
+			memcpy (&priority, RTA_DATA (attr), sizeof (guint32));
+		}
+	}
+
+	if (gateway && (!query->found || priority < query->priority)) {
+		memcpy (query->address, gateway, address_length (query->family));
+		query->priority = priority;
+		query->found = TRUE;
+	}
+}
+
+/* Returns the link layer address of a neighbour entry for address,
+ * or NULL if it has none usable; FALSE if the entry is not for address */
+static gboolean
+parse_neigh (struct nlmsghdr *msg,
+             int              family,
+             const guchar    *address,
+             const guchar   **lladdr)
+{
+	struct ndmsg *ndm = NLMSG_DATA (msg);
+	struct rtattr *attr;
+	int len;
+	const guchar *dst = NULL;
+
+	*lladdr = NULL;
+	if (ndm->ndm_family != family) {
+		return FALSE;
+	}
+
+	len = msg->nlmsg_len - NLMSG_LENGTH (sizeof (struct ndmsg));
+	for (attr = (struct rtattr *) ((char *) ndm + NLMSG_ALIGN (sizeof (struct ndmsg)));
+	     RTA_OK (attr, len); attr = RTA_NEXT (attr, len)) {
+		if (attr->rta_type == NDA_DST &&
+		    RTA_PAYLOAD (attr) == address_length (family)) {
+			dst = RTA_DATA (attr);
+		} else if (attr->rta_type == NDA_LLADDR && RTA_PAYLOAD (attr) == 6) {
+			*lladdr = RTA_DATA (attr);
+		}
+	}
+
+	if (dst == NULL || memcmp (dst, address, address_length (family)) != 0) {
+		return FALSE;
+	}
+	if (msg->nlmsg_type != RTM_NEWNEIGH ||
+	    ndm->ndm_state & (NUD_INCOMPLETE | NUD_FAILED)) {
+		*lladdr = NULL;
+	}
+	return TRUE;
+}
+
+static void
+neigh_func (struct nlmsghdr *msg, gpointer data)
+{
+	NeighQuery *query = data;
+	const guchar *lladdr;
+
+	if (query->mac == NULL &&
+	    parse_neigh (msg, query->family, query->address, &lladdr) &&
+	    lladdr != NULL) {
+		query->mac = format_mac (lladdr);
+	}
+}
+
+static void
+geoclue_netlink_invalidate (GeoclueNetlink *netlink)
+{
+	netlink->cached = FALSE;
+	g_free (netlink->cache_gateway);
+	netlink->cache_gateway = NULL;
+	g_free (netlink->mac);
+	netlink->mac = NULL;
+}
+
+/* Follows the neighbour entry of the router, and forgets the router
+ * on route changes */
+static gboolean
+monitor_cb (GIOChannel   *source,
+            GIOCondition  condition,
+            gpointer      data)
+{
+	GeoclueNetlink *netlink = data;
+	guchar buf[BUFFER_SIZE];
+	int len;
+
+	if (condition & (G_IO_ERR | G_IO_HUP)) {
+		geoclue_netlink_invalidate (netlink);
+		netlink->monitor_id = 0;
+		return FALSE;
+	}
+
+	while ((len = recv (netlink->monitor_fd, buf, sizeof (buf), MSG_DONTWAIT)) != 0) {
+		struct nlmsghdr *msg;
+
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN) {
+				/* ENOBUFS: notifications were lost */
+				geoclue_netlink_invalidate (netlink);
+			}
+			break;
+		}
+
+		for (msg = (struct nlmsghdr *) buf;
+		     netlink->cached && NLMSG_OK (msg, len);
+		     msg = NLMSG_NEXT (msg, len)) {
+			if (msg->nlmsg_type == RTM_NEWROUTE ||
+			    msg->nlmsg_type == RTM_DELROUTE) {
+				geoclue_netlink_invalidate (netlink);
+			} else if (msg->nlmsg_type == RTM_NEWNEIGH ||
+			           msg->nlmsg_type == RTM_DELNEIGH) {
+				const guchar *lladdr;
+
+				if (parse_neigh (msg, netlink->family,
+				                 netlink->address, &lladdr)) {
+					g_free (netlink->mac);
+					netlink->mac = lladdr ? format_mac (lladdr) : NULL;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+GeoclueNetlink *
+geoclue_netlink_new (void)
+{
+	GeoclueNetlink *netlink;
+	GIOChannel *channel;
+
+	netlink = g_slice_new0 (GeoclueNetlink);
+	netlink->fd = netlink_socket (0);
+	if (netlink->fd < 0) {
+		g_warning ("Could not open a netlink socket: %s",
+		           g_strerror (errno));
+		g_slice_free (GeoclueNetlink, netlink);
+		return NULL;
+	}
+
+	/* without notifications, nothing is cached */
+	netlink->monitor_fd = netlink_socket (RTMGRP_NEIGH |
+	                                      RTMGRP_IPV4_ROUTE |
+	                                      RTMGRP_IPV6_ROUTE);
+	if (netlink->monitor_fd >= 0) {
+		channel = g_io_channel_unix_new (netlink->monitor_fd);
+		netlink->monitor_id = g_io_add_watch (channel,
+		                                      G_IO_IN | G_IO_ERR | G_IO_HUP,
+		                                      monitor_cb, netlink);
+		g_io_channel_unref (channel);
+	}
+
+	return netlink;
+}
+
+void
+geoclue_netlink_free (GeoclueNetlink *netlink)
+{
+	if (netlink->monitor_id) {
+		g_source_remove (netlink->monitor_id);
+	}
+	if (netlink->monitor_fd >= 0) {
+		close (netlink->monitor_fd);
+	}
+	close (netlink->fd);
+	geoclue_netlink_invalidate (netlink);
+	g_slice_free (GeoclueNetlink, netlink);
+}
+
+/* Returns the MAC address of gateway, an IPv4 or IPv6 address, or of
+ * the IPv4 default router when gateway is NULL. */
+char *
+geoclue_netlink_get_router_mac (GeoclueNetlink *netlink,
+                                const char     *gateway)
+{
+	NeighQuery neigh;
+
+	if (netlink->cached && g_strcmp0 (gateway, netlink->cache_gateway) == 0) {
+		return g_strdup (netlink->mac);
+	}
+	geoclue_netlink_invalidate (netlink);
+
+	if (gateway == NULL) {
+		RouteQuery route;
+
+		memset (&route, 0, sizeof (route));
+		route.family = AF_INET;
+		if (!netlink_dump (netlink, RTM_GETROUTE, AF_INET, route_func, &route) ||
+		    !route.found) {
+			return NULL;
+		}
+		netlink->family = AF_INET;
+		memcpy (netlink->address, route.address, sizeof (route.address));
+	} else if (inet_pton (AF_INET, gateway, netlink->address) == 1) {
+		netlink->family = AF_INET;
+	} else if (inet_pton (AF_INET6, gateway, netlink->address) == 1) {
+		netlink->family = AF_INET6;
+	} else {
+		return NULL;
+	}
+
+	neigh.family = netlink->family;
+	neigh.address = netlink->address;
+	neigh.mac = NULL;
+	if (!netlink_dump (netlink, RTM_GETNEIGH, netlink->family, neigh_func, &neigh)) {
+		return NULL;
+	}
+
+	if (netlink->monitor_id) {
+		netlink->cached = TRUE;
+		netlink->cache_gateway = g_strdup (gateway);
+		netlink->mac = g_strdup (neigh.mac);
+	}
+	return neigh.mac;
+}
+
+#endif /* HAVE_NETWORK_MANAGER || HAVE_CONNMAN */
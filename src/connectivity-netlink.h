@@ -0,0 +1,41 @@
+/*
+ * Geoclue
+ * connectivity-netlink.h - Router MAC address from the kernel
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef _CONNECTIVITY_NETLINK_H
+#define _CONNECTIVITY_NETLINK_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GeoclueNetlink GeoclueNetlink;
+
+GeoclueNetlink *geoclue_netlink_new (void);
+void geoclue_netlink_free (GeoclueNetlink *netlink);
+
+char *geoclue_netlink_get_router_mac (GeoclueNetlink *netlink,
+                                      const char     *gateway);
+
+G_END_DECLS
+
+#endif
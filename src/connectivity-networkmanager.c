@@ -81,84 +81,151 @@ static GHashTable *
 get_aps (GeoclueConnectivity *iface)
 {
 	GeoclueNetworkManager *self = GEOCLUE_NETWORKMANAGER (iface);
-	const GPtrArray *devices;
-	GHashTable *ht;
-	guint i;
+	GHashTableIter iter;
+	gpointer mac, dbm;
 
-	devices = nm_client_get_devices (self->client);
-	if (devices == NULL)
+	if (self->aps == NULL || g_hash_table_size (self->aps) == 0)
 		return NULL;
 
-	ht = g_hash_table_new_full (g_str_hash, g_str_equal,
-				    (GDestroyNotify) g_free, NULL);
+	/* snapshots are never modified: the last one is good until
+	 * the access points change */
+	if (self->aps_snapshot == NULL ||
+	    self->snapshot_version != self->aps_version) {
+		if (self->aps_snapshot)
+			g_hash_table_unref (self->aps_snapshot);
+		self->aps_snapshot = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                            (GDestroyNotify) g_free, NULL);
+		g_hash_table_iter_init (&iter, self->aps);
+		while (g_hash_table_iter_next (&iter, &mac, &dbm))
+			g_hash_table_insert (self->aps_snapshot, g_strdup (mac), dbm);
+		self->snapshot_version = self->aps_version;
+	}
 
-	for (i = 0; i < devices->len; i++) {
-		NMDevice *device = g_ptr_array_index (devices, i);
-		if (NM_IS_DEVICE_WIFI (device)) {
-			const GPtrArray *aps;
-			guint j;
+	return g_hash_table_ref (self->aps_snapshot);
+}
 
-			aps = nm_device_wifi_get_access_points (NM_DEVICE_WIFI (device));
-			if (aps == NULL || aps->len == 0)
-				continue;
-			for (j = 0; j < aps->len; j++) {
-				NMAccessPoint *ap = NM_ACCESS_POINT (g_ptr_array_index (aps, j));
-				char *ap_mac;
-				int strength;
-
-				ap_mac = g_strdup (nm_access_point_get_hw_address (ap));
-				strength = nm_access_point_get_strength (ap);
-				g_hash_table_insert (ht, ap_mac, GINT_TO_POINTER (strength_to_dbm (strength)));
-			}
-		}
-	}
-	if (g_hash_table_size (ht) == 0) {
-		g_hash_table_destroy (ht);
-		return NULL;
-	}
+static guint
+get_aps_version (GeoclueConnectivity *iface)
+{
+	GeoclueNetworkManager *self = GEOCLUE_NETWORKMANAGER (iface);
 
-	return ht;
+	return self->aps_version;
 }
 
-static char *
-mac_strup (char *mac)
+/* The access point table follows the NetworkManager signals */
+
+static void
+aps_changed (GeoclueNetworkManager *self)
+{
+	/* 0 is for backends that cannot tell */
+	if (++self->aps_version == 0)
+		self->aps_version = 1;
+}
+
+static void
+ap_update (GeoclueNetworkManager *self, NMAccessPoint *ap)
+{
+	const char *mac;
+	gpointer old_dbm;
+	int dbm;
+
+	mac = nm_access_point_get_hw_address (ap);
+	if (mac == NULL)
+		return;
+
+	dbm = strength_to_dbm (nm_access_point_get_strength (ap));
+	if (g_hash_table_lookup_extended (self->aps, mac, NULL, &old_dbm) &&
+	    GPOINTER_TO_INT (old_dbm) == dbm)
+		return;
+
+	g_hash_table_insert (self->aps, g_strdup (mac), GINT_TO_POINTER (dbm));
+	aps_changed (self);
+}
+
+static void
+ap_strength_cb (GObject *obj, GParamSpec *spec, gpointer userdata)
+{
+	ap_update (GEOCLUE_NETWORKMANAGER (userdata), NM_ACCESS_POINT (obj));
+}
+
+static void
+ap_track (GeoclueNetworkManager *self, NMAccessPoint *ap)
+{
+	g_signal_connect (ap, "notify::strength",
+	                  G_CALLBACK (ap_strength_cb), self);
+	ap_update (self, ap);
+}
+
+static void
+ap_untrack (GeoclueNetworkManager *self, NMAccessPoint *ap)
+{
+	const char *mac;
+
+	g_signal_handlers_disconnect_by_func (ap, ap_strength_cb, self);
+
+	mac = nm_access_point_get_hw_address (ap);
+	if (mac != NULL && g_hash_table_remove (self->aps, mac))
+		aps_changed (self);
+}
+
+static void
+ap_added_cb (NMDeviceWifi *device, NMAccessPoint *ap, gpointer userdata)
+{
+	ap_track (GEOCLUE_NETWORKMANAGER (userdata), ap);
+}
+
+static void
+ap_removed_cb (NMDeviceWifi *device, NMAccessPoint *ap, gpointer userdata)
+{
+	ap_untrack (GEOCLUE_NETWORKMANAGER (userdata), ap);
+}
+
+static void
+device_track (GeoclueNetworkManager *self, NMDevice *device)
 {
+	const GPtrArray *aps;
 	guint i;
-	for (i = 0; mac[i] != '\0' ; i++) {
-		if (g_ascii_isalpha (mac[i]))
-			mac[i] = g_ascii_toupper (mac[i]);
-	}
-	return mac;
+
+	if (!NM_IS_DEVICE_WIFI (device))
+		return;
+
+	g_signal_connect (device, "access-point-added",
+	                  G_CALLBACK (ap_added_cb), self);
+	g_signal_connect (device, "access-point-removed",
+	                  G_CALLBACK (ap_removed_cb), self);
+
+	aps = nm_device_wifi_get_access_points (NM_DEVICE_WIFI (device));
+	for (i = 0; aps != NULL && i < aps->len; i++)
+		ap_track (self, NM_ACCESS_POINT (g_ptr_array_index (aps, i)));
 }
 
-static char *
-get_mac_for_gateway (const char *gateway)
+static void
+device_untrack (GeoclueNetworkManager *self, NMDevice *device)
 {
-	char *cmd, *out, *mac, **split;
+	const GPtrArray *aps;
+	guint i;
 
-	cmd = g_strdup_printf ("ip neigh show %s", gateway);
+	if (!NM_IS_DEVICE_WIFI (device))
+		return;
 
-	if (g_spawn_command_line_sync (cmd, &out, NULL, NULL, NULL) == FALSE) {
-		g_free (out);
-		g_free (cmd);
-		return NULL;
-	}
-	g_free (cmd);
+	g_signal_handlers_disconnect_by_func (device, ap_added_cb, self);
+	g_signal_handlers_disconnect_by_func (device, ap_removed_cb, self);
 
-	/* 192.168.1.1 dev eth0 lladdr 00:00:00:00:00:00 STALE */
-	split = g_strsplit (out, " ", -1);
-	g_free (out);
+	aps = nm_device_wifi_get_access_points (NM_DEVICE_WIFI (device));
+	for (i = 0; aps != NULL && i < aps->len; i++)
+		ap_untrack (self, NM_ACCESS_POINT (g_ptr_array_index (aps, i)));
+}
 
-	if (split == NULL)
-		return NULL;
-	if (g_strv_length (split) != 6) {
-		g_strfreev (split);
-		return NULL;
-	}
-	mac = g_strdup (split[4]);
-	g_strfreev (split);
+static void
+device_added_cb (NMClient *client, NMDevice *device, gpointer userdata)
+{
+	device_track (GEOCLUE_NETWORKMANAGER (userdata), device);
+}
 
-	return mac_strup (mac);
+static void
+device_removed_cb (NMClient *client, NMDevice *device, gpointer userdata)
+{
+	device_untrack (GEOCLUE_NETWORKMANAGER (userdata), device);
 }
 
 static gchar *
@@ -184,13 +251,16 @@ get_router_mac (GeoclueConnectivity *iface)
 	char *gateway, *mac;
 	guint i;
 
+	if (self->netlink == NULL)
+		return NULL;
+
 	devices = nm_client_get_devices (self->client);
 	if (devices == NULL)
 		return NULL;
 
 	gateway = NULL;
 
-	for (i = 0; i < devices->len; i++) {
+	for (i = 0; gateway == NULL && i < devices->len; i++) {
 		NMDevice *device = g_ptr_array_index (devices, i);
 		NMIP4Config *cfg4;
 		GSList *iter;
@@ -205,15 +275,16 @@ get_router_mac (GeoclueConnectivity *iface)
 		for (iter = (GSList *) nm_ip4_config_get_addresses (cfg4); iter; iter = g_slist_next (iter)) {
 			NMIP4Address *addr = (NMIP4Address *) iter->data;
 
+			if (nm_ip4_address_get_gateway (addr) == 0)
+				continue;
 			gateway = ip4_address_as_string (nm_ip4_address_get_gateway (addr));
 			if (gateway != NULL)
 				break;
 		}
 	}
-	if (gateway == NULL)
-		return NULL;
-
-	mac = get_mac_for_gateway (gateway);
+	/* without a gateway from NetworkManager, the kernel default
+	 * route is used */
+	mac = geoclue_netlink_get_router_mac (self->netlink, gateway);
 	g_free (gateway);
 
 	return mac;
@@ -268,8 +339,30 @@ dispose (GObject *object)
 	
 	g_free (self->cache_ap_mac);
 	self->cache_ap_mac = NULL;
+	if (self->client) {
+		const GPtrArray *devices;
+		guint i;
+
+		g_signal_handlers_disconnect_by_func (self->client, device_added_cb, self);
+		g_signal_handlers_disconnect_by_func (self->client, device_removed_cb, self);
+		devices = nm_client_get_devices (self->client);
+		for (i = 0; devices != NULL && i < devices->len; i++)
+			device_untrack (self, g_ptr_array_index (devices, i));
+	}
 	g_object_unref (self->client);
 	self->client = NULL;
+	if (self->aps_snapshot) {
+		g_hash_table_unref (self->aps_snapshot);
+		self->aps_snapshot = NULL;
+	}
+	if (self->aps) {
+		g_hash_table_destroy (self->aps);
+		self->aps = NULL;
+	}
+	if (self->netlink) {
+		geoclue_netlink_free (self->netlink);
+		self->netlink = NULL;
+	}
 	((GObjectClass *) geoclue_networkmanager_parent_class)->dispose (object);
 }
 
@@ -340,7 +433,13 @@ nm_update_status_cb (GObject *obj, GParamSpec *spec, gpointer userdata)
 static void
 geoclue_networkmanager_init (GeoclueNetworkManager *self)
 {
+	const GPtrArray *devices;
+	guint i;
+
 	self->status = GEOCLUE_CONNECTIVITY_UNKNOWN;
+	self->aps = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                   (GDestroyNotify) g_free, NULL);
+	self->netlink = geoclue_netlink_new ();
 	self->client = nm_client_new ();
 	if (self->client == NULL) {
 		g_warning ("%s was unable to create a connection to NetworkManager",
@@ -353,6 +452,14 @@ geoclue_networkmanager_init (GeoclueNetworkManager *self)
 	g_signal_connect (G_OBJECT (self->client), "notify::state",
 	                  G_CALLBACK (nm_update_status_cb), self);
 
+	g_signal_connect (G_OBJECT (self->client), "device-added",
+	                  G_CALLBACK (device_added_cb), self);
+	g_signal_connect (G_OBJECT (self->client), "device-removed",
+	                  G_CALLBACK (device_removed_cb), self);
+	devices = nm_client_get_devices (self->client);
+	for (i = 0; devices != NULL && i < devices->len; i++)
+		device_track (self, g_ptr_array_index (devices, i));
+
 	/* get initial status */
 	update_status (self, FALSE);
 }
@@ -364,6 +471,7 @@ geoclue_networkmanager_connectivity_init (GeoclueConnectivityInterface *iface)
 	iface->get_ap_mac = get_ap_mac;
 	iface->get_router_mac = get_router_mac;
 	iface->get_aps    = get_aps;
+	iface->get_aps_version = get_aps_version;
 }
 
 #endif /* HAVE_NETWORK_MANAGER */
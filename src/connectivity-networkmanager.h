@@ -28,6 +28,7 @@
 #include <glib-object.h>
 #include <nm-client.h>
 #include "connectivity.h"
+#include "connectivity-netlink.h"
 
 
 G_BEGIN_DECLS
@@ -41,6 +42,13 @@ typedef struct {
 	/* private */
 	GeoclueNetworkStatus status;
 	NMClient *client;
+	GeoclueNetlink *netlink;
+	/* MAC -> dBm of the access points heard, kept up to date */
+	GHashTable *aps;
+	guint aps_version;
+	/* copy of aps at snapshot_version, handed out by get_aps */
+	GHashTable *aps_snapshot;
+	guint snapshot_version;
 	char *cache_ap_mac;
 	int ap_strength;
 } GeoclueNetworkManager;
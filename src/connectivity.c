@@ -268,6 +268,18 @@ geoclue_connectivity_get_aps (GeoclueConnectivity *self)
 	return NULL;
 }
 
+/* Changes whenever the access points returned by get_aps() change.
+ * 0 means the backend cannot tell. */
+guint
+geoclue_connectivity_get_aps_version (GeoclueConnectivity *self)
+{
+	if (self != NULL &&
+	    GEOCLUE_CONNECTIVITY_GET_INTERFACE (self)->get_aps_version != NULL)
+		return GEOCLUE_CONNECTIVITY_GET_INTERFACE (self)->get_aps_version (self);
+
+	return 0;
+}
+
 void
 geoclue_connectivity_emit_status_changed (GeoclueConnectivity *self,
                                           GeoclueNetworkStatus status)
@@ -51,6 +51,7 @@ struct _GeoclueConnectivityInterface {
 	GHashTable * (*get_aps) (GeoclueConnectivity *self);
 	char * (*get_ap_mac) (GeoclueConnectivity *self);
 	char * (*get_router_mac) (GeoclueConnectivity *self);
+	guint (*get_aps_version) (GeoclueConnectivity *self);
 };
 
 GType geoclue_connectivity_get_type (void);
@@ -62,7 +63,10 @@ GeoclueNetworkStatus geoclue_connectivity_get_status (GeoclueConnectivity *self)
 char *geoclue_connectivity_get_ap_mac (GeoclueConnectivity *self);
 char *geoclue_connectivity_get_router_mac (GeoclueConnectivity *self);
 
+/* The table may be shared: do not modify it, release it with
+ * g_hash_table_unref() */
 GHashTable *geoclue_connectivity_get_aps (GeoclueConnectivity *self);
+guint geoclue_connectivity_get_aps_version (GeoclueConnectivity *self);
 
 void
 geoclue_connectivity_emit_status_changed (GeoclueConnectivity *self,
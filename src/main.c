@@ -33,6 +33,8 @@
 #include <dbus/dbus-glib.h>
 #include <dbus/dbus-glib-bindings.h>
 
+#include <geoclue/gc-provider.h>
+
 #include "master.h"
 
 static GMainLoop *mainloop;
@@ -72,6 +74,10 @@ gvariant_value_to_value (GVariant *value)
 		i = g_variant_get_uint32 (value);
 		g_value_init (gvalue, G_TYPE_INT);
 		g_value_set_int (gvalue, i);
+	} else if (g_variant_type_is_subtype_of (type, G_VARIANT_TYPE_BOOLEAN)) {
+		gvalue = g_new0 (GValue, 1);
+		g_value_init (gvalue, G_TYPE_BOOLEAN);
+		g_value_set_boolean (gvalue, g_variant_get_boolean (value));
 	} else {
 		gvalue = NULL;
 		g_warning ("Value is of unknown type");
@@ -97,6 +103,8 @@ debug_print_key (gboolean init,
 		string = g_value_dup_string (gvalue);
 	} else if (G_VALUE_TYPE (gvalue) == G_TYPE_INT) {
 		string = g_strdup_printf ("%d", g_value_get_int (gvalue));
+	} else if (G_VALUE_TYPE (gvalue) == G_TYPE_BOOLEAN) {
+		string = g_strdup (g_value_get_boolean (gvalue) ? "true" : "false");
 	} else {
 		return;
 	}
@@ -143,7 +151,9 @@ load_options (void)
         guint i;
         const char const * keys[] = {
 		"gps-baudrate",
-		"gps-device"
+		"gps-device",
+		"track-log",
+		"fuse-positions"
 	};
 
         /* Setup keys monitoring */
@@ -192,6 +202,8 @@ main (int    argc,
 	guint32 request_name_ret;
 
 	g_type_init ();
+	/* every GcProvider in the master is an in-process one */
+	gc_provider_set_plugin_mode (TRUE);
 
 	mainloop = g_main_loop_new (NULL, FALSE);
 
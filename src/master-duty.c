@@ -0,0 +1,114 @@
+/*
+ * Geoclue
+ * master-duty.c - GPS duty cycle from client requirements
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Decides how long a GPS provider may stop streaming between fixes.
+ *
+ *  The receiver streams unless every client counted here opted in by
+ *  setting the GPSInterval option on its master client. Such a client
+ *  allows up to that many seconds between fixes, but no more than its
+ *  min_time or, with an accuracy level, the time it takes to move as
+ *  far as its accuracy radius at the last known speed. The provider
+ *  gets the shortest of these. The track recorder and shared memory
+ *  readers do not count. Subscribers that are not clients (e.g. the
+ *  Fused provider) want every fix.
+ **/
+
+#include "client.h"
+#include "master-fusion.h"
+#include "master-duty.h"
+
+/* shorter intervals are not worth stopping the receiver for (s) */
+#define MIN_INTERVAL 10
+/* the receiver should not lose its ephemeris (s) */
+#define MAX_INTERVAL 300
+/* intervals are rounded down to this, so that small speed changes
+ * do not send new options every time (s) */
+#define INTERVAL_STEP 10
+/* assumed when the provider has not reported a speed (m/s) */
+#define UNKNOWN_SPEED 30.0
+/* slower than this counts as walking (m/s) */
+#define MIN_SPEED 1.0
+
+static int
+gc_duty_cycle_get_client_interval (GeoclueAccuracyLevel level,
+                                   int                  min_time,
+                                   int                  gps_interval,
+                                   double               speed)
+{
+	double interval = gps_interval;
+	
+	if (gps_interval <= 0) {
+		return 0;
+	}
+	if (level != GEOCLUE_ACCURACY_LEVEL_NONE) {
+		interval = MIN (interval,
+		                MAX (gc_accuracy_level_get_radius (level) / speed,
+		                     min_time));
+	}
+	return (int) MIN (interval, MAX_INTERVAL);
+}
+
+/* Seconds between fixes the position clients in 'clients' allow, 0 if
+ * the GPS should stream continuously. 'fields' and 'speed' are the
+ * last velocity from the provider. */
+int
+gc_duty_cycle_get_interval (GList                *clients,
+                            GeoclueVelocityFields fields,
+                            double                speed)
+{
+	int interval = MAX_INTERVAL;
+	gboolean counted = FALSE;
+	GList *l;
+	
+	
+	if (fields & GEOCLUE_VELOCITY_FIELDS_SPEED) {
+		speed = MAX (speed, MIN_SPEED);
+	} else {
+		speed = UNKNOWN_SPEED;
+	}
+	
+	for (l = clients; l && interval > 0; l = l->next) {
+		GeoclueAccuracyLevel level;
+		int min_time;
+		int gps_interval;
+		
+		if (!GC_IS_MASTER_CLIENT (l->data)) {
+			return 0;
+		}
+		if (!gc_master_client_get_gps_interval (l->data, &gps_interval)) {
+			continue;
+		}
+		counted = TRUE;
+		gc_master_client_get_requirements (l->data, &level, &min_time);
+		interval = MIN (interval,
+		                gc_duty_cycle_get_client_interval (level, min_time,
+		                                                   gps_interval,
+		                                                   speed));
+	}
+	
+	if (!counted || interval < MIN_INTERVAL) {
+		return 0;
+	}
+	return interval - interval % INTERVAL_STEP;
+}
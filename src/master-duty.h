@@ -0,0 +1,44 @@
+/*
+ * Geoclue
+ * master-duty.h - GPS duty cycle from client requirements
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_DUTY_H
+#define MASTER_DUTY_H
+
+#include <glib.h>
+#include <geoclue/geoclue-types.h>
+
+G_BEGIN_DECLS
+
+/* provider option: seconds between GPS fixes, 0 for continuous */
+#define GC_DUTY_CYCLE_OPTION "org.freedesktop.Geoclue.GPSInterval"
+/* provider option: number of clients of a cell provider, which need
+ * not poll the modem without any */
+#define GC_CLIENTS_OPTION "org.freedesktop.Geoclue.Clients"
+
+int gc_duty_cycle_get_interval (GList                *clients,
+                                GeoclueVelocityFields fields,
+                                double                speed);
+
+G_END_DECLS
+
+#endif /* MASTER_DUTY_H */
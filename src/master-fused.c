@@ -0,0 +1,366 @@
+/*
+ * Geoclue
+ * master-fused.c - Position provider fusing the other providers
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  The "Fused" provider runs in the master and combines the positions
+ *  of all updating position providers with a Kalman filter (see
+ *  master-fusion.c) instead of using just one of them. Clients get
+ *  smoother positions from it, and a useful estimate right after GPS
+ *  drops out.
+ *
+ *  It is used like a plug-in provider (see gc_master_provider_new_in_process()):
+ *  like them it is registered on the master's connection, so that
+ *  clients following PositionProviderChanged can talk to it directly.
+ **/
+
+#include <config.h>
+
+#include <time.h>
+
+#include <geoclue/gc-iface-position.h>
+#include <geoclue/gc-iface-velocity.h>
+
+#include "master-fused.h"
+
+/* older fixes (e.g. cached ones of idle providers) are ignored (s) */
+#define FUSED_MAX_AGE 120
+
+static GList *fused_sources = NULL;
+
+static void gc_master_fused_position_init (GcIfacePositionClass *iface);
+static void gc_master_fused_velocity_init (GcIfaceVelocityClass *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GcMasterFused, gc_master_fused, GC_TYPE_PROVIDER,
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_POSITION,
+                                                gc_master_fused_position_init)
+                         G_IMPLEMENT_INTERFACE (GC_TYPE_IFACE_VELOCITY,
+                                                gc_master_fused_velocity_init))
+
+/* The providers that new Fused objects use. Called by GcMaster
+ * before the first client can subscribe. */
+void
+gc_master_fused_set_sources (GList *sources)
+{
+	g_list_free (fused_sources);
+	fused_sources = g_list_copy (sources);
+}
+
+static void
+gc_master_fused_set_status (GcMasterFused *fused,
+                            GeoclueStatus  status)
+{
+	if (status == fused->status) {
+		return;
+	}
+	fused->status = status;
+	gc_iface_geoclue_emit_status_changed (GC_IFACE_GEOCLUE (fused), status);
+}
+
+/* Current estimate, GEOCLUE_POSITION_FIELDS_NONE if there is none */
+static GeocluePositionFields
+gc_master_fused_get_estimate (GcMasterFused    *fused,
+                              int              *timestamp,
+                              double           *latitude,
+                              double           *longitude,
+                              double           *altitude,
+                              GeoclueAccuracy **accuracy)
+{
+	GeocluePositionFields fields = GEOCLUE_POSITION_FIELDS_NONE;
+	double horizontal = 0.0, vertical = 0.0;
+	double time;
+
+	*timestamp = 0;
+	*latitude = *longitude = *altitude = 0.0;
+
+	time = gc_fusion_filter_get_time (fused->filter);
+	if (gc_fusion_filter_get_position (fused->filter, time,
+	                                   latitude, longitude, &horizontal)) {
+		fields |= GEOCLUE_POSITION_FIELDS_LATITUDE |
+		          GEOCLUE_POSITION_FIELDS_LONGITUDE;
+		*timestamp = (int) time;
+		if (gc_fusion_filter_get_altitude (fused->filter, time,
+		                                   altitude, &vertical)) {
+			fields |= GEOCLUE_POSITION_FIELDS_ALTITUDE;
+		}
+	}
+
+	if (accuracy) {
+		GeoclueAccuracyLevel level = GEOCLUE_ACCURACY_LEVEL_NONE;
+
+		if (fields != GEOCLUE_POSITION_FIELDS_NONE) {
+			level = gc_accuracy_level_for_radius (horizontal);
+		}
+		*accuracy = geoclue_accuracy_new (level, horizontal, vertical);
+	}
+	return fields;
+}
+
+/* 'fix_time' is when the fix arrived, with sub-second resolution where
+ * known: a 5 Hz receiver sends several fixes per timestamp */
+static void
+gc_master_fused_add_fix (GcMasterFused        *fused,
+                         GeocluePositionFields fields,
+                         double                fix_time,
+                         double                latitude,
+                         double                longitude,
+                         double                altitude,
+                         GeoclueAccuracy      *accuracy)
+{
+	GeoclueAccuracyLevel level;
+	double horizontal, vertical;
+
+	if ((fields & GEOCLUE_POSITION_FIELDS_LATITUDE) == 0 ||
+	    (fields & GEOCLUE_POSITION_FIELDS_LONGITUDE) == 0 ||
+	    accuracy == NULL ||
+	    fix_time < time (NULL) - FUSED_MAX_AGE) {
+		return;
+	}
+	geoclue_accuracy_get_details (accuracy, &level, &horizontal, &vertical);
+	if (level == GEOCLUE_ACCURACY_LEVEL_NONE) {
+		return;
+	}
+	if (horizontal <= 0.0) {
+		horizontal = gc_accuracy_level_get_radius (level);
+	}
+
+	if (!gc_fusion_filter_update (fused->filter, fix_time,
+	                              latitude, longitude, horizontal)) {
+		/* rejected as an outlier */
+		return;
+	}
+	if ((fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) && vertical > 0.0) {
+		gc_fusion_filter_update_altitude (fused->filter, fix_time,
+		                                  altitude, vertical);
+	}
+}
+
+static void
+source_position_changed (GcMasterProvider     *source,
+                         GeocluePositionFields fields,
+                         int                   timestamp,
+                         double                latitude,
+                         double                longitude,
+                         double                altitude,
+                         GeoclueAccuracy      *accuracy,
+                         GcMasterFused        *fused)
+{
+	GeoclueAccuracy *estimate_accuracy;
+	GeoclueVelocityFields velocity_fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	double speed = 0.0, direction = 0.0;
+	GTimeVal now;
+
+	/* the fix arrived just now, 'timestamp' is whole seconds */
+	g_get_current_time (&now);
+	gc_master_fused_add_fix (fused, fields, now.tv_sec + now.tv_usec / 1e6,
+	                         latitude, longitude, altitude, accuracy);
+
+	fields = gc_master_fused_get_estimate (fused, &timestamp,
+	                                       &latitude, &longitude, &altitude,
+	                                       &estimate_accuracy);
+	if (fields == GEOCLUE_POSITION_FIELDS_NONE) {
+		geoclue_accuracy_free (estimate_accuracy);
+		return;
+	}
+	gc_master_fused_set_status (fused, GEOCLUE_STATUS_AVAILABLE);
+	gc_iface_position_emit_position_changed (GC_IFACE_POSITION (fused),
+	                                         fields, timestamp,
+	                                         latitude, longitude, altitude,
+	                                         estimate_accuracy);
+	geoclue_accuracy_free (estimate_accuracy);
+
+	if (gc_fusion_filter_get_velocity (fused->filter, &speed, &direction)) {
+		velocity_fields = GEOCLUE_VELOCITY_FIELDS_SPEED |
+		                  GEOCLUE_VELOCITY_FIELDS_DIRECTION;
+	}
+	gc_iface_velocity_emit_velocity_changed (GC_IFACE_VELOCITY (fused),
+	                                         velocity_fields, timestamp,
+	                                         speed, direction, 0.0);
+}
+
+static void
+gc_master_fused_start (GcMasterFused *fused)
+{
+	GList *l;
+
+	for (l = fused_sources; l; l = l->next) {
+		GcMasterProvider *source = l->data;
+		GeocluePositionFields fields;
+		int timestamp;
+		double latitude, longitude, altitude;
+		GeoclueAccuracy *accuracy = NULL;
+		GError *error = NULL;
+
+		gc_master_provider_subscribe (source, fused, GC_IFACE_POSITION);
+		g_signal_connect (source, "position-changed",
+		                  G_CALLBACK (source_position_changed), fused);
+		fused->sources = g_list_prepend (fused->sources, source);
+
+		/* network providers may not send anything for a long time */
+		if (gc_master_provider_get_status (source) != GEOCLUE_STATUS_AVAILABLE) {
+			continue;
+		}
+		fields = gc_master_provider_get_position (source, &timestamp,
+		                                          &latitude, &longitude, &altitude,
+		                                          &accuracy, &error);
+		if (error) {
+			g_error_free (error);
+		} else {
+			gc_master_fused_add_fix (fused, fields, timestamp,
+			                         latitude, longitude, altitude, accuracy);
+		}
+		if (accuracy) {
+			geoclue_accuracy_free (accuracy);
+		}
+	}
+
+	if (gc_fusion_filter_get_time (fused->filter) > 0.0) {
+		fused->status = GEOCLUE_STATUS_AVAILABLE;
+	} else if (fused->sources) {
+		fused->status = GEOCLUE_STATUS_ACQUIRING;
+	}
+}
+
+static void
+gc_master_fused_stop (GcMasterFused *fused)
+{
+	GList *l;
+
+	for (l = fused->sources; l; l = l->next) {
+		g_signal_handlers_disconnect_by_func (l->data,
+		                                      source_position_changed,
+		                                      fused);
+		gc_master_provider_unsubscribe (l->data, fused, GC_IFACE_POSITION);
+	}
+	g_list_free (fused->sources);
+	fused->sources = NULL;
+}
+
+static gboolean
+get_status (GcIfaceGeoclue *gc,
+            GeoclueStatus  *status,
+            GError        **error)
+{
+	*status = GC_MASTER_FUSED (gc)->status;
+	return TRUE;
+}
+
+static void
+shutdown (GcProvider *provider)
+{
+	/* lives as long as the master uses it */
+}
+
+static void
+dispose (GObject *object)
+{
+	GcMasterFused *fused = GC_MASTER_FUSED (object);
+
+	gc_master_fused_stop (fused);
+
+	((GObjectClass *) gc_master_fused_parent_class)->dispose (object);
+}
+
+static void
+finalize (GObject *object)
+{
+	gc_fusion_filter_free (GC_MASTER_FUSED (object)->filter);
+
+	((GObjectClass *) gc_master_fused_parent_class)->finalize (object);
+}
+
+static void
+gc_master_fused_class_init (GcMasterFusedClass *klass)
+{
+	GObjectClass *o_class = (GObjectClass *) klass;
+	GcProviderClass *p_class = (GcProviderClass *) klass;
+
+	o_class->dispose = dispose;
+	o_class->finalize = finalize;
+
+	p_class->get_status = get_status;
+	p_class->shutdown = shutdown;
+}
+
+static void
+gc_master_fused_init (GcMasterFused *fused)
+{
+	fused->filter = gc_fusion_filter_new ();
+	fused->status = GEOCLUE_STATUS_UNAVAILABLE;
+
+	gc_provider_set_details (GC_PROVIDER (fused),
+	                         GC_MASTER_FUSED_SERVICE,
+	                         GC_MASTER_FUSED_PATH,
+	                         GC_MASTER_FUSED_NAME,
+	                         "Combines the positions of all position providers");
+
+	gc_master_fused_start (fused);
+}
+
+static gboolean
+get_position (GcIfacePosition       *gc,
+              GeocluePositionFields *fields,
+              int                   *timestamp,
+              double                *latitude,
+              double                *longitude,
+              double                *altitude,
+              GeoclueAccuracy      **accuracy,
+              GError               **error)
+{
+	*fields = gc_master_fused_get_estimate (GC_MASTER_FUSED (gc), timestamp,
+	                                        latitude, longitude, altitude,
+	                                        accuracy);
+	return TRUE;
+}
+
+static void
+gc_master_fused_position_init (GcIfacePositionClass *iface)
+{
+	iface->get_position = get_position;
+}
+
+static gboolean
+get_velocity (GcIfaceVelocity       *gc,
+              GeoclueVelocityFields *fields,
+              int                   *timestamp,
+              double                *speed,
+              double                *direction,
+              double                *climb,
+              GError               **error)
+{
+	GcMasterFused *fused = GC_MASTER_FUSED (gc);
+
+	*fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	*timestamp = (int) gc_fusion_filter_get_time (fused->filter);
+	*speed = *direction = *climb = 0.0;
+	if (gc_fusion_filter_get_velocity (fused->filter, speed, direction)) {
+		*fields = GEOCLUE_VELOCITY_FIELDS_SPEED |
+		          GEOCLUE_VELOCITY_FIELDS_DIRECTION;
+	}
+	return TRUE;
+}
+
+static void
+gc_master_fused_velocity_init (GcIfaceVelocityClass *iface)
+{
+	iface->get_velocity = get_velocity;
+}
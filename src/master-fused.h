@@ -0,0 +1,59 @@
+/*
+ * Geoclue
+ * master-fused.h - Position provider fusing the other providers
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_FUSED_H
+#define MASTER_FUSED_H
+
+#include <geoclue/gc-provider.h>
+
+#include "master-fusion.h"
+#include "master-provider.h"
+
+G_BEGIN_DECLS
+
+#define GC_TYPE_MASTER_FUSED (gc_master_fused_get_type ())
+#define GC_MASTER_FUSED(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GC_TYPE_MASTER_FUSED, GcMasterFused))
+
+#define GC_MASTER_FUSED_NAME "Fused"
+#define GC_MASTER_FUSED_SERVICE "org.freedesktop.Geoclue.Master"
+#define GC_MASTER_FUSED_PATH "/org/freedesktop/Geoclue/Master/Fused"
+
+typedef struct {
+	GcProvider parent;
+
+	GList *sources; /* subscribed GcMasterProviders */
+	GcFusionFilter *filter;
+	GeoclueStatus status;
+} GcMasterFused;
+
+typedef struct {
+	GcProviderClass parent_class;
+} GcMasterFusedClass;
+
+GType gc_master_fused_get_type (void);
+
+void gc_master_fused_set_sources (GList *sources);
+
+G_END_DECLS
+
+#endif /* MASTER_FUSED_H */
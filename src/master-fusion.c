@@ -0,0 +1,350 @@
+/*
+ * Geoclue
+ * master-fusion.c - Kalman filter for combining position fixes
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Constant velocity Kalman filter over position fixes of any
+ *  provider. Each fix is weighted by its horizontal accuracy, so a
+ *  GPS fix pulls the estimate much harder than a cell or network fix,
+ *  and cell fixes still keep the estimate near the truth while GPS is
+ *  away.
+ *
+ *  The state is the position (kept as latitude and longitude, the
+ *  innovations are taken in meters) and the east and north velocity.
+ *  Both axes see the same measurement noise, so they share one 2x2
+ *  covariance. Altitude is a separate random walk.
+ *
+ *  Fixes that are too far from the prediction are rejected, and the
+ *  filter starts again from the fix after a few rejections in a row
+ *  (e.g. the estimate followed a bad fix).
+ **/
+
+#include <string.h>
+#include <math.h>
+
+#include <geoclue/gc-geo.h>
+
+#include "master-fusion.h"
+
+/* white acceleration noise (m^2/s^3): allows a couple of m/s^2 */
+#define PROCESS_NOISE 2.0
+/* altitude random walk (m^2/s) */
+#define ALTITUDE_PROCESS_NOISE 0.5
+/* initial speed uncertainty (m/s) */
+#define INITIAL_SPEED_DEVIATION 30.0
+/* squared normalized innovation limit: 99.9% for 2 degrees of freedom */
+#define GATE_LIMIT 13.8
+#define MAX_REJECTIONS 3
+/* start again after a silence this long (s) */
+#define MAX_PREDICTION 600.0
+/* velocity is only reported when known this well (m/s) */
+#define MAX_SPEED_DEVIATION 5.0
+
+/* fixes without an error estimate are assumed to be this good */
+static const double level_radius[] = {
+	0.0,		/* GEOCLUE_ACCURACY_LEVEL_NONE */
+	500000.0,	/* GEOCLUE_ACCURACY_LEVEL_COUNTRY */
+	100000.0,	/* GEOCLUE_ACCURACY_LEVEL_REGION */
+	10000.0,	/* GEOCLUE_ACCURACY_LEVEL_LOCALITY */
+	5000.0,		/* GEOCLUE_ACCURACY_LEVEL_POSTALCODE */
+	1000.0,		/* GEOCLUE_ACCURACY_LEVEL_STREET */
+	100.0		/* GEOCLUE_ACCURACY_LEVEL_DETAILED */
+};
+
+struct _GcFusionFilter {
+	gboolean initialized;
+	double time;
+
+	double latitude;
+	double longitude;
+	double velocity_east;
+	double velocity_north;
+	/* position and velocity covariance, same for both axes */
+	double p_pos;
+	double p_cross;
+	double p_vel;
+	guint rejections;
+
+	gboolean has_altitude;
+	double altitude_time;
+	double altitude;
+	double p_altitude;
+};
+
+GcFusionFilter *
+gc_fusion_filter_new (void)
+{
+	return g_new0 (GcFusionFilter, 1);
+}
+
+void
+gc_fusion_filter_free (GcFusionFilter *filter)
+{
+	g_free (filter);
+}
+
+void
+gc_fusion_filter_reset (GcFusionFilter *filter)
+{
+	memset (filter, 0, sizeof (GcFusionFilter));
+}
+
+static double
+meters_per_degree_longitude (double latitude)
+{
+	return GC_METERS_PER_DEGREE * MAX (cos (latitude * G_PI / 180.0), 1e-6);
+}
+
+/* covariance 'dt' seconds after the filter time */
+static void
+predict_covariance (const GcFusionFilter *filter,
+                    double                dt,
+                    double               *p_pos,
+                    double               *p_cross,
+                    double               *p_vel)
+{
+	*p_pos = filter->p_pos + 2 * dt * filter->p_cross + dt * dt * filter->p_vel +
+	         PROCESS_NOISE * dt * dt * dt / 3;
+	*p_cross = filter->p_cross + dt * filter->p_vel + PROCESS_NOISE * dt * dt / 2;
+	*p_vel = filter->p_vel + PROCESS_NOISE * dt;
+}
+
+static void
+predict_position (const GcFusionFilter *filter,
+                  double                dt,
+                  double               *latitude,
+                  double               *longitude)
+{
+	*latitude = filter->latitude + filter->velocity_north * dt / GC_METERS_PER_DEGREE;
+	*longitude = filter->longitude + filter->velocity_east * dt /
+	             meters_per_degree_longitude (filter->latitude);
+	*latitude = CLAMP (*latitude, -90.0, 90.0);
+	if (*longitude > 180.0) {
+		*longitude -= 360.0;
+	} else if (*longitude < -180.0) {
+		*longitude += 360.0;
+	}
+}
+
+static void
+gc_fusion_filter_start (GcFusionFilter *filter,
+                        double          time,
+                        double          latitude,
+                        double          longitude,
+                        double          variance)
+{
+	filter->initialized = TRUE;
+	filter->time = time;
+	filter->latitude = latitude;
+	filter->longitude = longitude;
+	filter->velocity_east = 0.0;
+	filter->velocity_north = 0.0;
+	filter->p_pos = variance;
+	filter->p_cross = 0.0;
+	filter->p_vel = INITIAL_SPEED_DEVIATION * INITIAL_SPEED_DEVIATION;
+	filter->rejections = 0;
+}
+
+/* Adds a fix. Returns FALSE if the fix was rejected as an outlier.
+ * Fixes older than the previous one are used as if they were current. */
+gboolean
+gc_fusion_filter_update (GcFusionFilter *filter,
+                         double          time,
+                         double          latitude,
+                         double          longitude,
+                         double          horizontal_accuracy)
+{
+	double variance, dt, p_pos, p_cross, p_vel;
+	double predicted_latitude, predicted_longitude;
+	double lon_scale, innovation_east, innovation_north, s, gain_pos, gain_vel;
+
+	g_return_val_if_fail (horizontal_accuracy > 0.0, FALSE);
+
+	variance = horizontal_accuracy * horizontal_accuracy;
+	dt = MAX (time - filter->time, 0.0);
+
+	if (!filter->initialized || dt > MAX_PREDICTION) {
+		gc_fusion_filter_start (filter, time, latitude, longitude, variance);
+		return TRUE;
+	}
+
+	predict_covariance (filter, dt, &p_pos, &p_cross, &p_vel);
+	predict_position (filter, dt, &predicted_latitude, &predicted_longitude);
+
+	lon_scale = meters_per_degree_longitude (predicted_latitude);
+	innovation_north = (latitude - predicted_latitude) * GC_METERS_PER_DEGREE;
+	innovation_east = longitude - predicted_longitude;
+	if (innovation_east > 180.0) {
+		innovation_east -= 360.0;
+	} else if (innovation_east < -180.0) {
+		innovation_east += 360.0;
+	}
+	innovation_east *= lon_scale;
+
+	s = p_pos + variance;
+	if ((innovation_east * innovation_east +
+	     innovation_north * innovation_north) / s > GATE_LIMIT) {
+		if (++filter->rejections >= MAX_REJECTIONS) {
+			gc_fusion_filter_start (filter, time, latitude, longitude, variance);
+			return TRUE;
+		}
+		return FALSE;
+	}
+	filter->rejections = 0;
+
+	gain_pos = p_pos / s;
+	gain_vel = p_cross / s;
+
+	filter->time = MAX (time, filter->time);
+	filter->latitude = predicted_latitude + gain_pos * innovation_north / GC_METERS_PER_DEGREE;
+	filter->longitude = predicted_longitude + gain_pos * innovation_east / lon_scale;
+	filter->velocity_north += gain_vel * innovation_north;
+	filter->velocity_east += gain_vel * innovation_east;
+
+	filter->p_pos = (1 - gain_pos) * p_pos;
+	filter->p_cross = (1 - gain_pos) * p_cross;
+	filter->p_vel = p_vel - gain_vel * p_cross;
+
+	return TRUE;
+}
+
+void
+gc_fusion_filter_update_altitude (GcFusionFilter *filter,
+                                  double          time,
+                                  double          altitude,
+                                  double          vertical_accuracy)
+{
+	double variance, p, gain;
+
+	g_return_if_fail (vertical_accuracy > 0.0);
+
+	variance = vertical_accuracy * vertical_accuracy;
+	if (!filter->has_altitude ||
+	    time - filter->altitude_time > MAX_PREDICTION) {
+		filter->has_altitude = TRUE;
+		filter->altitude_time = time;
+		filter->altitude = altitude;
+		filter->p_altitude = variance;
+		return;
+	}
+
+	p = filter->p_altitude +
+	    ALTITUDE_PROCESS_NOISE * MAX (time - filter->altitude_time, 0.0);
+	gain = p / (p + variance);
+	filter->altitude += gain * (altitude - filter->altitude);
+	filter->p_altitude = (1 - gain) * p;
+	filter->altitude_time = MAX (time, filter->altitude_time);
+}
+
+/* Estimated position at 'time' (which may be later than the last fix)
+ * and its 1-sigma error in meters */
+gboolean
+gc_fusion_filter_get_position (GcFusionFilter *filter,
+                               double          time,
+                               double         *latitude,
+                               double         *longitude,
+                               double         *horizontal_accuracy)
+{
+	double dt, p_pos, p_cross, p_vel;
+
+	if (!filter->initialized) {
+		return FALSE;
+	}
+
+	dt = MAX (time - filter->time, 0.0);
+	predict_position (filter, dt, latitude, longitude);
+	if (horizontal_accuracy) {
+		predict_covariance (filter, dt, &p_pos, &p_cross, &p_vel);
+		*horizontal_accuracy = sqrt (p_pos);
+	}
+	return TRUE;
+}
+
+gboolean
+gc_fusion_filter_get_altitude (GcFusionFilter *filter,
+                               double          time,
+                               double         *altitude,
+                               double         *vertical_accuracy)
+{
+	if (!filter->has_altitude) {
+		return FALSE;
+	}
+
+	*altitude = filter->altitude;
+	if (vertical_accuracy) {
+		*vertical_accuracy = sqrt (filter->p_altitude + ALTITUDE_PROCESS_NOISE *
+		                           MAX (time - filter->altitude_time, 0.0));
+	}
+	return TRUE;
+}
+
+/* Speed in m/s and direction in degrees clockwise from north, only
+ * once the filter has seen enough fixes to know them */
+gboolean
+gc_fusion_filter_get_velocity (GcFusionFilter *filter,
+                               double         *speed,
+                               double         *direction)
+{
+	if (!filter->initialized ||
+	    filter->p_vel > MAX_SPEED_DEVIATION * MAX_SPEED_DEVIATION) {
+		return FALSE;
+	}
+
+	*speed = sqrt (filter->velocity_east * filter->velocity_east +
+	               filter->velocity_north * filter->velocity_north);
+	*direction = atan2 (filter->velocity_east, filter->velocity_north) * 180.0 / G_PI;
+	if (*direction < 0.0) {
+		*direction += 360.0;
+	}
+	return TRUE;
+}
+
+/* Time of the newest fix, 0 if there is none */
+double
+gc_fusion_filter_get_time (GcFusionFilter *filter)
+{
+	return filter->initialized ? filter->time : 0.0;
+}
+
+/* Typical error radius in meters of a fix with accuracy 'level' */
+double
+gc_accuracy_level_get_radius (GeoclueAccuracyLevel level)
+{
+	g_return_val_if_fail (level <= GEOCLUE_ACCURACY_LEVEL_DETAILED, 0.0);
+
+	return level_radius[level];
+}
+
+/* Best accuracy level that an error radius of 'radius' meters meets */
+GeoclueAccuracyLevel
+gc_accuracy_level_for_radius (double radius)
+{
+	GeoclueAccuracyLevel level;
+
+	for (level = GEOCLUE_ACCURACY_LEVEL_DETAILED;
+	     level > GEOCLUE_ACCURACY_LEVEL_COUNTRY; level--) {
+		if (radius <= level_radius[level]) {
+			break;
+		}
+	}
+	return level;
+}
@@ -0,0 +1,67 @@
+/*
+ * Geoclue
+ * master-fusion.h - Kalman filter for combining position fixes
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_FUSION_H
+#define MASTER_FUSION_H
+
+#include <glib.h>
+#include <geoclue/geoclue-types.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GcFusionFilter GcFusionFilter;
+
+GcFusionFilter *gc_fusion_filter_new (void);
+void gc_fusion_filter_free (GcFusionFilter *filter);
+void gc_fusion_filter_reset (GcFusionFilter *filter);
+
+gboolean gc_fusion_filter_update (GcFusionFilter *filter,
+                                  double          time,
+                                  double          latitude,
+                                  double          longitude,
+                                  double          horizontal_accuracy);
+void gc_fusion_filter_update_altitude (GcFusionFilter *filter,
+                                       double          time,
+                                       double          altitude,
+                                       double          vertical_accuracy);
+
+gboolean gc_fusion_filter_get_position (GcFusionFilter *filter,
+                                        double          time,
+                                        double         *latitude,
+                                        double         *longitude,
+                                        double         *horizontal_accuracy);
+gboolean gc_fusion_filter_get_altitude (GcFusionFilter *filter,
+                                        double          time,
+                                        double         *altitude,
+                                        double         *vertical_accuracy);
+gboolean gc_fusion_filter_get_velocity (GcFusionFilter *filter,
+                                        double         *speed,
+                                        double         *direction);
+double gc_fusion_filter_get_time (GcFusionFilter *filter);
+
+double gc_accuracy_level_get_radius (GeoclueAccuracyLevel level);
+GeoclueAccuracyLevel gc_accuracy_level_for_radius (double radius);
+
+G_END_DECLS
+
+#endif /* MASTER_FUSION_H */
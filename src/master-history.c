@@ -0,0 +1,161 @@
+/*
+ * Geoclue
+ * master-history.c - Bounded position history of a provider
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Ring of the latest fixes of a GcMasterProvider, so that clients
+ *  can fetch a whole track in one call instead of listening to every
+ *  PositionChanged. Only used from the main loop.
+ *
+ *  The ring is allocated with the first fix: most providers never
+ *  send one.
+ **/
+
+#include "master-history.h"
+
+struct _GcPositionHistory {
+	GeocluePositionFix *fixes;
+	guint size;
+	/* number of fixes ever appended, the newest is at (count - 1) % size */
+	guint count;
+};
+
+GcPositionHistory *
+gc_position_history_new (guint size)
+{
+	GcPositionHistory *history;
+
+	g_assert (size > 0);
+
+	history = g_new0 (GcPositionHistory, 1);
+	history->size = size;
+	return history;
+}
+
+void
+gc_position_history_free (GcPositionHistory *history)
+{
+	if (history == NULL) {
+		return;
+	}
+	g_free (history->fixes);
+	g_free (history);
+}
+
+static GeocluePositionFix *
+gc_position_history_nth (GcPositionHistory *history,
+                         guint              n)
+{
+	return &history->fixes[n % history->size];
+}
+
+void
+gc_position_history_append (GcPositionHistory        *history,
+                            const GeocluePositionFix *fix)
+{
+	if (history->fixes == NULL) {
+		history->fixes = g_new (GeocluePositionFix, history->size);
+	} else if (history->count > 0) {
+		GeocluePositionFix *last;
+
+		last = gc_position_history_nth (history, history->count - 1);
+		if (last->timestamp == fix->timestamp &&
+		    last->fields == fix->fields &&
+		    last->latitude == fix->latitude &&
+		    last->longitude == fix->longitude &&
+		    last->altitude == fix->altitude) {
+			/* the same fix again, e.g. from a cache update */
+			return;
+		}
+	}
+
+	*gc_position_history_nth (history, history->count) = *fix;
+	history->count++;
+}
+
+/* Returns the fixes with a timestamp after 'since', oldest first */
+GArray *
+gc_position_history_get_since (GcPositionHistory *history,
+                               int                since)
+{
+	GArray *fixes;
+	guint first, low, high;
+
+	fixes = g_array_new (FALSE, FALSE, sizeof (GeocluePositionFix));
+	if (history->count == 0) {
+		return fixes;
+	}
+
+	/* timestamps only go forward (mostly): find the first newer fix */
+	low = history->count > history->size ? history->count - history->size : 0;
+	high = history->count;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (gc_position_history_nth (history, mid)->timestamp > since) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+
+	/* at most two contiguous pieces */
+	for (first = low; first < history->count; ) {
+		guint start = first % history->size;
+		guint len = MIN (history->count - first, history->size - start);
+
+		g_array_append_vals (fixes, &history->fixes[start], len);
+		first += len;
+	}
+	return fixes;
+}
+
+/* Converts fixes to a GEOCLUE_POSITION_HISTORY_TYPE array for D-Bus */
+GPtrArray *
+gc_position_fixes_to_structs (GArray *fixes)
+{
+	GPtrArray *structs;
+	guint i;
+
+	structs = g_ptr_array_sized_new (fixes->len);
+	for (i = 0; i < fixes->len; i++) {
+		GeocluePositionFix *fix = &g_array_index (fixes, GeocluePositionFix, i);
+		GValue fix_struct = {0, };
+
+		g_value_init (&fix_struct, GEOCLUE_POSITION_FIX_TYPE);
+		g_value_take_boxed (&fix_struct,
+		                    dbus_g_type_specialized_construct (GEOCLUE_POSITION_FIX_TYPE));
+		dbus_g_type_struct_set (&fix_struct,
+		                        0, fix->fields,
+		                        1, fix->timestamp,
+		                        2, fix->latitude,
+		                        3, fix->longitude,
+		                        4, fix->altitude,
+		                        5, fix->accuracy_level,
+		                        6, fix->horizontal_accuracy,
+		                        7, fix->vertical_accuracy,
+		                        G_MAXUINT);
+		/* the array now owns the struct */
+		g_ptr_array_add (structs, g_value_get_boxed (&fix_struct));
+	}
+	return structs;
+}
@@ -0,0 +1,46 @@
+/*
+ * Geoclue
+ * master-history.h - Bounded position history of a provider
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_HISTORY_H
+#define MASTER_HISTORY_H
+
+#include <glib.h>
+#include <geoclue/geoclue-master-client.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GcPositionHistory GcPositionHistory;
+
+GcPositionHistory *gc_position_history_new (guint size);
+void gc_position_history_free (GcPositionHistory *history);
+
+void gc_position_history_append (GcPositionHistory        *history,
+                                 const GeocluePositionFix *fix);
+GArray *gc_position_history_get_since (GcPositionHistory *history,
+                                       int                since);
+
+GPtrArray *gc_position_fixes_to_structs (GArray *fixes);
+
+G_END_DECLS
+
+#endif /* MASTER_HISTORY_H */
@@ -0,0 +1,157 @@
+/*
+ * Geoclue
+ * master-predict.c - Dead reckoning between position fixes
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Extrapolates the last fix of a provider with its last velocity, so
+ *  that the master can send positions between fixes (e.g. 10 times a
+ *  second from a 1 Hz GPS) and while the GPS is in a tunnel.
+ *
+ *  The error radius grows with the time since the fix: by an assumed
+ *  speed error (a constant plus a fraction of the speed, which also
+ *  covers a heading error) and by the distance an unseen acceleration
+ *  would have moved the receiver. Predictions stop after a while.
+ **/
+
+#include <string.h>
+#include <math.h>
+
+#include <geoclue/gc-geo.h>
+
+#include "master-fusion.h"
+#include "master-predict.h"
+
+/* speed error: constant (m/s) plus relative part */
+#define SPEED_ERROR 0.5
+#define RELATIVE_SPEED_ERROR 0.1
+/* unseen acceleration (m/s^2) */
+#define MAX_ACCELERATION 1.0
+#define MAX_VERTICAL_SPEED_ERROR 0.5
+/* slower than this counts as standing still (m/s) */
+#define MIN_SPEED 0.1
+
+void
+gc_predictor_reset (GcPredictor *predictor)
+{
+	memset (predictor, 0, sizeof (GcPredictor));
+}
+
+void
+gc_predictor_set_position (GcPredictor          *predictor,
+                           double                time,
+                           GeocluePositionFields fields,
+                           double                latitude,
+                           double                longitude,
+                           double                altitude,
+                           GeoclueAccuracyLevel  level,
+                           double                horizontal_accuracy,
+                           double                vertical_accuracy)
+{
+	predictor->time = time;
+	predictor->fields = fields;
+	predictor->latitude = latitude;
+	predictor->longitude = longitude;
+	predictor->altitude = altitude;
+	if (horizontal_accuracy <= 0.0) {
+		horizontal_accuracy = gc_accuracy_level_get_radius (level);
+	}
+	predictor->horizontal_accuracy = horizontal_accuracy;
+	predictor->vertical_accuracy = vertical_accuracy;
+}
+
+void
+gc_predictor_set_velocity (GcPredictor          *predictor,
+                           GeoclueVelocityFields fields,
+                           double                speed,
+                           double                direction,
+                           double                climb)
+{
+	predictor->velocity_fields = fields;
+	predictor->speed = speed;
+	predictor->direction = direction;
+	predictor->climb = climb;
+}
+
+/* Returns the fields of the predicted position with
+ * GEOCLUE_POSITION_FIELDS_PREDICTED set, or GEOCLUE_POSITION_FIELDS_NONE
+ * if there is nothing to predict from */
+GeocluePositionFields
+gc_predictor_predict (GcPredictor *predictor,
+                      double       time,
+                      double      *latitude,
+                      double      *longitude,
+                      double      *altitude,
+                      double      *horizontal_accuracy,
+                      double      *vertical_accuracy)
+{
+	GeocluePositionFields fields;
+	double dt, speed, distance, lon_scale;
+
+	fields = predictor->fields & (GEOCLUE_POSITION_FIELDS_LATITUDE |
+	                              GEOCLUE_POSITION_FIELDS_LONGITUDE |
+	                              GEOCLUE_POSITION_FIELDS_ALTITUDE);
+	if ((fields & GEOCLUE_POSITION_FIELDS_LATITUDE) == 0 ||
+	    (fields & GEOCLUE_POSITION_FIELDS_LONGITUDE) == 0 ||
+	    (predictor->velocity_fields & GEOCLUE_VELOCITY_FIELDS_SPEED) == 0) {
+		return GEOCLUE_POSITION_FIELDS_NONE;
+	}
+	speed = predictor->speed;
+	if (speed < MIN_SPEED) {
+		speed = 0.0;
+	} else if ((predictor->velocity_fields & GEOCLUE_VELOCITY_FIELDS_DIRECTION) == 0) {
+		return GEOCLUE_POSITION_FIELDS_NONE;
+	}
+
+	dt = time - predictor->time;
+	if (dt < 0.0 || dt > GC_MAX_PREDICTION) {
+		return GEOCLUE_POSITION_FIELDS_NONE;
+	}
+
+	distance = speed * dt;
+	lon_scale = GC_METERS_PER_DEGREE * MAX (cos (predictor->latitude * G_PI / 180.0), 1e-6);
+	*latitude = predictor->latitude +
+	            distance * cos (predictor->direction * G_PI / 180.0) / GC_METERS_PER_DEGREE;
+	*longitude = predictor->longitude +
+	             distance * sin (predictor->direction * G_PI / 180.0) / lon_scale;
+	*latitude = CLAMP (*latitude, -90.0, 90.0);
+	if (*longitude > 180.0) {
+		*longitude -= 360.0;
+	} else if (*longitude < -180.0) {
+		*longitude += 360.0;
+	}
+	*horizontal_accuracy = predictor->horizontal_accuracy +
+	                       (SPEED_ERROR + RELATIVE_SPEED_ERROR * speed) * dt +
+	                       MAX_ACCELERATION * dt * dt / 2;
+
+	*altitude = predictor->altitude;
+	*vertical_accuracy = predictor->vertical_accuracy;
+	if (fields & GEOCLUE_POSITION_FIELDS_ALTITUDE) {
+		if (predictor->velocity_fields & GEOCLUE_VELOCITY_FIELDS_CLIMB) {
+			*altitude += predictor->climb * dt;
+		}
+		if (*vertical_accuracy > 0.0) {
+			*vertical_accuracy += MAX_VERTICAL_SPEED_ERROR * dt;
+		}
+	}
+
+	return fields | GEOCLUE_POSITION_FIELDS_PREDICTED;
+}
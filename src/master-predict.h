@@ -0,0 +1,77 @@
+/*
+ * Geoclue
+ * master-predict.h - Dead reckoning between position fixes
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_PREDICT_H
+#define MASTER_PREDICT_H
+
+#include <glib.h>
+#include <geoclue/geoclue-types.h>
+
+G_BEGIN_DECLS
+
+/* no predictions this long after the fix (s) */
+#define GC_MAX_PREDICTION 30.0
+/* shortest interval between predicted positions (ms) */
+#define GC_MIN_PREDICTION_INTERVAL 20
+
+typedef struct _GcPredictor {
+	double time; /* when the fix was received, in seconds */
+	GeocluePositionFields fields;
+	double latitude;
+	double longitude;
+	double altitude;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+
+	GeoclueVelocityFields velocity_fields;
+	double speed;
+	double direction;
+	double climb;
+} GcPredictor;
+
+void gc_predictor_reset (GcPredictor *predictor);
+void gc_predictor_set_position (GcPredictor          *predictor,
+                                double                time,
+                                GeocluePositionFields fields,
+                                double                latitude,
+                                double                longitude,
+                                double                altitude,
+                                GeoclueAccuracyLevel  level,
+                                double                horizontal_accuracy,
+                                double                vertical_accuracy);
+void gc_predictor_set_velocity (GcPredictor          *predictor,
+                                GeoclueVelocityFields fields,
+                                double                speed,
+                                double                direction,
+                                double                climb);
+GeocluePositionFields gc_predictor_predict (GcPredictor *predictor,
+                                            double       time,
+                                            double      *latitude,
+                                            double      *longitude,
+                                            double      *altitude,
+                                            double      *horizontal_accuracy,
+                                            double      *vertical_accuracy);
+
+G_END_DECLS
+
+#endif /* MASTER_PREDICT_H */
@@ -39,18 +39,26 @@
  * 	figure out what to do if get_* returns GEOCLUE_ERROR_NOT_AVAILABLE.
  * 	Should try again, but when?
  * 
- * 	implement velocity
- * 
  * 	implement other (non-updating) ifaces
  **/
 
 #include <string.h>
+#include <gmodule.h>
 
 #include "main.h"
 #include "master-provider.h"
+#include "master-snapshot.h"
+#include "master-history.h"
+#include "master-duty.h"
 #include <geoclue/geoclue-position.h>
 #include <geoclue/geoclue-address.h>
+#include <geoclue/geoclue-velocity.h>
 #include <geoclue/geoclue-marshal.h>
+#include <geoclue/geoclue-master.h>
+#include <geoclue/gc-provider.h>
+#include <geoclue/gc-iface-position.h>
+#include <geoclue/gc-iface-address.h>
+#include <geoclue/gc-iface-velocity.h>
 
 typedef enum _GeoclueProvideFlags {
 	GEOCLUE_PROVIDE_NONE = 0,
@@ -58,7 +66,14 @@ typedef enum _GeoclueProvideFlags {
 	GEOCLUE_PROVIDE_CACHEABLE_ON_CONNECTION = 1 << 1,	/* data can be queried on new connection, and cached until connection ends */
 } GeoclueProvideFlags;
 
+/* positions kept for GetPositionHistory: 3.5 minutes at 10 Hz */
+#define GC_POSITION_HISTORY_SIZE 2048
+
+/* Caches are immutable snapshots: the main loop publishes a new one 
+ * on every change, readers on any thread take a reference to the
+ * current one without locking (see master-snapshot.c) */
 typedef struct _GcPositionCache {
+	GcSnapshot snapshot;
 	int timestamp;
 	GeocluePositionFields fields;
 	double latitude;
@@ -68,7 +83,17 @@ typedef struct _GcPositionCache {
 	GError *error;
 } GcPositionCache;
 
+typedef struct _GcVelocityCache {
+	GcSnapshot snapshot;
+	int timestamp;
+	GeoclueVelocityFields fields;
+	double speed;
+	double direction;
+	double climb;
+} GcVelocityCache;
+
 typedef struct _GcAddressCache {
+	GcSnapshot snapshot;
 	int timestamp;
 	GHashTable *details;
 	GeoclueAccuracy *accuracy;
@@ -96,12 +121,22 @@ typedef struct _GcMasterProviderPrivate {
 	
 	GeoclueStatus status; /* cached status from actual provider */
 	
+	/* in-process provider, used instead of the D-Bus proxies below */
+	GType plugin_type;
+	GObject *plugin;
+	
 	GeocluePosition *position;
-	GcPositionCache position_cache;
+	GcSnapshotPublisher *position_cache; /* GcPositionCache */
+	GcPositionHistory *position_history;
 	
 	GeoclueAddress *address;
-	GcAddressCache address_cache;
+	GcSnapshotPublisher *address_cache; /* GcAddressCache */
+	
+	GeoclueVelocity *velocity;
+	GcSnapshotPublisher *velocity_cache; /* GcVelocityCache */
 	
+	GValue gps_interval; /* int GC_DUTY_CYCLE_OPTION for GPS providers */
+	GValue n_clients; /* int GC_CLIENTS_OPTION for cell providers */
 } GcMasterProviderPrivate;
 
 enum {
@@ -109,6 +144,7 @@ enum {
 	ACCURACY_CHANGED,
 	POSITION_CHANGED,
 	ADDRESS_CHANGED,
+	VELOCITY_CHANGED,
 	LAST_SIGNAL
 };
 static guint32 signals[LAST_SIGNAL] = {0, };
@@ -117,6 +153,8 @@ static guint32 signals[LAST_SIGNAL] = {0, };
 
 G_DEFINE_TYPE (GcMasterProvider, gc_master_provider, G_TYPE_OBJECT)
 
+static void gc_master_provider_update_n_clients (GcMasterProvider *provider);
+
 static void
 copy_error (GError **target, GError *source)
 {
@@ -153,61 +191,414 @@ gc_master_provider_get_provider (GcMasterProvider *master_provider)
 	if (priv->position) {
 		return GEOCLUE_PROVIDER (priv->position);
 	}
+	if (priv->velocity) {
+		return GEOCLUE_PROVIDER (priv->velocity);
+	}
 	return NULL;
 }
 
 static gboolean
 gc_master_provider_is_running (GcMasterProvider *master_provider)
 {
-	return (gc_master_provider_get_provider (master_provider) != NULL);
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	
+	return (priv->plugin != NULL ||
+	        gc_master_provider_get_provider (master_provider) != NULL);
 }
 
-static void 
-gc_master_provider_handle_new_position_accuracy (GcMasterProvider *provider,
-                                                 GeoclueAccuracy  *accuracy)
+/* TRUE if the running provider can be asked for 'iface' */
+static gboolean
+gc_master_provider_has_running_iface (GcMasterProvider *master_provider,
+                                      GcInterfaceFlags  iface)
 {
-	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
-	GeoclueAccuracyLevel old_level;
-	GeoclueAccuracyLevel new_level = GEOCLUE_ACCURACY_LEVEL_NONE;
-	double new_hor_acc, new_vert_acc;
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	
+	if (priv->plugin) {
+		return (priv->interfaces & iface) != 0;
+	}
+	switch (iface) {
+		case GC_IFACE_POSITION:
+			return priv->position != NULL;
+		case GC_IFACE_ADDRESS:
+			return priv->address != NULL;
+		case GC_IFACE_VELOCITY:
+			return priv->velocity != NULL;
+		default:
+			return FALSE;
+	}
+}
+
+/* The query functions below call in-process providers directly 
+ * through their GcIface vtables, other providers over D-Bus */
+
+static gboolean
+gc_master_provider_query_options (GcMasterProvider *master_provider,
+                                  GHashTable       *options,
+                                  GError          **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	
+	if (priv->plugin) {
+		return GC_IFACE_GEOCLUE_GET_CLASS (priv->plugin)->set_options
+			(GC_IFACE_GEOCLUE (priv->plugin), options, error);
+	}
+	return geoclue_provider_set_options (gc_master_provider_get_provider (master_provider),
+	                                     options, error);
+}
+
+/* The main options, plus the duty cycle for GPS providers and the
+ * number of clients for cell providers. Unref the table when done. */
+static GHashTable *
+gc_master_provider_get_options (GcMasterProvider *master_provider)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	GHashTable *options;
+	GHashTableIter iter;
+	gpointer key, value;
+	
+	if (!(priv->required_resources & (GEOCLUE_RESOURCE_GPS |
+	                                  GEOCLUE_RESOURCE_CELL))) {
+		return g_hash_table_ref (geoclue_get_main_options ());
+	}
+	
+	options = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                 NULL, NULL);
+	g_hash_table_iter_init (&iter, geoclue_get_main_options ());
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_hash_table_insert (options, key, value);
+	}
+	
+	if (g_value_get_int (&priv->gps_interval) > 0) {
+		g_hash_table_replace (options, GC_DUTY_CYCLE_OPTION,
+		                      &priv->gps_interval);
+	}
+	if (priv->required_resources & GEOCLUE_RESOURCE_CELL) {
+		g_hash_table_replace (options, GC_CLIENTS_OPTION,
+		                      &priv->n_clients);
+	}
+	return options;
+}
+
+static gboolean
+gc_master_provider_query_status (GcMasterProvider *master_provider,
+                                 GeoclueStatus    *status,
+                                 GError          **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	
+	if (priv->plugin) {
+		return GC_IFACE_GEOCLUE_GET_CLASS (priv->plugin)->get_status
+			(GC_IFACE_GEOCLUE (priv->plugin), status, error);
+	}
+	return geoclue_provider_get_status (gc_master_provider_get_provider (master_provider),
+	                                    status, error);
+}
+
+static gboolean
+gc_master_provider_query_description (GcMasterProvider *master_provider,
+                                      char            **description,
+                                      GError          **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	
+	if (priv->plugin) {
+		return GC_IFACE_GEOCLUE_GET_CLASS (priv->plugin)->get_provider_info
+			(GC_IFACE_GEOCLUE (priv->plugin), NULL, description, error);
+	}
+	return geoclue_provider_get_provider_info (gc_master_provider_get_provider (master_provider),
+	                                           NULL, description, error);
+}
+
+static GeocluePositionFields
+gc_master_provider_query_position (GcMasterProvider *master_provider,
+                                   int              *timestamp,
+                                   double           *latitude,
+                                   double           *longitude,
+                                   double           *altitude,
+                                   GeoclueAccuracy **accuracy,
+                                   GError          **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	GeocluePositionFields fields = GEOCLUE_POSITION_FIELDS_NONE;
+	int ts = 0;
+	double lat = 0.0, lon = 0.0, alt = 0.0;
+	GeoclueAccuracy *acc = NULL;
+	
+	if (!priv->plugin) {
+		return geoclue_position_get_position (priv->position, timestamp,
+		                                      latitude, longitude, altitude,
+		                                      accuracy, error);
+	}
+	
+	if (!GC_IFACE_POSITION_GET_CLASS (priv->plugin)->get_position
+		(GC_IFACE_POSITION (priv->plugin), &fields, &ts,
+		 &lat, &lon, &alt, &acc, error)) {
+		return GEOCLUE_POSITION_FIELDS_NONE;
+	}
+	
+	if (timestamp != NULL) {
+		*timestamp = ts;
+	}
+	if (latitude != NULL) {
+		*latitude = lat;
+	}
+	if (longitude != NULL) {
+		*longitude = lon;
+	}
+	if (altitude != NULL) {
+		*altitude = alt;
+	}
+	if (accuracy != NULL) {
+		*accuracy = acc;
+	} else {
+		geoclue_accuracy_free (acc);
+	}
+	return fields;
+}
+
+static gboolean
+gc_master_provider_query_address (GcMasterProvider  *master_provider,
+                                  int               *timestamp,
+                                  GHashTable       **details,
+                                  GeoclueAccuracy  **accuracy,
+                                  GError           **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	int ts = 0;
+	GHashTable *d = NULL;
+	GeoclueAccuracy *acc = NULL;
+	
+	if (!priv->plugin) {
+		return geoclue_address_get_address (priv->address, timestamp,
+		                                    details, accuracy, error);
+	}
+	
+	if (!GC_IFACE_ADDRESS_GET_CLASS (priv->plugin)->get_address
+		(GC_IFACE_ADDRESS (priv->plugin), &ts, &d, &acc, error)) {
+		return FALSE;
+	}
+	
+	if (timestamp != NULL) {
+		*timestamp = ts;
+	}
+	if (details != NULL) {
+		*details = d;
+	} else {
+		g_hash_table_destroy (d);
+	}
+	if (accuracy != NULL) {
+		*accuracy = acc;
+	} else {
+		geoclue_accuracy_free (acc);
+	}
+	return TRUE;
+}
+
+static GeoclueVelocityFields
+gc_master_provider_query_velocity (GcMasterProvider *master_provider,
+                                   int              *timestamp,
+                                   double           *speed,
+                                   double           *direction,
+                                   double           *climb,
+                                   GError          **error)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
+	GeoclueVelocityFields fields = GEOCLUE_VELOCITY_FIELDS_NONE;
+	int ts = 0;
+	double sp = 0.0, di = 0.0, cl = 0.0;
+	
+	if (!priv->plugin) {
+		return geoclue_velocity_get_velocity (priv->velocity, timestamp,
+		                                      speed, direction, climb,
+		                                      error);
+	}
+	
+	if (!GC_IFACE_VELOCITY_GET_CLASS (priv->plugin)->get_velocity
+		(GC_IFACE_VELOCITY (priv->plugin), &fields, &ts,
+		 &sp, &di, &cl, error)) {
+		return GEOCLUE_VELOCITY_FIELDS_NONE;
+	}
 	
-	geoclue_accuracy_get_details (priv->position_cache.accuracy,
-	                              &old_level, NULL, NULL);
+	if (timestamp != NULL) {
+		*timestamp = ts;
+	}
+	if (speed != NULL) {
+		*speed = sp;
+	}
+	if (direction != NULL) {
+		*direction = di;
+	}
+	if (climb != NULL) {
+		*climb = cl;
+	}
+	return fields;
+}
+
+static void
+gc_position_cache_free (GcPositionCache *cache)
+{
+	geoclue_accuracy_free (cache->accuracy);
+	if (cache->error) {
+		g_error_free (cache->error);
+	}
+	g_slice_free (GcPositionCache, cache);
+}
+
+static GcPositionCache *
+gc_position_cache_new (GeocluePositionFields  fields,
+                       int                    timestamp,
+                       double                 latitude,
+                       double                 longitude,
+                       double                 altitude,
+                       GeoclueAccuracy       *accuracy,
+                       GError                *error)
+{
+	GcPositionCache *cache;
+	
+	cache = g_slice_new0 (GcPositionCache);
+	gc_snapshot_init (&cache->snapshot, (GDestroyNotify)gc_position_cache_free);
+	
+	cache->timestamp = timestamp;
+	cache->fields = fields;
+	cache->latitude = latitude;
+	cache->longitude = longitude;
+	cache->altitude = altitude;
 	if (accuracy) {
-		geoclue_accuracy_get_details (accuracy,
-		                              &new_level, &new_hor_acc, &new_vert_acc);
+		cache->accuracy = geoclue_accuracy_copy (accuracy);
+	} else {
+		cache->accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
 	}
-	geoclue_accuracy_set_details (priv->position_cache.accuracy,
-	                              new_level, new_hor_acc, new_vert_acc);
+	copy_error (&cache->error, error);
 	
-	if (old_level != new_level) {
-		g_signal_emit (provider, signals[ACCURACY_CHANGED], 0,
-		               GC_IFACE_POSITION, new_level);
+	return cache;
+}
+
+static void
+gc_address_cache_free (GcAddressCache *cache)
+{
+	g_hash_table_destroy (cache->details);
+	geoclue_accuracy_free (cache->accuracy);
+	if (cache->error) {
+		g_error_free (cache->error);
 	}
+	g_slice_free (GcAddressCache, cache);
 }
 
-static void 
-gc_master_provider_handle_new_address_accuracy (GcMasterProvider *provider,
-                                                GeoclueAccuracy  *accuracy)
+static GcAddressCache *
+gc_address_cache_new (int               timestamp,
+                      GHashTable       *details,
+                      GeoclueAccuracy  *accuracy,
+                      GError           *error)
 {
-	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
-	GeoclueAccuracyLevel old_level;
-	GeoclueAccuracyLevel new_level = GEOCLUE_ACCURACY_LEVEL_NONE;
-	double new_hor_acc, new_vert_acc;
+	GcAddressCache *cache;
+	
+	cache = g_slice_new0 (GcAddressCache);
+	gc_snapshot_init (&cache->snapshot, (GDestroyNotify)gc_address_cache_free);
 	
-	geoclue_accuracy_get_details (priv->address_cache.accuracy,
-	                              &old_level, NULL, NULL);
+	cache->timestamp = timestamp;
+	if (details) {
+		cache->details = geoclue_address_details_copy (details);
+	} else {
+		cache->details = geoclue_address_details_new ();
+	}
 	if (accuracy) {
-		geoclue_accuracy_get_details (accuracy,
-		                              &new_level, &new_hor_acc, &new_vert_acc);
+		cache->accuracy = geoclue_accuracy_copy (accuracy);
+	} else {
+		cache->accuracy = geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0.0, 0.0);
 	}
-	geoclue_accuracy_set_details (priv->address_cache.accuracy,
-	                              new_level, new_hor_acc, new_vert_acc);
+	copy_error (&cache->error, error);
 	
-	if (old_level != new_level) {
-		g_signal_emit (provider, signals[ACCURACY_CHANGED], 0,
-		               GC_IFACE_ADDRESS, new_level);
+	return cache;
+}
+
+static void
+gc_velocity_cache_free (GcVelocityCache *cache)
+{
+	g_slice_free (GcVelocityCache, cache);
+}
+
+static GcVelocityCache *
+gc_velocity_cache_new (GeoclueVelocityFields  fields,
+                       int                    timestamp,
+                       double                 speed,
+                       double                 direction,
+                       double                 climb)
+{
+	GcVelocityCache *cache;
+	
+	cache = g_slice_new0 (GcVelocityCache);
+	gc_snapshot_init (&cache->snapshot, (GDestroyNotify)gc_velocity_cache_free);
+	
+	cache->timestamp = timestamp;
+	cache->fields = fields;
+	cache->speed = speed;
+	cache->direction = direction;
+	cache->climb = climb;
+	
+	return cache;
+}
+
+static GeoclueAccuracyLevel
+gc_master_provider_get_cached_level (GcMasterProvider *provider,
+                                     GcInterfaceFlags  iface)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GeoclueAccuracyLevel level;
+	
+	switch (iface) {
+		case GC_IFACE_POSITION: {
+			GcPositionCache *cache;
+			
+			cache = gc_snapshot_publisher_acquire (priv->position_cache);
+			geoclue_accuracy_get_details (cache->accuracy, &level, NULL, NULL);
+			gc_snapshot_unref (cache);
+			break;
+		}
+		case GC_IFACE_ADDRESS: {
+			GcAddressCache *cache;
+			
+			cache = gc_snapshot_publisher_acquire (priv->address_cache);
+			geoclue_accuracy_get_details (cache->accuracy, &level, NULL, NULL);
+			gc_snapshot_unref (cache);
+			break;
+		}
+		default:
+			g_warning("iface: %d", iface);
+			g_assert_not_reached ();
 	}
+	return level;
+}
+
+/* cached horizontal accuracy in meters, 0.0 if the provider 
+ * did not give one */
+static double
+gc_master_provider_get_cached_horizontal_accuracy (GcMasterProvider *provider,
+                                                   GcInterfaceFlags  iface)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	double horizontal = 0.0;
+	
+	switch (iface) {
+		case GC_IFACE_POSITION: {
+			GcPositionCache *cache;
+			
+			cache = gc_snapshot_publisher_acquire (priv->position_cache);
+			geoclue_accuracy_get_details (cache->accuracy, NULL, &horizontal, NULL);
+			gc_snapshot_unref (cache);
+			break;
+		}
+		case GC_IFACE_ADDRESS: {
+			GcAddressCache *cache;
+			
+			cache = gc_snapshot_publisher_acquire (priv->address_cache);
+			geoclue_accuracy_get_details (cache->accuracy, NULL, &horizontal, NULL);
+			gc_snapshot_unref (cache);
+			break;
+		}
+		default:
+			break;
+	}
+	return horizontal;
 }
 
 static void
@@ -221,25 +612,48 @@ gc_master_provider_set_position (GcMasterProvider      *provider,
                                  GError                *error)
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GcPositionCache *cache;
+	GeoclueAccuracyLevel old_level, new_level;
+	
+	old_level = gc_master_provider_get_cached_level (provider, GC_IFACE_POSITION);
 	
-	priv->position_cache.timestamp = timestamp;
-	priv->position_cache.fields = fields;
-	priv->position_cache.latitude = latitude;
-	priv->position_cache.longitude = longitude;
-	priv->position_cache.altitude = altitude;
+	cache = gc_position_cache_new (fields, timestamp,
+	                               latitude, longitude, altitude,
+	                               accuracy, error);
+	geoclue_accuracy_get_details (cache->accuracy, &new_level, NULL, NULL);
 	
-	copy_error (&priv->position_cache.error, error);
+	/* keep our own reference for the signal emissions below */
+	gc_snapshot_publisher_publish (priv->position_cache,
+	                               gc_snapshot_ref (cache));
 	
 	/* emit accuracy-changed if needed, so masterclient can re-choose providers 
 	 * before we emit position-changed */
-	gc_master_provider_handle_new_position_accuracy (provider, accuracy);
+	if (old_level != new_level) {
+		g_signal_emit (provider, signals[ACCURACY_CHANGED], 0,
+		               GC_IFACE_POSITION, new_level);
+	}
 	
 	if (!error) {
+		if (fields != GEOCLUE_POSITION_FIELDS_NONE) {
+			GeocluePositionFix fix;
+			
+			fix.fields = fields;
+			fix.timestamp = timestamp;
+			fix.latitude = latitude;
+			fix.longitude = longitude;
+			fix.altitude = altitude;
+			geoclue_accuracy_get_details (cache->accuracy, &fix.accuracy_level,
+			                              &fix.horizontal_accuracy,
+			                              &fix.vertical_accuracy);
+			gc_position_history_append (priv->position_history, &fix);
+		}
+		
 		g_signal_emit (provider, signals[POSITION_CHANGED], 0, 
-		               fields, timestamp, 
-		               latitude, longitude, altitude, 
-		               priv->position_cache.accuracy);
+		               cache->fields, cache->timestamp, 
+		               cache->latitude, cache->longitude, cache->altitude, 
+		               cache->accuracy);
 	}
+	gc_snapshot_unref (cache);
 }
 
 static void
@@ -250,30 +664,53 @@ gc_master_provider_set_address (GcMasterProvider *provider,
                                 GError           *error)
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GcAddressCache *cache;
+	GeoclueAccuracyLevel old_level, new_level;
 	
-	priv->address_cache.timestamp = timestamp;
+	old_level = gc_master_provider_get_cached_level (provider, GC_IFACE_ADDRESS);
 	
-	g_hash_table_destroy (priv->address_cache.details);
-	if (details) {
-		priv->address_cache.details = geoclue_address_details_copy (details);
-	}else {
-		priv->address_cache.details = geoclue_address_details_new ();
-	}
-	copy_error (&priv->address_cache.error, error);
+	cache = gc_address_cache_new (timestamp, details, accuracy, error);
+	geoclue_accuracy_get_details (cache->accuracy, &new_level, NULL, NULL);
+	
+	gc_snapshot_publisher_publish (priv->address_cache,
+	                               gc_snapshot_ref (cache));
 	
 	/* emit accuracy-changed if needed, so masterclient can re-choose providers 
 	 * before we emit position-changed */
-	gc_master_provider_handle_new_address_accuracy (provider, accuracy);
+	if (old_level != new_level) {
+		g_signal_emit (provider, signals[ACCURACY_CHANGED], 0,
+		               GC_IFACE_ADDRESS, new_level);
+	}
 	
 	if (!error) {
 		g_signal_emit (provider, signals[ADDRESS_CHANGED], 0, 
-		               priv->address_cache.timestamp, 
-		               priv->address_cache.details, 
-		               priv->address_cache.accuracy);
+		               cache->timestamp, 
+		               cache->details, 
+		               cache->accuracy);
 	}
+	gc_snapshot_unref (cache);
 }
 
 
+static void
+gc_master_provider_set_velocity (GcMasterProvider      *provider,
+                                 GeoclueVelocityFields  fields,
+                                 int                    timestamp,
+                                 double                 speed,
+                                 double                 direction,
+                                 double                 climb)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	
+	gc_snapshot_publisher_publish (priv->velocity_cache,
+	                               gc_velocity_cache_new (fields, timestamp,
+	                                                      speed, direction, climb));
+	
+	g_signal_emit (provider, signals[VELOCITY_CHANGED], 0,
+	               fields, timestamp, speed, direction, climb);
+	
+	gc_master_provider_update_duty_cycle (provider);
+}
 
 static GeoclueResourceFlags
 parse_resource_strings (char **flags)
@@ -322,6 +759,8 @@ parse_interface_strings (char **strs)
 			ifaces |= GC_IFACE_POSITION;
 		} else if (strcmp (strs[i], GEOCLUE_ADDRESS_INTERFACE_NAME) == 0) {
 			ifaces |= GC_IFACE_ADDRESS;
+		} else if (strcmp (strs[i], GEOCLUE_VELOCITY_INTERFACE_NAME) == 0) {
+			ifaces |= GC_IFACE_VELOCITY;
 		}
 	}
 	return ifaces;
@@ -421,7 +860,7 @@ gc_master_provider_update_cache (GcMasterProvider *master_provider)
 	priv = GET_PRIVATE (master_provider);
 	
 	if ((!(priv->provides & GEOCLUE_PROVIDE_UPDATES)) ||
-	    (!gc_master_provider_get_provider (master_provider))) {
+	    (!gc_master_provider_is_running (master_provider))) {
 		/* non-cacheable provider or provider not running */
 		return;
 	}
@@ -430,18 +869,18 @@ gc_master_provider_update_cache (GcMasterProvider *master_provider)
 	priv->master_status = GEOCLUE_STATUS_ACQUIRING;
 	g_signal_emit (master_provider, signals[STATUS_CHANGED], 0, priv->master_status);
 	
-	if (priv->position) {
+	if (gc_master_provider_has_running_iface (master_provider, GC_IFACE_POSITION)) {
 		int timestamp;
 		double lat, lon, alt;
 		GeocluePositionFields fields;
 		GeoclueAccuracy *accuracy = NULL;
 		GError *error = NULL;
 		
-		fields = geoclue_position_get_position (priv->position,
-							&timestamp,
-							&lat, &lon, &alt,
-							&accuracy, 
-							&error);
+		fields = gc_master_provider_query_position (master_provider,
+		                                            &timestamp,
+		                                            &lat, &lon, &alt,
+		                                            &accuracy, 
+		                                            &error);
 		if (error){
 			g_warning ("Error updating position cache: %s", error->message);
 			gc_master_provider_handle_error (master_provider, error);
@@ -452,17 +891,17 @@ gc_master_provider_update_cache (GcMasterProvider *master_provider)
 		                                 accuracy, error);
 	}
 	
-	if (priv->address) {
+	if (gc_master_provider_has_running_iface (master_provider, GC_IFACE_ADDRESS)) {
 		int timestamp;
 		GHashTable *details = NULL;
 		GeoclueAccuracy *accuracy = NULL;
 		GError *error = NULL;
 		
-		if (!geoclue_address_get_address (priv->address,
-		                                  &timestamp,
-		                                  &details,
-		                                  &accuracy,
-		                                  &error)) {
+		if (!gc_master_provider_query_address (master_provider,
+		                                       &timestamp,
+		                                       &details,
+		                                       &accuracy,
+		                                       &error)) {
 			g_warning ("Error updating address cache: %s", error->message);
 			gc_master_provider_handle_error (master_provider, error);
 		}
@@ -473,6 +912,26 @@ gc_master_provider_update_cache (GcMasterProvider *master_provider)
 		                                error);
 	}
 	
+	if (gc_master_provider_has_running_iface (master_provider, GC_IFACE_VELOCITY)) {
+		int timestamp = 0;
+		double speed = 0.0, direction = 0.0, climb = 0.0;
+		GeoclueVelocityFields fields;
+		GError *error = NULL;
+		
+		fields = gc_master_provider_query_velocity (master_provider,
+		                                            &timestamp,
+		                                            &speed, &direction, &climb,
+		                                            &error);
+		if (error) {
+			/* velocity is optional: just report it as unknown */
+			g_warning ("Error updating velocity cache: %s", error->message);
+			g_error_free (error);
+		}
+		gc_master_provider_set_velocity (master_provider,
+		                                 fields, timestamp,
+		                                 speed, direction, climb);
+	}
+	
 	gc_master_provider_handle_status_change (master_provider);
 }
 
@@ -523,20 +982,30 @@ address_changed (GeoclueAddress   *address,
                                         NULL);
 }
 
+static void
+velocity_changed (GeoclueVelocity      *velocity,
+                  GeoclueVelocityFields fields,
+                  int                   timestamp,
+                  double                speed,
+                  double                direction,
+                  double                climb,
+                  GcMasterProvider     *provider)
+{
+	gc_master_provider_set_velocity (provider,
+	                                 fields, timestamp,
+	                                 speed, direction, climb);
+}
+
 
 static void
 finalize (GObject *object)
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (object);
 	
-	geoclue_accuracy_free (priv->position_cache.accuracy);
-	geoclue_accuracy_free (priv->address_cache.accuracy);
-	if (priv->position_cache.error) {
-		g_error_free (priv->position_cache.error);
-	}
-	if (priv->address_cache.error) {
-		g_error_free (priv->address_cache.error);
-	}
+	gc_snapshot_publisher_free (priv->position_cache);
+	gc_position_history_free (priv->position_history);
+	gc_snapshot_publisher_free (priv->address_cache);
+	gc_snapshot_publisher_free (priv->velocity_cache);
 	
 	g_free (priv->name);
 	g_free (priv->description);
@@ -563,9 +1032,15 @@ dispose (GObject *object)
 		g_object_unref (priv->address);
 		priv->address = NULL;
 	}
-	if (priv->address_cache.details) {
-		g_hash_table_destroy (priv->address_cache.details);
-		priv->address_cache.details = NULL;
+	
+	if (priv->velocity) {
+		g_object_unref (priv->velocity);
+		priv->velocity = NULL;
+	}
+	
+	if (priv->plugin) {
+		g_object_unref (priv->plugin);
+		priv->plugin = NULL;
 	}
 	
 	G_OBJECT_CLASS (gc_master_provider_parent_class)->dispose (object);
@@ -621,6 +1096,16 @@ gc_master_provider_class_init (GcMasterProviderClass *klass)
 						 G_TYPE_INT, 
 						 G_TYPE_POINTER,
 						 G_TYPE_POINTER);
+	signals[VELOCITY_CHANGED] = g_signal_new ("velocity-changed",
+						  G_TYPE_FROM_CLASS (klass),
+						  G_SIGNAL_RUN_FIRST |
+						  G_SIGNAL_NO_RECURSE,
+						  G_STRUCT_OFFSET (GcMasterProviderClass, velocity_changed), 
+						  NULL, NULL,
+						  geoclue_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
+						  G_TYPE_NONE, 5,
+						  G_TYPE_INT, G_TYPE_INT,
+						  G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
 }
 
 static void
@@ -634,15 +1119,25 @@ gc_master_provider_init (GcMasterProvider *provider)
 	priv->master_status = GEOCLUE_STATUS_UNAVAILABLE;
 	
 	priv->position = NULL;
-	priv->position_cache.accuracy = 
-		geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0 ,0);
-	priv->position_cache.error = NULL;
+	priv->position_cache = gc_snapshot_publisher_new
+		(gc_position_cache_new (GEOCLUE_POSITION_FIELDS_NONE, 0,
+		                        0.0, 0.0, 0.0, NULL, NULL));
+	priv->position_history = gc_position_history_new (GC_POSITION_HISTORY_SIZE);
 	
 	priv->address = NULL;
-	priv->address_cache.accuracy = 
-		geoclue_accuracy_new (GEOCLUE_ACCURACY_LEVEL_NONE, 0 ,0);
-	priv->address_cache.details = geoclue_address_details_new ();
-	priv->address_cache.error = NULL;
+	priv->address_cache = gc_snapshot_publisher_new
+		(gc_address_cache_new (0, NULL, NULL, NULL));
+	
+	priv->plugin_type = G_TYPE_INVALID;
+	priv->plugin = NULL;
+	
+	priv->velocity = NULL;
+	priv->velocity_cache = gc_snapshot_publisher_new
+		(gc_velocity_cache_new (GEOCLUE_VELOCITY_FIELDS_NONE, 0,
+		                        0.0, 0.0, 0.0));
+	
+	g_value_init (&priv->gps_interval, G_TYPE_INT);
+	g_value_init (&priv->n_clients, G_TYPE_INT);
 }
 
 #if DEBUG_INFO
@@ -750,8 +1245,9 @@ gc_master_provider_dump_provider_details (GcMasterProvider *provider)
 	g_print ("   Service - %s\n", priv->service);
 	g_print ("   Path - %s\n", priv->path);
 	g_print ("   Accuracy level - %d\n", priv->expected_accuracy);
-	g_print ("   Provider is currently %srunning, status %d\n", 
-	         gc_master_provider_get_provider (master_provider) ? "" : "not ",
+	g_print ("   Provider is currently %srunning%s, status %d\n", 
+	         gc_master_provider_is_running (provider) ? "" : "not ",
+	         priv->plugin_type != G_TYPE_INVALID ? " (in-process)" : "",
 	         priv->master_status);
 	gc_master_provider_dump_required_resources (provider);
 	gc_master_provider_dump_provides (provider);
@@ -772,33 +1268,39 @@ static gboolean
 gc_master_provider_initialize_geoclue (GcMasterProvider *master_provider)
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (master_provider);
-	GeoclueProvider *geoclue;
+	GObject *geoclue;
+	GHashTable *options;
 	GError *error = NULL;
 	
-	geoclue = gc_master_provider_get_provider (master_provider);
+	if (priv->plugin) {
+		geoclue = priv->plugin;
+	} else {
+		geoclue = G_OBJECT (gc_master_provider_get_provider (master_provider));
+	}
 	
-	if (!geoclue_provider_set_options (geoclue,
-	                                   geoclue_get_main_options (),
-	                                   &error)) {
+	options = gc_master_provider_get_options (master_provider);
+	if (!gc_master_provider_query_options (master_provider, options, &error)) {
 		g_warning ("Error setting provider options: %s\n", error->message);
 		g_error_free (error);
+		g_hash_table_unref (options);
 		return FALSE;
 	}
+	g_hash_table_unref (options);
 	
 	/* priv->name has been read from .provider-file earlier...
 	 * could ask the provider anyway, just to be consistent */
-	if (!geoclue_provider_get_provider_info (geoclue, NULL, 
-	                                         &priv->description, &error)) {
+	if (!gc_master_provider_query_description (master_provider,
+	                                           &priv->description, &error)) {
 		g_warning ("Error getting provider info: %s\n", error->message);
 		g_error_free (error);
 		return FALSE;
 	}
 	
-	g_signal_connect (G_OBJECT (geoclue), "status-changed",
+	g_signal_connect (geoclue, "status-changed",
 			  G_CALLBACK (provider_status_changed), master_provider);
 	
 	
-	if (!geoclue_provider_get_status (geoclue, &priv->status, &error)) {
+	if (!gc_master_provider_query_status (master_provider, &priv->status, &error)) {
 		g_warning ("Error getting provider status: %s\n", error->message);
 		g_error_free (error);
 		return FALSE;
@@ -806,6 +1308,29 @@ gc_master_provider_initialize_geoclue (GcMasterProvider *master_provider)
 	return TRUE;
 }
 
+/* Registers the in-process provider object at its path on the master's 
+ * connection, where clients told about it by Get*Provider and 
+ * *ProviderChanged look for it, or unregisters it */
+static void
+gc_master_provider_export_plugin (GcMasterProvider *provider,
+                                  gboolean          export)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	DBusGConnection *connection;
+	
+	connection = dbus_g_bus_get (GEOCLUE_DBUS_BUS, NULL);
+	if (connection == NULL) {
+		return;
+	}
+	if (export) {
+		dbus_g_connection_register_g_object (connection, priv->path,
+		                                     priv->plugin);
+	} else {
+		dbus_g_connection_unregister_g_object (connection, priv->plugin);
+	}
+	dbus_g_connection_unref (connection);
+}
+
 static gboolean
 gc_master_provider_initialize_interfaces (GcMasterProvider *provider)
 {
@@ -818,6 +1343,28 @@ gc_master_provider_initialize_interfaces (GcMasterProvider *provider)
 		return FALSE;
 	}
 	
+	if (priv->plugin_type != G_TYPE_INVALID) {
+		g_assert (priv->plugin == NULL);
+		
+		/* the GcIface signals match the client API ones, 
+		 * so the same handlers work for both */
+		priv->plugin = g_object_new (priv->plugin_type, NULL);
+		gc_master_provider_export_plugin (provider, TRUE);
+		if (priv->interfaces & GC_IFACE_POSITION) {
+			g_signal_connect (priv->plugin, "position-changed",
+			                  G_CALLBACK (position_changed), provider);
+		}
+		if (priv->interfaces & GC_IFACE_ADDRESS) {
+			g_signal_connect (priv->plugin, "address-changed",
+			                  G_CALLBACK (address_changed), provider);
+		}
+		if (priv->interfaces & GC_IFACE_VELOCITY) {
+			g_signal_connect (priv->plugin, "velocity-changed",
+			                  G_CALLBACK (velocity_changed), provider);
+		}
+		return gc_master_provider_initialize_geoclue (provider);
+	}
+	
 	if (priv->interfaces & GC_IFACE_POSITION) {
 		g_assert (priv->position == NULL);
 		
@@ -834,6 +1381,14 @@ gc_master_provider_initialize_interfaces (GcMasterProvider *provider)
 		g_signal_connect (G_OBJECT (priv->address), "address-changed",
 		                  G_CALLBACK (address_changed), provider);
 	}
+	if (priv->interfaces & GC_IFACE_VELOCITY) {
+		g_assert (priv->velocity == NULL);
+		
+		priv->velocity = geoclue_velocity_new (priv->service, 
+		                                       priv->path);
+		g_signal_connect (G_OBJECT (priv->velocity), "velocity-changed",
+		                  G_CALLBACK (velocity_changed), provider);
+	}
 	
 	if (!gc_master_provider_initialize_geoclue (provider)) {
 		return FALSE;
@@ -870,6 +1425,15 @@ gc_master_provider_deinitialize (GcMasterProvider *provider)
 		g_object_unref (priv->address);
 		priv->address = NULL;
 	}
+	if (priv->velocity) {
+		g_object_unref (priv->velocity);
+		priv->velocity = NULL;
+	}
+	if (priv->plugin) {
+		gc_master_provider_export_plugin (provider, FALSE);
+		g_object_unref (priv->plugin);
+		priv->plugin = NULL;
+	}
 	g_debug ("deinited %s", priv->name);
 }
 
@@ -909,6 +1473,77 @@ update_cache_and_deinit (GcMasterProvider *provider)
 
 /* public methods (for GcMaster and GcMasterClient) */
 
+/* Loads provider plug-in module 'name' from GEOCLUE_PLUGINS_DIR and 
+ * returns the provider type, or G_TYPE_INVALID if the module cannot be
+ * used (in which case the provider is used over D-Bus) */
+static GType
+gc_master_provider_load_plugin (const char      *name,
+                                GcInterfaceFlags interfaces)
+{
+	GModule *module;
+	char *path;
+	gpointer abi_version = NULL;
+	GcProviderPluginGetType get_type = NULL;
+	GType type;
+	
+	if (!g_module_supported ()) {
+		return G_TYPE_INVALID;
+	}
+	
+	path = g_module_build_path (GEOCLUE_PLUGINS_DIR, name);
+	module = g_module_open (path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	if (!module) {
+		g_warning ("Could not load provider plugin %s: %s", 
+		           path, g_module_error ());
+		g_free (path);
+		return G_TYPE_INVALID;
+	}
+	
+	if (!g_module_symbol (module, "gc_provider_plugin_abi_version", &abi_version) ||
+	    *(const int *)abi_version != GC_PROVIDER_PLUGIN_ABI_VERSION ||
+	    !g_module_symbol (module, "gc_provider_plugin_get_type", (gpointer *)&get_type)) {
+		g_warning ("%s is not a compatible provider plugin", path);
+		g_module_close (module);
+		g_free (path);
+		return G_TYPE_INVALID;
+	}
+	g_free (path);
+	
+	/* the types registered by the module can't be unloaded */
+	g_module_make_resident (module);
+	
+	type = get_type ();
+	
+	if (!g_type_is_a (type, GC_TYPE_PROVIDER) ||
+	    ((interfaces & GC_IFACE_POSITION) && !g_type_is_a (type, GC_TYPE_IFACE_POSITION)) ||
+	    ((interfaces & GC_IFACE_ADDRESS) && !g_type_is_a (type, GC_TYPE_IFACE_ADDRESS)) ||
+	    ((interfaces & GC_IFACE_VELOCITY) && !g_type_is_a (type, GC_TYPE_IFACE_VELOCITY))) {
+		g_warning ("Provider plugin %s does not implement the interfaces it declares", 
+		           name);
+		return G_TYPE_INVALID;
+	}
+	
+	return type;
+}
+
+/* set cached accuracies to the expected accuracy */
+static void
+gc_master_provider_set_default_accuracy (GcMasterProvider *provider)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GeoclueAccuracy *accuracy;
+	
+	accuracy = geoclue_accuracy_new (priv->expected_accuracy, 0.0, 0.0);
+	gc_snapshot_publisher_publish 
+		(priv->position_cache,
+		 gc_position_cache_new (GEOCLUE_POSITION_FIELDS_NONE, 0,
+		                        0.0, 0.0, 0.0, accuracy, NULL));
+	gc_snapshot_publisher_publish 
+		(priv->address_cache,
+		 gc_address_cache_new (0, NULL, accuracy, NULL));
+	geoclue_accuracy_free (accuracy);
+}
+
 /* Loads provider details from 'filename' */ 
 GcMasterProvider *
 gc_master_provider_new (const char *filename,
@@ -921,6 +1556,7 @@ gc_master_provider_new (const char *filename,
 	gboolean ret;
 	char *accuracy_str; 
 	char **flags, **interfaces;
+	char *plugin;
 	
 	keyfile = g_key_file_new ();
 	ret = g_key_file_load_from_file (keyfile, filename, 
@@ -949,12 +1585,7 @@ gc_master_provider_new (const char *filename,
 		g_free (accuracy_str);
 	}
 	
-	/* set cached accuracies to a default value */
-	geoclue_accuracy_set_details (priv->position_cache.accuracy,
-	                              priv->expected_accuracy, 0.0, 0.0);
-	geoclue_accuracy_set_details (priv->address_cache.accuracy,
-	                              priv->expected_accuracy, 0.0, 0.0);
-
+	gc_master_provider_set_default_accuracy (provider);
 	
 	flags = g_key_file_get_string_list (keyfile, "Geoclue Provider",
 	                                    "Requires", NULL, NULL);
@@ -1006,6 +1637,21 @@ gc_master_provider_new (const char *filename,
 		g_strfreev (interfaces);
 	}
 	
+	plugin = g_key_file_get_value (keyfile, "Geoclue Provider",
+	                               "Plugin", NULL);
+	if (plugin) {
+		priv->plugin_type = gc_master_provider_load_plugin (plugin, 
+		                                                    priv->interfaces);
+		g_free (plugin);
+	}
+	if (priv->plugin_type != G_TYPE_INVALID) {
+		/* nothing owns the provider's own name: clients find the 
+		 * plug-in on the master's connection (see 
+		 * gc_master_provider_initialize_interfaces) */
+		g_free (priv->service);
+		priv->service = g_strdup (GEOCLUE_MASTER_DBUS_SERVICE);
+	}
+	
 	if (priv->provides & GEOCLUE_PROVIDE_CACHEABLE_ON_CONNECTION &&
 	    priv->net_status == GEOCLUE_CONNECTIVITY_ONLINE) {
 		/* do this as idle so we can return without waiting for http queries */
@@ -1014,6 +1660,94 @@ gc_master_provider_new (const char *filename,
 	return provider;
 }
 
+/* Creates a provider that runs in the master itself, without a
+ * .provider file. It sends updates, and its status does not depend
+ * on the network status (the providers it uses handle that). */
+GcMasterProvider *
+gc_master_provider_new_in_process (const char           *name,
+                                   const char           *service,
+                                   const char           *path,
+                                   GType                 type,
+                                   GcInterfaceFlags      interfaces,
+                                   GeoclueAccuracyLevel  expected_accuracy,
+                                   GeoclueResourceFlags  required_resources)
+{
+	GcMasterProvider *provider;
+	GcMasterProviderPrivate *priv;
+	
+	provider = g_object_new (GC_TYPE_MASTER_PROVIDER, NULL);
+	priv = GET_PRIVATE (provider);
+	
+	priv->name = g_strdup (name);
+	priv->service = g_strdup (service);
+	priv->path = g_strdup (path);
+	priv->expected_accuracy = expected_accuracy;
+	priv->required_resources = required_resources;
+	priv->provides = GEOCLUE_PROVIDE_UPDATES;
+	priv->net_status = GEOCLUE_CONNECTIVITY_ONLINE;
+	priv->interfaces = GC_IFACE_GEOCLUE | interfaces;
+	
+	gc_master_provider_set_default_accuracy (provider);
+	
+	priv->plugin_type = type;
+	
+	return provider;
+}
+
+/* Tells a GPS provider how long it may stop between fixes, when the
+ * clients or the speed allow a different interval (see master-duty.c) */
+void
+gc_master_provider_update_duty_cycle (GcMasterProvider *provider)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GeoclueVelocityFields fields;
+	double speed = 0.0;
+	int interval;
+	
+	if (!(priv->required_resources & GEOCLUE_RESOURCE_GPS)) {
+		return;
+	}
+	
+	fields = gc_master_provider_get_velocity (provider, NULL,
+	                                          &speed, NULL, NULL);
+	interval = gc_duty_cycle_get_interval (priv->position_clients,
+	                                       fields, speed);
+	if (interval == g_value_get_int (&priv->gps_interval)) {
+		return;
+	}
+	
+	g_debug ("%s: %d s between fixes", priv->name, interval);
+	g_value_set_int (&priv->gps_interval, interval);
+	gc_master_provider_update_options (provider);
+}
+
+/* Tells a cell provider how many clients it has, so that it can stop
+ * polling the modem when there are none */
+static void
+gc_master_provider_update_n_clients (GcMasterProvider *provider)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GList *l;
+	int n_clients;
+	
+	if (!(priv->required_resources & GEOCLUE_RESOURCE_CELL)) {
+		return;
+	}
+	
+	n_clients = g_list_length (priv->position_clients);
+	for (l = priv->address_clients; l; l = l->next) {
+		if (!g_list_find (priv->position_clients, l->data)) {
+			n_clients++;
+		}
+	}
+	if (n_clients == g_value_get_int (&priv->n_clients)) {
+		return;
+	}
+	
+	g_value_set_int (&priv->n_clients, n_clients);
+	gc_master_provider_update_options (provider);
+}
+
 /* client calls this when it wants to use the provider. 
    Returns true if provider was actually started, and 
    client should assume accuracy has changed. 
@@ -1039,12 +1773,14 @@ gc_master_provider_subscribe (GcMasterProvider *provider,
 		if (!g_list_find (priv->position_clients, client)) {
 			priv->position_clients = g_list_prepend (priv->position_clients, client);
 		}
+		gc_master_provider_update_duty_cycle (provider);
 	}
 	if (interface & GC_IFACE_ADDRESS) {
 		if (!g_list_find (priv->address_clients, client)) {
 			priv->address_clients = g_list_prepend (priv->address_clients, client);
 		}
 	}
+	gc_master_provider_update_n_clients (provider);
 	
 	return started;
 }
@@ -1059,10 +1795,12 @@ gc_master_provider_unsubscribe (GcMasterProvider *provider,
 	
 	if (interface & GC_IFACE_POSITION) {
 		priv->position_clients = g_list_remove (priv->position_clients, client);
+		gc_master_provider_update_duty_cycle (provider);
 	}
 	if (interface & GC_IFACE_ADDRESS) {
 		priv->address_clients = g_list_remove (priv->address_clients, client);
 	}
+	gc_master_provider_update_n_clients (provider);
 	
 	if (!priv->position_clients &&
 	    !priv->address_clients) {
@@ -1086,38 +1824,45 @@ gc_master_provider_get_position (GcMasterProvider *provider,
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
 	
-	g_assert (priv->position || 
+	g_assert (gc_master_provider_has_running_iface (provider, GC_IFACE_POSITION) || 
 	          priv->provides & GEOCLUE_PROVIDE_CACHEABLE_ON_CONNECTION);
 	
 	if (priv->provides & GEOCLUE_PROVIDE_UPDATES) {
+		GcPositionCache *cache;
+		GeocluePositionFields fields;
+		
+		cache = gc_snapshot_publisher_acquire (priv->position_cache);
 		if (timestamp != NULL) {
-			*timestamp = priv->position_cache.timestamp;
+			*timestamp = cache->timestamp;
 		}
 		if (latitude != NULL) {
-			*latitude = priv->position_cache.latitude;
+			*latitude = cache->latitude;
 		}
 		if (longitude != NULL) {
-			*longitude = priv->position_cache.longitude;
+			*longitude = cache->longitude;
 		}
 		if (altitude != NULL) {
-			*altitude = priv->position_cache.altitude;
+			*altitude = cache->altitude;
 		}
 		if (accuracy != NULL) {
-			*accuracy = geoclue_accuracy_copy (priv->position_cache.accuracy);
+			*accuracy = geoclue_accuracy_copy (cache->accuracy);
 		}
 		if (error != NULL) {
 			g_assert (!*error);
-			copy_error (error, priv->position_cache.error);
+			copy_error (error, cache->error);
 		}
-		return priv->position_cache.fields;
+		fields = cache->fields;
+		gc_snapshot_unref (cache);
+		
+		return fields;
 	} else {
-		return geoclue_position_get_position (priv->position,
-		                                      timestamp,
-		                                      latitude, 
-		                                      longitude, 
-		                                      altitude,
-		                                      accuracy, 
-		                                      error);
+		return gc_master_provider_query_position (provider,
+		                                          timestamp,
+		                                          latitude, 
+		                                          longitude, 
+		                                          altitude,
+		                                          accuracy, 
+		                                          error);
 	}
 }
 
@@ -1130,29 +1875,93 @@ gc_master_provider_get_address (GcMasterProvider  *provider,
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
 	if (priv->provides & GEOCLUE_PROVIDE_UPDATES) {
+		GcAddressCache *cache;
+		gboolean ret;
 		
+		cache = gc_snapshot_publisher_acquire (priv->address_cache);
 		if (timestamp != NULL) {
-			*timestamp = priv->address_cache.timestamp;
+			*timestamp = cache->timestamp;
 		}
 		if (details != NULL) {
-			*details = geoclue_address_details_copy (priv->address_cache.details);
+			*details = geoclue_address_details_copy (cache->details);
 		}
 		if (accuracy != NULL) {
-			*accuracy = geoclue_accuracy_copy (priv->address_cache.accuracy);
+			*accuracy = geoclue_accuracy_copy (cache->accuracy);
 		}
 		if (error != NULL) {
 			g_assert (!*error);
-			copy_error (error, priv->address_cache.error);
+			copy_error (error, cache->error);
 		}
-		return (!priv->address_cache.error);
+		ret = (cache->error == NULL);
+		gc_snapshot_unref (cache);
+		
+		return ret;
 	} else {
-		g_assert (priv->address);
-		return geoclue_address_get_address (priv->address,
-		                                    timestamp,
-		                                    details, 
-		                                    accuracy, 
-		                                    error);
+		g_assert (gc_master_provider_has_running_iface (provider, GC_IFACE_ADDRESS));
+		return gc_master_provider_query_address (provider,
+		                                         timestamp,
+		                                         details, 
+		                                         accuracy, 
+		                                         error);
+	}
+}
+
+/* Velocity is optional and never an error: providers without the
+ * Velocity interface just return GEOCLUE_VELOCITY_FIELDS_NONE */
+GeoclueVelocityFields
+gc_master_provider_get_velocity (GcMasterProvider *provider,
+                                 int              *timestamp,
+                                 double           *speed,
+                                 double           *direction,
+                                 double           *climb)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	GeoclueVelocityFields fields;
+	
+	if (!(priv->interfaces & GC_IFACE_VELOCITY)) {
+		return GEOCLUE_VELOCITY_FIELDS_NONE;
+	}
+	
+	if (priv->provides & GEOCLUE_PROVIDE_UPDATES) {
+		GcVelocityCache *cache;
+		
+		cache = gc_snapshot_publisher_acquire (priv->velocity_cache);
+		if (timestamp != NULL) {
+			*timestamp = cache->timestamp;
+		}
+		if (speed != NULL) {
+			*speed = cache->speed;
+		}
+		if (direction != NULL) {
+			*direction = cache->direction;
+		}
+		if (climb != NULL) {
+			*climb = cache->climb;
+		}
+		fields = cache->fields;
+		gc_snapshot_unref (cache);
+		
+		return fields;
 	}
+	
+	if (!gc_master_provider_has_running_iface (provider, GC_IFACE_VELOCITY)) {
+		return GEOCLUE_VELOCITY_FIELDS_NONE;
+	}
+	return gc_master_provider_query_velocity (provider,
+	                                          timestamp,
+	                                          speed, direction, climb,
+	                                          NULL);
+}
+
+/* Positions received after 'since', oldest first. Only providers that
+ * send updates have a history. Free the array with g_array_free(). */
+GArray *
+gc_master_provider_get_position_history (GcMasterProvider *provider,
+                                         int               since)
+{
+	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
+	
+	return gc_position_history_get_since (priv->position_history, since);
 }
 
 gboolean
@@ -1187,17 +1996,19 @@ gc_master_provider_is_good (GcMasterProvider     *provider,
 void
 gc_master_provider_update_options (GcMasterProvider *provider)
 {
-	GeoclueProvider *geoclue;
+	GHashTable *options;
 	GError *error = NULL;
 	
-	geoclue = gc_master_provider_get_provider (provider);
+	if (!gc_master_provider_is_running (provider)) {
+		return;
+	}
 	
-	if (!geoclue_provider_set_options (geoclue,
-	                                   geoclue_get_main_options (),
-	                                   &error)) {
+	options = gc_master_provider_get_options (provider);
+	if (!gc_master_provider_query_options (provider, options, &error)) {
 		g_warning ("Error setting provider options: %s\n", error->message);
 		g_error_free (error);
 	}
+	g_hash_table_unref (options);
 }
 
 GeoclueStatus 
@@ -1210,23 +2021,16 @@ gc_master_provider_get_status (GcMasterProvider *provider)
 
 GeoclueAccuracyLevel 
 gc_master_provider_get_accuracy (GcMasterProvider *provider, GcInterfaceFlags iface)
+{
+	return gc_master_provider_get_cached_level (provider, iface);
+}
+
+GeoclueResourceFlags
+gc_master_provider_get_required_resources (GcMasterProvider *provider)
 {
 	GcMasterProviderPrivate *priv = GET_PRIVATE (provider);
-	GeoclueAccuracyLevel acc_level;
 	
-	switch (iface) {
-		case GC_IFACE_POSITION:
-			geoclue_accuracy_get_details (priv->position_cache.accuracy,
-			                              &acc_level, NULL, NULL);
-			break;
-		case GC_IFACE_ADDRESS:
-			geoclue_accuracy_get_details (priv->address_cache.accuracy,
-			                              &acc_level, NULL, NULL);
-			break;
-		default:
-			g_assert_not_reached ();
-	}
-	return acc_level;
+	return priv->required_resources;
 }
 
 /*returns a reference, but is not meant for editing...*/
@@ -1266,7 +2070,6 @@ gc_master_provider_compare (GcMasterProvider *a,
                             GcInterfaceAccuracy *iface_min_accuracy)
 {
 	int diff;
-	GeoclueAccuracy *acc_a, *acc_b;
 	GeoclueAccuracyLevel level_a, level_b, min_level;
 	
 	
@@ -1274,23 +2077,8 @@ gc_master_provider_compare (GcMasterProvider *a,
 	GcMasterProviderPrivate *priv_b = GET_PRIVATE (b);
 	
 	/* get the current accuracylevels */
-	switch (iface_min_accuracy->interface) {
-		case GC_IFACE_POSITION:
-			acc_a = priv_a->position_cache.accuracy;
-			acc_b = priv_b->position_cache.accuracy;
-			break;
-		case GC_IFACE_ADDRESS:
-			acc_a = priv_a->address_cache.accuracy;
-			acc_b = priv_b->address_cache.accuracy;
-			break;
-		default:
-			g_warning("iface: %d", iface_min_accuracy->interface);
-			g_assert_not_reached ();
-	}
-	
-
-	geoclue_accuracy_get_details (acc_a, &level_a, NULL, NULL);
-	geoclue_accuracy_get_details (acc_b, &level_b, NULL, NULL);
+	level_a = gc_master_provider_get_cached_level (a, iface_min_accuracy->interface);
+	level_b = gc_master_provider_get_cached_level (b, iface_min_accuracy->interface);
 	min_level = iface_min_accuracy->accuracy_level;
 	
 	/* sort by resource requirements and accuracy, but only if both
@@ -1301,9 +2089,22 @@ gc_master_provider_compare (GcMasterProvider *a,
 		if (diff != 0 ) {
 			return diff;
 		}
-		return level_b - level_a;
 	}
 	
-	/* one or both do not meet req's, sort by accuracy */
+	/* same level: prefer the smaller error estimate if both have one */
+	if (level_a == level_b) {
+		double horizontal_a, horizontal_b;
+		
+		horizontal_a = gc_master_provider_get_cached_horizontal_accuracy 
+			(a, iface_min_accuracy->interface);
+		horizontal_b = gc_master_provider_get_cached_horizontal_accuracy 
+			(b, iface_min_accuracy->interface);
+		if (horizontal_a > 0.0 && horizontal_b > 0.0 && 
+		    horizontal_a != horizontal_b) {
+			return horizontal_a < horizontal_b ? -1 : 1;
+		}
+	}
+	
+	/* otherwise sort by accuracy level */
 	return level_b - level_a;
 }
@@ -73,12 +73,25 @@ typedef struct _GcMasterProviderClass {
 	                          int               timestamp,
 	                          GHashTable       *details,
 	                          GeoclueAccuracy  *accuracy);
+	void (* velocity_changed) (GcMasterProvider     *master_provider,
+	                           GeoclueVelocityFields fields,
+	                           int                   timestamp,
+	                           double                speed,
+	                           double                direction,
+	                           double                climb);
 } GcMasterProviderClass;
 
 GType gc_master_provider_get_type (void);
 
 GcMasterProvider *gc_master_provider_new (const char *filename,
                                           GeoclueConnectivity *connectivity);
+GcMasterProvider *gc_master_provider_new_in_process (const char           *name,
+                                                     const char           *service,
+                                                     const char           *path,
+                                                     GType                 type,
+                                                     GcInterfaceFlags      interfaces,
+                                                     GeoclueAccuracyLevel  expected_accuracy,
+                                                     GeoclueResourceFlags  required_resources);
 
 gboolean gc_master_provider_subscribe (GcMasterProvider *provider, 
                                        gpointer          client,
@@ -106,6 +119,7 @@ gboolean gc_master_provider_is_good (GcMasterProvider     *provider,
 void gc_master_provider_network_status_changed (GcMasterProvider *provider,
                                                 GeoclueNetworkStatus status);
 void gc_master_provider_update_options (GcMasterProvider *provider);
+void gc_master_provider_update_duty_cycle (GcMasterProvider *provider);
 
 char* gc_master_provider_get_name (GcMasterProvider *provider);
 char* gc_master_provider_get_description (GcMasterProvider *provider);
@@ -114,6 +128,7 @@ char* gc_master_provider_get_path (GcMasterProvider *provider);
 
 GeoclueStatus gc_master_provider_get_status (GcMasterProvider *provider);
 GeoclueAccuracyLevel gc_master_provider_get_accuracy (GcMasterProvider *provider, GcInterfaceFlags iface);
+GeoclueResourceFlags gc_master_provider_get_required_resources (GcMasterProvider *provider);
 
 GeocluePositionFields gc_master_provider_get_position (GcMasterProvider *master_provider,
                                                        int              *timestamp,
@@ -129,6 +144,15 @@ gboolean gc_master_provider_get_address (GcMasterProvider  *master_provider,
                                          GeoclueAccuracy  **accuracy,
                                          GError           **error);
 
+GeoclueVelocityFields gc_master_provider_get_velocity (GcMasterProvider *master_provider,
+                                                       int              *timestamp,
+                                                       double           *speed,
+                                                       double           *direction,
+                                                       double           *climb);
+
+GArray *gc_master_provider_get_position_history (GcMasterProvider *master_provider,
+                                                 int               since);
+
 
 G_END_DECLS
 
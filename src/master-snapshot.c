@@ -0,0 +1,150 @@
+/*
+ * Geoclue
+ * master-snapshot.c - Lock-free publishing of immutable cache snapshots
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Publisher for the cached provider data in GcMasterProvider.
+ *
+ *  The writer (always the main loop) builds a new immutable snapshot
+ *  and swaps it in. Readers take a reference to the current snapshot
+ *  without locking and can then use it for as long as they like.
+ *
+ *  The only race is between a reader loading the current pointer and
+ *  taking its reference, while the writer drops the last reference to
+ *  the replaced snapshot. That window is covered with two reader
+ *  counters, indexed by epoch parity: after swapping, the writer bumps
+ *  the epoch and waits for the readers of the previous epoch to leave.
+ *  Readers are only in that window for a single atomic increment, so
+ *  the writer never waits for long.
+ **/
+
+#include "master-snapshot.h"
+
+struct _GcSnapshotPublisher {
+	GcSnapshot * volatile current;
+	volatile gint epoch;
+	volatile gint readers[2];
+};
+
+void
+gc_snapshot_init (GcSnapshot     *snapshot,
+                  GDestroyNotify  free_func)
+{
+	snapshot->ref_count = 1;
+	snapshot->free_func = free_func;
+}
+
+gpointer
+gc_snapshot_ref (gpointer snapshot)
+{
+	g_atomic_int_inc (&((GcSnapshot *) snapshot)->ref_count);
+	return snapshot;
+}
+
+void
+gc_snapshot_unref (gpointer snapshot)
+{
+	GcSnapshot *s = snapshot;
+
+	if (s == NULL) {
+		return;
+	}
+	if (g_atomic_int_dec_and_test (&s->ref_count)) {
+		s->free_func (s);
+	}
+}
+
+/* takes ownership of 'initial' */
+GcSnapshotPublisher *
+gc_snapshot_publisher_new (gpointer initial)
+{
+	GcSnapshotPublisher *publisher;
+
+	g_assert (initial);
+
+	publisher = g_new0 (GcSnapshotPublisher, 1);
+	publisher->current = initial;
+	return publisher;
+}
+
+void
+gc_snapshot_publisher_free (GcSnapshotPublisher *publisher)
+{
+	if (publisher == NULL) {
+		return;
+	}
+
+	gc_snapshot_unref (publisher->current);
+	g_free (publisher);
+}
+
+/* Replaces the current snapshot, taking ownership of 'snapshot'.
+ * Only one thread may publish at a time. */
+void
+gc_snapshot_publisher_publish (GcSnapshotPublisher *publisher,
+                               gpointer             snapshot)
+{
+	GcSnapshot *old;
+	gint epoch;
+
+	g_assert (snapshot);
+
+	old = g_atomic_pointer_get (&publisher->current);
+	g_atomic_pointer_set (&publisher->current, snapshot);
+
+	epoch = g_atomic_int_get (&publisher->epoch);
+	g_atomic_int_set (&publisher->epoch, epoch + 1);
+
+	/* wait for readers that may have loaded 'old' but not yet ref'd it */
+	while (g_atomic_int_get (&publisher->readers[epoch & 1]) > 0) {
+		g_thread_yield ();
+	}
+
+	gc_snapshot_unref (old);
+}
+
+/* Returns a reference to the current snapshot. Never blocks.
+ * Release with gc_snapshot_unref(). */
+gpointer
+gc_snapshot_publisher_acquire (GcSnapshotPublisher *publisher)
+{
+	GcSnapshot *snapshot;
+	gint epoch;
+
+	while (TRUE) {
+		epoch = g_atomic_int_get (&publisher->epoch);
+		g_atomic_int_inc (&publisher->readers[epoch & 1]);
+
+		if (g_atomic_int_get (&publisher->epoch) == epoch) {
+			break;
+		}
+		/* a writer already stopped waiting for this epoch */
+		g_atomic_int_add (&publisher->readers[epoch & 1], -1);
+	}
+
+	snapshot = g_atomic_pointer_get (&publisher->current);
+	gc_snapshot_ref (snapshot);
+
+	g_atomic_int_add (&publisher->readers[epoch & 1], -1);
+
+	return snapshot;
+}
@@ -0,0 +1,54 @@
+/*
+ * Geoclue
+ * master-snapshot.h - Lock-free publishing of immutable cache snapshots
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_SNAPSHOT_H
+#define MASTER_SNAPSHOT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Header for refcounted snapshots. Must be the first member of
+ * the snapshot struct. Snapshots are never modified once published. */
+typedef struct _GcSnapshot {
+	volatile gint ref_count;
+	GDestroyNotify free_func;
+} GcSnapshot;
+
+typedef struct _GcSnapshotPublisher GcSnapshotPublisher;
+
+void gc_snapshot_init (GcSnapshot     *snapshot,
+                       GDestroyNotify  free_func);
+gpointer gc_snapshot_ref (gpointer snapshot);
+void gc_snapshot_unref (gpointer snapshot);
+
+GcSnapshotPublisher *gc_snapshot_publisher_new (gpointer initial);
+void gc_snapshot_publisher_free (GcSnapshotPublisher *publisher);
+
+void gc_snapshot_publisher_publish (GcSnapshotPublisher *publisher,
+                                    gpointer             snapshot);
+gpointer gc_snapshot_publisher_acquire (GcSnapshotPublisher *publisher);
+
+G_END_DECLS
+
+#endif /* MASTER_SNAPSHOT_H */
@@ -0,0 +1,711 @@
+/*
+ * Geoclue
+ * master-track.c - Compact on-disk track log
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/**
+ *  Append-only log of positions, written by the master's track
+ *  recorder and read for time range queries.
+ *
+ *  Positions are stored in data blocks of at most a minute or 256
+ *  fixes. The first fix of a block is stored against zero and the
+ *  others against the previous one, each value as a zigzag varint:
+ *  a walking or driving track takes about 8-10 bytes per fix.
+ *  After every 64 data blocks (and on close) an index block lists
+ *  their time spans and offsets, and the file header points to the
+ *  newest index block. Index blocks point to the previous one, so a
+ *  query follows the chain and decodes only the blocks it needs.
+ *
+ *  All numbers are little endian:
+ *    header  "GCTRACK\1", guint32 offset of the newest index block
+ *            (0 if none), guint32 0
+ *    block   guint8 type, 3 x guint8 0, guint32 length of the rest
+ *    data    guint16 fixes, guint16 0, gint32 first and last time,
+ *            then per fix: guint8 fields | accuracy level << 3 and
+ *            varints of the time (s), latitude and longitude (1e-7
+ *            degrees), altitude, horizontal and vertical accuracy (dm)
+ *    index   guint32 offset of the previous index block, guint32
+ *            entries, per entry gint32 first and last time and
+ *            guint32 block offset
+ *
+ *  Data blocks after the newest index block (if the master did not
+ *  exit cleanly) are found by walking the block headers.
+ **/
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <geoclue/geoclue-error.h>
+
+#include "master-track.h"
+
+#define TRACK_MAGIC "GCTRACK\1"
+#define TRACK_MAGIC_LENGTH 8
+#define TRACK_HEADER_LENGTH 16
+#define TRACK_BLOCK_HEADER_LENGTH 8
+#define TRACK_DATA_HEADER_LENGTH 12
+#define TRACK_INDEX_HEADER_LENGTH 8
+#define TRACK_INDEX_ENTRY_LENGTH 12
+
+#define TRACK_BLOCK_DATA 'D'
+#define TRACK_BLOCK_INDEX 'I'
+
+#define TRACK_BLOCK_MAX_FIXES 256
+#define TRACK_BLOCK_MAX_SECONDS 60
+#define TRACK_INDEX_MAX_ENTRIES 64
+
+/* a fix is a byte and 6 varints of at most 10 bytes */
+#define TRACK_FIX_MAX_LENGTH 61
+
+typedef struct {
+	gint32 first_time;
+	gint32 last_time;
+	guint32 offset;
+} GcTrackIndexEntry;
+
+/* values as stored, deltas are taken between these */
+typedef struct {
+	gint64 time;
+	gint64 latitude;
+	gint64 longitude;
+	gint64 altitude;
+	gint64 horizontal_accuracy;
+	gint64 vertical_accuracy;
+} GcTrackValues;
+
+struct _GcTrackLog {
+	int fd;
+	guint32 size;
+	guint32 last_index;
+
+	/* the data block being filled */
+	GByteArray *block;
+	guint n_fixes;
+	gint32 first_time;
+	gint32 last_time;
+	GcTrackValues previous;
+
+	/* written data blocks that are not in an index block yet */
+	GArray *pending; /* GcTrackIndexEntry */
+};
+
+static void
+put_uint32 (guint8  *p,
+            guint32  value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = (value >> 16) & 0xff;
+	p[3] = (value >> 24) & 0xff;
+}
+
+static guint32
+get_uint32 (const guint8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static guint
+put_varint (guint8 *p,
+            gint64  value)
+{
+	guint64 zigzag;
+	guint len = 0;
+
+	zigzag = ((guint64) value << 1) ^ (guint64) (value >> 63);
+	while (zigzag >= 0x80) {
+		p[len++] = (zigzag & 0x7f) | 0x80;
+		zigzag >>= 7;
+	}
+	p[len++] = zigzag;
+	return len;
+}
+
+/* returns NULL if the varint does not end before 'end' */
+static const guint8 *
+get_varint (const guint8 *p,
+            const guint8 *end,
+            gint64       *value)
+{
+	guint64 zigzag = 0;
+	guint shift = 0;
+
+	while (p < end && shift < 64) {
+		zigzag |= (guint64) (*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			*value = (gint64) (zigzag >> 1) ^ -(gint64) (zigzag & 1);
+			return p;
+		}
+		shift += 7;
+	}
+	return NULL;
+}
+
+static gint64
+round_to_int (double value)
+{
+	return (gint64) (value < 0 ? value - 0.5 : value + 0.5);
+}
+
+static gboolean
+write_all (int           fd,
+           const guint8 *data,
+           gsize         len,
+           off_t         offset)
+{
+	while (len > 0) {
+		gssize written = pwrite (fd, data, len, offset);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		data += written;
+		offset += written;
+		len -= written;
+	}
+	return TRUE;
+}
+
+/* appends a block to the file, returns its offset or 0 on error */
+static guint32
+gc_track_log_write_block (GcTrackLog   *log,
+                          guint8        type,
+                          const guint8 *payload,
+                          guint32       len)
+{
+	guint8 header[TRACK_BLOCK_HEADER_LENGTH] = { type, 0, 0, 0 };
+	guint32 offset = log->size;
+
+	put_uint32 (header + 4, len);
+	if (!write_all (log->fd, header, TRACK_BLOCK_HEADER_LENGTH, offset) ||
+	    !write_all (log->fd, payload, len, offset + TRACK_BLOCK_HEADER_LENGTH)) {
+		g_warning ("Could not write track log: %s", g_strerror (errno));
+		/* drop whatever made it */
+		if (ftruncate (log->fd, offset) < 0) {
+			g_warning ("Could not truncate track log: %s", g_strerror (errno));
+		}
+		return 0;
+	}
+	log->size += TRACK_BLOCK_HEADER_LENGTH + len;
+	return offset;
+}
+
+static void
+gc_track_log_write_index (GcTrackLog *log)
+{
+	guint8 *payload, header_offset[4];
+	guint32 len, offset;
+	guint i;
+
+	if (log->pending->len == 0) {
+		return;
+	}
+
+	len = TRACK_INDEX_HEADER_LENGTH + log->pending->len * TRACK_INDEX_ENTRY_LENGTH;
+	payload = g_malloc (len);
+	put_uint32 (payload, log->last_index);
+	put_uint32 (payload + 4, log->pending->len);
+	for (i = 0; i < log->pending->len; i++) {
+		GcTrackIndexEntry *entry = &g_array_index (log->pending, GcTrackIndexEntry, i);
+		guint8 *p = payload + TRACK_INDEX_HEADER_LENGTH + i * TRACK_INDEX_ENTRY_LENGTH;
+
+		put_uint32 (p, entry->first_time);
+		put_uint32 (p + 4, entry->last_time);
+		put_uint32 (p + 8, entry->offset);
+	}
+
+	offset = gc_track_log_write_block (log, TRACK_BLOCK_INDEX, payload, len);
+	g_free (payload);
+	if (offset == 0) {
+		return;
+	}
+
+	/* the index is complete on disk before the header points to it */
+	fdatasync (log->fd);
+	put_uint32 (header_offset, offset);
+	if (write_all (log->fd, header_offset, 4, TRACK_MAGIC_LENGTH)) {
+		log->last_index = offset;
+		g_array_set_size (log->pending, 0);
+	}
+}
+
+/* the header is only a placeholder while the block is being filled */
+static void
+gc_track_log_fill_header (GcTrackLog *log)
+{
+	guint8 *header = log->block->data;
+
+	header[0] = log->n_fixes & 0xff;
+	header[1] = (log->n_fixes >> 8) & 0xff;
+	put_uint32 (header + 4, log->first_time);
+	put_uint32 (header + 8, log->last_time);
+}
+
+/* Writes out the data block being filled, if any */
+void
+gc_track_log_flush (GcTrackLog *log)
+{
+	GcTrackIndexEntry entry;
+
+	if (log->n_fixes == 0) {
+		return;
+	}
+
+	gc_track_log_fill_header (log);
+
+	entry.first_time = log->first_time;
+	entry.last_time = log->last_time;
+	entry.offset = gc_track_log_write_block (log, TRACK_BLOCK_DATA,
+	                                         log->block->data, log->block->len);
+
+	g_byte_array_set_size (log->block, TRACK_DATA_HEADER_LENGTH);
+	log->n_fixes = 0;
+
+	if (entry.offset == 0) {
+		return;
+	}
+	g_array_append_val (log->pending, entry);
+	if (log->pending->len >= TRACK_INDEX_MAX_ENTRIES) {
+		gc_track_log_write_index (log);
+	}
+}
+
+void
+gc_track_log_append (GcTrackLog               *log,
+                     const GeocluePositionFix *fix)
+{
+	GcTrackValues values;
+	guint8 buffer[TRACK_FIX_MAX_LENGTH];
+	guint len;
+
+	if (log->n_fixes > 0 &&
+	    (fix->timestamp < log->last_time ||
+	     fix->timestamp - log->first_time >= TRACK_BLOCK_MAX_SECONDS)) {
+		/* clock went back or the block is old enough to be saved */
+		gc_track_log_flush (log);
+	}
+	if (log->n_fixes == 0) {
+		memset (&log->previous, 0, sizeof (GcTrackValues));
+		log->previous.time = fix->timestamp;
+		log->first_time = fix->timestamp;
+	}
+
+	values.time = fix->timestamp;
+	values.latitude = round_to_int (fix->latitude * 1e7);
+	values.longitude = round_to_int (fix->longitude * 1e7);
+	values.altitude = round_to_int (fix->altitude * 10);
+	values.horizontal_accuracy = round_to_int (fix->horizontal_accuracy * 10);
+	values.vertical_accuracy = round_to_int (fix->vertical_accuracy * 10);
+
+	buffer[0] = (fix->fields & 0x7) | ((fix->accuracy_level & 0x7) << 3);
+	len = 1;
+	len += put_varint (buffer + len, values.time - log->previous.time);
+	len += put_varint (buffer + len, values.latitude - log->previous.latitude);
+	len += put_varint (buffer + len, values.longitude - log->previous.longitude);
+	len += put_varint (buffer + len, values.altitude - log->previous.altitude);
+	len += put_varint (buffer + len, values.horizontal_accuracy - log->previous.horizontal_accuracy);
+	len += put_varint (buffer + len, values.vertical_accuracy - log->previous.vertical_accuracy);
+	g_byte_array_append (log->block, buffer, len);
+
+	log->previous = values;
+	log->last_time = fix->timestamp;
+	log->n_fixes++;
+
+	if (log->n_fixes == TRACK_BLOCK_MAX_FIXES) {
+		gc_track_log_flush (log);
+	}
+}
+
+/* Walks the blocks from 'offset' to the end of the file. Data blocks
+ * are added to 'entries' if given. Returns the end of the last whole
+ * block. */
+static guint32
+scan_blocks (const guint8 *data,
+             guint32       size,
+             guint32       offset,
+             GArray       *entries)
+{
+	while (offset + TRACK_BLOCK_HEADER_LENGTH <= size) {
+		guint32 len = get_uint32 (data + offset + 4);
+
+		if (len > size - offset - TRACK_BLOCK_HEADER_LENGTH) {
+			break;
+		}
+		if (data[offset] == TRACK_BLOCK_DATA && entries &&
+		    len >= TRACK_DATA_HEADER_LENGTH) {
+			const guint8 *p = data + offset + TRACK_BLOCK_HEADER_LENGTH;
+			GcTrackIndexEntry entry;
+
+			entry.first_time = get_uint32 (p + 4);
+			entry.last_time = get_uint32 (p + 8);
+			entry.offset = offset;
+			g_array_append_val (entries, entry);
+		}
+		offset += TRACK_BLOCK_HEADER_LENGTH + len;
+	}
+	return offset;
+}
+
+/* Maps 'fd' read-only, returns NULL with 'size' 0 for empty files */
+static const guint8 *
+map_file (int       fd,
+          guint32  *size,
+          GError  **error)
+{
+	struct stat st;
+	void *data;
+
+	if (fstat (fd, &st) < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not read track log: %s", g_strerror (errno));
+		return NULL;
+	}
+	*size = MIN (st.st_size, G_MAXUINT32);
+	if (*size == 0) {
+		return NULL;
+	}
+
+	data = mmap (NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not map track log: %s", g_strerror (errno));
+		return NULL;
+	}
+	if (*size < TRACK_HEADER_LENGTH ||
+	    memcmp (data, TRACK_MAGIC, TRACK_MAGIC_LENGTH) != 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Not a track log");
+		munmap (data, *size);
+		return NULL;
+	}
+	return data;
+}
+
+static gboolean
+is_index_block (const guint8 *data,
+                guint32       size,
+                guint32       offset)
+{
+	guint32 len;
+
+	if (offset < TRACK_HEADER_LENGTH ||
+	    offset > size - TRACK_BLOCK_HEADER_LENGTH - TRACK_INDEX_HEADER_LENGTH ||
+	    data[offset] != TRACK_BLOCK_INDEX) {
+		return FALSE;
+	}
+	len = get_uint32 (data + offset + 4);
+	return len >= TRACK_INDEX_HEADER_LENGTH &&
+	       len <= size - offset - TRACK_BLOCK_HEADER_LENGTH &&
+	       get_uint32 (data + offset + TRACK_BLOCK_HEADER_LENGTH + 4) <=
+	       (len - TRACK_INDEX_HEADER_LENGTH) / TRACK_INDEX_ENTRY_LENGTH;
+}
+
+/**
+ * gc_track_log_open:
+ * @filename: log file, created if it does not exist
+ * @error: return location for errors
+ *
+ * Opens a track log for appending. A block cut short by a crash is
+ * dropped, and blocks that were not indexed are indexed again.
+ */
+GcTrackLog *
+gc_track_log_open (const char *filename,
+                   GError    **error)
+{
+	GcTrackLog *log;
+	const guint8 *data;
+	guint32 size, end;
+	int fd;
+
+	fd = open (filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not open track log %s: %s",
+		             filename, g_strerror (errno));
+		return NULL;
+	}
+
+	log = g_new0 (GcTrackLog, 1);
+	log->fd = fd;
+	log->pending = g_array_new (FALSE, FALSE, sizeof (GcTrackIndexEntry));
+	log->block = g_byte_array_sized_new (TRACK_DATA_HEADER_LENGTH +
+	                                     TRACK_BLOCK_MAX_FIXES * 12);
+	g_byte_array_set_size (log->block, TRACK_DATA_HEADER_LENGTH);
+	memset (log->block->data, 0, TRACK_DATA_HEADER_LENGTH);
+
+	data = map_file (fd, &size, error);
+	if (data == NULL && size > 0) {
+		gc_track_log_close (log);
+		return NULL;
+	}
+
+	if (data == NULL) {
+		guint8 header[TRACK_HEADER_LENGTH] = { 0, };
+
+		memcpy (header, TRACK_MAGIC, TRACK_MAGIC_LENGTH);
+		if (!write_all (fd, header, TRACK_HEADER_LENGTH, 0)) {
+			g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+			             "Could not write track log %s: %s",
+			             filename, g_strerror (errno));
+			gc_track_log_close (log);
+			return NULL;
+		}
+		log->size = TRACK_HEADER_LENGTH;
+		return log;
+	}
+
+	/* if the newest index block is damaged all data blocks are
+	 * indexed again, in an index block that starts a new chain */
+	log->last_index = get_uint32 (data + TRACK_MAGIC_LENGTH);
+	if (is_index_block (data, size, log->last_index)) {
+		end = log->last_index + TRACK_BLOCK_HEADER_LENGTH +
+		      get_uint32 (data + log->last_index + 4);
+	} else {
+		log->last_index = 0;
+		end = TRACK_HEADER_LENGTH;
+	}
+	end = scan_blocks (data, size, end, log->pending);
+	munmap ((void *) data, size);
+
+	if (end < size && ftruncate (fd, end) < 0) {
+		g_warning ("Could not truncate track log: %s", g_strerror (errno));
+	}
+	log->size = end;
+	return log;
+}
+
+void
+gc_track_log_close (GcTrackLog *log)
+{
+	if (log == NULL) {
+		return;
+	}
+	if (log->size > 0) {
+		gc_track_log_flush (log);
+		gc_track_log_write_index (log);
+	}
+	close (log->fd);
+	g_array_free (log->pending, TRUE);
+	g_byte_array_free (log->block, TRUE);
+	g_free (log);
+}
+
+/* decodes the fixes of a data block body, header included */
+static void
+decode_fixes (const guint8 *p,
+              const guint8 *block_end,
+              int           start,
+              int           end,
+              GArray       *fixes)
+{
+	GcTrackValues values;
+	guint n_fixes, i;
+
+	n_fixes = p[0] | (p[1] << 8);
+
+	memset (&values, 0, sizeof (GcTrackValues));
+	values.time = (gint32) get_uint32 (p + 4);
+	p += TRACK_DATA_HEADER_LENGTH;
+
+	for (i = 0; i < n_fixes && p < block_end; i++) {
+		GeocluePositionFix fix;
+		gint64 delta[6];
+		guint8 flags = *p++;
+		guint j;
+
+		for (j = 0; j < G_N_ELEMENTS (delta); j++) {
+			p = get_varint (p, block_end, &delta[j]);
+			if (p == NULL) {
+				return;
+			}
+		}
+		values.time += delta[0];
+		values.latitude += delta[1];
+		values.longitude += delta[2];
+		values.altitude += delta[3];
+		values.horizontal_accuracy += delta[4];
+		values.vertical_accuracy += delta[5];
+
+		if (values.time < start) {
+			continue;
+		} else if (values.time > end) {
+			return;
+		}
+
+		fix.fields = flags & 0x7;
+		fix.accuracy_level = (flags >> 3) & 0x7;
+		fix.timestamp = values.time;
+		fix.latitude = values.latitude / 1e7;
+		fix.longitude = values.longitude / 1e7;
+		fix.altitude = values.altitude / 10.0;
+		fix.horizontal_accuracy = values.horizontal_accuracy / 10.0;
+		fix.vertical_accuracy = values.vertical_accuracy / 10.0;
+		g_array_append_val (fixes, fix);
+	}
+}
+
+static void
+decode_block (const guint8 *data,
+              guint32       size,
+              guint32       offset,
+              int           start,
+              int           end,
+              GArray       *fixes)
+{
+	const guint8 *p;
+	guint32 len;
+
+	if (offset > size - TRACK_BLOCK_HEADER_LENGTH ||
+	    data[offset] != TRACK_BLOCK_DATA) {
+		return;
+	}
+	len = get_uint32 (data + offset + 4);
+	if (len < TRACK_DATA_HEADER_LENGTH ||
+	    len > size - offset - TRACK_BLOCK_HEADER_LENGTH) {
+		return;
+	}
+	p = data + offset + TRACK_BLOCK_HEADER_LENGTH;
+	decode_fixes (p, p + len, start, end, fixes);
+}
+
+/**
+ * gc_track_log_query:
+ * @filename: log file
+ * @start: first timestamp to include
+ * @end: last timestamp to include
+ * @error: return location for errors
+ *
+ * Return value: a #GArray of #GeocluePositionFix in the order they
+ * were logged, or %NULL on error.
+ */
+GArray *
+gc_track_log_query (const char *filename,
+                    int         start,
+                    int         end,
+                    GError    **error)
+{
+	const guint8 *data;
+	GArray *index_blocks, *entries, *fixes;
+	guint32 size, offset;
+	int fd;
+	guint i;
+
+	fd = open (filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_FAILED,
+		             "Could not open track log %s: %s",
+		             filename, g_strerror (errno));
+		return NULL;
+	}
+	data = map_file (fd, &size, error);
+	close (fd);
+	if (data == NULL) {
+		if (size > 0) {
+			return NULL;
+		}
+		return g_array_new (FALSE, FALSE, sizeof (GeocluePositionFix));
+	}
+
+	/* follow the index chain back, then use it oldest first */
+	index_blocks = g_array_new (FALSE, FALSE, sizeof (guint32));
+	offset = get_uint32 (data + TRACK_MAGIC_LENGTH);
+	while (is_index_block (data, size, offset) &&
+	       index_blocks->len < size / TRACK_BLOCK_HEADER_LENGTH) {
+		g_array_append_val (index_blocks, offset);
+		offset = get_uint32 (data + offset + TRACK_BLOCK_HEADER_LENGTH);
+	}
+
+	entries = g_array_new (FALSE, FALSE, sizeof (GcTrackIndexEntry));
+	for (i = index_blocks->len; i > 0; i--) {
+		const guint8 *p;
+		guint32 n_entries, j;
+
+		offset = g_array_index (index_blocks, guint32, i - 1);
+		p = data + offset + TRACK_BLOCK_HEADER_LENGTH;
+		n_entries = get_uint32 (p + 4);
+		p += TRACK_INDEX_HEADER_LENGTH;
+		for (j = 0; j < n_entries; j++, p += TRACK_INDEX_ENTRY_LENGTH) {
+			GcTrackIndexEntry entry;
+
+			entry.first_time = get_uint32 (p);
+			entry.last_time = get_uint32 (p + 4);
+			entry.offset = get_uint32 (p + 8);
+			g_array_append_val (entries, entry);
+		}
+	}
+
+	/* and the blocks written after the newest index block */
+	if (index_blocks->len > 0) {
+		offset = g_array_index (index_blocks, guint32, 0);
+		offset += TRACK_BLOCK_HEADER_LENGTH + get_uint32 (data + offset + 4);
+	} else {
+		offset = TRACK_HEADER_LENGTH;
+	}
+	scan_blocks (data, size, offset, entries);
+	g_array_free (index_blocks, TRUE);
+
+	fixes = g_array_new (FALSE, FALSE, sizeof (GeocluePositionFix));
+	for (i = 0; i < entries->len; i++) {
+		GcTrackIndexEntry *entry = &g_array_index (entries, GcTrackIndexEntry, i);
+
+		if (entry->last_time >= start && entry->first_time <= end) {
+			decode_block (data, size, entry->offset, start, end, fixes);
+		}
+	}
+	g_array_free (entries, TRUE);
+	munmap ((void *) data, size);
+
+	return fixes;
+}
+
+/**
+ * gc_track_log_query_pending:
+ * @log: an open track log
+ * @start: first timestamp to include
+ * @end: last timestamp to include
+ * @fixes: #GArray of #GeocluePositionFix to append to
+ *
+ * Appends the fixes of the data block that has not been written yet,
+ * so queries see them without cutting the block short.
+ */
+void
+gc_track_log_query_pending (GcTrackLog *log,
+                            int         start,
+                            int         end,
+                            GArray     *fixes)
+{
+	if (log->n_fixes == 0 ||
+	    log->last_time < start || log->first_time > end) {
+		return;
+	}
+
+	gc_track_log_fill_header (log);
+
+	decode_fixes (log->block->data, log->block->data + log->block->len,
+	              start, end, fixes);
+}
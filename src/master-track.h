@@ -0,0 +1,53 @@
+/*
+ * Geoclue
+ * master-track.h - Compact on-disk track log
+ *
+ * Copyright 2007-2008 by Garmin Ltd. or its subsidiaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MASTER_TRACK_H
+#define MASTER_TRACK_H
+
+#include <glib.h>
+#include <geoclue/geoclue-master-client.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GcTrackLog GcTrackLog;
+
+GcTrackLog *gc_track_log_open (const char *filename,
+                               GError    **error);
+void gc_track_log_close (GcTrackLog *log);
+
+void gc_track_log_append (GcTrackLog               *log,
+                          const GeocluePositionFix *fix);
+void gc_track_log_flush (GcTrackLog *log);
+
+GArray *gc_track_log_query (const char *filename,
+                            int         start,
+                            int         end,
+                            GError    **error);
+void gc_track_log_query_pending (GcTrackLog *log,
+                                 int         start,
+                                 int         end,
+                                 GArray     *fixes);
+
+G_END_DECLS
+
+#endif /* MASTER_TRACK_H */
@@ -27,10 +27,15 @@
 
 #include <string.h>
 
+#include <geoclue/geoclue-error.h>
+
 #include "main.h"
 #include "master.h"
 #include "client.h"
 #include "master-provider.h"
+#include "master-history.h"
+#include "master-track.h"
+#include "master-fused.h"
 
 #ifdef HAVE_NETWORK_MANAGER
 #include "connectivity-networkmanager.h"
@@ -55,9 +60,25 @@ G_DEFINE_TYPE (GcMaster, gc_master, G_TYPE_OBJECT);
 
 static GList *providers = NULL;
 
+/* the Fused provider replaces its sources when clients can use it */
+#define FUSE_POSITIONS_OPTION "fuse-positions"
+static GcMasterProvider *fused_provider = NULL;
+static GList *fused_sources = NULL;
+
+/* the track recorder: a client that is not on the bus */
+#define TRACK_LOG_OPTION "track-log"
+static char *track_log_filename = NULL;
+static GcTrackLog *track_log = NULL;
+static GcMasterClient *track_client = NULL;
+
 static gboolean gc_iface_master_create (GcMaster    *master,
 					const char **object_path,
 					GError     **error);
+static gboolean gc_iface_master_get_track_log (GcMaster    *master,
+					       int          start,
+					       int          end,
+					       GPtrArray  **track,
+					       GError     **error);
 
 #include "gc-iface-master-glue.h"
 
@@ -82,9 +103,131 @@ gc_iface_master_create (GcMaster    *master,
 	return TRUE;
 }
 
+static gboolean
+gc_iface_master_get_track_log (GcMaster    *master,
+			       int          start,
+			       int          end,
+			       GPtrArray  **track,
+			       GError     **error)
+{
+	GArray *fixes;
+
+	if (track_log == NULL) {
+		g_set_error (error, GEOCLUE_ERROR, GEOCLUE_ERROR_NOT_AVAILABLE,
+			     "Track log is not enabled");
+		return FALSE;
+	}
+
+	fixes = gc_track_log_query (track_log_filename, start, end, error);
+	if (fixes == NULL) {
+		return FALSE;
+	}
+	/* the fixes of the last minute are still in memory */
+	gc_track_log_query_pending (track_log, start, end, fixes);
+	*track = gc_position_fixes_to_structs (fixes);
+	g_array_free (fixes, TRUE);
+
+	return TRUE;
+}
+
+static void
+track_position_changed (GcMasterClient        *client,
+			GeocluePositionFields  fields,
+			int                    timestamp,
+			double                 latitude,
+			double                 longitude,
+			double                 altitude,
+			GeoclueAccuracy       *accuracy,
+			gpointer               data)
+{
+	GeocluePositionFix fix;
+
+	if (fields == GEOCLUE_POSITION_FIELDS_NONE) {
+		return;
+	}
+
+	fix.fields = fields;
+	fix.timestamp = timestamp;
+	fix.latitude = latitude;
+	fix.longitude = longitude;
+	fix.altitude = altitude;
+	geoclue_accuracy_get_details (accuracy, &fix.accuracy_level,
+				      &fix.horizontal_accuracy,
+				      &fix.vertical_accuracy);
+	gc_track_log_append (track_log, &fix);
+}
+
+static void
+gc_master_stop_track_log (void)
+{
+	if (track_client) {
+		g_object_unref (track_client);
+		track_client = NULL;
+	}
+	gc_track_log_close (track_log);
+	track_log = NULL;
+	g_free (track_log_filename);
+	track_log_filename = NULL;
+}
+
+/* Starts, stops or moves the recorder to follow the "track-log" option */
+static void
+gc_master_update_track_log (GHashTable *options)
+{
+	GValue *value = NULL;
+	const char *filename = NULL;
+	GError *error = NULL;
+
+	if (options) {
+		value = g_hash_table_lookup (options, TRACK_LOG_OPTION);
+	}
+	if (value && G_VALUE_HOLDS_STRING (value)) {
+		filename = g_value_get_string (value);
+	}
+	if (g_strcmp0 (filename, track_log_filename) == 0) {
+		return;
+	}
+
+	gc_master_stop_track_log ();
+	if (filename == NULL) {
+		return;
+	}
+
+	track_log = gc_track_log_open (filename, &error);
+	if (track_log == NULL) {
+		g_warning ("Track log disabled: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+	track_log_filename = g_strdup (filename);
+
+	track_client = g_object_new (GC_TYPE_MASTER_CLIENT, NULL);
+	g_signal_connect (track_client, "position-changed",
+			  G_CALLBACK (track_position_changed), NULL);
+	if (!gc_master_client_start_position (track_client,
+					      GEOCLUE_ACCURACY_LEVEL_NONE,
+					      GEOCLUE_RESOURCE_ALL,
+					      &error)) {
+		g_warning ("Track log disabled: %s", error->message);
+		g_error_free (error);
+		gc_master_stop_track_log ();
+		return;
+	}
+	g_message ("Recording positions to %s", filename);
+}
+
+static void
+gc_master_options_changed (GcMaster   *master,
+			   GHashTable *options)
+{
+	gc_master_update_track_log (options);
+}
+
 static void
 gc_master_class_init (GcMasterClass *klass)
 {
+	klass->options_changed = gc_master_options_changed;
+
 	dbus_g_object_type_install_info (gc_master_get_type (),
 					 &dbus_glib_gc_iface_master_object_info);
 
@@ -163,6 +306,53 @@ gc_master_load_providers (GcMaster *master)
 	g_dir_close (dir);
 }
 
+/* Adds the Fused provider if enabled and there is something to fuse.
+ * It is not removed again while the master runs. */
+static void
+gc_master_add_fused_provider (GHashTable *options)
+{
+	GValue *value = NULL;
+	GeoclueAccuracyLevel accuracy = GEOCLUE_ACCURACY_LEVEL_NONE;
+	GeoclueResourceFlags resources = GEOCLUE_RESOURCE_NONE;
+	GList *l;
+
+	if (options) {
+		value = g_hash_table_lookup (options, FUSE_POSITIONS_OPTION);
+	}
+	if (!value || !G_VALUE_HOLDS_BOOLEAN (value) || !g_value_get_boolean (value)) {
+		return;
+	}
+
+	for (l = providers; l; l = l->next) {
+		GcMasterProvider *provider = l->data;
+
+		if (!gc_master_provider_is_good (provider, GC_IFACE_POSITION,
+		                                 GEOCLUE_ACCURACY_LEVEL_NONE, TRUE,
+		                                 GEOCLUE_RESOURCE_ALL)) {
+			continue;
+		}
+		fused_sources = g_list_prepend (fused_sources, provider);
+		accuracy = MAX (accuracy, gc_master_provider_get_accuracy (provider,
+		                                                           GC_IFACE_POSITION));
+		resources |= gc_master_provider_get_required_resources (provider);
+	}
+	if (fused_sources == NULL) {
+		return;
+	}
+
+	gc_master_fused_set_sources (fused_sources);
+	fused_provider = gc_master_provider_new_in_process (GC_MASTER_FUSED_NAME,
+	                                                    GC_MASTER_FUSED_SERVICE,
+	                                                    GC_MASTER_FUSED_PATH,
+	                                                    GC_TYPE_MASTER_FUSED,
+	                                                    GC_IFACE_POSITION |
+	                                                    GC_IFACE_VELOCITY,
+	                                                    accuracy, resources);
+	providers = g_list_prepend (providers, fused_provider);
+	g_print ("Fusing the positions of %d providers\n",
+	         g_list_length (fused_sources));
+}
+
 static void
 gc_master_init (GcMaster *master)
 {
@@ -179,6 +369,9 @@ gc_master_init (GcMaster *master)
 	master->connectivity = geoclue_connectivity_new ();
 
 	gc_master_load_providers (master);
+	gc_master_add_fused_provider (geoclue_get_main_options ());
+
+	gc_master_update_track_log (geoclue_get_main_options ());
 }
 
 
@@ -189,15 +382,26 @@ gc_master_get_providers (GcInterfaceFlags      iface_type,
                          GeoclueResourceFlags  allowed,
                          GError              **error)
 {
-	GList *l, *p = NULL;
+	GList *l, *p = NULL, *skip = NULL;
 	
 	if (providers == NULL) {
 		return NULL;
 	}
 	
+	/* clients that can use the Fused provider get it instead of
+	 * the position providers it uses */
+	if (fused_provider && (iface_type & GC_IFACE_POSITION) &&
+	    gc_master_provider_is_good (fused_provider, iface_type,
+	                                min_accuracy, can_update, allowed)) {
+		skip = fused_sources;
+	}
+	
 	for (l = providers; l; l = l->next) {
 		GcMasterProvider *provider = l->data;
 		
+		if (g_list_find (skip, provider)) {
+			continue;
+		}
 		if (gc_master_provider_is_good (provider,
 		                                iface_type, 
 		                                min_accuracy, 
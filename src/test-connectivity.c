@@ -23,6 +23,7 @@ print_aps (GeoclueConnectivity *conn)
 	}
 	g_message ("APs:");
 	g_hash_table_foreach (ht, print_ap, NULL);
+	g_hash_table_unref (ht);
 }
 
 static void